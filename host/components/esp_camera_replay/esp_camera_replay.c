@@ -0,0 +1,237 @@
+#include "esp_camera.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* Types */
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    uint16_t width;
+    uint16_t height;
+} replay_frame_t;
+
+/* Constants */
+static const char *TAG = "CameraReplay";
+static const int64_t fb_timeout = 1000000;
+
+/* Internal state */
+static const char *replay_path = NULL;
+static int replay_fps = 0;
+static replay_frame_t *frames = NULL;
+static size_t frames_count = 0, next_frame = 0;
+static camera_fb_t *fbs = NULL;
+static uint8_t *is_fb_held = NULL;
+static size_t fb_count = 0;
+static int64_t next_frame_time = 0;
+
+static int sensor_set(sensor_t *sensor, int enable)
+{
+    return 0;
+}
+
+static sensor_t sensor = {
+    .set_vflip = sensor_set,
+    .set_hmirror = sensor_set,
+};
+
+void esp_camera_replay_set(const char *path, int fps)
+{
+    replay_path = path;
+    replay_fps = fps;
+}
+
+static int jpeg_filter(const struct dirent *entry)
+{
+    const char *ext = strrchr(entry->d_name, '.');
+
+    return ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg"));
+}
+
+/* From the first Start Of Frame marker */
+static int jpeg_size_parse(const uint8_t *data, size_t length,
+    uint16_t *width, uint16_t *height)
+{
+    size_t i = 2;
+
+    while (i + 9 <= length && data[i] == 0xff)
+    {
+        if (data[i + 1] >= 0xc0 && data[i + 1] <= 0xc2)
+        {
+            *height = data[i + 5] << 8 | data[i + 6];
+            *width = data[i + 7] << 8 | data[i + 8];
+            return 0;
+        }
+
+        i += 2 + (data[i + 2] << 8 | data[i + 3]);
+    }
+
+    return -1;
+}
+
+static int frame_load(replay_frame_t *frame, const char *name)
+{
+    char path[512];
+    FILE *f;
+    long length;
+    int ret = -1;
+
+    snprintf(path, sizeof(path), "%s/%s", replay_path, name);
+    if (!(f = fopen(path, "rb")))
+    {
+        ESP_LOGE(TAG, "Failed opening %s", path);
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (length <= 0 || !(frame->data = malloc(length)) ||
+        fread(frame->data, 1, length, f) != (size_t)length)
+    {
+        ESP_LOGE(TAG, "Failed reading %s", path);
+        goto Exit;
+    }
+    frame->length = length;
+
+    if (jpeg_size_parse(frame->data, frame->length, &frame->width,
+        &frame->height))
+    {
+        ESP_LOGE(TAG, "Failed parsing JPEG size of %s", path);
+        goto Exit;
+    }
+
+    ret = 0;
+
+Exit:
+    fclose(f);
+    return ret;
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+    struct dirent **entries;
+    int n, i;
+
+    if (!replay_path || replay_fps <= 0)
+    {
+        ESP_LOGE(TAG, "No JPEG files to replay");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if ((n = scandir(replay_path, &entries, jpeg_filter, alphasort)) <= 0)
+    {
+        ESP_LOGE(TAG, "No JPEG files found in %s", replay_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    frames = calloc(n, sizeof(*frames));
+    fb_count = config->fb_count ? : 1;
+    fbs = calloc(fb_count, sizeof(*fbs));
+    is_fb_held = calloc(fb_count, sizeof(*is_fb_held));
+
+    for (i = 0; i < n; i++)
+    {
+        if (frames && fbs && is_fb_held &&
+            !frame_load(&frames[frames_count], entries[i]->d_name))
+        {
+            frames_count++;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+
+    if (!frames_count)
+    {
+        esp_camera_deinit();
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Replaying %zu frames from %s at up to %d fps",
+        frames_count, replay_path, replay_fps);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(void)
+{
+    size_t i;
+
+    for (i = 0; i < frames_count; i++)
+        free(frames[i].data);
+    free(frames);
+    free(fbs);
+    free(is_fb_held);
+
+    frames = NULL;
+    fbs = NULL;
+    is_fb_held = NULL;
+    frames_count = next_frame = fb_count = 0;
+
+    return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get(void)
+{
+    int64_t now = esp_timer_get_time(), deadline = now + fb_timeout;
+    replay_frame_t *frame;
+    camera_fb_t *fb = NULL;
+    size_t i;
+
+    if (!frames_count)
+        return NULL;
+
+    /* Held buffers stall capture, as they would with the real driver */
+    while (!fb)
+    {
+        for (i = 0; i < fb_count && !fb; i++)
+        {
+            if (!is_fb_held[i])
+                fb = &fbs[i];
+        }
+
+        if (!fb && (now = esp_timer_get_time()) >= deadline)
+        {
+            ESP_LOGW(TAG, "Failed to get the frame on time!");
+            return NULL;
+        }
+        if (!fb)
+            vTaskDelay(1);
+    }
+
+    /* Frames come at the sensor's rate */
+    if (next_frame_time > now)
+        vTaskDelay(pdMS_TO_TICKS((next_frame_time - now + 999) / 1000));
+    next_frame_time = (next_frame_time > now ? next_frame_time : now) +
+        1000000 / replay_fps;
+
+    frame = &frames[next_frame];
+    next_frame = (next_frame + 1) % frames_count;
+
+    is_fb_held[fb - fbs] = 1;
+    fb->buf = frame->data;
+    fb->len = frame->length;
+    fb->width = frame->width;
+    fb->height = frame->height;
+    fb->format = PIXFORMAT_JPEG;
+    gettimeofday(&fb->timestamp, NULL);
+
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+    if (fb && fb >= fbs && fb < fbs + fb_count)
+        is_fb_held[fb - fbs] = 0;
+}
+
+sensor_t *esp_camera_sensor_get(void)
+{
+    return &sensor;
+}
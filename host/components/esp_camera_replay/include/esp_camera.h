@@ -0,0 +1,103 @@
+#ifndef ESP_CAMERA_H
+#define ESP_CAMERA_H
+
+/* Host stand-in for the esp32-camera driver, replaying a directory of JPEG
+ * files. Only what the application uses is provided */
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+/* Types */
+typedef enum {
+    PIXFORMAT_JPEG,
+} pixformat_t;
+
+typedef enum {
+    FRAMESIZE_96X96,
+    FRAMESIZE_QQVGA,
+    FRAMESIZE_QCIF,
+    FRAMESIZE_HQVGA,
+    FRAMESIZE_240X240,
+    FRAMESIZE_QVGA,
+    FRAMESIZE_CIF,
+    FRAMESIZE_HVGA,
+    FRAMESIZE_VGA,
+    FRAMESIZE_SVGA,
+    FRAMESIZE_XGA,
+    FRAMESIZE_HD,
+    FRAMESIZE_SXGA,
+    FRAMESIZE_UXGA,
+    FRAMESIZE_FHD,
+    FRAMESIZE_P_HD,
+    FRAMESIZE_P_3MP,
+    FRAMESIZE_QXGA,
+    FRAMESIZE_QHD,
+    FRAMESIZE_WQXGA,
+    FRAMESIZE_P_FHD,
+    FRAMESIZE_QSXGA,
+    FRAMESIZE_INVALID
+} framesize_t;
+
+typedef enum {
+    LEDC_TIMER_0,
+} ledc_timer_t;
+
+typedef enum {
+    LEDC_CHANNEL_0,
+} ledc_channel_t;
+
+typedef struct {
+    int pin_pwdn;
+    int pin_reset;
+    int pin_xclk;
+    int pin_sccb_sda;
+    int pin_sccb_scl;
+    int pin_d7;
+    int pin_d6;
+    int pin_d5;
+    int pin_d4;
+    int pin_d3;
+    int pin_d2;
+    int pin_d1;
+    int pin_d0;
+    int pin_vsync;
+    int pin_href;
+    int pin_pclk;
+    int xclk_freq_hz;
+    ledc_timer_t ledc_timer;
+    ledc_channel_t ledc_channel;
+    pixformat_t pixel_format;
+    framesize_t frame_size;
+    int jpeg_quality;
+    size_t fb_count;
+} camera_config_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t width;
+    size_t height;
+    pixformat_t format;
+    struct timeval timestamp;
+} camera_fb_t;
+
+typedef struct _sensor sensor_t;
+struct _sensor {
+    int (*set_vflip)(sensor_t *sensor, int enable);
+    int (*set_hmirror)(sensor_t *sensor, int enable);
+};
+
+/* Frames are replayed in file name order, looping, and no faster than the
+ * given frame rate, as a sensor would. To be set before esp_camera_init() */
+void esp_camera_replay_set(const char *path, int fps);
+
+esp_err_t esp_camera_init(const camera_config_t *config);
+esp_err_t esp_camera_deinit(void);
+/* NULL if all of the configured frame buffers are still held */
+camera_fb_t *esp_camera_fb_get(void);
+void esp_camera_fb_return(camera_fb_t *fb);
+sensor_t *esp_camera_sensor_get(void);
+
+#endif
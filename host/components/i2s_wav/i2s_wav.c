@@ -0,0 +1,371 @@
+#include "driver/i2s_pdm.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Types */
+struct i2s_channel {
+    i2s_chan_config_t config;
+    uint32_t sample_rate;
+    int16_t **buffers;
+    size_t next_buffer;
+    /* Indexes of filled buffers, for i2s_channel_read() */
+    QueueHandle_t queue;
+    /* The buffer being read, and how much of it was */
+    int read_buffer;
+    size_t read_offset;
+    i2s_event_callbacks_t callbacks;
+    void *user_data;
+    volatile uint8_t is_enabled;
+    SemaphoreHandle_t stopped;
+};
+
+/* Constants */
+static const char *TAG = "I2SWav";
+
+/* Internal state */
+static const char *wav_path = NULL;
+static int16_t *wav_samples = NULL;
+static size_t wav_length = 0, wav_position = 0;
+
+void i2s_wav_set(const char *path)
+{
+    wav_path = path;
+}
+
+static uint32_t le32(const uint8_t *data)
+{
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t le16(const uint8_t *data)
+{
+    return data[0] | data[1] << 8;
+}
+
+/* 16 bit PCM only, keeping the first channel */
+static int wav_load(uint32_t sample_rate)
+{
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0, chunk_size;
+    uint8_t *data = NULL;
+    size_t i, offset = 12;
+    long length;
+    int ret = -1;
+    FILE *f;
+
+    if (!(f = fopen(wav_path, "rb")))
+    {
+        ESP_LOGE(TAG, "Failed opening %s", wav_path);
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (length < 12 || !(data = malloc(length)) ||
+        fread(data, 1, length, f) != (size_t)length)
+    {
+        ESP_LOGE(TAG, "Failed reading %s", wav_path);
+        goto Exit;
+    }
+
+    if (memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4))
+    {
+        ESP_LOGE(TAG, "%s isn't a WAV file", wav_path);
+        goto Exit;
+    }
+
+    /* Chunks are padded to an even size */
+    while (offset + 8 <= (size_t)length)
+    {
+        chunk_size = le32(data + offset + 4);
+        if (chunk_size > length - offset - 8)
+            chunk_size = length - offset - 8;
+
+        if (!memcmp(data + offset, "fmt ", 4) && chunk_size >= 16)
+        {
+            format = le16(data + offset + 8);
+            channels = le16(data + offset + 10);
+            rate = le32(data + offset + 12);
+            bits = le16(data + offset + 22);
+        }
+        else if (!memcmp(data + offset, "data", 4) && channels)
+        {
+            if (format != 1 || bits != 16)
+            {
+                ESP_LOGE(TAG, "%s isn't 16 bit PCM", wav_path);
+                goto Exit;
+            }
+
+            wav_length = chunk_size / (sizeof(int16_t) * channels);
+            if (!wav_length ||
+                !(wav_samples = malloc(wav_length * sizeof(int16_t))))
+            {
+                ESP_LOGE(TAG, "No samples in %s", wav_path);
+                wav_length = 0;
+                goto Exit;
+            }
+
+            for (i = 0; i < wav_length; i++)
+            {
+                wav_samples[i] = (int16_t)le16(data + offset + 8 +
+                    i * sizeof(int16_t) * channels);
+            }
+            break;
+        }
+
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    if (!wav_samples)
+    {
+        ESP_LOGE(TAG, "No audio data in %s", wav_path);
+        goto Exit;
+    }
+
+    /* Played as is, only the pitch is off */
+    if (rate != sample_rate)
+    {
+        ESP_LOGW(TAG, "%s is at %" PRIu32 " Hz, playing it at %" PRIu32 " Hz",
+            wav_path, rate, sample_rate);
+    }
+
+    ESP_LOGI(TAG, "Playing %zu samples from %s", wav_length, wav_path);
+    ret = 0;
+
+Exit:
+    free(data);
+    fclose(f);
+    return ret;
+}
+
+static void buffer_fill(int16_t *buffer, size_t samples)
+{
+    size_t length;
+
+    while (samples)
+    {
+        length = wav_length - wav_position;
+        if (length > samples)
+            length = samples;
+
+        memcpy(buffer, wav_samples + wav_position, length * sizeof(int16_t));
+        buffer += length;
+        samples -= length;
+        wav_position = (wav_position + length) % wav_length;
+    }
+}
+
+/* Stands in for the DMA, a buffer is filled every buffer's worth of time */
+static void playback_task(void *arg)
+{
+    i2s_chan_handle_t handle = arg;
+    size_t samples = handle->config.dma_frame_num;
+    int64_t period = samples * 1000000LL / handle->sample_rate;
+    int64_t next_time = esp_timer_get_time() + period, now;
+    i2s_event_data_t event;
+    int16_t *buffer;
+    int index, dropped;
+
+    while (handle->is_enabled)
+    {
+        if ((now = esp_timer_get_time()) < next_time)
+            vTaskDelay(pdMS_TO_TICKS((next_time - now + 999) / 1000));
+        next_time += period;
+
+        index = handle->next_buffer;
+        handle->next_buffer = (index + 1) % handle->config.dma_desc_num;
+        buffer = handle->buffers[index];
+        buffer_fill(buffer, samples);
+
+        event.data = &handle->buffers[index];
+        event.dma_buf = buffer;
+        event.size = samples * sizeof(int16_t);
+
+        if (handle->callbacks.on_recv)
+            handle->callbacks.on_recv(handle, &event, handle->user_data);
+
+        /* The oldest filled buffer is dropped, as with the driver */
+        if (xQueueSend(handle->queue, &index, 0) != pdTRUE)
+        {
+            xQueueReceive(handle->queue, &dropped, 0);
+            xQueueSend(handle->queue, &index, 0);
+
+            if (handle->callbacks.on_recv_q_ovf)
+            {
+                handle->callbacks.on_recv_q_ovf(handle, &event,
+                    handle->user_data);
+            }
+        }
+    }
+
+    xSemaphoreGive(handle->stopped);
+    vTaskDelete(NULL);
+}
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg,
+    i2s_chan_handle_t *tx_handle, i2s_chan_handle_t *rx_handle)
+{
+    i2s_chan_handle_t handle;
+    size_t i;
+
+    if (tx_handle || !rx_handle || !chan_cfg->dma_desc_num ||
+        !chan_cfg->dma_frame_num)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!(handle = calloc(1, sizeof(*handle))))
+        return ESP_ERR_NO_MEM;
+
+    handle->config = *chan_cfg;
+    handle->read_buffer = -1;
+    handle->buffers = calloc(chan_cfg->dma_desc_num, sizeof(int16_t *));
+    handle->queue = xQueueCreate(chan_cfg->dma_desc_num, sizeof(int));
+    handle->stopped = xSemaphoreCreateBinary();
+
+    for (i = 0; handle->buffers && i < chan_cfg->dma_desc_num; i++)
+    {
+        if (!(handle->buffers[i] = calloc(chan_cfg->dma_frame_num,
+            sizeof(int16_t))))
+        {
+            break;
+        }
+    }
+
+    if (!handle->buffers || i < chan_cfg->dma_desc_num || !handle->queue ||
+        !handle->stopped)
+    {
+        i2s_del_channel(handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *rx_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle)
+{
+    size_t i;
+
+    i2s_channel_disable(handle);
+
+    for (i = 0; handle->buffers && i < handle->config.dma_desc_num; i++)
+        free(handle->buffers[i]);
+    free(handle->buffers);
+    if (handle->queue)
+        vQueueDelete(handle->queue);
+    if (handle->stopped)
+        vSemaphoreDelete(handle->stopped);
+    free(handle);
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_pdm_rx_mode(i2s_chan_handle_t handle,
+    const i2s_pdm_rx_config_t *pdm_rx_cfg)
+{
+    if (pdm_rx_cfg->slot_cfg.data_bit_width != I2S_DATA_BIT_WIDTH_16BIT ||
+        pdm_rx_cfg->slot_cfg.slot_mode != I2S_SLOT_MODE_MONO)
+    {
+        ESP_LOGE(TAG, "Only 16 bit mono is supported");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    handle->sample_rate = pdm_rx_cfg->clk_cfg.sample_rate_hz;
+
+    if (!wav_path)
+    {
+        ESP_LOGE(TAG, "No WAV file to play");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!wav_samples && wav_load(handle->sample_rate))
+        return ESP_FAIL;
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle,
+    const i2s_event_callbacks_t *callbacks, void *user_data)
+{
+    if (handle->is_enabled)
+        return ESP_ERR_INVALID_STATE;
+
+    handle->callbacks = *callbacks;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    if (handle->is_enabled || !wav_samples)
+        return ESP_ERR_INVALID_STATE;
+
+    handle->is_enabled = 1;
+    if (xTaskCreate(playback_task, "i2s_playback_task", 4096, handle, 20,
+        NULL) != pdPASS)
+    {
+        handle->is_enabled = 0;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    if (!handle->is_enabled)
+        return ESP_ERR_INVALID_STATE;
+
+    handle->is_enabled = 0;
+    xSemaphoreTake(handle->stopped, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void *dest, size_t size,
+    size_t *bytes_read, uint32_t timeout_ms)
+{
+    size_t buffer_size = handle->config.dma_frame_num * sizeof(int16_t);
+    size_t length;
+
+    *bytes_read = 0;
+
+    while (*bytes_read < size)
+    {
+        if (handle->read_buffer == -1)
+        {
+            if (xQueueReceive(handle->queue, &handle->read_buffer,
+                pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+            {
+                handle->read_buffer = -1;
+                return ESP_ERR_TIMEOUT;
+            }
+            handle->read_offset = 0;
+        }
+
+        length = buffer_size - handle->read_offset;
+        if (length > size - *bytes_read)
+            length = size - *bytes_read;
+
+        memcpy((uint8_t *)dest + *bytes_read,
+            (uint8_t *)handle->buffers[handle->read_buffer] +
+            handle->read_offset, length);
+        *bytes_read += length;
+        handle->read_offset += length;
+
+        if (handle->read_offset == buffer_size)
+            handle->read_buffer = -1;
+    }
+
+    return ESP_OK;
+}
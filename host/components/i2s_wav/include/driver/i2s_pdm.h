@@ -0,0 +1,110 @@
+#ifndef DRIVER_I2S_PDM_H
+#define DRIVER_I2S_PDM_H
+
+/* Host stand-in for the I2S PDM RX driver, playing a WAV file back in real
+ * time. Only what the application uses is provided */
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Types */
+typedef struct i2s_channel *i2s_chan_handle_t;
+
+typedef enum {
+    I2S_NUM_AUTO,
+} i2s_port_t;
+
+typedef enum {
+    I2S_ROLE_MASTER,
+} i2s_role_t;
+
+typedef enum {
+    I2S_DATA_BIT_WIDTH_16BIT = 16,
+} i2s_data_bit_width_t;
+
+typedef enum {
+    I2S_SLOT_MODE_MONO = 1,
+} i2s_slot_mode_t;
+
+typedef struct {
+    i2s_port_t id;
+    i2s_role_t role;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+} i2s_chan_config_t;
+
+typedef struct {
+    uint32_t sample_rate_hz;
+} i2s_pdm_rx_clk_config_t;
+
+typedef struct {
+    i2s_data_bit_width_t data_bit_width;
+    i2s_slot_mode_t slot_mode;
+} i2s_pdm_rx_slot_config_t;
+
+typedef struct {
+    int clk;
+    int din;
+    struct {
+        uint32_t clk_inv: 1;
+    } invert_flags;
+} i2s_pdm_rx_gpio_config_t;
+
+typedef struct {
+    i2s_pdm_rx_clk_config_t clk_cfg;
+    i2s_pdm_rx_slot_config_t slot_cfg;
+    i2s_pdm_rx_gpio_config_t gpio_cfg;
+} i2s_pdm_rx_config_t;
+
+typedef struct {
+    /* A pointer to the DMA buffer pointer, deprecated in the driver */
+    void *data;
+    void *dma_buf;
+    size_t size;
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle,
+    i2s_event_data_t *event, void *ctx);
+
+typedef struct {
+    i2s_isr_callback_t on_recv;
+    i2s_isr_callback_t on_recv_q_ovf;
+    i2s_isr_callback_t on_sent;
+    i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(i2s_num, i2s_role) { \
+    .id = i2s_num, \
+    .role = i2s_role, \
+    .dma_desc_num = 6, \
+    .dma_frame_num = 240, \
+}
+
+#define I2S_PDM_RX_CLK_DEFAULT_CONFIG(rate) { \
+    .sample_rate_hz = rate, \
+}
+
+#define I2S_PDM_RX_SLOT_DEFAULT_CONFIG(bits_per_sample, mono_or_stereo) { \
+    .data_bit_width = bits_per_sample, \
+    .slot_mode = mono_or_stereo, \
+}
+
+/* The file is looped, its first channel played at the configured rate. To be
+ * set before i2s_channel_init_pdm_rx_mode() */
+void i2s_wav_set(const char *path);
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg,
+    i2s_chan_handle_t *tx_handle, i2s_chan_handle_t *rx_handle);
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_init_pdm_rx_mode(i2s_chan_handle_t handle,
+    const i2s_pdm_rx_config_t *pdm_rx_cfg);
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle,
+    const i2s_event_callbacks_t *callbacks, void *user_data);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void *dest, size_t size,
+    size_t *bytes_read, uint32_t timeout_ms);
+
+#endif
@@ -0,0 +1,77 @@
+#!/usr/bin/env python
+
+from __future__ import print_function
+import argparse
+import math
+import os
+import struct
+import wave
+
+from PIL import Image, ImageDraw
+
+WIDTH = 320
+HEIGHT = 240
+STILL_FRAMES = 6
+MOVING_FRAMES = 4
+BLOCK = (128, 96, 64, 64)
+BLOCK_STEP = 16
+SAMPLE_RATE = 16000
+TONE_FREQUENCY = 440
+TONE_AMPLITUDE = 8192
+
+def scene_draw(block_x=None):
+  image = Image.new('L', (WIDTH, HEIGHT))
+  draw = ImageDraw.Draw(image)
+  for y in range(HEIGHT):
+    draw.line([(0, y), (WIDTH - 1, y)], fill=40 + y * 80 // HEIGHT)
+  draw.rectangle([16, 16, 79, 63], fill=100)
+  draw.rectangle([240, 160, 303, 223], fill=60)
+  if block_x is not None:
+    x, y, width, height = BLOCK
+    draw.rectangle([block_x, y, block_x + width - 1, y + height - 1],
+      fill=230)
+  return image.convert('RGB')
+
+def frames_write(path):
+  if not os.path.isdir(path):
+    os.makedirs(path)
+
+  # A still scene the motion detector learns, then a bright block moving
+  # right across it, on the 8x8 block grid
+  for i in range(STILL_FRAMES + MOVING_FRAMES):
+    block_x = None
+    if i >= STILL_FRAMES:
+      block_x = BLOCK[0] + (i - STILL_FRAMES) * BLOCK_STEP
+    # 4:2:2, as the camera sensors produce
+    scene_draw(block_x).save(os.path.join(path, 'frame_%02d.jpg' % i),
+      quality=80, subsampling=1)
+
+def tone_write(path):
+  # Half a second of tone, then half a second of silence
+  samples = []
+  for i in range(SAMPLE_RATE):
+    value = 0
+    if i < SAMPLE_RATE // 2:
+      value = int(TONE_AMPLITUDE * math.sin(2 * math.pi * TONE_FREQUENCY * i /
+        SAMPLE_RATE))
+    samples.append(value)
+
+  f = wave.open(path, 'wb')
+  f.setnchannels(1)
+  f.setsampwidth(2)
+  f.setframerate(SAMPLE_RATE)
+  f.writeframes(struct.pack('<%dh' % len(samples), *samples))
+  f.close()
+
+def main():
+  parser = argparse.ArgumentParser(description='Generates the JPEG frames '
+    'and the WAV file replayed by the host build and its tests')
+  parser.add_argument('-o', '--output', default=os.path.dirname(
+    os.path.abspath(__file__)), help='Directory to write to')
+  args = parser.parse_args()
+
+  frames_write(os.path.join(args.output, 'frames'))
+  tone_write(os.path.join(args.output, 'tone.wav'))
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,169 @@
+#include "audio_encoder.h"
+#include "audio_processor.h"
+#include "camera.h"
+#include "live.h"
+#include "microphone.h"
+#include "motion_detector.h"
+#include "prebuffer.h"
+#include "rtp.h"
+#include "sound_detector.h"
+#include "stats.h"
+#include "suppressor.h"
+#include "trace.h"
+#include <driver/i2s_pdm.h>
+#include <esp_camera.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Runs the capture, encoding and RTP pipeline on the host, with frames and
+ * audio replayed from files and sent over real UDP sockets. Everything is set
+ * through the environment, with the device's configuration defaults */
+
+/* Constants */
+static const char *TAG = "Host";
+
+static const char *env_get(const char *name, const char *def)
+{
+    const char *value = getenv(name);
+
+    return value && *value ? value : def;
+}
+
+static int env_int_get(const char *name, int def)
+{
+    const char *value = getenv(name);
+
+    return value && *value ? atoi(value) : def;
+}
+
+static int trace_file_write(const void *data, size_t length, void *ctx)
+{
+    return fwrite(data, 1, length, ctx) != length;
+}
+
+static void trace_save(const char *path)
+{
+    FILE *f;
+
+    if (!trace_is_enabled())
+        return;
+
+    if (!(f = fopen(path, "wb")))
+    {
+        ESP_LOGE(TAG, "Failed opening %s", path);
+        return;
+    }
+
+    if (trace_dump(trace_file_write, f))
+        ESP_LOGE(TAG, "Failed writing trace to %s", path);
+    else
+        ESP_LOGI(TAG, "Wrote trace to %s", path);
+    fclose(f);
+}
+
+static void stats_log(void)
+{
+    uint32_t frames, allocations, exhaustions, overruns;
+    rtp_stats_t video, audio;
+    int fps;
+
+    camera_stats_get(&frames, &fps);
+    microphone_stats_get(&allocations, &exhaustions, &overruns);
+    rtp_stats_get(&video, &audio);
+
+    ESP_LOGI(TAG, "Camera: %" PRIu32 " frames captured, %d fps", frames, fps);
+    ESP_LOGI(TAG, "Microphone: %" PRIu32 " frames, %" PRIu32
+        " exhaustions, %" PRIu32 " overruns", allocations, exhaustions,
+        overruns);
+    ESP_LOGI(TAG, "RTP video: %" PRIu32 " frames, %" PRIu32 " packets, %"
+        PRIu64 " bytes, %" PRIu32 " errors", video.frames, video.packets,
+        video.bytes, video.errors);
+    ESP_LOGI(TAG, "RTP audio: %" PRIu32 " frames, %" PRIu32 " packets, %"
+        PRIu64 " bytes, %" PRIu32 " errors", audio.frames, audio.packets,
+        audio.bytes, audio.errors);
+}
+
+void app_main()
+{
+    const char *jpeg_dir = env_get("IPCAM_JPEG_DIR", NULL);
+    const char *wav = env_get("IPCAM_WAV", NULL);
+    int fps = env_int_get("IPCAM_FPS", 5);
+    int duration = env_int_get("IPCAM_DURATION", 0);
+    uint32_t sample_rate = wav ? 16000 : 0;
+    int i;
+
+    if (!jpeg_dir)
+    {
+        ESP_LOGE(TAG, "IPCAM_JPEG_DIR has to be set to a directory of JPEG "
+            "files");
+        exit(1);
+    }
+
+    esp_camera_replay_set(jpeg_dir, fps);
+    if (wav)
+        i2s_wav_set(wav);
+
+    /* Init stats, sampling task usage every 10 seconds */
+    ESP_ERROR_CHECK(stats_initialize(10));
+
+    /* Init pipeline tracing */
+    ESP_ERROR_CHECK(trace_initialize(env_int_get("IPCAM_TRACE_RECORDS", 0)));
+
+    /* Init motion detector */
+    ESP_ERROR_CHECK(motion_detector_initialize(0, 2));
+
+    /* Init static scene suppression */
+    ESP_ERROR_CHECK(suppressor_initialize(0, 0));
+
+    /* Init pre-event buffer, disabled as there's no recorder */
+    ESP_ERROR_CHECK(prebuffer_initialize(0, 0, fps, 0));
+
+    /* Init live stream, disabled as there's no web server */
+    ESP_ERROR_CHECK(live_initialize(0, 0, 0, 0));
+
+    /* Init camera, the pins are ignored */
+    ESP_ERROR_CHECK(camera_initialize(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, "800x600", fps, fps, 30, 0, 0, 12));
+
+    /* Init audio encoder, if needed. The microphone captures frames of the
+     * size it encodes */
+    if (wav)
+    {
+        ESP_ERROR_CHECK(audio_encoder_initialize(AUDIO_CODEC_OPUS,
+            sample_rate, 24000, 20000, 120000, 5, 1, 1, 0, 50));
+    }
+
+    /* Init audio pre-processing */
+    ESP_ERROR_CHECK(audio_processor_initialize(16000, 1, 80, 0, 24, 0));
+
+    /* Init sound detector */
+    ESP_ERROR_CHECK(sound_detector_initialize(sample_rate, 0, 6, 2));
+
+    /* Init microphone, the pins are ignored */
+    ESP_ERROR_CHECK(microphone_initialize(wav ? 0 : -1, wav ? 0 : -1,
+        16000));
+
+    /* Init RTP */
+    ESP_ERROR_CHECK(rtp_initialize(env_get("IPCAM_RTP_HOST", "127.0.0.1"),
+        env_int_get("IPCAM_RTP_VIDEO_PORT", 5000),
+        env_int_get("IPCAM_RTP_AUDIO_PORT", 5002)));
+    rtp_latency_test_set(env_int_get("IPCAM_LATENCY_TEST", 0));
+
+    camera_start();
+    microphone_start();
+
+    /* Runs until killed, unless given a duration in seconds */
+    for (i = 0; !duration || i < duration; i++)
+        vTaskDelay(pdMS_TO_TICKS(1000));
+
+    camera_stop();
+    microphone_stop();
+    stats_log();
+    trace_save(env_get("IPCAM_TRACE_FILE", "trace.bin"));
+    exit(0);
+}
@@ -0,0 +1,31 @@
+#include "config.h"
+#include "recorder.h"
+
+/* The configuration is kept on SPIFFS and the recordings on the SD card,
+ * neither of which the host build has. Tasks keep their built-in layout and
+ * nothing is recorded */
+
+int config_task_core_get(const char *name, int def)
+{
+    return def;
+}
+
+int config_task_priority_get(const char *name, int def)
+{
+    return def;
+}
+
+uint32_t config_task_stack_size_get(const char *name, uint32_t def)
+{
+    return def;
+}
+
+int recorder_add_jpeg(const uint8_t *data, size_t length, int64_t timestamp)
+{
+    return 0;
+}
+
+int recorder_add_opus(const uint8_t *data, size_t length, int64_t timestamp)
+{
+    return 0;
+}
@@ -0,0 +1,19 @@
+#include "config.h"
+
+/* The configuration is kept on SPIFFS, which the tests don't have. Tasks keep
+ * their built-in layout */
+
+int config_task_core_get(const char *name, int def)
+{
+    return def;
+}
+
+int config_task_priority_get(const char *name, int def)
+{
+    return def;
+}
+
+uint32_t config_task_stack_size_get(const char *name, uint32_t def)
+{
+    return def;
+}
@@ -0,0 +1,407 @@
+#include "audio_encoder.h"
+#include "rtp.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <opus.h>
+#include <unity.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SAMPLE_RATE 16000
+#define FRAME_DURATION 20000
+#define FRAME_SIZE (SAMPLE_RATE / (1000000 / FRAME_DURATION))
+#define FRAMES_COUNT 500
+/* Before the encoder updates the loss it expects */
+#define FIRST_SECOND_FRAMES (1000000 / FRAME_DURATION)
+#define PACKET_LOSS 20
+/* A frame counts as recovered if it's this close to the frame decoded without
+ * loss, which concealment alone doesn't get to */
+#define RECOVERED_SNR 3
+/* Audio encoded by the benchmarks, the fixture looped */
+#define BENCH_SECONDS 10
+#define BENCH_MAX_FRAME_SIZE (SAMPLE_RATE * 60 / 1000)
+/* As many frames as the encoder queues */
+#define BENCH_FRAMES_IN_FLIGHT 5
+/* RTP, UDP and IPv4 headers */
+#define PACKET_HEADERS_SIZE (12 + 8 + 20)
+
+/* Types */
+typedef struct {
+    size_t packets;
+    uint64_t bytes;
+    /* Opus' own framing, its TOC byte and frame lengths */
+    uint64_t framing_bytes;
+    /* From capturing a packet's first sample to it being sent, the most */
+    int64_t max_latency;
+    /* CPU time of the encoder task, from the first frame encoded */
+    int64_t cpu_time;
+} bench_t;
+
+/* Internal state */
+static uint8_t packets[FRAMES_COUNT][RTP_MAX_PAYLOAD_SIZE];
+static size_t packet_lengths[FRAMES_COUNT];
+static size_t packets_count = 0;
+static SemaphoreHandle_t packet_sent;
+static int16_t samples[FRAMES_COUNT][FRAME_SIZE];
+static bench_t bench;
+static SemaphoreHandle_t bench_frames_free;
+static uint32_t bench_frame_duration;
+static size_t bench_frames_encoded;
+static int64_t bench_cpu_start;
+static int16_t bench_frames[BENCH_FRAMES_IN_FLIGHT][BENCH_MAX_FRAME_SIZE];
+
+/* Called on the encoder task, as a frame is encoded. Frames are timestamped
+ * from 0 */
+static void bench_packet_add(const uint8_t *buffer, size_t length,
+    int64_t timestamp, uint8_t is_opus)
+{
+    const uint8_t *frames[48];
+    int16_t sizes[48];
+    int64_t latency;
+    int i, count;
+
+    bench.packets++;
+    bench.bytes += length;
+    latency = (int64_t)(bench_frames_encoded + 1) * bench_frame_duration -
+        timestamp;
+    if (latency > bench.max_latency)
+        bench.max_latency = latency;
+
+    if (!is_opus)
+        return;
+
+    TEST_ASSERT_GREATER_THAN(0, count = opus_packet_parse(buffer, length,
+        NULL, frames, sizes, NULL));
+    bench.framing_bytes += length;
+    for (i = 0; i < count; i++)
+        bench.framing_bytes -= sizes[i];
+}
+
+/* The encoder's packets are sent here instead of over RTP, which reports the
+ * loss the test simulates */
+int rtp_send_opus(const uint8_t *buffer, size_t length, int64_t timestamp,
+    rtp_frame_free_func_t free_func, void *ctx)
+{
+    /* Kept while the FEC test runs */
+    if (packet_sent && packets_count < FRAMES_COUNT &&
+        length <= RTP_MAX_PAYLOAD_SIZE)
+    {
+        memcpy(packets[packets_count], buffer, length);
+        packet_lengths[packets_count++] = length;
+    }
+    bench_packet_add(buffer, length, timestamp, 1);
+    free_func(ctx);
+    if (packet_sent)
+        xSemaphoreGive(packet_sent);
+
+    return 0;
+}
+
+int rtp_send_pcmu(const uint8_t *buffer, size_t length, int64_t timestamp,
+    rtp_frame_free_func_t free_func, void *ctx)
+{
+    bench_packet_add(buffer, length, timestamp, 0);
+    free_func(ctx);
+
+    return 0;
+}
+
+int rtp_send_pcma(const uint8_t *buffer, size_t length, int64_t timestamp,
+    rtp_frame_free_func_t free_func, void *ctx)
+{
+    bench_packet_add(buffer, length, timestamp, 0);
+    free_func(ctx);
+
+    return 0;
+}
+
+uint8_t rtp_audio_loss_get(void)
+{
+    return PACKET_LOSS;
+}
+
+static void frame_free(void *ctx)
+{
+}
+
+/* Voiced, with the pitch changing every frame so a lost one can't be
+ * extrapolated from the ones before */
+static void voice_generate(void)
+{
+    uint32_t seed = 1;
+    double phase = 0, pitch, level;
+    int i, j;
+
+    for (i = 0; i < FRAMES_COUNT; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        pitch = 150 + (seed >> 16) % 400;
+        level = 6000 * (0.6 + 0.4 * sin(2 * M_PI * i / 25));
+
+        for (j = 0; j < FRAME_SIZE; j++)
+        {
+            phase += 2 * M_PI * pitch / SAMPLE_RATE;
+            samples[i][j] = level * (sin(phase) + 0.5 * sin(2 * phase) +
+                0.3 * sin(3 * phase));
+        }
+    }
+}
+
+static double snr_get(const int16_t *reference, const int16_t *decoded)
+{
+    double signal = 0, noise = 1;
+    int i;
+
+    for (i = 0; i < FRAME_SIZE; i++)
+    {
+        signal += (double)reference[i] * reference[i];
+        noise += (double)(reference[i] - decoded[i]) *
+            (reference[i] - decoded[i]);
+    }
+
+    return 10 * log10(signal / noise);
+}
+
+TEST_CASE("Opus FEC recovers frames lost at the reported loss", "[audio]")
+{
+    OpusDecoder *reference, *fec, *plc;
+    int16_t expected[FRAME_SIZE], recovered[FRAME_SIZE],
+        concealed[FRAME_SIZE];
+    size_t lost = 0, fec_recovered = 0, plc_recovered = 0;
+    size_t first_lost = 0, first_recovered = 0;
+    uint32_t seed = 7;
+    uint8_t is_lost;
+    int i, err;
+
+    packets_count = 0;
+    TEST_ASSERT_NOT_NULL(packet_sent = xSemaphoreCreateBinary());
+    voice_generate();
+
+    /* One frame a packet, the loss is taken from RTP from the start */
+    TEST_ASSERT_EQUAL(0, audio_encoder_initialize(AUDIO_CODEC_OPUS,
+        SAMPLE_RATE, 24000, FRAME_DURATION, FRAME_DURATION, 5, 1, 0, 1, 0));
+    TEST_ASSERT_TRUE(audio_encoder_fec_is_enabled());
+    TEST_ASSERT_EQUAL(FRAME_SIZE, audio_encoder_frame_size());
+
+    for (i = 0; i < FRAMES_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL(0, audio_encoder_encode(samples[i], FRAME_SIZE,
+            (int64_t)i * FRAME_DURATION, frame_free, NULL));
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(packet_sent,
+            pdMS_TO_TICKS(1000)));
+    }
+    TEST_ASSERT_EQUAL(FRAMES_COUNT, packets_count);
+
+    reference = opus_decoder_create(SAMPLE_RATE, 1, &err);
+    fec = opus_decoder_create(SAMPLE_RATE, 1, &err);
+    plc = opus_decoder_create(SAMPLE_RATE, 1, &err);
+    TEST_ASSERT_TRUE(reference && fec && plc);
+
+    /* A lost frame is decoded from the redundancy in the next packet, or
+     * concealed without it */
+    for (i = 0; i < FRAMES_COUNT - 1; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        is_lost = i > 0 && (seed >> 16) % 100 < PACKET_LOSS;
+
+        TEST_ASSERT_EQUAL(FRAME_SIZE, opus_decode(reference, packets[i],
+            packet_lengths[i], expected, FRAME_SIZE, 0));
+
+        if (!is_lost)
+        {
+            TEST_ASSERT_EQUAL(FRAME_SIZE, opus_decode(fec, packets[i],
+                packet_lengths[i], recovered, FRAME_SIZE, 0));
+            TEST_ASSERT_EQUAL(FRAME_SIZE, opus_decode(plc, packets[i],
+                packet_lengths[i], concealed, FRAME_SIZE, 0));
+            continue;
+        }
+
+        lost++;
+        TEST_ASSERT_EQUAL(FRAME_SIZE, opus_decode(fec, packets[i + 1],
+            packet_lengths[i + 1], recovered, FRAME_SIZE, 1));
+        TEST_ASSERT_EQUAL(FRAME_SIZE, opus_decode(plc, NULL, 0, concealed,
+            FRAME_SIZE, 0));
+
+        if (i < FIRST_SECOND_FRAMES)
+            first_lost++;
+        if (snr_get(expected, recovered) >= RECOVERED_SNR)
+        {
+            fec_recovered++;
+            if (i < FIRST_SECOND_FRAMES)
+                first_recovered++;
+        }
+        if (snr_get(expected, concealed) >= RECOVERED_SNR)
+            plc_recovered++;
+    }
+
+    printf("%zu frames lost, %zu recovered with FEC (%zu of %zu in the "
+        "first second), %zu concealed as well\n", lost, fec_recovered,
+        first_recovered, first_lost, plc_recovered);
+    TEST_ASSERT_GREATER_THAN(FRAMES_COUNT * PACKET_LOSS / 200, lost);
+    TEST_ASSERT_GREATER_OR_EQUAL(lost * 2 / 3, fec_recovered);
+    TEST_ASSERT_LESS_THAN(lost / 10, plc_recovered);
+    TEST_ASSERT_GREATER_THAN(0, first_lost);
+    TEST_ASSERT_GREATER_OR_EQUAL(first_lost / 2, first_recovered);
+
+    opus_decoder_destroy(reference);
+    opus_decoder_destroy(fec);
+    opus_decoder_destroy(plc);
+    vSemaphoreDelete(packet_sent);
+    packet_sent = NULL;
+}
+
+static int64_t thread_cpu_time_get(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void bench_frame_free(void *ctx)
+{
+    int64_t now = thread_cpu_time_get();
+
+    /* The first frame includes setting the encoder task up */
+    if (!bench_frames_encoded++)
+        bench_cpu_start = now;
+    bench.cpu_time = now - bench_cpu_start;
+    xSemaphoreGive(bench_frames_free);
+}
+
+/* The mono 16-bit samples of the WAV fixture */
+static int16_t *wav_load(size_t *count)
+{
+    uint8_t header[44];
+    int16_t *data;
+    size_t length;
+    FILE *f;
+
+    TEST_ASSERT_NOT_NULL(f = fopen(FIXTURES_DIR "/tone.wav", "rb"));
+    TEST_ASSERT_EQUAL(sizeof(header), fread(header, 1, sizeof(header), f));
+    TEST_ASSERT_EQUAL_MEMORY("data", header + 36, 4);
+    TEST_ASSERT_EQUAL(1, header[22]);
+    TEST_ASSERT_EQUAL(SAMPLE_RATE, header[24] | header[25] << 8 |
+        header[26] << 16);
+    length = header[40] | header[41] << 8 | header[42] << 16;
+    TEST_ASSERT_NOT_NULL(data = malloc(length));
+    TEST_ASSERT_EQUAL(length, fread(data, 1, length, f));
+    fclose(f);
+
+    *count = length / sizeof(int16_t);
+    return data;
+}
+
+/* Encodes BENCH_SECONDS of the fixture as fast as the encoder takes it */
+static void bench_run(audio_codec_t codec, uint32_t frame_duration,
+    uint32_t packet_duration)
+{
+    size_t wav_count, wav_offset = 0, frame_size, frames_count, i, j;
+    int16_t *wav = wav_load(&wav_count);
+    int16_t *frame;
+
+    memset(&bench, 0, sizeof(bench));
+    bench_frames_encoded = 0;
+    TEST_ASSERT_NOT_NULL(bench_frames_free = xSemaphoreCreateCounting(
+        BENCH_FRAMES_IN_FLIGHT, BENCH_FRAMES_IN_FLIGHT));
+
+    TEST_ASSERT_EQUAL(0, audio_encoder_initialize(codec, SAMPLE_RATE, 24000,
+        frame_duration, packet_duration, 5, 1, 0, 0, 0));
+    TEST_ASSERT_EQUAL(packet_duration, audio_encoder_packet_duration());
+    frame_size = audio_encoder_frame_size();
+    TEST_ASSERT_LESS_OR_EQUAL(BENCH_MAX_FRAME_SIZE, frame_size);
+    bench_frame_duration = frame_size * 1000000ULL / SAMPLE_RATE;
+    frames_count = BENCH_SECONDS * SAMPLE_RATE / frame_size;
+
+    /* Frames are freed in order, so a slot is free again once a frame is */
+    for (i = 0; i < frames_count; i++)
+    {
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(bench_frames_free,
+            pdMS_TO_TICKS(1000)));
+        frame = bench_frames[i % BENCH_FRAMES_IN_FLIGHT];
+        for (j = 0; j < frame_size; j++, wav_offset++)
+            frame[j] = wav[wav_offset % wav_count];
+
+        TEST_ASSERT_EQUAL(0, audio_encoder_encode(frame, frame_size,
+            (int64_t)i * bench_frame_duration, bench_frame_free, NULL));
+    }
+
+    for (i = 0; i < BENCH_FRAMES_IN_FLIGHT; i++)
+    {
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(bench_frames_free,
+            pdMS_TO_TICKS(1000)));
+    }
+    TEST_ASSERT_EQUAL(frames_count, bench_frames_encoded);
+    TEST_ASSERT_EQUAL((uint64_t)BENCH_SECONDS * 1000000 / packet_duration,
+        bench.packets);
+
+    vSemaphoreDelete(bench_frames_free);
+    free(wav);
+}
+
+TEST_CASE("Opus overhead and latency per packet duration", "[audio][bench]")
+{
+    const uint32_t durations[][2] = {
+        { 10000, 10000 }, { 20000, 20000 }, { 20000, 40000 },
+        { 20000, 60000 }, { 20000, 120000 }, { 40000, 120000 },
+        { 60000, 60000 }, { 60000, 120000 },
+    };
+    uint64_t overhead, last_overhead = UINT64_MAX;
+    size_t i;
+
+    printf("frame  ptime  packets/s  Opus B/s  overhead B/s  latency\n");
+    for (i = 0; i < sizeof(durations) / sizeof(durations[0]); i++)
+    {
+        bench_run(AUDIO_CODEC_OPUS, durations[i][0], durations[i][1]);
+
+        /* The headers of every packet, and Opus' framing within it */
+        overhead = (bench.packets * PACKET_HEADERS_SIZE +
+            bench.framing_bytes) / BENCH_SECONDS;
+        printf("%3" PRIu32 "ms  %3" PRIu32 "ms  %9.1f  %8" PRIu64 "  %5" PRIu64
+            " (%2" PRIu64 "%%)  %5.1fms\n", durations[i][0] / 1000,
+            durations[i][1] / 1000, (double)bench.packets / BENCH_SECONDS,
+            bench.bytes / BENCH_SECONDS, overhead, overhead * 100 /
+            (bench.bytes / BENCH_SECONDS + bench.packets * PACKET_HEADERS_SIZE /
+            BENCH_SECONDS), bench.max_latency / 1000.0);
+
+        /* A packet goes as soon as its last frame is encoded */
+        TEST_ASSERT_EQUAL(durations[i][1], bench.max_latency);
+
+        /* Longer packets of the same frames cost less */
+        if (i && durations[i][0] == durations[i - 1][0])
+            TEST_ASSERT_LESS_THAN(last_overhead, overhead);
+        last_overhead = overhead;
+    }
+}
+
+TEST_CASE("G.711 takes a fraction of the CPU time of Opus", "[audio][bench]")
+{
+    const audio_codec_t codecs[] = { AUDIO_CODEC_OPUS, AUDIO_CODEC_PCMU,
+        AUDIO_CODEC_PCMA };
+    const char *names[] = { "Opus", "G.711 u-law", "G.711 A-law" };
+    int64_t opus_cpu_time = 0;
+    size_t i;
+
+    /* In 20ms packets, of 20ms frames for Opus */
+    for (i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++)
+    {
+        bench_run(codecs[i], 20000, 20000);
+        TEST_ASSERT_GREATER_THAN(0, bench.cpu_time);
+        printf("%s: %" PRId64 "us of CPU per second of audio", names[i],
+            bench.cpu_time / BENCH_SECONDS);
+        if (!i)
+        {
+            printf("\n");
+            opus_cpu_time = bench.cpu_time;
+            continue;
+        }
+
+        printf(", Opus takes %.1fx\n", (double)opus_cpu_time /
+            bench.cpu_time);
+        TEST_ASSERT_LESS_THAN(opus_cpu_time / 4, bench.cpu_time);
+    }
+}
@@ -0,0 +1,261 @@
+#include "audio_processor.h"
+#include <unity.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+/* The processing is all integer, so its output is checked to the sample
+ * against references written here. Only the filter coefficients are computed
+ * in floating point, the high-pass is checked against a double precision
+ * filter to within rounding */
+
+#define SAMPLE_RATE 16000
+#define BLOCK_SIZE 320
+#define GAIN_UNITY 4096
+/* -20dBFS and -40dBFS */
+#define AGC_TARGET 3276
+#define NOISE_GATE 327
+/* 200ms */
+#define GATE_HOLD_BLOCKS (SAMPLE_RATE / 5 / BLOCK_SIZE)
+
+static int16_t *signal_create(size_t count, int32_t offset, int32_t amplitude,
+    float frequency)
+{
+    int16_t *samples = malloc(count * sizeof(int16_t));
+    size_t i;
+
+    TEST_ASSERT_NOT_NULL(samples);
+    for (i = 0; i < count; i++)
+    {
+        samples[i] = offset + amplitude *
+            sinf(2 * M_PI * frequency * i / SAMPLE_RATE);
+    }
+
+    return samples;
+}
+
+/* A full scale square wave at the Nyquist frequency, of an RMS of amplitude */
+static void square_fill(int16_t *samples, size_t count, int16_t amplitude)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        samples[i] = i & 1 ? -amplitude : amplitude;
+}
+
+static void blocks_process(int16_t *samples, size_t count, size_t block_size)
+{
+    size_t i;
+
+    for (i = 0; i < count; i += block_size)
+        audio_processor_process(samples + i, MIN(block_size, count - i));
+}
+
+static int16_t peak_get(const int16_t *samples, size_t count)
+{
+    int16_t peak = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        peak = MAX(peak, abs(samples[i]));
+
+    return peak;
+}
+
+/* The gain ramps linearly across a block from the previous one, in Q16 */
+static void gain_expected(const int16_t *in, int16_t *out, size_t count,
+    int32_t from, int32_t to)
+{
+    int64_t gain = (int64_t)from * 65536;
+    int64_t step = (int64_t)(to - from) * 65536 / (int64_t)count;
+    size_t i;
+
+    for (i = 0; i < count; i++, gain += step)
+    {
+        int64_t sample = (int64_t)in[i] * (gain >> 16) >> 12;
+
+        out[i] = sample > INT16_MAX ? INT16_MAX :
+            sample < INT16_MIN ? INT16_MIN : sample;
+    }
+}
+
+static void block_check(int16_t *samples, int16_t amplitude, int32_t from,
+    int32_t to)
+{
+    int16_t in[BLOCK_SIZE], expected[BLOCK_SIZE];
+
+    square_fill(in, BLOCK_SIZE, amplitude);
+    gain_expected(in, expected, BLOCK_SIZE, from, to);
+    memcpy(samples, in, sizeof(in));
+    audio_processor_process(samples, BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expected, samples, BLOCK_SIZE);
+}
+
+TEST_CASE("DC blocker removes the offset", "[audio]")
+{
+    /* y[n] = x[n] - x[n-1] + y[n-1] * 32639 / 32768, the pole for 10Hz */
+    int16_t step[12] = { 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000,
+        -1000, -1000, -1000, -1000 };
+    const int16_t step_expected[12] = { 1000, 996, 992, 988, 984, 980, 976,
+        972, -1032, -1028, -1023, -1019 };
+    int16_t *samples = signal_create(SAMPLE_RATE, 1000, 8192, 440);
+    int16_t *whole = malloc(SAMPLE_RATE * sizeof(int16_t));
+    int32_t sum = 0;
+    size_t i;
+
+    TEST_ASSERT_NOT_NULL(whole);
+    memcpy(whole, samples, SAMPLE_RATE * sizeof(int16_t));
+
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 1, 0, 0, 0,
+        0));
+    audio_processor_process(step, 12);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(step_expected, step, 12);
+
+    /* The state carries across blocks, as if processed at once */
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 1, 0, 0, 0,
+        0));
+    audio_processor_process(whole, SAMPLE_RATE);
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 1, 0, 0, 0,
+        0));
+    blocks_process(samples, SAMPLE_RATE, BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(whole, samples, SAMPLE_RATE);
+
+    /* Settled over the last 100ms, 44 periods of the tone */
+    for (i = SAMPLE_RATE - SAMPLE_RATE / 10; i < SAMPLE_RATE; i++)
+        sum += samples[i];
+    TEST_ASSERT_INT_WITHIN(2, 0, sum / (SAMPLE_RATE / 10));
+    TEST_ASSERT_INT_WITHIN(8192 / 50, 8192, peak_get(samples + SAMPLE_RATE -
+        SAMPLE_RATE / 10, SAMPLE_RATE / 10));
+
+    free(whole);
+    free(samples);
+}
+
+TEST_CASE("high-pass filter attenuates below the cutoff", "[audio]")
+{
+    /* Butterworth at 100Hz, from the Audio EQ Cookbook */
+    double w0 = 2 * M_PI * 100 / SAMPLE_RATE, alpha = sin(w0) * M_SQRT1_2;
+    double a0 = 1 + alpha, b0 = (1 + cos(w0)) / 2 / a0, b1 = -2 * b0;
+    double a1 = -2 * cos(w0) / a0, a2 = (1 - alpha) / a0;
+    double x1 = 0, x2 = 0, y1 = 0, y2 = 0, x, y;
+    int16_t impulse[64] = { 16384 };
+    int16_t *samples, *whole;
+    size_t i;
+
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 100, 0, 0,
+        0));
+    audio_processor_process(impulse, 64);
+    for (i = 0; i < 64; i++)
+    {
+        x = i ? 0 : 16384;
+        y = b0 * x + b1 * x1 + b0 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        TEST_ASSERT_INT_WITHIN(1, lround(y), impulse[i]);
+    }
+
+    /* 1kHz passes, and 20Hz is down by 28dB, to 328 */
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 100, 0, 0,
+        0));
+    samples = signal_create(SAMPLE_RATE, 0, 8192, 1000);
+    blocks_process(samples, SAMPLE_RATE, BLOCK_SIZE);
+    TEST_ASSERT_INT_WITHIN(8192 / 50, 8192, peak_get(samples + SAMPLE_RATE / 2,
+        SAMPLE_RATE / 2));
+    free(samples);
+
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 100, 0, 0,
+        0));
+    samples = signal_create(SAMPLE_RATE, 0, 8192, 20);
+    TEST_ASSERT_NOT_NULL(whole = malloc(SAMPLE_RATE * sizeof(int16_t)));
+    memcpy(whole, samples, SAMPLE_RATE * sizeof(int16_t));
+    blocks_process(samples, SAMPLE_RATE, BLOCK_SIZE);
+    TEST_ASSERT_LESS_THAN(8192 / 20, peak_get(samples + SAMPLE_RATE / 2,
+        SAMPLE_RATE / 2));
+
+    /* The state carries across blocks, as if processed at once */
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 100, 0, 0,
+        0));
+    audio_processor_process(whole, SAMPLE_RATE);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(whole, samples, SAMPLE_RATE);
+
+    free(whole);
+    free(samples);
+}
+
+TEST_CASE("noise gate closes after the hold time", "[audio]")
+{
+    int16_t samples[BLOCK_SIZE];
+    int i;
+
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 0, 0, 0,
+        -40));
+
+    /* Below the gate, held open for 200ms and then faded out in a block */
+    for (i = 0; i < GATE_HOLD_BLOCKS; i++)
+        block_check(samples, NOISE_GATE / 3, GAIN_UNITY, GAIN_UNITY);
+    block_check(samples, NOISE_GATE / 3, GAIN_UNITY, 0);
+    block_check(samples, NOISE_GATE / 3, 0, 0);
+    TEST_ASSERT_EQUAL(0, peak_get(samples, BLOCK_SIZE));
+
+    /* And faded back in as soon as the level is above it */
+    block_check(samples, NOISE_GATE * 3, 0, GAIN_UNITY);
+    block_check(samples, NOISE_GATE * 3, GAIN_UNITY, GAIN_UNITY);
+
+    /* From the start again once initialized */
+    block_check(samples, NOISE_GATE / 3, GAIN_UNITY, GAIN_UNITY);
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 0, 0, 0,
+        -40));
+    for (i = 0; i < GATE_HOLD_BLOCKS; i++)
+        block_check(samples, NOISE_GATE / 3, GAIN_UNITY, GAIN_UNITY);
+
+    /* And not at all once disabled */
+    block_check(samples, NOISE_GATE / 3, GAIN_UNITY, 0);
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 0, 0, 0,
+        0));
+    block_check(samples, NOISE_GATE / 3, GAIN_UNITY, GAIN_UNITY);
+}
+
+TEST_CASE("AGC converges on the target level", "[audio]")
+{
+    /* Up to 20dB of gain, at 1/32 of the difference a block */
+    const int32_t max_gain = GAIN_UNITY * 10, min_gain = GAIN_UNITY / 4;
+    int16_t samples[BLOCK_SIZE];
+    int32_t gain = GAIN_UNITY, target, prev;
+    int i;
+
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 0, -20, 20,
+        0));
+
+    /* A quiet sound is lifted slowly */
+    for (i = 0; i < 200; i++)
+    {
+        target = MIN(((int64_t)AGC_TARGET << 12) / 1000, max_gain);
+        prev = gain;
+        gain += (target - gain) / 32;
+        block_check(samples, 1000, prev, gain);
+    }
+    TEST_ASSERT_INT_WITHIN(AGC_TARGET / 50, AGC_TARGET,
+        peak_get(samples, BLOCK_SIZE));
+
+    /* And a loud one brought down quickly, by half the difference a block,
+     * to no less than 12dB of attenuation */
+    for (i = 0; i < 20; i++)
+    {
+        target = MAX(((int64_t)AGC_TARGET << 12) / 20000, min_gain);
+        prev = gain;
+        gain -= (gain - target) / 2;
+        block_check(samples, 20000, prev, gain);
+    }
+    TEST_ASSERT_INT_WITHIN(20000 / 4 / 100, 20000 / 4,
+        peak_get(samples, BLOCK_SIZE));
+
+    /* From unity again once initialized */
+    TEST_ASSERT_EQUAL(0, audio_processor_initialize(SAMPLE_RATE, 0, 0, -20, 20,
+        0));
+    target = MIN(((int64_t)AGC_TARGET << 12) / 1000, max_gain);
+    block_check(samples, 1000, GAIN_UNITY,
+        GAIN_UNITY + (target - GAIN_UNITY) / 32);
+}
@@ -0,0 +1,114 @@
+#include "g711.h"
+#include <unity.h>
+
+/* The reference encoders, as in Sun Microsystems' g711.c released to the
+ * public domain, which most implementations derive from */
+
+#define SAMPLES_COUNT 65536
+
+/* Indexed by the sample, from INT16_MIN */
+static uint8_t expected[SAMPLES_COUNT], encoded[SAMPLES_COUNT];
+
+static const int16_t seg_aend[8] = { 0x1f, 0x3f, 0x7f, 0xff, 0x1ff, 0x3ff,
+    0x7ff, 0xfff };
+static const int16_t seg_uend[8] = { 0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff,
+    0xfff, 0x1fff };
+
+static int16_t search(int16_t val, const int16_t *table, int16_t size)
+{
+    int16_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (val <= *table++)
+            return i;
+    }
+    return size;
+}
+
+static uint8_t linear2alaw(int16_t pcm_val)
+{
+    int16_t mask, seg;
+    uint8_t aval;
+
+    pcm_val = pcm_val >> 3;
+
+    if (pcm_val >= 0)
+        mask = 0xd5;
+    else
+    {
+        mask = 0x55;
+        pcm_val = -pcm_val - 1;
+    }
+
+    seg = search(pcm_val, seg_aend, 8);
+
+    if (seg >= 8)
+        return 0x7f ^ mask;
+
+    aval = (uint8_t)seg << 4;
+    if (seg < 2)
+        aval |= (pcm_val >> 1) & 0x0f;
+    else
+        aval |= (pcm_val >> seg) & 0x0f;
+    return aval ^ mask;
+}
+
+static uint8_t linear2ulaw(int16_t pcm_val)
+{
+    int16_t mask, seg;
+    uint8_t uval;
+
+    pcm_val = pcm_val >> 2;
+    if (pcm_val < 0)
+    {
+        pcm_val = -pcm_val;
+        mask = 0x7f;
+    }
+    else
+        mask = 0xff;
+    if (pcm_val > 8159)
+        pcm_val = 8159;
+    pcm_val += 0x84 >> 2;
+
+    seg = search(pcm_val, seg_uend, 8);
+
+    if (seg >= 8)
+        return 0x7f ^ mask;
+
+    uval = (uint8_t)(seg << 4) | ((pcm_val >> (seg + 1)) & 0x0f);
+    return uval ^ mask;
+}
+
+TEST_CASE("u-law encodes every sample as the reference does", "[g711]")
+{
+    int32_t sample;
+
+    for (sample = INT16_MIN; sample <= INT16_MAX; sample++)
+    {
+        expected[sample - INT16_MIN] = linear2ulaw(sample);
+        encoded[sample - INT16_MIN] = g711_ulaw_encode(sample);
+    }
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, encoded, SAMPLES_COUNT);
+
+    /* The codes of silence and full scale */
+    TEST_ASSERT_EQUAL_HEX8(0xff, g711_ulaw_encode(0));
+    TEST_ASSERT_EQUAL_HEX8(0x80, g711_ulaw_encode(INT16_MAX));
+    TEST_ASSERT_EQUAL_HEX8(0x00, g711_ulaw_encode(INT16_MIN));
+}
+
+TEST_CASE("A-law encodes every sample as the reference does", "[g711]")
+{
+    int32_t sample;
+
+    for (sample = INT16_MIN; sample <= INT16_MAX; sample++)
+    {
+        expected[sample - INT16_MIN] = linear2alaw(sample);
+        encoded[sample - INT16_MIN] = g711_alaw_encode(sample);
+    }
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, encoded, SAMPLES_COUNT);
+
+    TEST_ASSERT_EQUAL_HEX8(0xd5, g711_alaw_encode(0));
+    TEST_ASSERT_EQUAL_HEX8(0xaa, g711_alaw_encode(INT16_MAX));
+    TEST_ASSERT_EQUAL_HEX8(0x2a, g711_alaw_encode(INT16_MIN));
+}
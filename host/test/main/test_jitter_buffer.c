@@ -0,0 +1,248 @@
+#include "jitter_buffer.h"
+#include <unity.h>
+#include <string.h>
+
+/* Opus at 48kHz in 20ms packets, played out every 20ms from when the first
+ * packet is sent. Packets carry their sequence number */
+#define CLOCK_RATE 48000
+#define PACKET_DURATION 960
+#define PACKET_INTERVAL 20000
+#define SLOTS 16
+#define MAX_PACKET_SIZE 16
+#define MIN_DELAY 40000
+#define MAX_DELAY 300000
+#define MAX_TICKS 1024
+
+/* Types */
+typedef struct {
+    uint16_t seq;
+    int64_t arrival_time;
+} arrival_t;
+
+/* What was played out on each tick, the sequence number of the packet or -1
+ * for concealment and -2 for silence */
+typedef struct {
+    int played[MAX_TICKS];
+    size_t ticks;
+} playout_t;
+
+#define PLAYED_LOST -1
+#define PLAYED_EMPTY -2
+
+static jitter_buffer_t *create(void)
+{
+    jitter_buffer_t *jitter_buffer = jitter_buffer_create(SLOTS,
+        MAX_PACKET_SIZE, CLOCK_RATE, MIN_DELAY, MAX_DELAY);
+
+    TEST_ASSERT_NOT_NULL(jitter_buffer);
+    return jitter_buffer;
+}
+
+static void put(jitter_buffer_t *jitter_buffer, uint16_t seq,
+    int64_t arrival_time)
+{
+    uint8_t data[2] = { seq >> 8, seq };
+
+    TEST_ASSERT_EQUAL(0, jitter_buffer_put(jitter_buffer, seq,
+        (uint32_t)seq * PACKET_DURATION, PACKET_DURATION, data, sizeof(data),
+        arrival_time));
+}
+
+static int get(jitter_buffer_t *jitter_buffer)
+{
+    uint8_t data[MAX_PACKET_SIZE];
+    size_t length;
+
+    switch (jitter_buffer_get(jitter_buffer, data, &length))
+    {
+    case JITTER_BUFFER_PACKET:
+        TEST_ASSERT_EQUAL(2, length);
+        return data[0] << 8 | data[1];
+    case JITTER_BUFFER_LOST:
+        return PLAYED_LOST;
+    case JITTER_BUFFER_EMPTY:
+        return PLAYED_EMPTY;
+    }
+
+    TEST_FAIL();
+    return 0;
+}
+
+/* Replays the ticks of a trace of arrivals, in the order received, putting
+ * in what arrived since the tick before */
+static void replay(jitter_buffer_t *jitter_buffer, const arrival_t *trace,
+    size_t count, size_t first_tick, size_t ticks, playout_t *playout)
+{
+    int64_t now, before = first_tick ? (first_tick - 1) * PACKET_INTERVAL :
+        INT64_MIN;
+    size_t i, tick;
+
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_TICKS, ticks);
+    for (tick = 0; tick < ticks; tick++, before = now)
+    {
+        now = (int64_t)(first_tick + tick) * PACKET_INTERVAL;
+        for (i = 0; i < count; i++)
+        {
+            if (trace[i].arrival_time > before &&
+                trace[i].arrival_time <= now)
+            {
+                put(jitter_buffer, trace[i].seq, trace[i].arrival_time);
+            }
+        }
+        playout->played[tick] = get(jitter_buffer);
+    }
+    playout->ticks = ticks;
+}
+
+TEST_CASE("jitter buffer plays reordered packets in order", "[jitter]")
+{
+    const uint16_t order[10] = { 100, 102, 101, 104, 103, 105, 107, 106, 109,
+        108 };
+    const int expected[12] = { PLAYED_EMPTY, 100, 101, 102, 103, 104, 105,
+        106, 107, 108, 109, PLAYED_LOST };
+    jitter_buffer_t *jitter_buffer = create();
+    arrival_t trace[10];
+    jitter_buffer_stats_t stats;
+    playout_t playout;
+    size_t i;
+
+    for (i = 0; i < 10; i++)
+    {
+        trace[i].seq = order[i];
+        trace[i].arrival_time = i * PACKET_INTERVAL;
+    }
+
+    /* Buffering up to the minimum delay first */
+    replay(jitter_buffer, trace, 10, 0, 12, &playout);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, playout.played, 12);
+
+    jitter_buffer_stats_get(jitter_buffer, &stats);
+    TEST_ASSERT_EQUAL(10, stats.received);
+    TEST_ASSERT_EQUAL(0, stats.late);
+    TEST_ASSERT_EQUAL(0, stats.lost);
+    TEST_ASSERT_EQUAL(0, stats.dropped);
+    TEST_ASSERT_EQUAL(1, stats.underruns);
+    /* Reordering shows as jitter */
+    TEST_ASSERT_GREATER_THAN(MIN_DELAY, stats.target_delay);
+
+    jitter_buffer_destroy(jitter_buffer);
+}
+
+TEST_CASE("jitter buffer conceals missing packets and drops late ones",
+    "[jitter]")
+{
+    /* 3 arrives after it was due, and 6 never does */
+    const arrival_t trace[9] = {
+        { 0, 0 }, { 1, 20000 }, { 2, 40000 }, { 4, 80000 }, { 5, 100000 },
+        { 3, 110000 }, { 7, 140000 }, { 8, 160000 }, { 9, 180000 },
+    };
+    const int expected[10] = { PLAYED_EMPTY, 0, 1, 2, PLAYED_LOST, 4, 5,
+        PLAYED_LOST, 7, 8 };
+    jitter_buffer_t *jitter_buffer = create();
+    jitter_buffer_stats_t stats;
+    playout_t playout;
+
+    replay(jitter_buffer, trace, 9, 0, 10, &playout);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, playout.played, 10);
+
+    jitter_buffer_stats_get(jitter_buffer, &stats);
+    TEST_ASSERT_EQUAL(9, stats.received);
+    TEST_ASSERT_EQUAL(1, stats.late);
+    TEST_ASSERT_EQUAL(2, stats.lost);
+    TEST_ASSERT_EQUAL(0, stats.underruns);
+
+    /* Still buffered */
+    TEST_ASSERT_EQUAL(9, get(jitter_buffer));
+
+    jitter_buffer_destroy(jitter_buffer);
+}
+
+TEST_CASE("jitter buffer rebuffers after an underrun", "[jitter]")
+{
+    jitter_buffer_t *jitter_buffer = create();
+    jitter_buffer_stats_t stats;
+    int64_t now = 0;
+
+    put(jitter_buffer, 0, now);
+    put(jitter_buffer, 1, now);
+    TEST_ASSERT_EQUAL(0, get(jitter_buffer));
+    TEST_ASSERT_EQUAL(1, get(jitter_buffer));
+
+    /* Concealed once as it runs dry, and then silent until filled up to
+     * the target delay again */
+    TEST_ASSERT_EQUAL(PLAYED_LOST, get(jitter_buffer));
+    TEST_ASSERT_EQUAL(PLAYED_EMPTY, get(jitter_buffer));
+    jitter_buffer_stats_get(jitter_buffer, &stats);
+    TEST_ASSERT_EQUAL(1, stats.underruns);
+    TEST_ASSERT_EQUAL(0, stats.delay);
+
+    /* What was already played is late */
+    put(jitter_buffer, 1, now);
+    put(jitter_buffer, 4, now);
+    TEST_ASSERT_EQUAL(PLAYED_EMPTY, get(jitter_buffer));
+    put(jitter_buffer, 5, now);
+    TEST_ASSERT_EQUAL(4, get(jitter_buffer));
+    TEST_ASSERT_EQUAL(5, get(jitter_buffer));
+
+    jitter_buffer_stats_get(jitter_buffer, &stats);
+    TEST_ASSERT_EQUAL(1, stats.late);
+    TEST_ASSERT_EQUAL(0, stats.lost);
+
+    /* A sender restarting far ahead starts it over */
+    put(jitter_buffer, 1000, now);
+    put(jitter_buffer, 1001, now);
+    TEST_ASSERT_EQUAL(1000, get(jitter_buffer));
+
+    jitter_buffer_destroy(jitter_buffer);
+}
+
+TEST_CASE("jitter buffer delay follows the measured jitter", "[jitter]")
+{
+    arrival_t trace[700];
+    jitter_buffer_stats_t stats;
+    jitter_buffer_t *jitter_buffer = create();
+    playout_t playout;
+    size_t i, concealed = 0;
+    uint32_t lost;
+
+    /* Steady for 2 seconds, then every other packet held back by 50ms for 6
+     * seconds, and steady again */
+    for (i = 0; i < 700; i++)
+    {
+        trace[i].seq = i;
+        trace[i].arrival_time = i * PACKET_INTERVAL +
+            (i >= 100 && i < 400 && i & 1 ? 50000 : 0);
+    }
+
+    /* The first packets held back are lost before the jitter shows, then
+     * they're waited for, which raises the delay */
+    replay(jitter_buffer, trace, 700, 0, 250, &playout);
+    jitter_buffer_stats_get(jitter_buffer, &stats);
+    TEST_ASSERT_INT_WITHIN(2000, 50000, stats.jitter);
+    TEST_ASSERT_INT_WITHIN(8000, 200000, stats.target_delay);
+    for (i = 100; i < playout.ticks; i++)
+        concealed += playout.played[i] == PLAYED_LOST;
+    TEST_ASSERT_GREATER_THAN(0, stats.stretched);
+    TEST_ASSERT_EQUAL(stats.lost + stats.stretched, concealed);
+    TEST_ASSERT_EQUAL(stats.lost, stats.late);
+    TEST_ASSERT_EQUAL(0, stats.underruns);
+
+    /* Until it covers them, and none is lost any more */
+    for (i = 150; i < playout.ticks; i++)
+        TEST_ASSERT_GREATER_OR_EQUAL(0, playout.played[i]);
+    lost = stats.lost;
+    replay(jitter_buffer, trace, 700, 250, 150, &playout);
+    for (i = 0; i < playout.ticks; i++)
+        TEST_ASSERT_GREATER_OR_EQUAL(0, playout.played[i]);
+
+    /* Once steady, packets are skipped to bring the delay back down */
+    replay(jitter_buffer, trace, 700, 400, 300, &playout);
+    jitter_buffer_stats_get(jitter_buffer, &stats);
+    TEST_ASSERT_EQUAL(MIN_DELAY, stats.target_delay);
+    TEST_ASSERT_GREATER_THAN(0, stats.dropped);
+    TEST_ASSERT_LESS_OR_EQUAL(MIN_DELAY * 3 / 2, stats.delay);
+    TEST_ASSERT_EQUAL(lost, stats.lost);
+    TEST_ASSERT_EQUAL(0, stats.underruns);
+
+    jitter_buffer_destroy(jitter_buffer);
+}
@@ -0,0 +1,9 @@
+#include <unity.h>
+#include <stdlib.h>
+
+void app_main()
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    exit(UNITY_END());
+}
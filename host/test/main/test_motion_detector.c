@@ -0,0 +1,243 @@
+#include "jpeg.h"
+#include "motion_detector.h"
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The fixture frames are 320x240, a still scene and then a 64x64 block at
+ * (128, 96), moving right by 16 pixels a frame, aligned to the block grid */
+#define MAP_WIDTH 40
+#define MAP_HEIGHT 30
+#define STILL_FRAMES 6
+#define MOVING_FRAMES 4
+#define FRAME_INTERVAL 200000
+
+/* Types */
+typedef struct {
+    int calls;
+    uint8_t detected;
+    uint8_t score;
+    uint16_t x, y, width, height;
+} trigger_t;
+
+/* Internal state */
+static trigger_t trigger;
+
+static void on_trigger(uint8_t detected, uint8_t score, uint16_t x,
+    uint16_t y, uint16_t width, uint16_t height)
+{
+    trigger.calls++;
+    trigger.detected = detected;
+    trigger.score = score;
+    trigger.x = x;
+    trigger.y = y;
+    trigger.width = width;
+    trigger.height = height;
+}
+
+static uint8_t *frame_load(int index, size_t *length)
+{
+    char path[256];
+    uint8_t *data;
+    FILE *f;
+
+    snprintf(path, sizeof(path), FIXTURES_DIR "/frames/frame_%02d.jpg",
+        index);
+    TEST_ASSERT_NOT_NULL(f = fopen(path, "rb"));
+    fseek(f, 0, SEEK_END);
+    *length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    TEST_ASSERT_NOT_NULL(data = malloc(*length));
+    TEST_ASSERT_EQUAL(*length, fread(data, 1, *length, f));
+    fclose(f);
+
+    return data;
+}
+
+static void frame_process(jpeg_dc_decoder_t *decoder, int index,
+    int64_t timestamp)
+{
+    const uint8_t *map;
+    uint16_t width, height;
+    uint8_t *data;
+    size_t length;
+
+    data = frame_load(index, &length);
+    TEST_ASSERT_NOT_NULL(map = jpeg_dc_decode(decoder, data, length, &width,
+        &height));
+    TEST_ASSERT_EQUAL(0, motion_detector_process(map, width, height,
+        timestamp));
+    free(data);
+}
+
+/* Every DC table in the frame decodes to a category of 16 */
+static void dc_categories_corrupt(uint8_t *data, size_t length)
+{
+    size_t i = 2, end, count, j, corrupted = 0;
+
+    while (i + 4 <= length && data[i] == 0xff && data[i + 1] != 0xda)
+    {
+        end = i + 2 + (data[i + 2] << 8 | data[i + 3]);
+        for (j = i + 4; data[i + 1] == 0xc4 && j + 17 <= end; j += count)
+        {
+            size_t k;
+
+            for (k = 1, count = 17; k <= 16; k++)
+                count += data[j + k];
+            if (data[j] >> 4)
+                continue;
+            memset(data + j + 17, 16, count - 17);
+            corrupted++;
+        }
+        i = end;
+    }
+
+    TEST_ASSERT_GREATER_THAN(0, corrupted);
+}
+
+/* In the first moving frame, a vertical gradient from 40 to 120 with
+ * rectangles of 100 and 60, and the block of 230 */
+static int luma_expected(uint16_t x, uint16_t y)
+{
+    if (x >= 2 && x < 10 && y >= 2 && y < 8)
+        return 100;
+    if (x >= 30 && x < 38 && y >= 20 && y < 28)
+        return 60;
+    if (x >= 16 && x < 24 && y >= 12 && y < 20)
+        return 230;
+    return 40 + (y * 8 + 3) * 80 / 240;
+}
+
+TEST_CASE("DC map holds the average luma of every block", "[motion]")
+{
+    jpeg_dc_decoder_t *decoder = jpeg_dc_decoder_create();
+    const uint8_t *map;
+    uint16_t width, height, x, y;
+    uint8_t *data, *truncated;
+    size_t length;
+
+    TEST_ASSERT_NOT_NULL(decoder);
+    data = frame_load(STILL_FRAMES, &length);
+
+    TEST_ASSERT_EQUAL(0, jpeg_size_get(data, length, &width, &height));
+    TEST_ASSERT_EQUAL(320, width);
+    TEST_ASSERT_EQUAL(240, height);
+
+    TEST_ASSERT_NOT_NULL(map = jpeg_dc_decode(decoder, data, length, &width,
+        &height));
+    TEST_ASSERT_EQUAL(MAP_WIDTH, width);
+    TEST_ASSERT_EQUAL(MAP_HEIGHT, height);
+
+    for (y = 0; y < MAP_HEIGHT; y++)
+    {
+        for (x = 0; x < MAP_WIDTH; x++)
+        {
+            TEST_ASSERT_INT_WITHIN(3, luma_expected(x, y),
+                map[y * MAP_WIDTH + x]);
+        }
+    }
+
+    /* A truncated frame is read up to its end only, and zero filled from
+     * there as libjpeg does, so the blocks before the cut are still right */
+    TEST_ASSERT_NOT_NULL(truncated = malloc(length / 2));
+    memcpy(truncated, data, length / 2);
+    TEST_ASSERT_NOT_NULL(map = jpeg_dc_decode(decoder, truncated, length / 2,
+        &width, &height));
+    for (x = 0; x < MAP_WIDTH; x++)
+        TEST_ASSERT_INT_WITHIN(3, luma_expected(x, 0), map[x]);
+
+    /* Or not at all, if the headers are cut */
+    TEST_ASSERT_NULL(jpeg_dc_decode(decoder, truncated, 100, &width,
+        &height));
+
+    /* Nor with DC categories too wide for 8 bits */
+    dc_categories_corrupt(data, length);
+    TEST_ASSERT_NULL(jpeg_dc_decode(decoder, data, length, &width, &height));
+
+    free(truncated);
+    free(data);
+    jpeg_dc_decoder_destroy(decoder);
+}
+
+TEST_CASE("motion detector bounds the moving block", "[motion]")
+{
+    jpeg_dc_decoder_t *decoder = jpeg_dc_decoder_create();
+    int64_t timestamp = 0;
+    int i;
+
+    TEST_ASSERT_NOT_NULL(decoder);
+    memset(&trigger, 0, sizeof(trigger));
+    motion_detector_set_on_trigger(on_trigger);
+    TEST_ASSERT_EQUAL(0, motion_detector_initialize(20, 2));
+    TEST_ASSERT_TRUE(motion_detector_is_enabled());
+
+    /* The first frame is the background */
+    for (i = 0; i < STILL_FRAMES; i++, timestamp += FRAME_INTERVAL)
+        frame_process(decoder, i, timestamp);
+    TEST_ASSERT_EQUAL(0, trigger.calls);
+
+    /* 64 of the 1200 blocks changed */
+    frame_process(decoder, STILL_FRAMES, timestamp);
+    timestamp += FRAME_INTERVAL;
+    TEST_ASSERT_EQUAL(1, trigger.calls);
+    TEST_ASSERT_EQUAL(1, trigger.detected);
+    TEST_ASSERT_EQUAL(64 * 100 / (MAP_WIDTH * MAP_HEIGHT), trigger.score);
+    TEST_ASSERT_EQUAL(128, trigger.x);
+    TEST_ASSERT_EQUAL(96, trigger.y);
+    TEST_ASSERT_EQUAL(64, trigger.width);
+    TEST_ASSERT_EQUAL(64, trigger.height);
+
+    /* Reported once while it keeps moving */
+    for (i = STILL_FRAMES + 1; i < STILL_FRAMES + MOVING_FRAMES;
+        i++, timestamp += FRAME_INTERVAL)
+    {
+        frame_process(decoder, i, timestamp);
+    }
+    TEST_ASSERT_EQUAL(1, trigger.calls);
+
+    /* And cleared once the scene is still for the hold time */
+    for (i = 0; i < 30; i++, timestamp += FRAME_INTERVAL)
+        frame_process(decoder, 0, timestamp);
+    TEST_ASSERT_EQUAL(2, trigger.calls);
+    TEST_ASSERT_EQUAL(0, trigger.detected);
+
+    motion_detector_set_on_trigger(NULL);
+    jpeg_dc_decoder_destroy(decoder);
+}
+
+TEST_CASE("motion detector ignores global brightness changes", "[motion]")
+{
+    uint8_t map[MAP_WIDTH * MAP_HEIGHT];
+    size_t i;
+
+    memset(&trigger, 0, sizeof(trigger));
+    motion_detector_set_on_trigger(on_trigger);
+    TEST_ASSERT_EQUAL(0, motion_detector_initialize(20, 2));
+
+    for (i = 0; i < sizeof(map); i++)
+        map[i] = 60 + i % 50;
+    TEST_ASSERT_EQUAL(0, motion_detector_process(map, MAP_WIDTH, MAP_HEIGHT,
+        0));
+
+    /* As auto exposure would */
+    for (i = 0; i < sizeof(map); i++)
+        map[i] += 60;
+    TEST_ASSERT_EQUAL(0, motion_detector_process(map, MAP_WIDTH, MAP_HEIGHT,
+        FRAME_INTERVAL));
+    TEST_ASSERT_EQUAL(0, trigger.calls);
+
+    /* While a change to a few blocks is still scored, against the rest */
+    for (i = 0; i < 24; i++)
+        map[i] = 255;
+    TEST_ASSERT_EQUAL(0, motion_detector_process(map, MAP_WIDTH, MAP_HEIGHT,
+        2 * FRAME_INTERVAL));
+    TEST_ASSERT_EQUAL(1, trigger.calls);
+    TEST_ASSERT_EQUAL(2, trigger.score);
+    TEST_ASSERT_EQUAL(0, trigger.x);
+    TEST_ASSERT_EQUAL(0, trigger.y);
+    TEST_ASSERT_EQUAL(24 * 8, trigger.width);
+    TEST_ASSERT_EQUAL(8, trigger.height);
+
+    motion_detector_set_on_trigger(NULL);
+}
@@ -0,0 +1,74 @@
+#include "opus_layout.h"
+#include "rtp.h"
+#include <unity.h>
+
+TEST_CASE("Opus frames are combined up to the packet duration", "[opus]")
+{
+    opus_layout_t layout;
+
+    /* 20ms at 32kbps averages 80 bytes, twice that plus the TOC byte */
+    TEST_ASSERT_EQUAL(0, opus_layout_get(32000, 20000, 120000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(6, layout.frames_per_packet);
+    TEST_ASSERT_EQUAL(120000, layout.packet_duration);
+    TEST_ASSERT_EQUAL(161, layout.max_frame_size);
+    TEST_ASSERT_EQUAL(2 + 6 * (161 + 2), layout.max_packet_size);
+
+    /* A single frame isn't repacketized */
+    TEST_ASSERT_EQUAL(0, opus_layout_get(32000, 2500, 2500,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(1, layout.frames_per_packet);
+    TEST_ASSERT_EQUAL(2500, layout.packet_duration);
+    TEST_ASSERT_EQUAL(21, layout.max_frame_size);
+    TEST_ASSERT_EQUAL(21, layout.max_packet_size);
+}
+
+TEST_CASE("Opus packets are shortened to fit the payload", "[opus]")
+{
+    opus_layout_t layout;
+
+    /* 20ms at 128kbps is up to 641 bytes, two fill 1288 exactly */
+    TEST_ASSERT_EQUAL(0, opus_layout_get(128000, 20000, 60000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(2, layout.frames_per_packet);
+    TEST_ASSERT_EQUAL(40000, layout.packet_duration);
+    TEST_ASSERT_EQUAL(641, layout.max_frame_size);
+    TEST_ASSERT_EQUAL(RTP_MAX_PAYLOAD_SIZE, layout.max_packet_size);
+
+    /* 10ms at 64kbps is up to 161 bytes, 7 fit in 1288 */
+    TEST_ASSERT_EQUAL(0, opus_layout_get(64000, 10000, 120000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(7, layout.frames_per_packet);
+    TEST_ASSERT_EQUAL(70000, layout.packet_duration);
+    TEST_ASSERT_LESS_OR_EQUAL(RTP_MAX_PAYLOAD_SIZE, layout.max_packet_size);
+
+    /* Frames larger than the payload are limited to it, and to Opus' own
+     * largest frame */
+    TEST_ASSERT_EQUAL(0, opus_layout_get(510000, 60000, 60000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(1, layout.frames_per_packet);
+    TEST_ASSERT_EQUAL(1276, layout.max_frame_size);
+    TEST_ASSERT_EQUAL(0, opus_layout_get(510000, 60000, 60000, 1000,
+        &layout));
+    TEST_ASSERT_EQUAL(1000, layout.max_frame_size);
+    TEST_ASSERT_EQUAL(1000, layout.max_packet_size);
+}
+
+TEST_CASE("Opus durations are validated", "[opus]")
+{
+    opus_layout_t layout;
+
+    /* Frame durations Opus doesn't support */
+    TEST_ASSERT_EQUAL(-1, opus_layout_get(32000, 0, 20000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(-1, opus_layout_get(32000, 30000, 60000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+
+    /* Packets shorter than a frame, not a multiple of it or too long */
+    TEST_ASSERT_EQUAL(-1, opus_layout_get(32000, 20000, 10000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(-1, opus_layout_get(32000, 20000, 50000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+    TEST_ASSERT_EQUAL(-1, opus_layout_get(32000, 60000, 180000,
+        RTP_MAX_PAYLOAD_SIZE, &layout));
+}
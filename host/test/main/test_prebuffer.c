@@ -0,0 +1,143 @@
+#include "mkv.h"
+#include "prebuffer.h"
+#include <esp_timer.h>
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_LENGTH 100
+#define FRAMES_COUNT 10
+#define SAMPLE_RATE 16000
+#define OUTPUT_SIZE 65536
+
+/* Types */
+typedef struct {
+    int frames;
+    int64_t timestamps[2 * FRAMES_COUNT];
+} collected_t;
+
+typedef struct {
+    uint8_t data[OUTPUT_SIZE];
+    size_t length;
+} output_t;
+
+static int collect_sink(const prebuffer_frame_t *frame, void *ctx)
+{
+    collected_t *collected = (collected_t *)ctx;
+
+    TEST_ASSERT_LESS_THAN(2 * FRAMES_COUNT, collected->frames);
+    collected->timestamps[collected->frames++] = frame->timestamp;
+    return 0;
+}
+
+static int output_write(const void *data, size_t length, void *ctx)
+{
+    output_t *output = (output_t *)ctx;
+
+    TEST_ASSERT_LESS_OR_EQUAL(OUTPUT_SIZE, output->length + length);
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    return 0;
+}
+
+static uint8_t *frame_load(size_t *length)
+{
+    uint8_t *data;
+    FILE *f;
+
+    TEST_ASSERT_NOT_NULL(f = fopen(FIXTURES_DIR "/frames/frame_00.jpg",
+        "rb"));
+    fseek(f, 0, SEEK_END);
+    *length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    TEST_ASSERT_NOT_NULL(data = malloc(*length));
+    TEST_ASSERT_EQUAL(*length, fread(data, 1, *length, f));
+    fclose(f);
+
+    return data;
+}
+
+TEST_CASE("prebuffer keeps buffering after an event", "[prebuffer]")
+{
+    uint8_t frame[FRAME_LENGTH] = {};
+    int64_t start = esp_timer_get_time();
+    collected_t collected = {};
+    int i;
+
+    /* Room for exactly FRAMES_COUNT frames */
+    TEST_ASSERT_EQUAL(0, prebuffer_initialize(FRAMES_COUNT * FRAME_LENGTH, 1,
+        FRAMES_COUNT, 0));
+
+    for (i = 0; i < FRAMES_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_JPEG, frame,
+            FRAME_LENGTH, start + i * 1000));
+    }
+    prebuffer_trigger();
+
+    /* New frames evict the oldest event frames rather than being dropped */
+    for (; i < FRAMES_COUNT + 3; i++)
+    {
+        TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_JPEG, frame,
+            FRAME_LENGTH, start + i * 1000));
+    }
+
+    /* So only the rest of the event is dumped, none of the newer frames */
+    TEST_ASSERT_EQUAL(0, prebuffer_dump(collect_sink, &collected));
+    TEST_ASSERT_EQUAL(FRAMES_COUNT - 3, collected.frames);
+    for (i = 0; i < collected.frames; i++)
+        TEST_ASSERT_EQUAL(start + (i + 3) * 1000, collected.timestamps[i]);
+
+    /* And the event is still there for the next reader */
+    collected.frames = 0;
+    TEST_ASSERT_EQUAL(0, prebuffer_dump(collect_sink, &collected));
+    TEST_ASSERT_EQUAL(FRAMES_COUNT - 3, collected.frames);
+
+    /* Audio isn't buffered without a sample rate */
+    collected.frames = 0;
+    TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_OPUS, frame, 10,
+        start + i * 1000));
+    TEST_ASSERT_EQUAL(0, prebuffer_dump(collect_sink, &collected));
+    TEST_ASSERT_EQUAL(FRAMES_COUNT - 3, collected.frames);
+}
+
+TEST_CASE("prebuffer dumps video and audio as Matroska", "[prebuffer]")
+{
+    static output_t output, expected;
+    uint8_t packet[40] = { 0x78 };
+    int64_t start = esp_timer_get_time();
+    mkv_writer_t writer;
+    uint8_t *jpeg;
+    size_t length;
+
+    jpeg = frame_load(&length);
+    TEST_ASSERT_EQUAL(0, prebuffer_initialize(65536, 1, 10, SAMPLE_RATE));
+
+    /* Audio before the first video frame is left out */
+    TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_OPUS, packet,
+        sizeof(packet), start));
+    TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_JPEG, jpeg, length,
+        start + 10000));
+    TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_OPUS, packet,
+        sizeof(packet), start + 30000));
+    TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_JPEG, jpeg, length,
+        start + 110000));
+
+    mkv_writer_init(&writer, output_write, &expected);
+    TEST_ASSERT_EQUAL(0, mkv_header_write(&writer, 320, 240, SAMPLE_RATE));
+    TEST_ASSERT_EQUAL(0, mkv_block_write(&writer, MKV_TRACK_VIDEO, 0, jpeg,
+        length));
+    TEST_ASSERT_EQUAL(0, mkv_block_write(&writer, MKV_TRACK_AUDIO, 20,
+        packet, sizeof(packet)));
+    TEST_ASSERT_EQUAL(0, mkv_block_write(&writer, MKV_TRACK_VIDEO, 100, jpeg,
+        length));
+
+    output.length = 0;
+    TEST_ASSERT_EQUAL(0, prebuffer_mkv_dump(output_write, &output));
+    TEST_ASSERT_EQUAL(expected.length, output.length);
+    TEST_ASSERT_EQUAL_MEMORY(expected.data, output.data, expected.length);
+
+    TEST_ASSERT_EQUAL(0, prebuffer_initialize(0, 0, 10, 0));
+    free(jpeg);
+}
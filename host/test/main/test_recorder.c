@@ -0,0 +1,165 @@
+#include "mkv.h"
+#include "prebuffer.h"
+#include "recorder.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Segments are written to tmpfs, as they would be to the SD card */
+#define PRE_EVENT_FRAMES 3
+#define FRAMES_COUNT 6
+#define FRAME_INTERVAL 100000
+#define PREALLOCATE (256 * 1024)
+#define OUTPUT_SIZE (64 * 1024)
+
+/* Types */
+typedef struct {
+    uint8_t data[OUTPUT_SIZE];
+    size_t length;
+} output_t;
+
+static int output_write(const void *data, size_t length, void *ctx)
+{
+    output_t *output = (output_t *)ctx;
+
+    TEST_ASSERT_LESS_OR_EQUAL(OUTPUT_SIZE, output->length + length);
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    return 0;
+}
+
+static uint8_t *frame_load(size_t *length)
+{
+    uint8_t *data;
+    FILE *f;
+
+    TEST_ASSERT_NOT_NULL(f = fopen(FIXTURES_DIR "/frames/frame_00.jpg",
+        "rb"));
+    fseek(f, 0, SEEK_END);
+    *length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    TEST_ASSERT_NOT_NULL(data = malloc(*length));
+    TEST_ASSERT_EQUAL(*length, fread(data, 1, *length, f));
+    fclose(f);
+
+    return data;
+}
+
+static void frames_written_wait(uint32_t expected)
+{
+    uint32_t written, dropped, sync_failures;
+    int i;
+
+    for (i = 0; i < 200; i++)
+    {
+        recorder_stats_get(&written, &dropped, &sync_failures);
+        if (written >= expected)
+            break;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    TEST_ASSERT_EQUAL(expected, written);
+    TEST_ASSERT_EQUAL(0, dropped);
+    TEST_ASSERT_EQUAL(0, sync_failures);
+}
+
+TEST_CASE("recorder writes the event with its pre-event frames",
+    "[recorder]")
+{
+    static output_t expected;
+    char dir[] = "/dev/shm/ipcam_recorder_XXXXXX";
+    char segment[64], index[64];
+    recorder_segment_info_t info;
+    int64_t start = esp_timer_get_time();
+    uint64_t header_size, offset;
+    mkv_writer_t writer;
+    struct stat st;
+    uint8_t *jpeg, *data;
+    size_t length;
+    FILE *f;
+    int i;
+
+    jpeg = frame_load(&length);
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    snprintf(segment, sizeof(segment), "%s/00000001.mkv", dir);
+    snprintf(index, sizeof(index), "%s/00000001.idx", dir);
+
+    TEST_ASSERT_EQUAL(0, prebuffer_initialize(65536, 1, 10, 0));
+    TEST_ASSERT_EQUAL(0, recorder_initialize(dir, RECORDER_MODE_MOTION, 60, 0,
+        256 * 1024, PREALLOCATE, 0));
+
+    /* Nothing is recorded before the event, but it's buffered */
+    for (i = 0; i < PRE_EVENT_FRAMES; i++)
+    {
+        TEST_ASSERT_EQUAL(0, recorder_add_jpeg(jpeg, length,
+            start + i * FRAME_INTERVAL));
+        TEST_ASSERT_EQUAL(0, prebuffer_add(PREBUFFER_TYPE_JPEG, jpeg, length,
+            start + i * FRAME_INTERVAL));
+    }
+
+    /* The writer dumps the pre-event frames before recording the new ones */
+    prebuffer_trigger();
+    recorder_motion_set(1);
+    frames_written_wait(PRE_EVENT_FRAMES);
+
+    for (; i < FRAMES_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL(0, recorder_add_jpeg(jpeg, length,
+            start + i * FRAME_INTERVAL));
+    }
+    frames_written_wait(FRAMES_COUNT);
+
+    /* The queued frames are written before the segment is closed, which
+     * drops the preallocated space */
+    recorder_motion_set(0);
+    for (i = 0; i < 200; i++)
+    {
+        TEST_ASSERT_EQUAL(0, stat(segment, &st));
+        if (st.st_size != PREALLOCATE)
+            break;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    /* And nothing more is recorded */
+    TEST_ASSERT_EQUAL(0, recorder_add_jpeg(jpeg, length,
+        start + FRAMES_COUNT * FRAME_INTERVAL));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    frames_written_wait(FRAMES_COUNT);
+
+    mkv_writer_init(&writer, output_write, &expected);
+    TEST_ASSERT_EQUAL(0, mkv_header_write(&writer, 320, 240, 0));
+    header_size = writer.offset;
+    for (i = 0; i < FRAMES_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL(0, mkv_block_write(&writer, MKV_TRACK_VIDEO,
+            i * FRAME_INTERVAL / 1000, jpeg, length));
+    }
+
+    TEST_ASSERT_EQUAL(0, stat(segment, &st));
+    TEST_ASSERT_EQUAL(expected.length, st.st_size);
+    TEST_ASSERT_NOT_NULL(data = malloc(st.st_size));
+    TEST_ASSERT_NOT_NULL(f = fopen(segment, "rb"));
+    TEST_ASSERT_EQUAL(st.st_size, fread(data, 1, st.st_size, f));
+    fclose(f);
+    TEST_ASSERT_EQUAL_MEMORY(expected.data, data, expected.length);
+
+    /* The index points at the first cluster */
+    TEST_ASSERT_EQUAL(0, recorder_segment_info_get(1, &info));
+    TEST_ASSERT_EQUAL(expected.length, info.size);
+    TEST_ASSERT_EQUAL(header_size, info.header_size);
+    TEST_ASSERT_EQUAL(0, recorder_segment_seek(1, 0, &offset));
+    TEST_ASSERT_EQUAL(header_size, offset);
+
+    unlink(segment);
+    unlink(index);
+    rmdir(dir);
+    free(data);
+    free(jpeg);
+    TEST_ASSERT_EQUAL(0, prebuffer_initialize(0, 0, 10, 0));
+}
@@ -0,0 +1,127 @@
+#include <driver/i2s_pdm.h>
+#include <esp_camera.h>
+#include <esp_timer.h>
+#include <unity.h>
+#include <math.h>
+#include <stdlib.h>
+
+/* The stand-ins the pipeline is tested and benchmarked against have to behave
+ * like the drivers they replace */
+
+#define FRAMES_COUNT 10
+#define TONE_SAMPLES 16000
+#define TONE_FREQUENCY 440
+#define TONE_AMPLITUDE 8192
+
+static bool on_recv(i2s_chan_handle_t handle, i2s_event_data_t *event,
+    void *ctx)
+{
+    (*(int *)ctx)++;
+    return false;
+}
+
+TEST_CASE("camera replays the frames in order at the frame rate", "[replay]")
+{
+    camera_config_t config = { .fb_count = 2 };
+    camera_fb_t *fb, *first;
+    int64_t start, elapsed;
+    size_t length;
+    int i;
+
+    esp_camera_replay_set(FIXTURES_DIR "/frames", 20);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_camera_init(&config));
+
+    TEST_ASSERT_NOT_NULL(first = esp_camera_fb_get());
+    TEST_ASSERT_EQUAL(320, first->width);
+    TEST_ASSERT_EQUAL(240, first->height);
+    TEST_ASSERT_EQUAL(PIXFORMAT_JPEG, first->format);
+    length = first->len;
+    esp_camera_fb_return(first);
+
+    /* Looping back to the first frame */
+    start = esp_timer_get_time();
+    for (i = 1; i <= FRAMES_COUNT; i++)
+    {
+        TEST_ASSERT_NOT_NULL(fb = esp_camera_fb_get());
+        esp_camera_fb_return(fb);
+    }
+    elapsed = esp_timer_get_time() - start;
+
+    TEST_ASSERT_EQUAL(length, fb->len);
+    TEST_ASSERT_GREATER_OR_EQUAL(FRAMES_COUNT * 50000 - 5000, elapsed);
+
+    esp_camera_deinit();
+}
+
+TEST_CASE("camera stalls while all frame buffers are held", "[replay]")
+{
+    camera_config_t config = { .fb_count = 2 };
+    camera_fb_t *fbs[2];
+
+    esp_camera_replay_set(FIXTURES_DIR "/frames", 100);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_camera_init(&config));
+
+    TEST_ASSERT_NOT_NULL(fbs[0] = esp_camera_fb_get());
+    TEST_ASSERT_NOT_NULL(fbs[1] = esp_camera_fb_get());
+    TEST_ASSERT_NULL(esp_camera_fb_get());
+
+    esp_camera_fb_return(fbs[0]);
+    TEST_ASSERT_NOT_NULL(fbs[0] = esp_camera_fb_get());
+
+    esp_camera_fb_return(fbs[0]);
+    esp_camera_fb_return(fbs[1]);
+    esp_camera_deinit();
+}
+
+TEST_CASE("microphone plays the WAV file in real time, looping", "[replay]")
+{
+    i2s_chan_config_t chan_config =
+        I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    i2s_pdm_rx_config_t pdm_config = {
+        .clk_cfg = I2S_PDM_RX_CLK_DEFAULT_CONFIG(16000),
+        .slot_cfg = I2S_PDM_RX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT,
+            I2S_SLOT_MODE_MONO),
+    };
+    i2s_event_callbacks_t callbacks = { .on_recv = on_recv };
+    size_t length = TONE_SAMPLES + 1600, bytes_read;
+    int16_t *samples = malloc(length * sizeof(int16_t));
+    i2s_chan_handle_t handle;
+    int64_t start, elapsed;
+    int received = 0;
+    size_t i;
+
+    TEST_ASSERT_NOT_NULL(samples);
+
+    i2s_wav_set(FIXTURES_DIR "/tone.wav");
+    chan_config.dma_desc_num = 4;
+    chan_config.dma_frame_num = 320;
+    TEST_ASSERT_EQUAL(ESP_OK, i2s_new_channel(&chan_config, NULL, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, i2s_channel_init_pdm_rx_mode(handle,
+        &pdm_config));
+    TEST_ASSERT_EQUAL(ESP_OK, i2s_channel_register_event_callback(handle,
+        &callbacks, &received));
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, i2s_channel_enable(handle));
+    TEST_ASSERT_EQUAL(ESP_OK, i2s_channel_read(handle, samples,
+        length * sizeof(int16_t), &bytes_read, 2000));
+    elapsed = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(ESP_OK, i2s_channel_disable(handle));
+    TEST_ASSERT_EQUAL(ESP_OK, i2s_del_channel(handle));
+
+    TEST_ASSERT_EQUAL(length * sizeof(int16_t), bytes_read);
+    TEST_ASSERT_GREATER_OR_EQUAL(length / 320, received);
+    TEST_ASSERT_GREATER_OR_EQUAL(length * 1000000LL / 16000 - 10000, elapsed);
+
+    /* Half a second of tone and then silence, as generated */
+    for (i = 0; i < length; i++)
+    {
+        int32_t expected = i % TONE_SAMPLES >= TONE_SAMPLES / 2 ? 0 :
+            TONE_AMPLITUDE * sin(2 * M_PI * TONE_FREQUENCY *
+            (i % TONE_SAMPLES) / TONE_SAMPLES);
+
+        TEST_ASSERT_INT_WITHIN(1, expected, samples[i]);
+    }
+
+    free(samples);
+}
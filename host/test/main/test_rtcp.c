@@ -0,0 +1,218 @@
+#include "rtcp.h"
+#include <unity.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+
+#define SSRC 0xdeadbabe
+#define OTHER_SSRC 0x12345678
+#define RTCP_PT_SR 200
+#define RTCP_PT_RR 201
+#define RTCP_PT_SDES 202
+#define MAX_REPORTS 8
+/* Where receivers report to, the port after the audio one */
+#define GROUP "239.255.42.99"
+#define RTCP_PORT 45679
+
+/* Types */
+typedef struct {
+    uint8_t data[512];
+    size_t length;
+} packet_t;
+
+/* Internal state */
+static uint8_t reports[MAX_REPORTS];
+static int reports_count;
+
+static void on_report(uint8_t fraction_lost, void *ctx)
+{
+    TEST_ASSERT_EQUAL_PTR(&reports_count, ctx);
+    TEST_ASSERT_LESS_THAN(MAX_REPORTS, reports_count);
+    reports[reports_count++] = fraction_lost;
+}
+
+static int parse(const packet_t *packet)
+{
+    reports_count = 0;
+    return rtcp_reports_parse(packet->data, packet->length, SSRC, on_report,
+        &reports_count);
+}
+
+static void be32_put(uint8_t *data, uint32_t value)
+{
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+/* Appends the header of a packet of the given length in bytes, followed by
+ * zeros for its sender info or any other content */
+static uint8_t *header_add(packet_t *packet, uint8_t pt, uint8_t count,
+    size_t length)
+{
+    uint8_t *data = packet->data + packet->length;
+
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(packet->data), packet->length + length);
+    memset(data, 0, length);
+    data[0] = 0x80 | count;
+    data[1] = pt;
+    data[2] = (length / 4 - 1) >> 8;
+    data[3] = length / 4 - 1;
+    be32_put(data + 4, OTHER_SSRC);
+    packet->length += length;
+
+    return data;
+}
+
+static void block_put(uint8_t *data, uint32_t ssrc, uint8_t fraction_lost)
+{
+    memset(data, 0xff, 24);
+    be32_put(data, ssrc);
+    data[4] = fraction_lost;
+}
+
+static void rr_add(packet_t *packet, const uint32_t *ssrcs,
+    const uint8_t *fractions, uint8_t count)
+{
+    uint8_t *data = header_add(packet, RTCP_PT_RR, count, 8 + count * 24);
+    uint8_t i;
+
+    for (i = 0; i < count; i++)
+        block_put(data + 8 + i * 24, ssrcs[i], fractions[i]);
+}
+
+static void sr_add(packet_t *packet, const uint32_t *ssrcs,
+    const uint8_t *fractions, uint8_t count)
+{
+    uint8_t *data = header_add(packet, RTCP_PT_SR, count, 28 + count * 24);
+    uint8_t i;
+
+    for (i = 0; i < count; i++)
+        block_put(data + 28 + i * 24, ssrcs[i], fractions[i]);
+}
+
+TEST_CASE("RTCP reports are found for the audio source only", "[rtcp]")
+{
+    const uint32_t ssrcs[2] = { OTHER_SSRC, SSRC };
+    const uint8_t fractions[2] = { 200, 64 };
+    packet_t packet = { 0 };
+
+    /* A receiver report on its own */
+    rr_add(&packet, ssrcs, fractions, 2);
+    TEST_ASSERT_EQUAL(1, parse(&packet));
+    TEST_ASSERT_EQUAL(1, reports_count);
+    TEST_ASSERT_EQUAL(64, reports[0]);
+
+    /* With no blocks */
+    packet.length = 0;
+    rr_add(&packet, NULL, NULL, 0);
+    TEST_ASSERT_EQUAL(0, parse(&packet));
+    TEST_ASSERT_EQUAL(0, reports_count);
+}
+
+TEST_CASE("RTCP compound packets are parsed to the end", "[rtcp]")
+{
+    const uint32_t ssrcs[2] = { SSRC, OTHER_SSRC };
+    const uint8_t sr_fractions[2] = { 25, 255 }, rr_fraction = 128;
+    packet_t packet = { 0 };
+
+    /* A sender report, its source's description, and then another receiver
+     * report */
+    sr_add(&packet, ssrcs, sr_fractions, 2);
+    header_add(&packet, RTCP_PT_SDES, 1, 20);
+    rr_add(&packet, ssrcs, &rr_fraction, 1);
+
+    TEST_ASSERT_EQUAL(2, parse(&packet));
+    TEST_ASSERT_EQUAL(2, reports_count);
+    TEST_ASSERT_EQUAL(25, reports[0]);
+    TEST_ASSERT_EQUAL(128, reports[1]);
+}
+
+TEST_CASE("RTCP parsing stops at a malformed packet", "[rtcp]")
+{
+    const uint32_t ssrc = SSRC;
+    const uint8_t fraction = 10;
+    packet_t packet = { 0 };
+    uint8_t *data;
+
+    /* Cut short, after the reports before it */
+    rr_add(&packet, &ssrc, &fraction, 1);
+    rr_add(&packet, &ssrc, &fraction, 1);
+    packet.length -= 4;
+    TEST_ASSERT_EQUAL(-1, parse(&packet));
+    TEST_ASSERT_EQUAL(1, reports_count);
+
+    /* Less than a header left */
+    packet.length = 32 + 4;
+    TEST_ASSERT_EQUAL(-1, parse(&packet));
+    TEST_ASSERT_EQUAL(1, reports_count);
+
+    /* Claiming more blocks than it holds */
+    packet.length = 0;
+    data = header_add(&packet, RTCP_PT_RR, 2, 32);
+    block_put(data + 8, SSRC, fraction);
+    TEST_ASSERT_EQUAL(-1, parse(&packet));
+    TEST_ASSERT_EQUAL(0, reports_count);
+
+    /* Of another version */
+    packet.length = 0;
+    rr_add(&packet, &ssrc, &fraction, 1);
+    packet.data[0] = (packet.data[0] & 0x3f) | 0x40;
+    TEST_ASSERT_EQUAL(-1, parse(&packet));
+    TEST_ASSERT_EQUAL(0, reports_count);
+
+    /* Or shorter than its header */
+    packet.length = 0;
+    header_add(&packet, RTCP_PT_RR, 0, 8);
+    packet.data[3] = 0;
+    TEST_ASSERT_EQUAL(-1, parse(&packet));
+}
+
+/* Sends a report to where the media is sent, and receives it as the device
+ * would */
+static void report_send_receive(const char *destination, uint8_t fraction)
+{
+    struct timeval timeout = { .tv_sec = 1 };
+    struct sockaddr_in dst = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RTCP_PORT),
+    };
+    const uint32_t ssrc = SSRC;
+    packet_t packet = { 0 }, received = { 0 };
+    ssize_t length;
+    int sock, sender;
+
+    TEST_ASSERT_EQUAL(1, inet_pton(AF_INET, destination, &dst.sin_addr));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, sock = rtcp_socket_create(destination,
+        RTCP_PORT));
+    TEST_ASSERT_EQUAL(0, setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+        sizeof(timeout)));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, sender = socket(AF_INET, SOCK_DGRAM, 0));
+
+    rr_add(&packet, &ssrc, &fraction, 1);
+    TEST_ASSERT_EQUAL(packet.length, sendto(sender, packet.data,
+        packet.length, 0, (struct sockaddr *)&dst, sizeof(dst)));
+    length = recv(sock, received.data, sizeof(received.data), 0);
+    TEST_ASSERT_EQUAL(packet.length, length);
+    received.length = length;
+
+    TEST_ASSERT_EQUAL(1, parse(&received));
+    TEST_ASSERT_EQUAL(fraction, reports[0]);
+
+    close(sender);
+    close(sock);
+}
+
+TEST_CASE("RTCP reports are received on the multicast group", "[rtcp]")
+{
+    /* Receivers of a multicast stream report to its group, and of a unicast
+     * one to the device itself */
+    report_send_receive(GROUP, 32);
+    report_send_receive("127.0.0.1", 48);
+
+    TEST_ASSERT_EQUAL(-1, rtcp_socket_create("not an address", RTCP_PORT));
+}
@@ -0,0 +1,193 @@
+#!/usr/bin/env python
+
+from __future__ import print_function
+import argparse
+import ipaddress
+import json
+import socket
+import struct
+import time
+
+RTP_HEADER = struct.Struct('>BBHII')
+EXT_ONE_BYTE = 0xbede
+EXT_CAPTURE_TIME = 1
+EXT_FRAME_NUMBER = 2
+EXT_QUEUE_DELAY = 3
+EXT_SEND_DELAY = 4
+
+STAGES = ['capture->enqueue', 'enqueue->send', 'send first->last',
+  'send->receive', 'capture->receive']
+
+class Frame(object):
+  def __init__(self, number, capture_time, queue_delay):
+    self.number = number
+    self.capture_time = capture_time
+    self.queue_delay = queue_delay
+    self.first_send_delay = None
+    self.last_send_delay = None
+    self.last_receive_time = None
+    self.first_seq = None
+    self.last_seq = None
+    self.packets = 0
+    self.has_start = False
+    self.has_end = False
+
+  def is_complete(self):
+    return self.has_start and self.has_end and \
+      self.packets == ((self.last_seq - self.first_seq) & 0xffff) + 1
+
+  # In microseconds, per stage
+  def stages(self):
+    send_time = self.capture_time + self.last_send_delay
+    return [
+      self.queue_delay,
+      self.first_send_delay - self.queue_delay,
+      self.last_send_delay - self.first_send_delay,
+      self.last_receive_time - send_time,
+      self.last_receive_time - self.capture_time,
+    ]
+
+def parse_extension(data, offset):
+  profile, length = struct.unpack_from('>HH', data, offset)
+  end = offset + 4 + length * 4
+  elements = dict()
+  if profile != EXT_ONE_BYTE:
+    return elements, end
+
+  offset += 4
+  while offset < end:
+    id, size = data[offset] >> 4, (data[offset] & 0xf) + 1
+    offset += 1
+    # Padding
+    if id == 0:
+      continue
+    if id == 15:
+      break
+    elements[id] = int.from_bytes(data[offset:offset + size], 'big')
+    offset += size
+
+  return elements, end
+
+def parse_packet(data):
+  flags, pt, seq, ts, ssrc = RTP_HEADER.unpack_from(data)
+  if flags >> 6 != 2 or not flags & 0x10:
+    return None
+
+  offset = RTP_HEADER.size + (flags & 0xf) * 4
+  elements, offset = parse_extension(data, offset)
+  if EXT_CAPTURE_TIME not in elements or EXT_FRAME_NUMBER not in elements:
+    return None
+
+  # RFC2435 fragment offset, the marker bit ends the frame
+  fragment_offset = struct.unpack_from('>I', data, offset)[0] & 0xffffff
+  return seq, pt & 0x80 != 0, fragment_offset, elements
+
+def percentile(values, p):
+  return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+def report(frames, lost, incomplete):
+  print('%d frames, %d lost, %d incomplete' % (len(frames) + incomplete,
+    lost, incomplete))
+  if not frames:
+    return
+
+  print('%-18s %9s %9s %9s %9s %9s' % ('Stage (ms)', 'min', 'p50', 'p90',
+    'p99', 'max'))
+  for i, stage in enumerate(STAGES):
+    values = sorted(frame.stages()[i] / 1000.0 for frame in frames)
+    print('%-18s %9.2f %9.2f %9.2f %9.2f %9.2f' % (stage, values[0],
+      percentile(values, 50), percentile(values, 90), percentile(values, 99),
+      values[-1]))
+
+def receiver(args):
+  ip = ipaddress.ip_address(str(socket.gethostbyname(args.host)))
+
+  sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+  sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+  if ip.is_multicast:
+    mreq = struct.pack("4sl", socket.inet_aton(str(ip)), socket.INADDR_ANY)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+  sock.bind(('', args.port))
+  sock.settimeout(1)
+
+  print('Listening on %s:%d' % (args.host, args.port))
+  frame = None
+  frames, lost, incomplete = [], 0, 0
+  last_number, last_report = None, time.time()
+
+  while True:
+    try:
+      data = sock.recv(2048)
+      receive_time = int(time.time() * 1000000)
+      packet = parse_packet(data)
+    except socket.timeout:
+      packet = None
+    except KeyboardInterrupt:
+      break
+
+    if packet:
+      seq, marker, fragment_offset, elements = packet
+      number = elements[EXT_FRAME_NUMBER]
+
+      # A frame is done once the next one starts, whether it ended or not
+      if frame and frame.number != number:
+        if frame.is_complete():
+          frames.append(frame)
+        else:
+          incomplete += 1
+        frame = None
+
+      if not frame:
+        if last_number is not None and number > last_number + 1:
+          lost += number - last_number - 1
+        last_number = number
+        frame = Frame(number, elements[EXT_CAPTURE_TIME],
+          elements.get(EXT_QUEUE_DELAY, 0))
+
+      send_delay = elements.get(EXT_SEND_DELAY, frame.queue_delay)
+      if frame.first_send_delay is None:
+        frame.first_send_delay = send_delay
+        frame.first_seq = seq
+      frame.last_send_delay = send_delay
+      frame.last_receive_time = receive_time
+      frame.last_seq = seq
+      frame.packets += 1
+      frame.has_start |= fragment_offset == 0
+      frame.has_end |= marker
+
+    if time.time() - last_report >= args.interval:
+      report(frames, lost, incomplete)
+      if not args.cumulative:
+        frames, lost, incomplete = [], 0, 0
+      last_report = time.time()
+
+  report(frames, lost, incomplete)
+
+def main():
+  parser = argparse.ArgumentParser(description='Reports the latency of each '
+    'stage of the video pipeline, from the latency test RTP header extension')
+  parser.add_argument('--host', help='Host or IP address to listen on. '
+    'Default take from configuration file')
+  parser.add_argument('--port', type=int, help='Video RTP port to listen on. '
+    'Default take from configuration file')
+  parser.add_argument('--interval', type=int, default=10, help='Seconds '
+    'between reports. Default 10')
+  parser.add_argument('--cumulative', action='store_true', help='Report on '
+    'all frames received so far, instead of since the last report')
+  args = parser.parse_args()
+
+  try:
+    if args.host is None or args.port is None:
+      config = json.load(open('data/config.json'))
+    if args.host is None:
+      args.host = config['rtp']['host']
+    if args.port is None:
+      args.port = config['rtp']['video_port']
+  except KeyError:
+    print('RTP seems to be missing in the configuration file')
+    return
+
+  receiver(args)
+
+if __name__ == '__main__':
+  main()
@@ -1,16 +1,34 @@
 #include "audio_encoder.h"
+#include "g711.h"
+#include "live.h"
+#include "opus_layout.h"
+#include "pool.h"
+#include "prebuffer.h"
+#include "recorder.h"
 #include "rtp.h"
+#include "stats.h"
+#include "task_layout.h"
+#include "trace.h"
+#include <esp_heap_caps.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <opus.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <inttypes.h>
 #include <stddef.h>
+#include <string.h>
 
 static const char *TAG = "Audio Encoder";
-static const size_t opus_frame_length_ms = 20;
-static const size_t opus_max_combined_frames = 120 /* ms */ / opus_frame_length_ms;
-static const size_t opus_max_packet_size = 3 * 1276;
+/* Audio queued for longer than this, in microseconds, is too late to be worth
+ * sending, so long packets need fewer of them */
+static const uint32_t max_queue_delay = 200000;
+/* Lowest bitrate the governor goes down to, in bits per second */
+static const uint32_t opus_min_bitrate = 6000;
+/* G.711 is always sampled at 8kHz */
+static const uint32_t g711_sample_rate = 8000;
 
 typedef struct {
     int16_t *samples;
@@ -32,40 +50,144 @@ typedef struct {
     audio_codec_t codec;
     int (*init)(audio_encoder_t *audio_encoder);
     size_t (*required_task_stack_size)(audio_encoder_t *audio_encoder);
-    size_t (*required_frame_size)(uint32_t sample_rate);
+    size_t (*required_frame_size)(audio_encoder_t *audio_encoder);
     int (*encode)(audio_encoder_t *audio_encoder, frame_t *frame);
+    /* Optional, frees what init allocated besides the packet pool */
+    void (*deinit)(audio_encoder_t *audio_encoder);
 } audio_encoder_ops_t;
 
 typedef struct audio_encoder_t {
     uint32_t sample_rate;
+    uint32_t bitrate;
+    /* In microseconds, the packet duration may be shortened by the encoder */
+    uint32_t frame_duration;
+    uint32_t packet_duration;
+    /* Encoder settings, not all codecs use all of them */
+    uint8_t complexity;
+    uint8_t vbr;
+    uint8_t dtx;
+    uint8_t fec;
+    /* Percentage of the real time encoding may take, 0 to never adapt */
+    uint8_t cpu_budget;
     audio_encoder_ops_t *ops;
     union {
         struct {
             OpusEncoder *encoder;
             OpusRepacketizer *repacketizer;
             size_t current_frame;
-            uint8_t **pending_frames;
+            size_t frames_per_packet;
+            /* Frames are encoded back to back, until they're combined */
+            uint8_t *pending_frames;
+            size_t pending_length;
+            size_t max_frame_size;
             int64_t first_frame_timestamp;
+            /* CPU governor, encode time is summed over a second of audio */
+            int64_t encode_time;
+            size_t encoded_frames;
+            uint8_t current_complexity;
+            uint32_t current_bitrate;
+            /* FEC redundancy follows the loss receivers report */
+            uint8_t packet_loss;
         } opus;
+        struct {
+            uint8_t is_alaw;
+            /* Captured samples averaged into each 8kHz one */
+            size_t decimation;
+        } g711;
     };
 } audio_encoder_t;
 
 static QueueHandle_t frames_queue;
+static stats_queue_t *frames_queue_stats;
+static SemaphoreHandle_t encoder_stopped;
+static uint8_t is_running = 0;
 static QueueHandle_t packets_queue;
-
+static pool_t *packet_pool = NULL;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static size_t max_packet_length = 0;
+static size_t frame_size = 0;
+static uint32_t packet_duration = 0;
+static uint8_t load = 0, complexity = 0;
+static uint32_t bitrate = 0;
+static audio_codec_t codec = AUDIO_CODEC_OPUS;
+static uint8_t is_fec_enabled = 0;
+
+/* Takes a packet from the pool, returning it once sent */
 static int push_audio_packet(uint8_t *data, size_t length, int64_t timestamp)
 {
+    int ret = -1;
+
+    portENTER_CRITICAL(&stats_lock);
+    if (length > max_packet_length)
+        max_packet_length = length;
+    portEXIT_CRITICAL(&stats_lock);
+
     /* XXX TODO Should go through ipcam.c */
-    return rtp_send_opus(data, length, timestamp, free, data);
+    switch (codec)
+    {
+    case AUDIO_CODEC_OPUS:
+        prebuffer_add(PREBUFFER_TYPE_OPUS, data, length, timestamp);
+        recorder_add_opus(data, length, timestamp);
+        live_add_opus(data, length, timestamp);
+        ret = rtp_send_opus(data, length, timestamp, pool_put, data);
+        break;
+    /* Recordings and live streams only hold Opus */
+    case AUDIO_CODEC_PCMU:
+        ret = rtp_send_pcmu(data, length, timestamp, pool_put, data);
+        break;
+    case AUDIO_CODEC_PCMA:
+        ret = rtp_send_pcma(data, length, timestamp, pool_put, data);
+        break;
+    }
+
+    if (ret)
+    {
+        pool_put(data);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Packets are held until sent, so there are enough for what the RTP queue
+ * holds, the one being sent and the one being built */
+static size_t packet_pool_size(uint32_t packet_duration)
+{
+    size_t queued = (max_queue_delay + packet_duration - 1) / packet_duration;
+
+    if (queued > RTP_AUDIO_QUEUE_SIZE)
+        queued = RTP_AUDIO_QUEUE_SIZE;
+
+    return queued + 2;
 }
 
 /* Opus */
 static int opus_init(audio_encoder_t *audio_encoder)
 {
-    int i, err = 0;
+    opus_layout_t layout;
+    size_t pool_size;
+    int err = 0;
 
+    if (opus_layout_get(audio_encoder->bitrate, audio_encoder->frame_duration,
+        audio_encoder->packet_duration, RTP_MAX_PAYLOAD_SIZE, &layout))
+    {
+        return -1;
+    }
+
+    if (layout.packet_duration != audio_encoder->packet_duration)
+    {
+        audio_encoder->packet_duration = layout.packet_duration;
+        ESP_LOGW(TAG, "Shortened Opus packets to %" PRIu32 "us to fit the MTU",
+            audio_encoder->packet_duration);
+    }
+    audio_encoder->opus.max_frame_size = layout.max_frame_size;
+    audio_encoder->opus.frames_per_packet = layout.frames_per_packet;
+
+    /* The CELT only low delay mode has no voice activity detection to drive
+     * DTX, nor in-band FEC, those take SILK */
     audio_encoder->opus.encoder =
         opus_encoder_create(audio_encoder->sample_rate, 1,
+        audio_encoder->dtx || audio_encoder->fec ? OPUS_APPLICATION_VOIP :
         OPUS_APPLICATION_RESTRICTED_LOWDELAY, &err);
     if (err < 0)
     {
@@ -80,27 +202,73 @@ static int opus_init(audio_encoder_t *audio_encoder)
         return -1;
     }
 
-    audio_encoder->opus.pending_frames = malloc(opus_max_combined_frames *
-        sizeof(*audio_encoder->opus.pending_frames));
-    for (i = 0; i < opus_max_combined_frames; i++)
-        audio_encoder->opus.pending_frames[i] = malloc(opus_max_packet_size);
+    opus_encoder_ctl(audio_encoder->opus.encoder,
+        OPUS_SET_BITRATE(audio_encoder->bitrate));
+    opus_encoder_ctl(audio_encoder->opus.encoder,
+        OPUS_SET_COMPLEXITY(audio_encoder->complexity));
+    opus_encoder_ctl(audio_encoder->opus.encoder,
+        OPUS_SET_VBR(audio_encoder->vbr));
+    opus_encoder_ctl(audio_encoder->opus.encoder,
+        OPUS_SET_DTX(audio_encoder->dtx));
+    opus_encoder_ctl(audio_encoder->opus.encoder,
+        OPUS_SET_INBAND_FEC(audio_encoder->fec));
+    /* Opus only adds the redundancy once loss is expected, from the start if
+     * it's estimated rather than until the first update */
+    if (audio_encoder->fec)
+    {
+        audio_encoder->opus.packet_loss = rtp_audio_loss_get();
+        opus_encoder_ctl(audio_encoder->opus.encoder,
+            OPUS_SET_PACKET_LOSS_PERC(audio_encoder->opus.packet_loss));
+    }
+    audio_encoder->opus.current_complexity = audio_encoder->complexity;
+    audio_encoder->opus.current_bitrate = audio_encoder->bitrate;
+
+    pool_size = packet_pool_size(audio_encoder->packet_duration);
+
+    if (!(audio_encoder->opus.pending_frames = malloc(
+        audio_encoder->opus.frames_per_packet *
+        audio_encoder->opus.max_frame_size)))
+    {
+        ESP_LOGE(TAG, "Failed allocating pending frames");
+        return -1;
+    }
+
+    if (!(packet_pool = pool_create(layout.max_packet_size, pool_size,
+        MALLOC_CAP_DEFAULT)))
+    {
+        ESP_LOGE(TAG, "Failed allocating packet pool");
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Opus at %" PRIu32 "bps, %zu frames of %" PRIu32 "us per "
+        "packet, %zu packets of %zu bytes", audio_encoder->bitrate,
+        audio_encoder->opus.frames_per_packet, audio_encoder->frame_duration,
+        pool_size, layout.max_packet_size);
 
     return 0;
 }
 
 static int opus_combine_packets(audio_encoder_t *audio_encoder)
 {
-    size_t max_combined_length = 1277 * opus_repacketizer_get_nb_frames(
-        audio_encoder->opus.repacketizer);
-    uint8_t *data = malloc(max_combined_length);
-    int32_t ret = opus_repacketizer_out(
-        audio_encoder->opus.repacketizer, data, max_combined_length);
+    uint8_t *data = pool_get(packet_pool);
+    int32_t ret;
+
+    /* The frames are dropped, the RTP sender is too far behind */
+    if (!data)
+    {
+        opus_repacketizer_init(audio_encoder->opus.repacketizer);
+        audio_encoder->opus.pending_length = 0;
+        return -1;
+    }
 
+    ret = opus_repacketizer_out(audio_encoder->opus.repacketizer, data,
+        pool_block_size(packet_pool));
     opus_repacketizer_init(audio_encoder->opus.repacketizer);
+    audio_encoder->opus.pending_length = 0;
     if (ret < 0)
     {
         ESP_LOGE(TAG, "Failed creating combined packet: %s", opus_strerror(ret));
-        free(data);
+        pool_put(data);
         return -1;
     }
 
@@ -108,33 +276,109 @@ static int opus_combine_packets(audio_encoder_t *audio_encoder)
         audio_encoder->opus.first_frame_timestamp);
 }
 
+/* Lowers the complexity, and then the bitrate, while encoding takes more
+ * than its share of the CPU. They're raised back, up to the configured ones,
+ * once it takes well below that. The expected packet loss is updated along */
+static void opus_govern(audio_encoder_t *audio_encoder)
+{
+    OpusEncoder *encoder = audio_encoder->opus.encoder;
+    int64_t percent = audio_encoder->opus.encode_time * 100 /
+        ((int64_t)audio_encoder->opus.encoded_frames *
+        audio_encoder->frame_duration);
+    uint8_t _load = percent > UINT8_MAX ? UINT8_MAX : percent;
+    uint8_t _complexity = audio_encoder->opus.current_complexity;
+    uint32_t _bitrate = audio_encoder->opus.current_bitrate;
+    uint8_t _packet_loss;
+
+    audio_encoder->opus.encode_time = 0;
+    audio_encoder->opus.encoded_frames = 0;
+
+    if (audio_encoder->cpu_budget && _load > audio_encoder->cpu_budget)
+    {
+        if (_complexity > 0)
+            _complexity--;
+        else if (_bitrate > opus_min_bitrate &&
+            (_bitrate = _bitrate * 3 / 4) < opus_min_bitrate)
+        {
+            _bitrate = opus_min_bitrate;
+        }
+    }
+    else if (audio_encoder->cpu_budget &&
+        _load < audio_encoder->cpu_budget * 3 / 4)
+    {
+        if (_bitrate < audio_encoder->bitrate)
+        {
+            if ((_bitrate = _bitrate * 4 / 3) > audio_encoder->bitrate)
+                _bitrate = audio_encoder->bitrate;
+        }
+        else if (_complexity < audio_encoder->complexity)
+            _complexity++;
+    }
+
+    if (audio_encoder->fec && (_packet_loss = rtp_audio_loss_get()) !=
+        audio_encoder->opus.packet_loss)
+    {
+        opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(_packet_loss));
+        audio_encoder->opus.packet_loss = _packet_loss;
+        ESP_LOGD(TAG, "Packet loss set to %u%%", _packet_loss);
+    }
+
+    if (_complexity != audio_encoder->opus.current_complexity)
+    {
+        opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(_complexity));
+        audio_encoder->opus.current_complexity = _complexity;
+        ESP_LOGD(TAG, "Load %u%%, complexity set to %u", _load, _complexity);
+    }
+    if (_bitrate != audio_encoder->opus.current_bitrate)
+    {
+        opus_encoder_ctl(encoder, OPUS_SET_BITRATE(_bitrate));
+        audio_encoder->opus.current_bitrate = _bitrate;
+        ESP_LOGD(TAG, "Load %u%%, bitrate set to %" PRIu32, _load, _bitrate);
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    load = _load;
+    complexity = _complexity;
+    bitrate = _bitrate;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
 static int opus_encode_frame(audio_encoder_t *audio_encoder, frame_t *frame)
 {
+    int64_t start;
+    uint8_t *pending = audio_encoder->opus.pending_frames +
+        audio_encoder->opus.pending_length;
     int ret;
 
     if (audio_encoder->opus.current_frame == 0)
         audio_encoder->opus.first_frame_timestamp = frame->timestamp;
 
+    start = esp_timer_get_time();
     ret = opus_encode(audio_encoder->opus.encoder, frame->samples,
-        frame->number_of_samples,
-        audio_encoder->opus.pending_frames[audio_encoder->opus.current_frame],
-        opus_max_packet_size);
+        frame->number_of_samples, pending, audio_encoder->opus.max_frame_size);
+    audio_encoder->opus.encode_time += esp_timer_get_time() - start;
+    if (++audio_encoder->opus.encoded_frames * audio_encoder->frame_duration >=
+        1000000)
+    {
+        opus_govern(audio_encoder);
+    }
     if (ret < 0)
     {
         ESP_LOGE(TAG, "Failed to encode Opus: %s", opus_strerror(ret));
         return -1;
     }
+    audio_encoder->opus.pending_length += ret;
 
     if ((ret = opus_repacketizer_cat(audio_encoder->opus.repacketizer,
-        audio_encoder->opus.pending_frames[audio_encoder->opus.current_frame],
-        ret)))
+        pending, ret)))
     {
         ESP_LOGE(TAG, "Failed concatenating Opus packet: %s", opus_strerror(ret));
         return -1;
     }
 
     audio_encoder->opus.current_frame++;
-    if (audio_encoder->opus.current_frame != opus_max_combined_frames)
+    if (audio_encoder->opus.current_frame !=
+        audio_encoder->opus.frames_per_packet)
         return 0;
 
     audio_encoder->opus.current_frame = 0;
@@ -146,9 +390,17 @@ static size_t opus_required_task_stack_size(audio_encoder_t *audio_encoder)
     return 24576;
 }
 
-static size_t opus_required_frame_size(uint32_t sample_rate)
+static size_t opus_required_frame_size(audio_encoder_t *audio_encoder)
+{
+    return (uint64_t)audio_encoder->sample_rate *
+        audio_encoder->frame_duration / 1000000;
+}
+
+static void opus_deinit(audio_encoder_t *audio_encoder)
 {
-    return sample_rate * (opus_frame_length_ms / 1000.0);
+    opus_encoder_destroy(audio_encoder->opus.encoder);
+    opus_repacketizer_destroy(audio_encoder->opus.repacketizer);
+    free(audio_encoder->opus.pending_frames);
 }
 
 static audio_encoder_ops_t opus_encoder = {
@@ -157,11 +409,110 @@ static audio_encoder_ops_t opus_encoder = {
     .required_task_stack_size = opus_required_task_stack_size,
     .required_frame_size = opus_required_frame_size,
     .encode = opus_encode_frame,
+    .deinit = opus_deinit,
+};
+
+/* G.711 */
+static int g711_init(audio_encoder_t *audio_encoder)
+{
+    size_t packet_size = (uint64_t)g711_sample_rate *
+        audio_encoder->packet_duration / 1000000;
+    size_t pool_size;
+
+    if (audio_encoder->sample_rate % g711_sample_rate)
+    {
+        ESP_LOGE(TAG, "G.711 needs a sample rate that's a multiple of %" PRIu32
+            "Hz", g711_sample_rate);
+        return -1;
+    }
+
+    if (!packet_size || packet_size > RTP_MAX_PAYLOAD_SIZE)
+    {
+        ESP_LOGE(TAG, "Invalid G.711 packet duration %" PRIu32 "us",
+            audio_encoder->packet_duration);
+        return -1;
+    }
+
+    audio_encoder->g711.is_alaw = audio_encoder->ops->codec == AUDIO_CODEC_PCMA;
+    audio_encoder->g711.decimation = audio_encoder->sample_rate /
+        g711_sample_rate;
+    audio_encoder->frame_duration = audio_encoder->packet_duration;
+    pool_size = packet_pool_size(audio_encoder->packet_duration);
+
+    if (!(packet_pool = pool_create(packet_size, pool_size,
+        MALLOC_CAP_DEFAULT)))
+    {
+        ESP_LOGE(TAG, "Failed allocating packet pool");
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "G.711 %s-law, %zu packets of %zu bytes",
+        audio_encoder->g711.is_alaw ? "A" : "u", pool_size, packet_size);
+
+    return 0;
+}
+
+/* Each frame is a packet. Captured samples are averaged down to 8kHz, which
+ * is a crude low-pass filter, but cheap */
+static int g711_encode_frame(audio_encoder_t *audio_encoder, frame_t *frame)
+{
+    size_t decimation = audio_encoder->g711.decimation;
+    size_t length = frame->number_of_samples / decimation;
+    const int16_t *samples = frame->samples;
+    uint8_t *data = pool_get(packet_pool);
+    size_t i, j;
+
+    /* The frame is dropped, the RTP sender is too far behind */
+    if (!data)
+        return -1;
+
+    for (i = 0; i < length; i++, samples += decimation)
+    {
+        int32_t sum = 0;
+
+        for (j = 0; j < decimation; j++)
+            sum += samples[j];
+        sum /= (int32_t)decimation;
+
+        data[i] = audio_encoder->g711.is_alaw ? g711_alaw_encode(sum) :
+            g711_ulaw_encode(sum);
+    }
+
+    return push_audio_packet(data, length, frame->timestamp);
+}
+
+static size_t g711_required_task_stack_size(audio_encoder_t *audio_encoder)
+{
+    return 3072;
+}
+
+static size_t g711_required_frame_size(audio_encoder_t *audio_encoder)
+{
+    return (uint64_t)audio_encoder->sample_rate *
+        audio_encoder->packet_duration / 1000000;
+}
+
+static audio_encoder_ops_t pcmu_encoder = {
+    .codec = AUDIO_CODEC_PCMU,
+    .init = g711_init,
+    .required_task_stack_size = g711_required_task_stack_size,
+    .required_frame_size = g711_required_frame_size,
+    .encode = g711_encode_frame,
+};
+
+static audio_encoder_ops_t pcma_encoder = {
+    .codec = AUDIO_CODEC_PCMA,
+    .init = g711_init,
+    .required_task_stack_size = g711_required_task_stack_size,
+    .required_frame_size = g711_required_frame_size,
+    .encode = g711_encode_frame,
 };
 
 /* Common */
 static audio_encoder_ops_t *audio_encoder_ops[] = {
     &opus_encoder,
+    &pcmu_encoder,
+    &pcma_encoder,
     NULL
 };
 
@@ -188,12 +539,35 @@ static void audio_encoder_task(void *pvParameter)
         if (xQueueReceive(frames_queue, &frame, portMAX_DELAY) != pdTRUE)
             continue;
 
+        /* Stopped once the frames queued before are encoded */
+        if (!frame.samples)
+            break;
+
+        trace_event(TRACE_EVENT_ENCODE_START, frame.timestamp);
         encoder->ops->encode(encoder, &frame);
+        trace_event(TRACE_EVENT_ENCODE_END, frame.timestamp);
         frame.free_func(frame.ctx);
     }
+
+    if (encoder->ops->deinit)
+        encoder->ops->deinit(encoder);
+    free(encoder);
+    xSemaphoreGive(encoder_stopped);
     vTaskDelete(NULL);
 }
 
+/* The packet pool is kept if packets are still being sent from it */
+static void audio_encoder_stop(void)
+{
+    frame_t frame = { 0 };
+
+    xQueueSend(frames_queue, &frame, portMAX_DELAY);
+    xSemaphoreTake(encoder_stopped, portMAX_DELAY);
+    pool_destroy(packet_pool);
+    packet_pool = NULL;
+    is_running = 0;
+}
+
 int audio_encoder_encode(int16_t *samples, size_t number_of_samples,
     int64_t timestamp, audio_encoder_frame_free_func_t free_func, void *ctx)
 {
@@ -204,8 +578,32 @@ int audio_encoder_encode(int16_t *samples, size_t number_of_samples,
         .free_func = free_func,
         .ctx = ctx,
     };
+    BaseType_t result = xQueueSend(frames_queue, &frame, 0);
 
-    return xQueueSend(frames_queue, &frame, 0) != pdTRUE;
+    stats_queue_sent(frames_queue_stats, result);
+    return result != pdTRUE;
+}
+
+void audio_encoder_stats_get(pool_stats_t *packet_stats,
+    size_t *_max_packet_length)
+{
+    memset(packet_stats, 0, sizeof(*packet_stats));
+    if (packet_pool)
+        pool_stats_get(packet_pool, packet_stats);
+
+    portENTER_CRITICAL(&stats_lock);
+    *_max_packet_length = max_packet_length;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void audio_encoder_load_get(uint8_t *_load, uint8_t *_complexity,
+    uint32_t *_bitrate)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *_load = load;
+    *_complexity = complexity;
+    *_bitrate = bitrate;
+    portEXIT_CRITICAL(&stats_lock);
 }
 
 int audio_encoder_get_encoded(uint8_t **data, size_t *length,
@@ -223,16 +621,40 @@ int audio_encoder_get_encoded(uint8_t **data, size_t *length,
     return 0;
 }
 
-size_t audio_encoder_frame_size(audio_codec_t codec, uint32_t sample_rate)
+audio_codec_t audio_encoder_atocodec(const char *_codec)
 {
-    audio_encoder_ops_t *ops = get_audio_encoder_ops(codec);
+    if (_codec && !strcmp(_codec, "pcmu"))
+        return AUDIO_CODEC_PCMU;
+    if (_codec && !strcmp(_codec, "pcma"))
+        return AUDIO_CODEC_PCMA;
 
-    if (ops)
-        return ops->required_frame_size(sample_rate);
-    return 0;
+    return AUDIO_CODEC_OPUS;
 }
 
-int audio_encoder_initialize(audio_codec_t codec, uint32_t sample_rate)
+audio_codec_t audio_encoder_codec_get(void)
+{
+    return codec;
+}
+
+uint8_t audio_encoder_fec_is_enabled(void)
+{
+    return is_fec_enabled;
+}
+
+size_t audio_encoder_frame_size(void)
+{
+    return frame_size;
+}
+
+uint32_t audio_encoder_packet_duration(void)
+{
+    return packet_duration;
+}
+
+int audio_encoder_initialize(audio_codec_t _codec, uint32_t sample_rate,
+    uint32_t _bitrate, uint32_t _frame_duration, uint32_t _packet_duration,
+    uint8_t _complexity, uint8_t vbr, uint8_t dtx, uint8_t fec,
+    uint8_t cpu_budget)
 {
     audio_encoder_t *audio_encoder = calloc(1, sizeof(*audio_encoder));
     size_t task_stack_size;
@@ -243,24 +665,37 @@ int audio_encoder_initialize(audio_codec_t codec, uint32_t sample_rate)
         return -1;
     }
 
-    if (!(frames_queue = xQueueCreate(5, sizeof(frame_t))))
-    {
-        ESP_LOGE(TAG, "Failed creating queue");
-        return -1;
-    }
+    if (is_running)
+        audio_encoder_stop();
 
-    if (!(packets_queue = xQueueCreate(5, sizeof(packet_t))))
+    /* Kept from the first time on */
+    if (!frames_queue)
     {
-        ESP_LOGE(TAG, "Failed creating queue");
-        return -1;
+        if (!(frames_queue = xQueueCreate(5, sizeof(frame_t))) ||
+            !(packets_queue = xQueueCreate(5, sizeof(packet_t))) ||
+            !(encoder_stopped = xSemaphoreCreateBinary()))
+        {
+            ESP_LOGE(TAG, "Failed creating queues");
+            return -1;
+        }
+        frames_queue_stats = stats_queue_register("audio_frames",
+            frames_queue);
     }
 
     audio_encoder->sample_rate = sample_rate;
-    audio_encoder->ops = get_audio_encoder_ops(codec);
+    audio_encoder->bitrate = _bitrate;
+    audio_encoder->frame_duration = _frame_duration;
+    audio_encoder->packet_duration = _packet_duration;
+    audio_encoder->complexity = _complexity;
+    audio_encoder->vbr = vbr;
+    audio_encoder->dtx = dtx;
+    audio_encoder->fec = fec;
+    audio_encoder->cpu_budget = cpu_budget;
+    audio_encoder->ops = get_audio_encoder_ops(_codec);
 
     if (!audio_encoder->ops)
     {
-        ESP_LOGE(TAG, "Unknown audio codec %d", codec);
+        ESP_LOGE(TAG, "Unknown audio codec %d", _codec);
         return -1;
     }
 
@@ -270,15 +705,22 @@ int audio_encoder_initialize(audio_codec_t codec, uint32_t sample_rate)
         return -1;
     }
 
+    codec = _codec;
+    is_fec_enabled = codec == AUDIO_CODEC_OPUS && fec;
+    frame_size = audio_encoder->ops->required_frame_size(audio_encoder);
+    packet_duration = audio_encoder->packet_duration;
+    complexity = _complexity;
+    bitrate = _bitrate;
     task_stack_size =
         audio_encoder->ops->required_task_stack_size(audio_encoder);
 
-    if (xTaskCreatePinnedToCore(audio_encoder_task, "audio_encoder_task",
+    if (task_layout_create(audio_encoder_task, "audio_encoder_task",
         task_stack_size, audio_encoder, 5, NULL, 1) != pdPASS)
     {
         ESP_LOGE(TAG, "Failed creating audio encoder task");
         return -1;
     }
+    is_running = 1;
 
     return 0;
 }
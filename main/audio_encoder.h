@@ -1,21 +1,50 @@
 #ifndef AUDIO_ENCODER_H
 #define AUDIO_ENCODER_H
 
+#include "pool.h"
 #include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
     AUDIO_CODEC_OPUS,
+    AUDIO_CODEC_PCMU,
+    AUDIO_CODEC_PCMA,
 } audio_codec_t;
 
 typedef void (*audio_encoder_frame_free_func_t)(void *ctx);
 
 int audio_encoder_encode(int16_t *samples, size_t number_of_samples,
     int64_t timestamp, audio_encoder_frame_free_func_t free_func, void *ctx);
+/* Encoded packets come from a pool, these are its stats and the largest packet
+ * so far */
+void audio_encoder_stats_get(pool_stats_t *packet_stats,
+    size_t *max_packet_length);
 int audio_encoder_get_encoded(uint8_t **data, size_t *length,
     int64_t *timestamp);
 
-size_t audio_encoder_frame_size(audio_codec_t codec, uint32_t sample_rate);
-int audio_encoder_initialize(audio_codec_t codec, uint32_t sample_rate);
+audio_codec_t audio_encoder_atocodec(const char *codec);
+/* The codec in use, Opus until initialized */
+audio_codec_t audio_encoder_codec_get(void);
+/* Whether Opus packets carry in-band FEC, sized to the loss over RTCP */
+uint8_t audio_encoder_fec_is_enabled(void);
+
+/* Samples per frame to be encoded, and the duration (in microseconds) of the
+ * packets sent, 0 until initialized */
+size_t audio_encoder_frame_size(void);
+uint32_t audio_encoder_packet_duration(void);
+/* Share of the real time (percentage) encoding took over the last second,
+ * and the complexity and bitrate it was adjusted to */
+void audio_encoder_load_get(uint8_t *load, uint8_t *complexity,
+    uint32_t *bitrate);
+
+/* Durations are in microseconds. G.711 is sent at 8kHz, one frame of the
+ * packet duration per packet, and ignores the other settings. Encoding is
+ * kept within the CPU budget, a percentage of the real time, by lowering the
+ * complexity and then the bitrate. 0 leaves them as is. Initializing again
+ * replaces the encoder, once the frames queued to it are encoded */
+int audio_encoder_initialize(audio_codec_t codec, uint32_t sample_rate,
+    uint32_t bitrate, uint32_t frame_duration, uint32_t packet_duration,
+    uint8_t complexity, uint8_t vbr, uint8_t dtx, uint8_t fec,
+    uint8_t cpu_budget);
 
 #endif
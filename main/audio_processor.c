@@ -0,0 +1,275 @@
+#include "audio_processor.h"
+#include <esp_log.h>
+#include <math.h>
+#include <string.h>
+
+/* Gains are Q12, i.e., 4096 is unity */
+#define GAIN_SHIFT 12
+#define GAIN_UNITY (1 << GAIN_SHIFT)
+/* Biquad coefficients are Q28, its output is kept with 8 fractional bits as
+ * the poles of a low cutoff are close enough to 1 to otherwise amplify the
+ * rounding error into a DC offset */
+#define BIQUAD_SHIFT 28
+#define BIQUAD_Y_SHIFT 8
+/* The DC blocker keeps its output with 14 fractional bits */
+#define DC_SHIFT 14
+
+/* Types */
+typedef struct {
+    int32_t pole; /* Q15 */
+    int32_t x1, y1;
+} dc_block_t;
+
+typedef struct {
+    int32_t b0, b1, b2, a1, a2;
+    int16_t x1, x2;
+    int32_t y1, y2;
+} biquad_t;
+
+/* Constants */
+static const char *TAG = "Audio Processor";
+static const float dc_block_cutoff = 10; /* Hz */
+/* The gate stays open this long after the level drops */
+static const uint32_t noise_gate_hold_time = 200; /* ms */
+/* The AGC gain only drops, down to this, to avoid clipping */
+static const int32_t agc_min_gain = GAIN_UNITY / 4;
+
+/* Configuration */
+static uint8_t is_dc_blocking = 0, is_high_passing = 0;
+static uint32_t agc_target = 0, noise_gate = 0; /* RMS, 0 when disabled */
+static int32_t agc_max_gain = GAIN_UNITY;
+static uint32_t noise_gate_hold_samples = 0;
+
+/* Internal state */
+static dc_block_t dc_block;
+static biquad_t high_pass;
+static int32_t agc_gain = GAIN_UNITY, gate_gain = GAIN_UNITY;
+static uint32_t gate_closed_for = 0;
+
+static inline int16_t saturate(int32_t x)
+{
+    return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : x;
+}
+
+/* Kernels, each processes a block with no branches beyond saturation so the
+ * compiler can pipeline them. This is the generic C version */
+static void dc_block_process(dc_block_t *state, int16_t *restrict samples,
+    size_t count)
+{
+    int32_t x1 = state->x1, y1 = state->y1;
+    size_t i;
+
+    /* y[n] = x[n] - x[n-1] + p * y[n-1], |y| stays within twice full scale */
+    for (i = 0; i < count; i++)
+    {
+        int32_t x = samples[i];
+
+        y1 = ((x - x1) << DC_SHIFT) +
+            (int32_t)(((int64_t)y1 * state->pole) >> 15);
+        x1 = x;
+        samples[i] = saturate(y1 >> DC_SHIFT);
+    }
+
+    state->x1 = x1;
+    state->y1 = y1;
+}
+
+/* Direct form I */
+static void biquad_process(biquad_t *state, int16_t *restrict samples,
+    size_t count)
+{
+    int16_t x1 = state->x1, x2 = state->x2;
+    int32_t y1 = state->y1, y2 = state->y2;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        int16_t x = samples[i];
+        int64_t acc = ((int64_t)state->b0 * x + (int64_t)state->b1 * x1 +
+            (int64_t)state->b2 * x2) * (1 << BIQUAD_Y_SHIFT) -
+            (int64_t)state->a1 * y1 - (int64_t)state->a2 * y2;
+        int32_t y = (acc + (1 << (BIQUAD_SHIFT - 1))) >> BIQUAD_SHIFT;
+
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        samples[i] = saturate((y + (1 << (BIQUAD_Y_SHIFT - 1))) >>
+            BIQUAD_Y_SHIFT);
+    }
+
+    state->x1 = x1;
+    state->x2 = x2;
+    state->y1 = y1;
+    state->y2 = y2;
+}
+
+static uint64_t energy_get(const int16_t *restrict samples, size_t count)
+{
+    uint64_t energy = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        energy += (int32_t)samples[i] * samples[i];
+
+    return energy;
+}
+
+/* Ramps the gain linearly across the block to avoid clicks */
+static void gain_apply(int16_t *restrict samples, size_t count, int32_t from,
+    int32_t to)
+{
+    int64_t gain = (int64_t)from << 16;
+    int64_t step = ((int64_t)(to - from) << 16) / (int64_t)count;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        samples[i] = saturate((int64_t)samples[i] * (gain >> 16) >>
+            GAIN_SHIFT);
+        gain += step;
+    }
+}
+
+static uint32_t isqrt(uint64_t x)
+{
+    uint64_t root = 0, bit = 1ULL << 62;
+
+    while (bit > x)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (x >= root + bit)
+        {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+            root >>= 1;
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+void audio_processor_process(int16_t *samples, size_t count)
+{
+    int32_t prev_gain = (int64_t)agc_gain * gate_gain >> GAIN_SHIFT, gain;
+    uint32_t level;
+
+    if (!count)
+        return;
+
+    if (is_dc_blocking)
+        dc_block_process(&dc_block, samples, count);
+
+    if (is_high_passing)
+        biquad_process(&high_pass, samples, count);
+
+    if (!agc_target && !noise_gate)
+        return;
+
+    level = isqrt(energy_get(samples, count) / count);
+
+    /* The gate is decided on the level before any gain, so the AGC doesn't
+     * lift the noise above it. It closes fully within a single block */
+    if (noise_gate && level < noise_gate)
+    {
+        if (gate_closed_for < noise_gate_hold_samples)
+            gate_closed_for += count;
+        else
+            gate_gain = 0;
+    }
+    else
+    {
+        gate_closed_for = 0;
+        gate_gain = GAIN_UNITY;
+    }
+
+    /* The AGC reacts quickly to loud sounds and slowly to quiet ones, and is
+     * frozen while the gate is closed */
+    if (agc_target && gate_gain && level)
+    {
+        int64_t target = ((int64_t)agc_target << GAIN_SHIFT) / level;
+
+        if (target > agc_max_gain)
+            target = agc_max_gain;
+        if (target < agc_min_gain)
+            target = agc_min_gain;
+
+        if (target < agc_gain)
+            agc_gain -= (agc_gain - target) / 2;
+        else
+            agc_gain += (target - agc_gain) / 32;
+    }
+
+    gain = (int64_t)agc_gain * gate_gain >> GAIN_SHIFT;
+    if (gain != GAIN_UNITY || prev_gain != GAIN_UNITY)
+        gain_apply(samples, count, prev_gain, gain);
+}
+
+static void high_pass_init(biquad_t *state, uint32_t sample_rate,
+    uint16_t cutoff)
+{
+    /* Butterworth, from the Audio EQ Cookbook */
+    float w0 = 2 * M_PI * cutoff / sample_rate;
+    float alpha = sinf(w0) * M_SQRT1_2;
+    float a0 = 1 + alpha, scale = (1 << BIQUAD_SHIFT) / a0;
+
+    memset(state, 0, sizeof(*state));
+    state->b0 = (1 + cosf(w0)) / 2 * scale;
+    state->b1 = -(1 + cosf(w0)) * scale;
+    state->b2 = state->b0;
+    state->a1 = -2 * cosf(w0) * scale;
+    state->a2 = (1 - alpha) * scale;
+}
+
+static uint32_t dbfs_to_rms(int8_t dbfs)
+{
+    return INT16_MAX * powf(10, dbfs / 20.0f);
+}
+
+int audio_processor_initialize(uint32_t sample_rate, uint8_t _dc_block,
+    uint16_t _high_pass, int8_t _agc_target, uint8_t _agc_max_gain,
+    int8_t _noise_gate)
+{
+    ESP_LOGD(TAG, "Initializing audio processor");
+
+    /* Nothing carries over from a previous configuration */
+    memset(&dc_block, 0, sizeof(dc_block));
+    memset(&high_pass, 0, sizeof(high_pass));
+    agc_target = noise_gate = 0;
+    agc_max_gain = GAIN_UNITY;
+    noise_gate_hold_samples = 0;
+    agc_gain = gate_gain = GAIN_UNITY;
+    gate_closed_for = 0;
+
+    if ((is_dc_blocking = _dc_block))
+    {
+        dc_block.pole = (1 - 2 * M_PI * dc_block_cutoff / sample_rate) *
+            (1 << 15);
+    }
+
+    if ((is_high_passing = _high_pass && _high_pass < sample_rate / 2))
+        high_pass_init(&high_pass, sample_rate, _high_pass);
+
+    if (_agc_target)
+    {
+        agc_target = dbfs_to_rms(_agc_target);
+        agc_max_gain = GAIN_UNITY * powf(10, _agc_max_gain / 20.0f);
+    }
+
+    if (_noise_gate)
+    {
+        noise_gate = dbfs_to_rms(_noise_gate);
+        noise_gate_hold_samples = sample_rate * noise_gate_hold_time / 1000;
+    }
+
+    ESP_LOGI(TAG, "DC blocking %s, high-pass at %uHz, AGC to %ddBFS, noise "
+        "gate at %ddBFS", is_dc_blocking ? "on" : "off",
+        is_high_passing ? _high_pass : 0, agc_target ? _agc_target : 0,
+        noise_gate ? _noise_gate : 0);
+
+    return 0;
+}
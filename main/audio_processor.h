@@ -0,0 +1,16 @@
+#ifndef AUDIO_PROCESSOR_H
+#define AUDIO_PROCESSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Processes captured samples in place, before they're encoded */
+void audio_processor_process(int16_t *samples, size_t count);
+
+/* high_pass is the cutoff in Hz, agc_target and noise_gate are levels in
+ * dBFS and agc_max_gain is in dB. 0 disables each of them */
+int audio_processor_initialize(uint32_t sample_rate, uint8_t dc_block,
+    uint16_t high_pass, int8_t agc_target, uint8_t agc_max_gain,
+    int8_t noise_gate);
+
+#endif
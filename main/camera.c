@@ -1,5 +1,14 @@
 #include "camera.h"
+#include "jpeg.h"
+#include "live.h"
+#include "motion_detector.h"
+#include "prebuffer.h"
+#include "recorder.h"
 #include "rtp.h"
+#include "suppressor.h"
+#include "task_layout.h"
+#include "trace.h"
+#include <driver/gpio.h>
 #include <esp_camera.h>
 #include <esp_err.h>
 #include <esp_log.h>
@@ -10,25 +19,116 @@
 #include <string.h>
 
 static const char *TAG = "Camera";
+/* Frames captured right after powering up are dropped while the auto exposure
+ * and white balance settle */
+static const int settle_frames = 3;
 
 static uint8_t is_capturing = 0;
 static SemaphoreHandle_t capture_semaphore;
+static TaskHandle_t capture_task = NULL;
+static jpeg_dc_decoder_t *dc_decoder = NULL;
+
+/* Power management, once used continuous capture is no longer available. The
+ * lock is held by whoever's capturing single frames */
+static SemaphoreHandle_t power_lock = NULL;
+static camera_config_t camera_config = {
+    .xclk_freq_hz = 10000000,
+    .ledc_timer = LEDC_TIMER_0,
+    .ledc_channel = LEDC_CHANNEL_0,
+    .pixel_format = PIXFORMAT_JPEG,
+    .fb_count = 2,
+};
+static uint8_t is_power_managed = 0, is_powered = 1;
+static uint8_t vertical_flip = 0, horizontal_mirror = 0;
+
+/* Frame rate profile */
+static portMUX_TYPE profile_lock = portMUX_INITIALIZER_UNLOCKED;
+static int active_fps, idle_fps;
+static int64_t hold_time;
+static uint8_t motion_detected = 0;
+static int64_t last_motion_time = 0;
+static uint8_t is_active = 1;
+static int64_t state_change_time = 0;
+static uint64_t state_time[2] = {};
+static uint32_t frames_captured = 0;
 
 static void camera_release_fb(void *fb)
 {
     esp_camera_fb_return((camera_fb_t *)fb);
 }
 
+static int camera_current_fps(void)
+{
+    int64_t now = esp_timer_get_time();
+    uint8_t active, changed = 0;
+
+    portENTER_CRITICAL(&profile_lock);
+    active = motion_detected || now - last_motion_time < hold_time;
+    if (active != is_active)
+    {
+        state_time[is_active] += now - state_change_time;
+        state_change_time = now;
+        is_active = active;
+        changed = 1;
+    }
+    portEXIT_CRITICAL(&profile_lock);
+
+    if (changed)
+    {
+        ESP_LOGI(TAG, "Switching to %s frame rate (%d fps)",
+            active ? "active" : "idle", active ? active_fps : idle_fps);
+    }
+
+    return active ? active_fps : idle_fps;
+}
+
+void camera_motion_set(uint8_t detected)
+{
+    portENTER_CRITICAL(&profile_lock);
+    motion_detected = detected;
+    last_motion_time = esp_timer_get_time();
+    portEXIT_CRITICAL(&profile_lock);
+
+    /* Don't wait for the idle interval to end before capturing */
+    if (detected && capture_task)
+        xTaskNotifyGive(capture_task);
+}
+
+void camera_stats_get(uint32_t *frames, int *fps)
+{
+    portENTER_CRITICAL(&profile_lock);
+    *frames = frames_captured;
+    *fps = is_active ? active_fps : idle_fps;
+    portEXIT_CRITICAL(&profile_lock);
+}
+
+void camera_state_time_get(uint64_t *idle_time, uint64_t *active_time)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&profile_lock);
+    *idle_time = state_time[0];
+    *active_time = state_time[1];
+    if (is_active)
+        *active_time += now - state_change_time;
+    else
+        *idle_time += now - state_change_time;
+    portEXIT_CRITICAL(&profile_lock);
+}
+
 static void camera_capture_task(void *pvParameter)
 {
-    int sleep_time = 1000 / (int)pvParameter;
     camera_fb_t *fb;
+    int64_t timestamp;
+    const uint8_t *map = NULL;
+    uint16_t map_width = 0, map_height = 0;
 
     while (1)
     {
         if (xSemaphoreTake(capture_semaphore, portMAX_DELAY) != pdTRUE)
             continue;
 
+        trace_event(TRACE_EVENT_CAPTURE_START, 0);
         if (!(fb = esp_camera_fb_get()))
         {
             ESP_LOGE(TAG, "Camera capture failed");
@@ -37,12 +137,31 @@ static void camera_capture_task(void *pvParameter)
         }
 
         /* XXX TODO Should go through ipcam.c */
-        rtp_send_jpeg(fb->width, fb->height, fb->buf, fb->len,
-            esp_timer_get_time(), camera_release_fb, fb);
+        timestamp = esp_timer_get_time();
+        trace_event(TRACE_EVENT_CAPTURE_END, timestamp);
+        portENTER_CRITICAL(&profile_lock);
+        frames_captured++;
+        portEXIT_CRITICAL(&profile_lock);
+        if (dc_decoder && !(map = jpeg_dc_decode(dc_decoder, fb->buf, fb->len,
+            &map_width, &map_height)))
+        {
+            ESP_LOGE(TAG, "Failed decoding DC map");
+        }
+        motion_detector_process(map, map_width, map_height, timestamp);
+        prebuffer_add(PREBUFFER_TYPE_JPEG, fb->buf, fb->len, timestamp);
+        recorder_add_jpeg(fb->buf, fb->len, timestamp);
+        if (suppressor_check(map, map_width, map_height, fb->len, timestamp))
+        {
+            live_add_jpeg(fb->buf, fb->len, timestamp);
+            rtp_send_jpeg(fb->width, fb->height, fb->buf, fb->len, timestamp,
+                camera_release_fb, fb);
+        }
+        else
+            camera_release_fb(fb);
 
         xSemaphoreGive(capture_semaphore);
 
-        vTaskDelay(pdMS_TO_TICKS(sleep_time));
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000 / camera_current_fps()));
     };
 
     vTaskDelete(NULL);
@@ -91,7 +210,7 @@ static int resolution_to_frame_size(const char *resolution)
 
 void camera_start(void)
 {
-    if (is_capturing)
+    if (is_capturing || is_power_managed)
         return;
 
     if (xSemaphoreGive(capture_semaphore) != pdTRUE )
@@ -113,20 +232,82 @@ void camera_stop(void)
     ESP_LOGI(TAG, "Stopped camera capture");
 }
 
+static void sensor_configure(void)
+{
+    sensor_t *s = esp_camera_sensor_get();
+
+    s->set_vflip(s, vertical_flip);
+    s->set_hmirror(s, horizontal_mirror);
+}
+
+static int power_set(uint8_t on)
+{
+    camera_fb_t *fb;
+    esp_err_t err;
+    int i;
+
+    if (on == is_powered)
+        return 0;
+
+    /* Deinitializing stops the clock and DMA, the sensor is then powered down
+     * if it has a power down pin. Initializing powers it back up */
+    if (!on)
+    {
+        esp_camera_deinit();
+        if (camera_config.pin_pwdn != -1)
+            gpio_set_level(camera_config.pin_pwdn, 1);
+        is_powered = 0;
+        return 0;
+    }
+
+    if ((err = esp_camera_init(&camera_config)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed powering camera up: %s", esp_err_to_name(err));
+        return -1;
+    }
+    sensor_configure();
+    is_powered = 1;
+
+    for (i = 0; i < settle_frames && (fb = esp_camera_fb_get()); i++)
+        esp_camera_fb_return(fb);
+
+    return 0;
+}
+
+void camera_power_manage(void)
+{
+    xSemaphoreTake(power_lock, portMAX_DELAY);
+    is_power_managed = 1;
+    power_set(0);
+    xSemaphoreGive(power_lock);
+}
+
+int camera_acquire(void)
+{
+    xSemaphoreTake(power_lock, portMAX_DELAY);
+
+    if (power_set(1))
+    {
+        xSemaphoreGive(power_lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+void camera_release(void)
+{
+    if (is_power_managed)
+        power_set(0);
+
+    xSemaphoreGive(power_lock);
+}
+
 int camera_initialize(int pwdn, int reset, int xclk, int siod, int sioc, int d7,
     int d6, int d5, int d4, int d3, int d2, int d1, int d0, int vsync, int href,
-    int pclk, const char *resolution, int fps, uint8_t vflip, uint8_t hmirror,
-    int quality)
+    int pclk, const char *resolution, int fps, int _idle_fps,
+    int _hold_time, uint8_t vflip, uint8_t hmirror, int quality)
 {
-    sensor_t *s;
-    camera_config_t camera_config = {
-        .xclk_freq_hz = 10000000,
-        .ledc_timer = LEDC_TIMER_0,
-        .ledc_channel = LEDC_CHANNEL_0,
-        .pixel_format = PIXFORMAT_JPEG,
-        .fb_count = 2,
-    };
-
     ESP_LOGD(TAG, "Initializing camera");
 
     camera_config.pin_pwdn = pwdn;
@@ -158,18 +339,37 @@ int camera_initialize(int pwdn, int reset, int xclk, int siod, int sioc, int d7,
 
     ESP_ERROR_CHECK(esp_camera_init(&camera_config));
 
-    s = esp_camera_sensor_get();
-    s->set_vflip(s, vflip);
-    s->set_hmirror(s, hmirror);
+    vertical_flip = vflip;
+    horizontal_mirror = hmirror;
+    sensor_configure();
+
+    /* The DC map is shared by the motion detector and the suppressor */
+    if ((motion_detector_is_enabled() || suppressor_is_enabled()) &&
+        !(dc_decoder = jpeg_dc_decoder_create()))
+    {
+        ESP_LOGE(TAG, "Failed creating JPEG DC decoder");
+        return -1;
+    }
 
-    if (!(capture_semaphore = xSemaphoreCreateBinary()))
+    if (!(capture_semaphore = xSemaphoreCreateBinary()) ||
+        !(power_lock = xSemaphoreCreateMutex()))
     {
         ESP_LOGE(TAG, "Failed creating semaphore");
         return -1;
     }
 
-    if (xTaskCreatePinnedToCore(camera_capture_task, "camer_capture_task", 4096,
-        (void *)fps, 5, NULL, 1) != pdPASS)
+    /* Idle frame rate is only used if it's lower than the active one */
+    active_fps = fps;
+    idle_fps = _idle_fps > 0 && _idle_fps < fps ? _idle_fps : fps;
+    hold_time = (int64_t)_hold_time * 1000 * 1000;
+    if (idle_fps != active_fps)
+    {
+        ESP_LOGI(TAG, "Using idle frame rate of %d fps, %d fps on motion",
+            idle_fps, active_fps);
+    }
+
+    if (task_layout_create(camera_capture_task, "camer_capture_task", 4096,
+        NULL, 5, &capture_task, 1) != pdPASS)
     {
         ESP_LOGE(TAG, "Failed creating capture task");
         return -1;
@@ -6,9 +6,24 @@
 void camera_start(void);
 void camera_stop(void);
 
+/* Powers the camera down until it's acquired. Continuous capture can't be
+ * started once this is used */
+void camera_power_manage(void);
+/* Single frames are captured with esp_camera_fb_get() in between, one user at
+ * a time. The camera is powered up, and settled, for them if it's managed */
+int camera_acquire(void);
+void camera_release(void);
+
+/* Whether any event source is triggered, the active frame rate is kept for the
+ * hold time after the last one clears */
+void camera_motion_set(uint8_t detected);
+void camera_state_time_get(uint64_t *idle_time, uint64_t *active_time);
+/* Frames captured so far, and the frame rate currently captured at */
+void camera_stats_get(uint32_t *frames, int *fps);
+
 int camera_initialize(int pwdn, int reset, int xclk, int siod, int sioc, int d7,
     int d6, int d5, int d4, int d3, int d2, int d1, int d0, int vsync, int href,
-    int pclk, const char *resolution, int fps, uint8_t vflip, uint8_t hmirror,
-    int quality);
+    int pclk, const char *resolution, int fps, int idle_fps, int hold_time,
+    uint8_t vflip, uint8_t hmirror, int quality);
 
 #endif
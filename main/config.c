@@ -104,6 +104,41 @@ uint8_t config_rtp_ttl_get(void)
     return 1;
 }
 
+uint8_t config_rtp_latency_test_get(void)
+{
+    cJSON *rtp = cJSON_GetObjectItemCaseSensitive(config, "rtp");
+    cJSON *latency_test = cJSON_GetObjectItemCaseSensitive(rtp,
+        "latency_test");
+
+    return cJSON_IsTrue(latency_test);
+}
+
+uint8_t config_rtp_suppression_threshold_get(void)
+{
+    cJSON *rtp = cJSON_GetObjectItemCaseSensitive(config, "rtp");
+    cJSON *suppression = cJSON_GetObjectItemCaseSensitive(rtp, "suppression");
+    cJSON *threshold = cJSON_GetObjectItemCaseSensitive(suppression,
+        "threshold");
+
+    if (cJSON_IsNumber(threshold))
+        return threshold->valuedouble;
+
+    return 0;
+}
+
+uint16_t config_rtp_suppression_keyframe_interval_get(void)
+{
+    cJSON *rtp = cJSON_GetObjectItemCaseSensitive(config, "rtp");
+    cJSON *suppression = cJSON_GetObjectItemCaseSensitive(rtp, "suppression");
+    cJSON *keyframe_interval = cJSON_GetObjectItemCaseSensitive(suppression,
+        "keyframe_interval");
+
+    if (cJSON_IsNumber(keyframe_interval))
+        return keyframe_interval->valuedouble;
+
+    return 5;
+}
+
 /* Camera Configuraton */
 static int config_camera_pin_get(const char *name)
 {
@@ -162,6 +197,28 @@ int config_camera_fps_get(void)
     return 5;
 }
 
+int config_camera_idle_fps_get(void)
+{
+    cJSON *camera = cJSON_GetObjectItemCaseSensitive(config, "camera");
+    cJSON *idle_fps = cJSON_GetObjectItemCaseSensitive(camera, "idle_fps");
+
+    if (cJSON_IsNumber(idle_fps))
+        return idle_fps->valuedouble;
+
+    return config_camera_fps_get();
+}
+
+int config_camera_hold_time_get(void)
+{
+    cJSON *camera = cJSON_GetObjectItemCaseSensitive(config, "camera");
+    cJSON *hold_time = cJSON_GetObjectItemCaseSensitive(camera, "hold_time");
+
+    if (cJSON_IsNumber(hold_time))
+        return hold_time->valuedouble;
+
+    return 30;
+}
+
 uint8_t config_camera_vertical_flip_get(void)
 {
     cJSON *camera = cJSON_GetObjectItemCaseSensitive(config, "camera");
@@ -225,6 +282,257 @@ uint32_t config_microphone_sample_rate_get(void)
     return 16000;
 }
 
+const char *config_microphone_codec_get(void)
+{
+    cJSON *microphone = cJSON_GetObjectItemCaseSensitive(config, "microphone");
+    cJSON *codec = cJSON_GetObjectItemCaseSensitive(microphone, "codec");
+
+    if (cJSON_IsString(codec))
+        return codec->valuestring;
+
+    return "opus";
+}
+
+uint8_t config_microphone_dc_block_get(void)
+{
+    cJSON *microphone = cJSON_GetObjectItemCaseSensitive(config, "microphone");
+    cJSON *dc_block = cJSON_GetObjectItemCaseSensitive(microphone, "dc_block");
+
+    if (cJSON_IsBool(dc_block))
+        return cJSON_IsTrue(dc_block);
+
+    return 1;
+}
+
+uint16_t config_microphone_high_pass_get(void)
+{
+    cJSON *microphone = cJSON_GetObjectItemCaseSensitive(config, "microphone");
+    cJSON *high_pass = cJSON_GetObjectItemCaseSensitive(microphone,
+        "high_pass");
+
+    if (cJSON_IsNumber(high_pass))
+        return high_pass->valuedouble;
+
+    return 80;
+}
+
+int8_t config_microphone_agc_target_get(void)
+{
+    cJSON *microphone = cJSON_GetObjectItemCaseSensitive(config, "microphone");
+    cJSON *agc_target = cJSON_GetObjectItemCaseSensitive(microphone,
+        "agc_target");
+
+    if (cJSON_IsNumber(agc_target))
+        return agc_target->valuedouble;
+
+    return 0;
+}
+
+uint8_t config_microphone_agc_max_gain_get(void)
+{
+    cJSON *microphone = cJSON_GetObjectItemCaseSensitive(config, "microphone");
+    cJSON *agc_max_gain = cJSON_GetObjectItemCaseSensitive(microphone,
+        "agc_max_gain");
+
+    if (cJSON_IsNumber(agc_max_gain))
+        return agc_max_gain->valuedouble;
+
+    return 24;
+}
+
+int8_t config_microphone_noise_gate_get(void)
+{
+    cJSON *microphone = cJSON_GetObjectItemCaseSensitive(config, "microphone");
+    cJSON *noise_gate = cJSON_GetObjectItemCaseSensitive(microphone,
+        "noise_gate");
+
+    if (cJSON_IsNumber(noise_gate))
+        return noise_gate->valuedouble;
+
+    return 0;
+}
+
+/* Opus Configuration */
+uint32_t config_opus_bitrate_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *bitrate = cJSON_GetObjectItemCaseSensitive(opus, "bitrate");
+
+    if (cJSON_IsNumber(bitrate))
+        return bitrate->valuedouble;
+
+    return 24000;
+}
+
+uint32_t config_opus_frame_duration_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *frame_duration = cJSON_GetObjectItemCaseSensitive(opus,
+        "frame_duration");
+
+    /* Milliseconds in the configuration, 2.5 is valid */
+    if (cJSON_IsNumber(frame_duration))
+        return frame_duration->valuedouble * 1000;
+
+    return 20000;
+}
+
+uint32_t config_opus_ptime_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *ptime = cJSON_GetObjectItemCaseSensitive(opus, "ptime");
+
+    if (cJSON_IsNumber(ptime))
+        return ptime->valuedouble * 1000;
+
+    return 120000;
+}
+
+uint8_t config_opus_complexity_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *complexity = cJSON_GetObjectItemCaseSensitive(opus, "complexity");
+
+    if (cJSON_IsNumber(complexity))
+        return complexity->valuedouble;
+
+    return 5;
+}
+
+uint8_t config_opus_vbr_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *vbr = cJSON_GetObjectItemCaseSensitive(opus, "vbr");
+
+    if (cJSON_IsBool(vbr))
+        return cJSON_IsTrue(vbr);
+
+    return 1;
+}
+
+uint8_t config_opus_dtx_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *dtx = cJSON_GetObjectItemCaseSensitive(opus, "dtx");
+
+    if (cJSON_IsBool(dtx))
+        return cJSON_IsTrue(dtx);
+
+    return 1;
+}
+
+uint8_t config_opus_fec_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *fec = cJSON_GetObjectItemCaseSensitive(opus, "fec");
+
+    return cJSON_IsTrue(fec);
+}
+
+uint8_t config_opus_packet_loss_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *packet_loss = cJSON_GetObjectItemCaseSensitive(opus,
+        "packet_loss");
+
+    if (cJSON_IsNumber(packet_loss))
+        return packet_loss->valuedouble;
+
+    return 0;
+}
+
+uint8_t config_opus_cpu_budget_get(void)
+{
+    cJSON *opus = cJSON_GetObjectItemCaseSensitive(config, "opus");
+    cJSON *cpu_budget = cJSON_GetObjectItemCaseSensitive(opus, "cpu_budget");
+
+    if (cJSON_IsNumber(cpu_budget))
+        return cpu_budget->valuedouble;
+
+    return 50;
+}
+
+/* Talkback Configuration */
+uint16_t config_talkback_port_get(void)
+{
+    cJSON *talkback = cJSON_GetObjectItemCaseSensitive(config, "talkback");
+    cJSON *port = cJSON_GetObjectItemCaseSensitive(talkback, "port");
+
+    if (cJSON_IsNumber(port))
+        return port->valuedouble;
+
+    return 0;
+}
+
+int config_talkback_bclk_get(void)
+{
+    cJSON *talkback = cJSON_GetObjectItemCaseSensitive(config, "talkback");
+    cJSON *bclk = cJSON_GetObjectItemCaseSensitive(talkback, "bclk");
+
+    if (cJSON_IsNumber(bclk))
+        return bclk->valuedouble;
+
+    return -1;
+}
+
+int config_talkback_ws_get(void)
+{
+    cJSON *talkback = cJSON_GetObjectItemCaseSensitive(config, "talkback");
+    cJSON *ws = cJSON_GetObjectItemCaseSensitive(talkback, "ws");
+
+    if (cJSON_IsNumber(ws))
+        return ws->valuedouble;
+
+    return -1;
+}
+
+int config_talkback_dout_get(void)
+{
+    cJSON *talkback = cJSON_GetObjectItemCaseSensitive(config, "talkback");
+    cJSON *dout = cJSON_GetObjectItemCaseSensitive(talkback, "dout");
+
+    if (cJSON_IsNumber(dout))
+        return dout->valuedouble;
+
+    return -1;
+}
+
+uint32_t config_talkback_sample_rate_get(void)
+{
+    cJSON *talkback = cJSON_GetObjectItemCaseSensitive(config, "talkback");
+    cJSON *sample_rate = cJSON_GetObjectItemCaseSensitive(talkback,
+        "sample_rate");
+
+    if (cJSON_IsNumber(sample_rate))
+        return sample_rate->valuedouble;
+
+    return 16000;
+}
+
+uint16_t config_talkback_min_delay_get(void)
+{
+    cJSON *talkback = cJSON_GetObjectItemCaseSensitive(config, "talkback");
+    cJSON *min_delay = cJSON_GetObjectItemCaseSensitive(talkback,
+        "min_delay");
+
+    if (cJSON_IsNumber(min_delay))
+        return min_delay->valuedouble;
+
+    return 60;
+}
+
+uint16_t config_talkback_max_delay_get(void)
+{
+    cJSON *talkback = cJSON_GetObjectItemCaseSensitive(config, "talkback");
+    cJSON *max_delay = cJSON_GetObjectItemCaseSensitive(talkback,
+        "max_delay");
+
+    if (cJSON_IsNumber(max_delay))
+        return max_delay->valuedouble;
+
+    return 400;
+}
+
 /* Motion Sensor Configuraton */
 int config_motion_sensor_pin_get(void)
 {
@@ -238,6 +546,301 @@ int config_motion_sensor_pin_get(void)
     return -1;
 }
 
+/* Motion Detector Configuraton */
+uint8_t config_motion_detector_threshold_get(void)
+{
+    cJSON *motion_detector = cJSON_GetObjectItemCaseSensitive(config,
+        "motion_detector");
+    cJSON *threshold = cJSON_GetObjectItemCaseSensitive(motion_detector,
+        "threshold");
+
+    if (cJSON_IsNumber(threshold))
+        return threshold->valuedouble;
+
+    return 0;
+}
+
+uint8_t config_motion_detector_area_get(void)
+{
+    cJSON *motion_detector = cJSON_GetObjectItemCaseSensitive(config,
+        "motion_detector");
+    cJSON *area = cJSON_GetObjectItemCaseSensitive(motion_detector, "area");
+
+    if (cJSON_IsNumber(area))
+        return area->valuedouble;
+
+    return 2;
+}
+
+/* Sound Detector Configuraton */
+int8_t config_sound_detector_threshold_get(void)
+{
+    cJSON *sound_detector = cJSON_GetObjectItemCaseSensitive(config,
+        "sound_detector");
+    cJSON *threshold = cJSON_GetObjectItemCaseSensitive(sound_detector,
+        "threshold");
+
+    if (cJSON_IsNumber(threshold))
+        return threshold->valuedouble;
+
+    return 0;
+}
+
+uint8_t config_sound_detector_hysteresis_get(void)
+{
+    cJSON *sound_detector = cJSON_GetObjectItemCaseSensitive(config,
+        "sound_detector");
+    cJSON *hysteresis = cJSON_GetObjectItemCaseSensitive(sound_detector,
+        "hysteresis");
+
+    if (cJSON_IsNumber(hysteresis))
+        return hysteresis->valuedouble;
+
+    return 6;
+}
+
+uint16_t config_sound_detector_hold_time_get(void)
+{
+    cJSON *sound_detector = cJSON_GetObjectItemCaseSensitive(config,
+        "sound_detector");
+    cJSON *hold_time = cJSON_GetObjectItemCaseSensitive(sound_detector,
+        "hold_time");
+
+    if (cJSON_IsNumber(hold_time))
+        return hold_time->valuedouble;
+
+    return 2;
+}
+
+/* Pre-event Buffer Configuration */
+uint8_t config_prebuffer_seconds_get(void)
+{
+    cJSON *prebuffer = cJSON_GetObjectItemCaseSensitive(config, "prebuffer");
+    cJSON *seconds = cJSON_GetObjectItemCaseSensitive(prebuffer, "seconds");
+
+    if (cJSON_IsNumber(seconds))
+        return seconds->valuedouble;
+
+    return 0;
+}
+
+size_t config_prebuffer_size_get(void)
+{
+    cJSON *prebuffer = cJSON_GetObjectItemCaseSensitive(config, "prebuffer");
+    cJSON *size = cJSON_GetObjectItemCaseSensitive(prebuffer, "size");
+
+    if (cJSON_IsNumber(size))
+        return size->valuedouble;
+
+    return 1024 * 1024;
+}
+
+/* SD Card Configuration */
+static int config_sdcard_pin_get(const char *name)
+{
+    cJSON *sdcard = cJSON_GetObjectItemCaseSensitive(config, "sdcard");
+    cJSON *pin = cJSON_GetObjectItemCaseSensitive(sdcard, name);
+
+    if (cJSON_IsNumber(pin))
+        return pin->valuedouble;
+
+    return -1;
+}
+
+int config_sdcard_clk_get(void)
+{
+    return config_sdcard_pin_get("clk");
+}
+
+int config_sdcard_mosi_get(void)
+{
+    return config_sdcard_pin_get("mosi");
+}
+
+int config_sdcard_miso_get(void)
+{
+    return config_sdcard_pin_get("miso");
+}
+
+int config_sdcard_cs_get(void)
+{
+    return config_sdcard_pin_get("cs");
+}
+
+/* Recorder Configuration */
+const char *config_recorder_path_get(void)
+{
+    cJSON *recorder = cJSON_GetObjectItemCaseSensitive(config, "recorder");
+    cJSON *path = cJSON_GetObjectItemCaseSensitive(recorder, "path");
+
+    if (cJSON_IsString(path))
+        return path->valuestring;
+
+    return NULL;
+}
+
+const char *config_recorder_mode_get(void)
+{
+    cJSON *recorder = cJSON_GetObjectItemCaseSensitive(config, "recorder");
+    cJSON *mode = cJSON_GetObjectItemCaseSensitive(recorder, "mode");
+
+    if (cJSON_IsString(mode))
+        return mode->valuestring;
+
+    return "continuous";
+}
+
+uint16_t config_recorder_segment_duration_get(void)
+{
+    cJSON *recorder = cJSON_GetObjectItemCaseSensitive(config, "recorder");
+    cJSON *segment_duration = cJSON_GetObjectItemCaseSensitive(recorder,
+        "segment_duration");
+
+    if (cJSON_IsNumber(segment_duration))
+        return segment_duration->valuedouble;
+
+    return 300;
+}
+
+int config_recorder_hold_time_get(void)
+{
+    cJSON *recorder = cJSON_GetObjectItemCaseSensitive(config, "recorder");
+    cJSON *hold_time = cJSON_GetObjectItemCaseSensitive(recorder, "hold_time");
+
+    if (cJSON_IsNumber(hold_time))
+        return hold_time->valuedouble;
+
+    return 10;
+}
+
+size_t config_recorder_buffer_size_get(void)
+{
+    cJSON *recorder = cJSON_GetObjectItemCaseSensitive(config, "recorder");
+    cJSON *buffer_size = cJSON_GetObjectItemCaseSensitive(recorder,
+        "buffer_size");
+
+    if (cJSON_IsNumber(buffer_size))
+        return buffer_size->valuedouble;
+
+    return 1024 * 1024;
+}
+
+size_t config_recorder_preallocate_get(void)
+{
+    cJSON *recorder = cJSON_GetObjectItemCaseSensitive(config, "recorder");
+    cJSON *preallocate = cJSON_GetObjectItemCaseSensitive(recorder,
+        "preallocate");
+
+    if (cJSON_IsNumber(preallocate))
+        return preallocate->valuedouble;
+
+    return 16 * 1024 * 1024;
+}
+
+/* Live Stream Configuration */
+uint8_t config_live_max_clients_get(void)
+{
+    cJSON *live = cJSON_GetObjectItemCaseSensitive(config, "live");
+    cJSON *max_clients = cJSON_GetObjectItemCaseSensitive(live, "max_clients");
+
+    if (cJSON_IsNumber(max_clients))
+        return max_clients->valuedouble;
+
+    return 2;
+}
+
+size_t config_live_frame_size_get(void)
+{
+    cJSON *live = cJSON_GetObjectItemCaseSensitive(config, "live");
+    cJSON *frame_size = cJSON_GetObjectItemCaseSensitive(live, "frame_size");
+
+    if (cJSON_IsNumber(frame_size))
+        return frame_size->valuedouble;
+
+    return 64 * 1024;
+}
+
+uint8_t config_live_frames_get(void)
+{
+    cJSON *live = cJSON_GetObjectItemCaseSensitive(config, "live");
+    cJSON *frames = cJSON_GetObjectItemCaseSensitive(live, "frames");
+
+    if (cJSON_IsNumber(frames))
+        return frames->valuedouble;
+
+    return 4;
+}
+
+/* Timelapse Configuration */
+uint32_t config_timelapse_interval_get(void)
+{
+    cJSON *timelapse = cJSON_GetObjectItemCaseSensitive(config, "timelapse");
+    cJSON *interval = cJSON_GetObjectItemCaseSensitive(timelapse, "interval");
+
+    if (cJSON_IsNumber(interval))
+        return interval->valuedouble;
+
+    return 0;
+}
+
+const char *config_timelapse_path_get(void)
+{
+    cJSON *timelapse = cJSON_GetObjectItemCaseSensitive(config, "timelapse");
+    cJSON *path = cJSON_GetObjectItemCaseSensitive(timelapse, "path");
+
+    if (cJSON_IsString(path))
+        return path->valuestring;
+
+    return "/sdcard/timelapse";
+}
+
+uint8_t config_timelapse_fps_get(void)
+{
+    cJSON *timelapse = cJSON_GetObjectItemCaseSensitive(config, "timelapse");
+    cJSON *fps = cJSON_GetObjectItemCaseSensitive(timelapse, "fps");
+
+    if (cJSON_IsNumber(fps))
+        return fps->valuedouble;
+
+    return 25;
+}
+
+uint32_t config_timelapse_clip_frames_get(void)
+{
+    cJSON *timelapse = cJSON_GetObjectItemCaseSensitive(config, "timelapse");
+    cJSON *clip_frames = cJSON_GetObjectItemCaseSensitive(timelapse,
+        "clip_frames");
+
+    if (cJSON_IsNumber(clip_frames))
+        return clip_frames->valuedouble;
+
+    return 1440;
+}
+
+const char *config_timelapse_upload_url_get(void)
+{
+    cJSON *timelapse = cJSON_GetObjectItemCaseSensitive(config, "timelapse");
+    cJSON *upload_url = cJSON_GetObjectItemCaseSensitive(timelapse,
+        "upload_url");
+
+    if (cJSON_IsString(upload_url))
+        return upload_url->valuestring;
+
+    return NULL;
+}
+
+uint32_t config_timelapse_active_power_get(void)
+{
+    cJSON *timelapse = cJSON_GetObjectItemCaseSensitive(config, "timelapse");
+    cJSON *active_power = cJSON_GetObjectItemCaseSensitive(timelapse,
+        "active_power");
+
+    if (cJSON_IsNumber(active_power))
+        return active_power->valuedouble;
+
+    return 0;
+}
+
 /* Ethernet Configuration */
 const char *config_network_eth_phy_get(void)
 {
@@ -390,6 +993,18 @@ config_network_type_t config_network_type_get(void)
     return eth ? NETWORK_TYPE_ETH : NETWORK_TYPE_WIFI;
 }
 
+const char *config_network_ntp_server_get(void)
+{
+    cJSON *network = cJSON_GetObjectItemCaseSensitive(config, "network");
+    cJSON *ntp_server = cJSON_GetObjectItemCaseSensitive(network,
+        "ntp_server");
+
+    if (cJSON_IsString(ntp_server))
+        return ntp_server->valuestring;
+
+    return "pool.ntp.org";
+}
+
 /* WiFi Configuration */
 const char *config_network_hostname_get(void)
 {
@@ -524,6 +1139,57 @@ uint16_t config_log_port_get(void)
     return 0;
 }
 
+/* Task Layout Configuration */
+static cJSON *config_task_get(const char *name, const char *key)
+{
+    cJSON *tasks = cJSON_GetObjectItemCaseSensitive(config, "tasks");
+    cJSON *task = cJSON_GetObjectItemCaseSensitive(tasks, name);
+
+    return cJSON_GetObjectItemCaseSensitive(task, key);
+}
+
+int config_task_core_get(const char *name, int def)
+{
+    cJSON *core = config_task_get(name, "core");
+
+    if (cJSON_IsNumber(core))
+        return core->valuedouble;
+
+    return def;
+}
+
+int config_task_priority_get(const char *name, int def)
+{
+    cJSON *priority = config_task_get(name, "priority");
+
+    if (cJSON_IsNumber(priority))
+        return priority->valuedouble;
+
+    return def;
+}
+
+uint32_t config_task_stack_size_get(const char *name, uint32_t def)
+{
+    cJSON *stack_size = config_task_get(name, "stack_size");
+
+    if (cJSON_IsNumber(stack_size))
+        return stack_size->valuedouble;
+
+    return def;
+}
+
+/* Trace Configuration */
+size_t config_trace_records_get(void)
+{
+    cJSON *trace = cJSON_GetObjectItemCaseSensitive(config, "trace");
+    cJSON *records = cJSON_GetObjectItemCaseSensitive(trace, "records");
+
+    if (cJSON_IsNumber(records))
+        return records->valuedouble;
+
+    return 0;
+}
+
 /* Configuration Update */
 static int config_active_partition_get(void)
 {
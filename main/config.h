@@ -16,6 +16,9 @@ const char *config_rtp_host_get(void);
 uint16_t config_rtp_video_port_get(void);
 uint16_t config_rtp_audio_port_get(void);
 uint8_t config_rtp_ttl_get(void);
+uint8_t config_rtp_latency_test_get(void);
+uint8_t config_rtp_suppression_threshold_get(void);
+uint16_t config_rtp_suppression_keyframe_interval_get(void);
 
 /* Camera Configuraton */
 int config_camera_pin_pwdn_get(void);
@@ -36,6 +39,8 @@ int config_camera_pin_href_get(void);
 int config_camera_pin_pclk_get(void);
 const char *config_camera_resolution_get(void);
 int config_camera_fps_get(void);
+int config_camera_idle_fps_get(void);
+int config_camera_hold_time_get(void);
 uint8_t config_camera_vertical_flip_get(void);
 uint8_t config_camera_horizontal_mirror_get(void);
 int config_camera_quality_get(void);
@@ -44,10 +49,77 @@ int config_camera_quality_get(void);
 int config_microphone_din_get(void);
 int config_microphone_clk_get(void);
 uint32_t config_microphone_sample_rate_get(void);
+const char *config_microphone_codec_get(void);
+uint8_t config_microphone_dc_block_get(void);
+uint16_t config_microphone_high_pass_get(void);
+int8_t config_microphone_agc_target_get(void);
+uint8_t config_microphone_agc_max_gain_get(void);
+int8_t config_microphone_noise_gate_get(void);
+
+/* Opus Configuration */
+uint32_t config_opus_bitrate_get(void);
+/* In microseconds */
+uint32_t config_opus_frame_duration_get(void);
+uint32_t config_opus_ptime_get(void);
+uint8_t config_opus_complexity_get(void);
+uint8_t config_opus_vbr_get(void);
+uint8_t config_opus_dtx_get(void);
+uint8_t config_opus_fec_get(void);
+uint8_t config_opus_packet_loss_get(void);
+uint8_t config_opus_cpu_budget_get(void);
+
+/* Talkback Configuration */
+uint16_t config_talkback_port_get(void);
+int config_talkback_bclk_get(void);
+int config_talkback_ws_get(void);
+int config_talkback_dout_get(void);
+uint32_t config_talkback_sample_rate_get(void);
+uint16_t config_talkback_min_delay_get(void);
+uint16_t config_talkback_max_delay_get(void);
 
 /* Motion Sensor Configuraton */
 int config_motion_sensor_pin_get(void);
 
+/* Motion Detector Configuraton */
+uint8_t config_motion_detector_threshold_get(void);
+uint8_t config_motion_detector_area_get(void);
+
+/* Sound Detector Configuraton */
+int8_t config_sound_detector_threshold_get(void);
+uint8_t config_sound_detector_hysteresis_get(void);
+uint16_t config_sound_detector_hold_time_get(void);
+
+/* Pre-event Buffer Configuration */
+uint8_t config_prebuffer_seconds_get(void);
+size_t config_prebuffer_size_get(void);
+
+/* SD Card Configuration */
+int config_sdcard_clk_get(void);
+int config_sdcard_mosi_get(void);
+int config_sdcard_miso_get(void);
+int config_sdcard_cs_get(void);
+
+/* Recorder Configuration */
+const char *config_recorder_path_get(void);
+const char *config_recorder_mode_get(void);
+uint16_t config_recorder_segment_duration_get(void);
+int config_recorder_hold_time_get(void);
+size_t config_recorder_buffer_size_get(void);
+size_t config_recorder_preallocate_get(void);
+
+/* Live Stream Configuration */
+uint8_t config_live_max_clients_get(void);
+size_t config_live_frame_size_get(void);
+uint8_t config_live_frames_get(void);
+
+/* Timelapse Configuration */
+uint32_t config_timelapse_interval_get(void);
+const char *config_timelapse_path_get(void);
+uint8_t config_timelapse_fps_get(void);
+uint32_t config_timelapse_clip_frames_get(void);
+const char *config_timelapse_upload_url_get(void);
+uint32_t config_timelapse_active_power_get(void);
+
 /* Ethernet Configuration */
 const char *config_network_eth_phy_get(void);
 int8_t config_network_eth_phy_power_pin_get(void);
@@ -67,6 +139,7 @@ uint8_t config_mqtt_retained_get(void);
 
 /* Network Configuration */
 config_network_type_t config_network_type_get(void);
+const char *config_network_ntp_server_get(void);
 
 /* WiFi Configuration*/
 const char *config_network_hostname_get(void);
@@ -84,6 +157,15 @@ const char *config_eap_password_get(void);
 const char *config_log_host_get(void);
 uint16_t config_log_port_get(void);
 
+/* Task Layout Configuration, falling back to the given defaults. A core of -1
+ * lets the task run on any core */
+int config_task_core_get(const char *name, int def);
+int config_task_priority_get(const char *name, int def);
+uint32_t config_task_stack_size_get(const char *name, uint32_t def);
+
+/* Trace Configuration */
+size_t config_trace_records_get(void);
+
 /* Configuration Update */
 int config_update_begin(config_update_handle_t **handle);
 int config_update_write(config_update_handle_t *handle, uint8_t *data,
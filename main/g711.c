@@ -0,0 +1,63 @@
+#include "g711.h"
+
+/* Constants */
+/* Segment (exponent) of the top 8 bits of a 13 bit magnitude, shared by both
+ * laws as u-law adds its bias before looking it up */
+static const uint8_t segment_table[256] = {
+    0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+};
+/* The u-law bias, in 14 bits */
+static const int32_t ulaw_bias = 0x21;
+/* Above this the biased magnitude would overflow the top segment */
+static const int32_t ulaw_clip = 0x1fff - 0x21;
+
+uint8_t g711_ulaw_encode(int16_t sample)
+{
+    /* Truncated before taking the magnitude, as the reference does */
+    int32_t value = sample >> 2;
+    uint8_t mask = 0xff, segment;
+
+    if (value < 0)
+    {
+        value = -value;
+        mask = 0x7f;
+    }
+    if (value > ulaw_clip)
+        value = ulaw_clip;
+    value += ulaw_bias;
+
+    segment = segment_table[value >> 5];
+    return (segment << 4 | ((value >> (segment + 1)) & 0x0f)) ^ mask;
+}
+
+uint8_t g711_alaw_encode(int16_t sample)
+{
+    int32_t value = sample >> 3;
+    uint8_t mask = 0xd5, segment;
+
+    if (value < 0)
+    {
+        value = -value - 1;
+        mask = 0x55;
+    }
+
+    /* The two lowest segments have the same step */
+    segment = segment_table[value >> 4];
+    return (segment << 4 | ((value >> (segment ? segment : 1)) & 0x0f)) ^
+        mask;
+}
@@ -0,0 +1,11 @@
+#ifndef G711_H
+#define G711_H
+
+#include <stdint.h>
+
+/* ITU-T G.711 encoding of 16 bit linear samples, bit exact with the reference
+ * implementation. u-law keeps the 14 most significant bits, A-law 13 */
+uint8_t g711_ulaw_encode(int16_t sample);
+uint8_t g711_alaw_encode(int16_t sample);
+
+#endif
@@ -1,13 +1,27 @@
 #include "httpd.h"
+#include "audio_encoder.h"
+#include "camera.h"
 #include "config.h"
 #include "httpd_static_files.h"
+#include "live.h"
 #include "ota.h"
+#include "prebuffer.h"
+#include "recorder.h"
+#include "rtp.h"
+#include "stats.h"
+#include "task_layout.h"
+#include "timelapse.h"
+#include "trace.h"
+#include "wifi.h"
 #include <esp_camera.h>
 #include <esp_err.h>
+#include <esp_heap_caps.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
+#include <esp_timer.h>
 #include <cJSON.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <freertos/timers.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -15,12 +29,42 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <unistd.h>
 
+#define FILE_READ_SIZE (16 * 1024)
+#define METRICS_BUFFER_SIZE 1024
+#define MAX_URI_HANDLERS 24
+
+/* Types */
+typedef struct {
+    const char *host;
+    uint16_t video_port;
+    uint16_t audio_port;
+} stream_destination_t;
+
+/* Metrics are rendered into a fixed buffer, sent as a chunk whenever it fills
+ * up, so scraping never allocates */
+typedef struct {
+    httpd_req_t *req;
+    char buffer[METRICS_BUFFER_SIZE];
+    size_t length;
+    esp_err_t err;
+} metrics_writer_t;
+
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+    uint32_t label;
+} traced_handler_t;
+
 static const char *TAG = "HTTPD";
 
 /* Internal state */
 static httpd_handle_t server = NULL;
+static traced_handler_t traced_handlers[MAX_URI_HANDLERS];
+static size_t traced_handlers_count = 0;
 
 /* Callback functions */
 static httpd_on_ota_completed_cb_t on_ota_completed_cb = NULL;
@@ -30,6 +74,40 @@ void httpd_set_on_ota_completed_cb(httpd_on_ota_completed_cb_t cb)
     on_ota_completed_cb = cb;
 }
 
+static esp_err_t traced_handler(httpd_req_t *req)
+{
+    traced_handler_t *traced = (traced_handler_t *)req->user_ctx;
+    esp_err_t ret;
+
+    req->user_ctx = traced->user_ctx;
+    trace_event(TRACE_EVENT_HTTP_START, traced->label);
+    ret = traced->handler(req);
+    trace_event(TRACE_EVENT_HTTP_END, traced->label);
+
+    return ret;
+}
+
+/* While tracing, handlers are called through one recording their start and
+ * end, labelled by their URI */
+static esp_err_t uri_handler_register(httpd_handle_t server,
+    const httpd_uri_t *uri)
+{
+    httpd_uri_t traced_uri = *uri;
+    traced_handler_t *traced;
+
+    if (!trace_is_enabled() || traced_handlers_count == MAX_URI_HANDLERS)
+        return httpd_register_uri_handler(server, uri);
+
+    traced = &traced_handlers[traced_handlers_count++];
+    traced->handler = uri->handler;
+    traced->user_ctx = uri->user_ctx;
+    traced->label = trace_label_add(uri->uri);
+    traced_uri.handler = traced_handler;
+    traced_uri.user_ctx = traced;
+
+    return httpd_register_uri_handler(server, &traced_uri);
+}
+
 static void delayed_restart_timer_cb(TimerHandle_t xTimer)
 {
     abort();
@@ -64,6 +142,337 @@ static esp_err_t status_handler(httpd_req_t *req)
     return ret;
 }
 
+static void stats_add_rtp_to_response(cJSON *response, const char *name,
+    rtp_stats_t *stats)
+{
+    cJSON *object = cJSON_AddObjectToObject(response, name);
+
+    cJSON_AddNumberToObject(object, "frames", stats->frames);
+    cJSON_AddNumberToObject(object, "packets", stats->packets);
+    cJSON_AddNumberToObject(object, "bytes", stats->bytes);
+    cJSON_AddNumberToObject(object, "errors", stats->errors);
+}
+
+static esp_err_t stats_handler(httpd_req_t *req)
+{
+    esp_err_t ret;
+    char *response_str;
+    cJSON *response = cJSON_CreateObject();
+    cJSON *tasks = cJSON_AddArrayToObject(response, "tasks");
+    cJSON *queues = cJSON_AddArrayToObject(response, "queues");
+    cJSON *rtp = cJSON_AddObjectToObject(response, "rtp");
+    cJSON *object;
+    stats_task_t task;
+    stats_queue_t queue;
+    rtp_stats_t video_stats, audio_stats;
+    size_t i;
+
+    /* CPU usage is in percentage of a core, free stack in bytes */
+    for (i = 0; !stats_task_get(i, &task); i++)
+    {
+        object = cJSON_CreateObject();
+        cJSON_AddStringToObject(object, "name", task.name);
+        cJSON_AddNumberToObject(object, "core", task.core);
+        cJSON_AddNumberToObject(object, "priority", task.priority);
+        cJSON_AddNumberToObject(object, "cpu", task.cpu / 10.0);
+        cJSON_AddNumberToObject(object, "stack_free", task.stack_free);
+        cJSON_AddItemToArray(tasks, object);
+    }
+
+    for (i = 0; !stats_queue_get(i, &queue); i++)
+    {
+        object = cJSON_CreateObject();
+        cJSON_AddStringToObject(object, "name", queue.name);
+        cJSON_AddNumberToObject(object, "size", queue.size);
+        cJSON_AddNumberToObject(object, "depth", queue.depth);
+        cJSON_AddNumberToObject(object, "max_depth", queue.max_depth);
+        cJSON_AddNumberToObject(object, "sent", queue.sent);
+        cJSON_AddNumberToObject(object, "dropped", queue.dropped);
+        cJSON_AddItemToArray(queues, object);
+    }
+
+    rtp_stats_get(&video_stats, &audio_stats);
+    stats_add_rtp_to_response(rtp, "video", &video_stats);
+    stats_add_rtp_to_response(rtp, "audio", &audio_stats);
+
+    response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    ret = httpd_resp_sendstr(req, response_str);
+
+    cJSON_free(response_str);
+    cJSON_Delete(response);
+    return ret;
+}
+
+static void metrics_flush(metrics_writer_t *writer)
+{
+    if (writer->length && writer->err == ESP_OK)
+    {
+        writer->err = httpd_resp_send_chunk(writer->req, writer->buffer,
+            writer->length);
+    }
+    writer->length = 0;
+}
+
+static void metrics_printf(metrics_writer_t *writer, const char *fmt, ...)
+{
+    size_t left = sizeof(writer->buffer) - writer->length;
+    va_list args;
+    int len;
+
+    if (writer->err != ESP_OK)
+        return;
+
+    va_start(args, fmt);
+    len = vsnprintf(writer->buffer + writer->length, left, fmt, args);
+    va_end(args);
+
+    /* Didn't fit, send what's there and render it again */
+    if (len >= 0 && (size_t)len >= left)
+    {
+        metrics_flush(writer);
+        va_start(args, fmt);
+        len = vsnprintf(writer->buffer, sizeof(writer->buffer), fmt, args);
+        va_end(args);
+    }
+
+    if (len < 0 || (size_t)len >= sizeof(writer->buffer))
+    {
+        ESP_LOGW(TAG, "Dropping metric too long to render");
+        return;
+    }
+
+    writer->length += len;
+}
+
+static void metrics_header(metrics_writer_t *writer, const char *name,
+    const char *type, const char *help)
+{
+    metrics_printf(writer, "# HELP ipcam_%s %s\n# TYPE ipcam_%s %s\n", name,
+        help, name, type);
+}
+
+/* Prometheus buckets are cumulative, the values are divided by scale, e.g. to
+ * have microseconds in seconds */
+static void metrics_histogram(metrics_writer_t *writer, const char *name,
+    const char *labels, const stats_histogram_t *histogram, double scale)
+{
+    const char *sep = *labels ? "," : "";
+    uint32_t count = 0;
+    size_t i;
+
+    for (i = 0; i < histogram->count; i++)
+    {
+        count += histogram->buckets[i];
+        metrics_printf(writer, "ipcam_%s_bucket{%s%sle=\"%g\"} %" PRIu32 "\n",
+            name, labels, sep, histogram->bounds[i] / scale, count);
+    }
+    metrics_printf(writer, "ipcam_%s_bucket{%s%sle=\"+Inf\"} %" PRIu32 "\n",
+        name, labels, sep, histogram->total);
+
+    if (*labels)
+    {
+        metrics_printf(writer, "ipcam_%s_sum{%s} %.6f\n", name, labels,
+            histogram->sum / scale);
+        metrics_printf(writer, "ipcam_%s_count{%s} %" PRIu32 "\n", name,
+            labels, histogram->total);
+    }
+    else
+    {
+        metrics_printf(writer, "ipcam_%s_sum %.6f\n", name,
+            histogram->sum / scale);
+        metrics_printf(writer, "ipcam_%s_count %" PRIu32 "\n", name,
+            histogram->total);
+    }
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    static const char *streams[] = { "video", "audio" };
+    static const struct {
+        const char *name;
+        uint32_t caps;
+    } regions[] = {
+        { "internal", MALLOC_CAP_INTERNAL },
+        { "spiram", MALLOC_CAP_SPIRAM },
+    };
+    metrics_writer_t writer = { .req = req, .err = ESP_OK };
+    stats_histogram_t frame_sizes, latency[2];
+    rtp_stats_t rtp[2];
+    stats_task_t task;
+    stats_queue_t queue;
+    uint32_t frames;
+    int fps;
+    int8_t rssi;
+    size_t i;
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    metrics_header(&writer, "uptime_seconds", "counter", "Time since boot");
+    metrics_printf(&writer, "ipcam_uptime_seconds %.3f\n",
+        esp_timer_get_time() / 1000000.0);
+
+    /* Camera */
+    camera_stats_get(&frames, &fps);
+    metrics_header(&writer, "camera_fps", "gauge",
+        "Frame rate currently captured at");
+    metrics_printf(&writer, "ipcam_camera_fps %d\n", fps);
+    metrics_header(&writer, "camera_frames_total", "counter",
+        "Frames captured");
+    metrics_printf(&writer, "ipcam_camera_frames_total %" PRIu32 "\n", frames);
+
+    /* RTP */
+    rtp_stats_get(&rtp[0], &rtp[1]);
+    rtp_histograms_get(&frame_sizes, &latency[0], &latency[1]);
+    metrics_header(&writer, "rtp_frame_size_bytes", "histogram",
+        "Sizes of the video frames sent");
+    metrics_histogram(&writer, "rtp_frame_size_bytes", "", &frame_sizes, 1);
+    metrics_header(&writer, "rtp_latency_seconds", "histogram",
+        "Time from capturing a frame to sending it");
+    metrics_histogram(&writer, "rtp_latency_seconds", "stream=\"video\"",
+        &latency[0], 1000000);
+    metrics_histogram(&writer, "rtp_latency_seconds", "stream=\"audio\"",
+        &latency[1], 1000000);
+    metrics_header(&writer, "rtp_frames_total", "counter", "Frames sent");
+    for (i = 0; i < 2; i++)
+    {
+        metrics_printf(&writer, "ipcam_rtp_frames_total{stream=\"%s\"} %"
+            PRIu32 "\n", streams[i], rtp[i].frames);
+    }
+    metrics_header(&writer, "rtp_packets_total", "counter", "Packets sent");
+    for (i = 0; i < 2; i++)
+    {
+        metrics_printf(&writer, "ipcam_rtp_packets_total{stream=\"%s\"} %"
+            PRIu32 "\n", streams[i], rtp[i].packets);
+    }
+    metrics_header(&writer, "rtp_bytes_total", "counter", "Bytes sent");
+    for (i = 0; i < 2; i++)
+    {
+        metrics_printf(&writer, "ipcam_rtp_bytes_total{stream=\"%s\"} %"
+            PRIu64 "\n", streams[i], rtp[i].bytes);
+    }
+    metrics_header(&writer, "rtp_errors_total", "counter",
+        "Packets that failed sending");
+    for (i = 0; i < 2; i++)
+    {
+        metrics_printf(&writer, "ipcam_rtp_errors_total{stream=\"%s\"} %"
+            PRIu32 "\n", streams[i], rtp[i].errors);
+    }
+
+    /* Queues */
+    metrics_header(&writer, "queue_depth", "gauge", "Items waiting");
+    for (i = 0; !stats_queue_get(i, &queue); i++)
+    {
+        metrics_printf(&writer, "ipcam_queue_depth{queue=\"%s\"} %u\n",
+            queue.name, queue.depth);
+    }
+    metrics_header(&writer, "queue_max_depth", "gauge",
+        "Most items ever waiting");
+    for (i = 0; !stats_queue_get(i, &queue); i++)
+    {
+        metrics_printf(&writer, "ipcam_queue_max_depth{queue=\"%s\"} %u\n",
+            queue.name, queue.max_depth);
+    }
+    metrics_header(&writer, "queue_sent_total", "counter", "Items sent");
+    for (i = 0; !stats_queue_get(i, &queue); i++)
+    {
+        metrics_printf(&writer, "ipcam_queue_sent_total{queue=\"%s\"} %"
+            PRIu32 "\n", queue.name, queue.sent);
+    }
+    metrics_header(&writer, "queue_dropped_total", "counter",
+        "Items dropped since the queue was full");
+    for (i = 0; !stats_queue_get(i, &queue); i++)
+    {
+        metrics_printf(&writer, "ipcam_queue_dropped_total{queue=\"%s\"} %"
+            PRIu32 "\n", queue.name, queue.dropped);
+    }
+
+    /* Tasks */
+    metrics_header(&writer, "task_cpu_ratio", "gauge",
+        "Share of a core used over the last sampling interval");
+    for (i = 0; !stats_task_get(i, &task); i++)
+    {
+        metrics_printf(&writer, "ipcam_task_cpu_ratio{task=\"%s\"} %.3f\n",
+            task.name, task.cpu / 1000.0);
+    }
+    metrics_header(&writer, "task_stack_free_bytes", "gauge",
+        "Least stack ever left free");
+    for (i = 0; !stats_task_get(i, &task); i++)
+    {
+        metrics_printf(&writer, "ipcam_task_stack_free_bytes{task=\"%s\"} %"
+            PRIu32 "\n", task.name, task.stack_free);
+    }
+
+    /* Heap, PSRAM is left out when there's none */
+    metrics_header(&writer, "heap_size_bytes", "gauge", "Heap size");
+    for (i = 0; i < sizeof(regions) / sizeof(regions[0]); i++)
+    {
+        if (heap_caps_get_total_size(regions[i].caps))
+        {
+            metrics_printf(&writer, "ipcam_heap_size_bytes{region=\"%s\"} "
+                "%zu\n", regions[i].name,
+                heap_caps_get_total_size(regions[i].caps));
+        }
+    }
+    metrics_header(&writer, "heap_free_bytes", "gauge", "Heap free");
+    for (i = 0; i < sizeof(regions) / sizeof(regions[0]); i++)
+    {
+        if (heap_caps_get_total_size(regions[i].caps))
+        {
+            metrics_printf(&writer, "ipcam_heap_free_bytes{region=\"%s\"} "
+                "%zu\n", regions[i].name,
+                heap_caps_get_free_size(regions[i].caps));
+        }
+    }
+    metrics_header(&writer, "heap_min_free_bytes", "gauge",
+        "Least heap ever free");
+    for (i = 0; i < sizeof(regions) / sizeof(regions[0]); i++)
+    {
+        if (heap_caps_get_total_size(regions[i].caps))
+        {
+            metrics_printf(&writer, "ipcam_heap_min_free_bytes{region=\"%s\"} "
+                "%zu\n", regions[i].name,
+                heap_caps_get_minimum_free_size(regions[i].caps));
+        }
+    }
+
+    /* Wi-Fi, only when connected to an access point */
+    if (!wifi_rssi_get(&rssi))
+    {
+        metrics_header(&writer, "wifi_rssi_dbm", "gauge",
+            "Signal strength of the access point");
+        metrics_printf(&writer, "ipcam_wifi_rssi_dbm %d\n", rssi);
+    }
+
+    metrics_flush(&writer);
+    if (writer.err != ESP_OK)
+        return writer.err;
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static int trace_http_write(const void *data, size_t length, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, length) != ESP_OK;
+}
+
+static esp_err_t trace_handler(httpd_req_t *req)
+{
+    if (!trace_is_enabled())
+        return httpd_resp_send_404(req);
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition",
+        "attachment; filename=trace.bin");
+    if (trace_dump(trace_http_write, req))
+    {
+        ESP_LOGE(TAG, "Failed sending trace");
+        return ESP_FAIL;
+    }
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 static int register_management_routes(httpd_handle_t server)
 {
     httpd_uri_t uri_restart = {
@@ -79,8 +488,32 @@ static int register_management_routes(httpd_handle_t server)
         .user_ctx = NULL,
     };
 
-    httpd_register_uri_handler(server, &uri_restart);
-    httpd_register_uri_handler(server, &uri_status);
+    httpd_uri_t uri_stats = {
+        .uri      = "/stats",
+        .method   = HTTP_GET,
+        .handler  = stats_handler,
+        .user_ctx = NULL,
+    };
+
+    httpd_uri_t uri_metrics = {
+        .uri      = "/metrics",
+        .method   = HTTP_GET,
+        .handler  = metrics_handler,
+        .user_ctx = NULL,
+    };
+
+    httpd_uri_t uri_trace = {
+        .uri      = "/trace",
+        .method   = HTTP_GET,
+        .handler  = trace_handler,
+        .user_ctx = NULL,
+    };
+
+    uri_handler_register(server, &uri_restart);
+    uri_handler_register(server, &uri_status);
+    uri_handler_register(server, &uri_stats);
+    uri_handler_register(server, &uri_metrics);
+    uri_handler_register(server, &uri_trace);
 
     return 0;
 }
@@ -89,9 +522,17 @@ esp_err_t still_handler(httpd_req_t *req)
 {
     camera_fb_t * fb = NULL;
 
+    /* The camera may be powered down between timelapse frames */
+    if (camera_acquire())
+    {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
     fb = esp_camera_fb_get();
     if (!fb) {
         ESP_LOGE(TAG, "Camera capture failed");
+        camera_release();
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
@@ -101,38 +542,188 @@ esp_err_t still_handler(httpd_req_t *req)
     httpd_resp_send(req, (const char *)fb->buf, fb->len);
 
     esp_camera_fb_return(fb);
+    camera_release();
 
     return ESP_OK;
 }
 
-esp_err_t stream_handler(httpd_req_t *req)
+/* Appended to what's there, it fails once it doesn't fit */
+static int sdp_printf(char *buffer, size_t size, const char *fmt, ...)
 {
-    return httpd_resp_send(req, req->user_ctx, strlen(req->user_ctx));
+    size_t length = strlen(buffer);
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(buffer + length, size - length, fmt, args);
+    va_end(args);
+
+    return len < 0 || (size_t)len >= size - length ? -1 : 0;
 }
 
-static void generate_sdp(char *buffer, const char *stream_host,
+static int generate_sdp(char *buffer, size_t size, const char *stream_host,
     uint16_t stream_video_port, uint16_t stream_audio_port)
 {
-    sprintf(buffer,
+    uint32_t ptime = audio_encoder_packet_duration();
+    char ptime_str[16];
+    int err = 0;
+
+    buffer[0] = '\0';
+    err |= sdp_printf(buffer, size,
         "v=0\n"
         "c=IN IP4 %s\n"
         "m=video %" PRIu16 " RTP/AVP 26\n",
         stream_host, stream_video_port);
 
+    /* Receivers tell the latency test's header extension elements apart by
+     * their URIs, as of RFC8285 */
+    if (rtp_latency_test_is_enabled())
+    {
+        err |= sdp_printf(buffer, size,
+            "a=extmap:%d " RTP_EXT_URI_CAPTURE_TIME "\n"
+            "a=extmap:%d " RTP_EXT_URI_FRAME_NUMBER "\n"
+            "a=extmap:%d " RTP_EXT_URI_QUEUE_DELAY "\n"
+            "a=extmap:%d " RTP_EXT_URI_SEND_DELAY "\n",
+            RTP_EXT_ID_CAPTURE_TIME, RTP_EXT_ID_FRAME_NUMBER,
+            RTP_EXT_ID_QUEUE_DELAY, RTP_EXT_ID_SEND_DELAY);
+    }
+
+    /* G.711 has static payload types, the rtpmap is only informative */
     if (stream_audio_port)
     {
-        sprintf(buffer + strlen(buffer),
-            "m=audio %" PRIu16 " RTP/AVP 97\n"
-            "a=rtpmap:97 opus/48000/2\n",
-            stream_audio_port);
+        switch (audio_encoder_codec_get())
+        {
+        case AUDIO_CODEC_OPUS:
+            err |= sdp_printf(buffer, size,
+                "m=audio %" PRIu16 " RTP/AVP 97\n"
+                "a=rtpmap:97 opus/48000/2\n",
+                stream_audio_port);
+            if (audio_encoder_fec_is_enabled())
+                err |= sdp_printf(buffer, size, "a=fmtp:97 useinbandfec=1\n");
+            break;
+        case AUDIO_CODEC_PCMU:
+            err |= sdp_printf(buffer, size,
+                "m=audio %" PRIu16 " RTP/AVP 0\n"
+                "a=rtpmap:0 PCMU/8000\n",
+                stream_audio_port);
+            break;
+        case AUDIO_CODEC_PCMA:
+            err |= sdp_printf(buffer, size,
+                "m=audio %" PRIu16 " RTP/AVP 8\n"
+                "a=rtpmap:8 PCMA/8000\n",
+                stream_audio_port);
+            break;
+        }
     }
+
+    /* In milliseconds, Opus packets can be 2.5ms long. G.711 doesn't set a
+     * maximum, but the packets are all the same length */
+    if (stream_audio_port && ptime)
+    {
+        if (ptime % 1000)
+        {
+            sprintf(ptime_str, "%" PRIu32 ".%" PRIu32, ptime / 1000,
+                ptime % 1000 / 100);
+        }
+        else
+            sprintf(ptime_str, "%" PRIu32, ptime / 1000);
+
+        err |= sdp_printf(buffer, size,
+            "a=ptime:%s\n"
+            "a=maxptime:%s\n",
+            ptime_str, ptime_str);
+    }
+
+    return err;
+}
+
+/* The SDP is generated on request, once the audio encoder is set up */
+esp_err_t stream_handler(httpd_req_t *req)
+{
+    stream_destination_t *destination = req->user_ctx;
+    char sdp[512];
+
+    if (generate_sdp(sdp, sizeof(sdp), destination->host,
+        destination->video_port, destination->audio_port))
+    {
+        ESP_LOGE(TAG, "SDP too long");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    return httpd_resp_send(req, sdp, strlen(sdp));
+}
+
+static int prebuffer_http_sink(const void *data, size_t length, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, length) != ESP_OK;
+}
+
+esp_err_t prebuffer_handler(httpd_req_t *req)
+{
+    if (!prebuffer_is_enabled())
+        return httpd_resp_send_404(req);
+
+    httpd_resp_set_type(req, "video/x-matroska");
+    if (prebuffer_mkv_dump(prebuffer_http_sink, req))
+    {
+        ESP_LOGE(TAG, "Failed sending pre-event frames");
+        return ESP_FAIL;
+    }
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static int live_http_sink(const void *data, size_t length, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, length) != ESP_OK;
+}
+
+static void live_task(void *pvParameter)
+{
+    httpd_req_t *req = (httpd_req_t *)pvParameter;
+
+    httpd_resp_set_type(req, "video/x-matroska");
+    if (live_stream(live_http_sink, req))
+    {
+        /* Nothing was sent yet, most likely too many clients */
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, NULL, 0);
+    }
+    else
+        httpd_resp_send_chunk(req, NULL, 0);
+
+    httpd_req_async_handler_complete(req);
+    vTaskDelete(NULL);
+}
+
+/* Streaming never ends, so each client is served by its own task to keep the
+ * server responsive */
+esp_err_t live_handler(httpd_req_t *req)
+{
+    httpd_req_t *async_req;
+
+    if (!live_is_enabled())
+        return httpd_resp_send_404(req);
+
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK)
+        return httpd_resp_send_500(req);
+
+    if (task_layout_create(live_task, "live_task", 4096, async_req, 4,
+        NULL, 1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed creating live stream task");
+        httpd_req_async_handler_complete(async_req);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
 }
 
 static int register_camera_routes(httpd_handle_t server,
     const char *stream_host, uint16_t stream_video_port,
     uint16_t stream_audio_port)
 {
-    static char sdp[128];
+    static stream_destination_t destination;
 
     httpd_uri_t uri_still = {
         .uri      = "/still",
@@ -144,13 +735,29 @@ static int register_camera_routes(httpd_handle_t server,
         .uri      = "/stream",
         .method   = HTTP_GET,
         .handler  = stream_handler,
-        .user_ctx = (void *)sdp,
+        .user_ctx = &destination,
+    };
+    httpd_uri_t uri_live = {
+        .uri      = "/live",
+        .method   = HTTP_GET,
+        .handler  = live_handler,
+        .user_ctx = NULL,
+    };
+    httpd_uri_t uri_prebuffer = {
+        .uri      = "/prebuffer",
+        .method   = HTTP_GET,
+        .handler  = prebuffer_handler,
+        .user_ctx = NULL,
     };
 
-    generate_sdp(sdp, stream_host, stream_video_port, stream_audio_port);
+    destination.host = stream_host;
+    destination.video_port = stream_video_port;
+    destination.audio_port = stream_audio_port;
 
-    httpd_register_uri_handler(server, &uri_still);
-    httpd_register_uri_handler(server, &uri_stream);
+    uri_handler_register(server, &uri_still);
+    uri_handler_register(server, &uri_stream);
+    uri_handler_register(server, &uri_live);
+    uri_handler_register(server, &uri_prebuffer);
 
     return 0;
 }
@@ -219,10 +826,10 @@ static int register_ota_routes(httpd_handle_t server)
 
     uri_ota.uri = "/ota/firmware";
     uri_ota.user_ctx = (void *)OTA_TYPE_FIRMWARE;
-    httpd_register_uri_handler(server, &uri_ota);
+    uri_handler_register(server, &uri_ota);
     uri_ota.uri = "/ota/configuration";
     uri_ota.user_ctx = (void *)OTA_TYPE_CONFIG;
-    httpd_register_uri_handler(server, &uri_ota);
+    uri_handler_register(server, &uri_ota);
 
     return 0;
 }
@@ -323,11 +930,114 @@ static esp_err_t fs_serve_directory(httpd_req_t *req, const char *path)
     return ret;
 }
 
+/* Sends part of a file in large chunks, reading into DMA capable memory */
+static esp_err_t file_send(httpd_req_t *req, int fd, char *buffer,
+    uint64_t offset, uint64_t length)
+{
+    while (length)
+    {
+        size_t n = length < FILE_READ_SIZE ? length : FILE_READ_SIZE;
+        ssize_t len = pread(fd, buffer, n, offset);
+        int sent;
+
+        if (len <= 0)
+            return ESP_FAIL;
+
+        offset += len;
+        length -= len;
+        for (sent = 0; sent < len;)
+        {
+            int ret = httpd_send(req, buffer + sent, len - sent);
+
+            if (ret < 0)
+                return ESP_FAIL;
+            sent += ret;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/* Parses a single "bytes=" range, returning the first and last byte */
+static int range_parse(const char *range, uint64_t size, uint64_t *first,
+    uint64_t *last)
+{
+    char *p;
+
+    if (strncmp(range, "bytes=", 6) || !size)
+        return -1;
+    range += 6;
+
+    if (*range == '-')
+    {
+        uint64_t suffix = strtoull(range + 1, &p, 10);
+
+        if (!suffix || *p)
+            return -1;
+        *first = suffix < size ? size - suffix : 0;
+        *last = size - 1;
+        return 0;
+    }
+
+    *first = strtoull(range, &p, 10);
+    if (p == range || *p++ != '-')
+        return -1;
+    *last = *p ? strtoull(p, &p, 10) : size - 1;
+    if (*p)
+        return -1;
+    if (*last >= size)
+        *last = size - 1;
+
+    return *first <= *last ? 0 : -1;
+}
+
+static esp_err_t file_serve(httpd_req_t *req, int fd, uint64_t size,
+    const char *type)
+{
+    char range[64], content_range[64], *buffer;
+    uint64_t first = 0, last = size - 1;
+    esp_err_t ret;
+
+    httpd_resp_set_type(req, type);
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+
+    if (httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) ==
+        ESP_OK)
+    {
+        if (range_parse(range, size, &first, &last))
+        {
+            snprintf(content_range, sizeof(content_range), "bytes */%" PRIu64,
+                size);
+            httpd_resp_set_status(req, "416 Range Not Satisfiable");
+            httpd_resp_set_hdr(req, "Content-Range", content_range);
+            return httpd_resp_send(req, NULL, 0);
+        }
+
+        snprintf(content_range, sizeof(content_range),
+            "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64, first, last, size);
+        httpd_resp_set_status(req, "206 Partial Content");
+        httpd_resp_set_hdr(req, "Content-Range", content_range);
+    }
+
+    if (!size)
+        return httpd_resp_send(req, NULL, 0);
+
+    if (!(buffer = heap_caps_malloc(FILE_READ_SIZE, MALLOC_CAP_DMA)))
+        return httpd_resp_send_500(req);
+
+    httpd_resp_send(req, NULL, last - first + 1);
+    ret = file_send(req, fd, buffer, first, last - first + 1);
+
+    free(buffer);
+    return ret;
+}
+
 static esp_err_t fs_serve_file(httpd_req_t *req, const char *path)
 {
-    char full_path[PATH_MAX], buffer[2048];
+    char full_path[PATH_MAX];
     struct stat st;
-    int fd, len;
+    esp_err_t ret;
+    int fd;
 
     snprintf(full_path, sizeof(full_path), "/spiffs%s", path);
     ESP_LOGD(TAG, "Serving file %s", full_path);
@@ -338,13 +1048,10 @@ static esp_err_t fs_serve_file(httpd_req_t *req, const char *path)
     if ((fd = open(full_path, O_RDONLY)) < 0)
         return httpd_resp_send_500(req);
 
-    httpd_resp_set_type(req, "application/octet-stream");
-    httpd_resp_send(req, NULL, st.st_size);
-    while ((len = read(fd, buffer, sizeof(buffer))) > 0)
-        httpd_send(req, buffer, len);
+    ret = file_serve(req, fd, st.st_size, "application/octet-stream");
 
     close(fd);
-    return len < 0 ? ESP_FAIL : ESP_OK;
+    return ret;
 }
 
 static esp_err_t fs_get_handler(httpd_req_t *req)
@@ -439,15 +1146,255 @@ static int register_fs_routes(httpd_handle_t server)
 
     uri_fs.method = HTTP_GET;
     uri_fs.handler = fs_get_handler;
-    httpd_register_uri_handler(server, &uri_fs);
+    uri_handler_register(server, &uri_fs);
 
     uri_fs.method = HTTP_POST;
     uri_fs.handler = fs_post_handler;
-    httpd_register_uri_handler(server, &uri_fs);
+    uri_handler_register(server, &uri_fs);
 
     uri_fs.method = HTTP_DELETE;
     uri_fs.handler = fs_delete_handler;
-    httpd_register_uri_handler(server, &uri_fs);
+    uri_handler_register(server, &uri_fs);
+
+    return 0;
+}
+
+static esp_err_t recordings_list_handler(httpd_req_t *req)
+{
+    recorder_segment_info_t info;
+    struct dirent *entry;
+    char query[64], value[24], name[16], *response_str;
+    int64_t from = 0, to = INT64_MAX;
+    cJSON *response;
+    esp_err_t ret;
+    DIR *dir;
+
+    if (!recorder_is_enabled())
+        return httpd_resp_send_404(req);
+
+    /* Optional time range, in seconds since the epoch */
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+    {
+        if (httpd_query_key_value(query, "from", value, sizeof(value)) ==
+            ESP_OK)
+        {
+            from = strtoll(value, NULL, 10) * 1000;
+        }
+        if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK)
+            to = strtoll(value, NULL, 10) * 1000;
+    }
+
+    if (!(dir = opendir(recorder_path_get())))
+        return httpd_resp_send_500(req);
+
+    response = cJSON_CreateArray();
+    while ((entry = readdir(dir)))
+    {
+        cJSON *object;
+        char *ext;
+        uint32_t number = strtoul(entry->d_name, &ext, 10);
+
+        if (strcasecmp(ext, ".mkv") || recorder_segment_info_get(number, &info))
+            continue;
+
+        if (info.start_time + info.duration < from || info.start_time > to)
+            continue;
+
+        snprintf(name, sizeof(name), "%08" PRIu32 ".mkv", number);
+        object = cJSON_CreateObject();
+        cJSON_AddStringToObject(object, "name", name);
+        cJSON_AddNumberToObject(object, "start_time", info.start_time);
+        cJSON_AddNumberToObject(object, "duration", info.duration);
+        cJSON_AddNumberToObject(object, "size", info.size);
+        cJSON_AddItemToArray(response, object);
+    }
+    closedir(dir);
+
+    response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    ret = httpd_resp_sendstr(req, response_str);
+
+    cJSON_free(response_str);
+    cJSON_Delete(response);
+    return ret;
+}
+
+/* Plays from a given time by sending the headers followed by the clusters
+ * starting at that time */
+static esp_err_t recording_seek(httpd_req_t *req, int fd, uint32_t number,
+    const recorder_segment_info_t *info, int64_t time)
+{
+    uint64_t offset;
+    esp_err_t ret;
+    char *buffer;
+
+    if (recorder_segment_seek(number, time, &offset) || offset > info->size)
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+
+    if (!(buffer = heap_caps_malloc(FILE_READ_SIZE, MALLOC_CAP_DMA)))
+        return httpd_resp_send_500(req);
+
+    httpd_resp_set_type(req, "video/x-matroska");
+    httpd_resp_send(req, NULL, info->header_size + info->size - offset);
+    ret = file_send(req, fd, buffer, 0, info->header_size);
+    if (ret == ESP_OK)
+        ret = file_send(req, fd, buffer, offset, info->size - offset);
+
+    free(buffer);
+    return ret;
+}
+
+static esp_err_t recording_handler(httpd_req_t *req)
+{
+    const char *name = req->uri + strlen("/recordings/");
+    recorder_segment_info_t info;
+    char file_name[PATH_MAX], query[32], value[16], *ext;
+    uint32_t number = strtoul(name, &ext, 10);
+    esp_err_t ret;
+    int fd;
+
+    ESP_LOGD(TAG, "Handling GET for recording: '%s'", name);
+
+    if (!recorder_is_enabled() || ext == name || strncasecmp(ext, ".mkv", 4) ||
+        (ext[4] && ext[4] != '?') || recorder_segment_info_get(number, &info))
+    {
+        return httpd_resp_send_404(req);
+    }
+
+    snprintf(file_name, sizeof(file_name), "%s/%08" PRIu32 ".mkv",
+        recorder_path_get(), number);
+    if ((fd = open(file_name, O_RDONLY)) < 0)
+        return httpd_resp_send_500(req);
+
+    /* Seek to a time, in seconds since the start of the recording */
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "t", value, sizeof(value)) == ESP_OK)
+    {
+        ret = recording_seek(req, fd, number, &info,
+            strtod(value, NULL) * 1000);
+    }
+    else
+        ret = file_serve(req, fd, info.size, "video/x-matroska");
+
+    close(fd);
+    return ret;
+}
+
+static int register_recording_routes(httpd_handle_t server)
+{
+    httpd_uri_t uri_recordings = {
+        .uri      = "/recordings",
+        .method   = HTTP_GET,
+        .handler  = recordings_list_handler,
+        .user_ctx = NULL,
+    };
+    httpd_uri_t uri_recording = {
+        .uri      = "/recordings/*",
+        .method   = HTTP_GET,
+        .handler  = recording_handler,
+        .user_ctx = NULL,
+    };
+
+    uri_handler_register(server, &uri_recordings);
+    uri_handler_register(server, &uri_recording);
+
+    return 0;
+}
+
+static esp_err_t timelapse_list_handler(httpd_req_t *req)
+{
+    struct dirent *entry;
+    struct stat st;
+    char file_name[PATH_MAX], *response_str, *ext;
+    cJSON *response;
+    esp_err_t ret;
+    DIR *dir;
+
+    if (!timelapse_is_enabled())
+        return httpd_resp_send_404(req);
+
+    if (!(dir = opendir(timelapse_path_get())))
+        return httpd_resp_send_500(req);
+
+    response = cJSON_CreateArray();
+    while ((entry = readdir(dir)))
+    {
+        cJSON *object;
+
+        strtoul(entry->d_name, &ext, 10);
+        if (ext == entry->d_name || strcasecmp(ext, ".mkv"))
+            continue;
+
+        snprintf(file_name, sizeof(file_name), "%s/%s", timelapse_path_get(),
+            entry->d_name);
+        if (stat(file_name, &st))
+            continue;
+
+        object = cJSON_CreateObject();
+        cJSON_AddStringToObject(object, "name", entry->d_name);
+        cJSON_AddNumberToObject(object, "size", st.st_size);
+        cJSON_AddItemToArray(response, object);
+    }
+    closedir(dir);
+
+    response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    ret = httpd_resp_sendstr(req, response_str);
+
+    cJSON_free(response_str);
+    cJSON_Delete(response);
+    return ret;
+}
+
+static esp_err_t timelapse_handler(httpd_req_t *req)
+{
+    const char *name = req->uri + strlen("/timelapse/");
+    char file_name[PATH_MAX], *ext;
+    uint32_t number = strtoul(name, &ext, 10);
+    struct stat st;
+    esp_err_t ret;
+    int fd;
+
+    ESP_LOGD(TAG, "Handling GET for timelapse: '%s'", name);
+
+    if (!timelapse_is_enabled() || ext == name || strncasecmp(ext, ".mkv", 4) ||
+        (ext[4] && ext[4] != '?'))
+    {
+        return httpd_resp_send_404(req);
+    }
+
+    snprintf(file_name, sizeof(file_name), "%s/%08" PRIu32 ".mkv",
+        timelapse_path_get(), number);
+    if ((fd = open(file_name, O_RDONLY)) < 0)
+        return httpd_resp_send_404(req);
+
+    /* The clip being captured can be downloaded too, up to its last frame */
+    if (fstat(fd, &st))
+        ret = httpd_resp_send_500(req);
+    else
+        ret = file_serve(req, fd, st.st_size, "video/x-matroska");
+
+    close(fd);
+    return ret;
+}
+
+static int register_timelapse_routes(httpd_handle_t server)
+{
+    httpd_uri_t uri_timelapse_list = {
+        .uri      = "/timelapse",
+        .method   = HTTP_GET,
+        .handler  = timelapse_list_handler,
+        .user_ctx = NULL,
+    };
+    httpd_uri_t uri_timelapse = {
+        .uri      = "/timelapse/*",
+        .method   = HTTP_GET,
+        .handler  = timelapse_handler,
+        .user_ctx = NULL,
+    };
+
+    uri_handler_register(server, &uri_timelapse_list);
+    uri_handler_register(server, &uri_timelapse);
 
     return 0;
 }
@@ -477,7 +1424,7 @@ static int register_static_routes(httpd_handle_t server)
         ESP_LOGD(TAG, "Registerting route %s", static_file->path);
         uri_static_file.uri = static_file->path;
         uri_static_file.user_ctx = static_file;
-        httpd_register_uri_handler(server, &uri_static_file);
+        uri_handler_register(server, &uri_static_file);
     }
 
     return 0;
@@ -491,7 +1438,7 @@ int httpd_initialize(const char *stream_host, uint16_t stream_video_port,
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn = httpd_uri_match_wildcard;
 
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = MAX_URI_HANDLERS;
     config.stack_size = 8192;
     config.lru_purge_enable = 1;
     ESP_ERROR_CHECK(httpd_start(&server, &config));
@@ -501,6 +1448,8 @@ int httpd_initialize(const char *stream_host, uint16_t stream_video_port,
     register_camera_routes(server, stream_host, stream_video_port, stream_audio_port);
     register_ota_routes(server);
     register_fs_routes(server);
+    register_recording_routes(server);
+    register_timelapse_routes(server);
     register_static_routes(server);
 
     return 0;
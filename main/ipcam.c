@@ -1,18 +1,32 @@
 #include "audio_encoder.h"
+#include "audio_processor.h"
 #include "camera.h"
 #include "config.h"
 #include "eth.h"
 #include "httpd.h"
+#include "live.h"
 #include "log.h"
 #include "microphone.h"
+#include "motion_detector.h"
 #include "motion_sensor.h"
 #include "mqtt.h"
 #include "ota.h"
+#include "prebuffer.h"
+#include "recorder.h"
 #include "resolve.h"
 #include "rtp.h"
+#include "sdcard.h"
+#include "sound_detector.h"
+#include "stats.h"
+#include "suppressor.h"
+#include "talkback.h"
+#include "task_layout.h"
+#include "timelapse.h"
+#include "trace.h"
 #include "wifi.h"
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_netif_sntp.h>
 #include <esp_system.h>
 #include <esp_timer.h>
 #include <nvs.h>
@@ -22,6 +36,7 @@
 #include <freertos/queue.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define MAX_TOPIC_LEN 256
@@ -54,10 +69,101 @@ static const char *device_name_get(void)
 }
 
 /* Bookkeeping functions */
+/* Task, queue and RTP stats, to tell which stage of the pipeline falls
+ * behind */
+static void stats_publish(void)
+{
+    char topic[MAX_TOPIC_LEN];
+    char buf[24];
+    stats_task_t task;
+    stats_queue_t queue;
+    rtp_stats_t video_stats, audio_stats;
+    size_t i;
+
+    /* CPU usage (percentage of a core) and least free stack (in bytes) */
+    for (i = 0; !stats_task_get(i, &task); i++)
+    {
+        sprintf(buf, "%u.%u", task.cpu / 10, task.cpu % 10);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Tasks/%s/Cpu", device_name_get(),
+            task.name);
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, task.stack_free);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Tasks/%s/StackFree",
+            device_name_get(), task.name);
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    /* Current and maximal queue depths, and items dropped since it was full */
+    for (i = 0; !stats_queue_get(i, &queue); i++)
+    {
+        sprintf(buf, "%u", queue.depth);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Queues/%s/Depth", device_name_get(),
+            queue.name);
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%u", queue.max_depth);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Queues/%s/MaxDepth",
+            device_name_get(), queue.name);
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, queue.dropped);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Queues/%s/Dropped",
+            device_name_get(), queue.name);
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    /* Frames sent over RTP, and packets sent and failed sending */
+    rtp_stats_get(&video_stats, &audio_stats);
+    sprintf(buf, "%" PRIu32, video_stats.frames);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Rtp/Video/Frames", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+    sprintf(buf, "%" PRIu32, video_stats.packets);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Rtp/Video/Packets", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+    sprintf(buf, "%" PRIu32, video_stats.errors);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Rtp/Video/Errors", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+
+    if (!microphone_is_enabled())
+        return;
+
+    sprintf(buf, "%" PRIu32, audio_stats.frames);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Rtp/Audio/Frames", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+    sprintf(buf, "%" PRIu32, audio_stats.packets);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Rtp/Audio/Packets", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+    sprintf(buf, "%" PRIu32, audio_stats.errors);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Rtp/Audio/Errors", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+}
+
 static void heartbeat_publish(void)
 {
     char topic[MAX_TOPIC_LEN];
-    char buf[16];
+    char buf[24];
+    uint64_t idle_time, active_time, bytes_saved;
+    uint32_t frames_sent, frames_suppressed;
+    uint32_t timelapse_frames, awake_time, energy;
+    uint32_t frames_written, frames_dropped, sync_failures;
+    uint32_t pcm_allocations, pcm_exhaustions, pcm_overruns;
+    pool_stats_t packet_stats;
+    size_t max_packet_length;
+    uint8_t load, complexity;
+    uint32_t bitrate, packets_suppressed;
+    uint64_t dtx_bytes_saved;
+    int8_t rms, peak;
+    jitter_buffer_stats_t talkback_stats;
+    uint32_t talkback_latency;
 
     /* Only publish uptime when connected, we don't want it to be queued */
     if (!mqtt_is_connected())
@@ -74,6 +180,204 @@ static void heartbeat_publish(void)
     snprintf(topic, MAX_TOPIC_LEN, "%s/FreeMemory", device_name_get());
     mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
         config_mqtt_retained_get());
+
+    /* Time spent in idle/active frame rate (in seconds) */
+    camera_state_time_get(&idle_time, &active_time);
+    sprintf(buf, "%" PRIu64, idle_time / 1000 / 1000);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/FrameRate/IdleTime", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+    sprintf(buf, "%" PRIu64, active_time / 1000 / 1000);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/FrameRate/ActiveTime",
+        device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+
+    stats_publish();
+
+    if (microphone_is_enabled())
+    {
+        /* PCM buffers used, times none were available and times the DMA
+         * buffers overran */
+        microphone_stats_get(&pcm_allocations, &pcm_exhaustions,
+            &pcm_overruns);
+        sprintf(buf, "%" PRIu32, pcm_allocations);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Microphone/Buffers/Allocations",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, pcm_exhaustions);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Microphone/Buffers/Exhausted",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, pcm_overruns);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Microphone/Overruns",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+
+        /* Opus packets in use at most, times none were available and the
+         * largest packet (in bytes) */
+        audio_encoder_stats_get(&packet_stats, &max_packet_length);
+        sprintf(buf, "%zu", packet_stats.high_water);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/Packets/HighWater",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, packet_stats.exhaustions);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/Packets/Exhausted",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%zu", max_packet_length);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/Packets/MaxSize",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+
+        /* Encoder CPU load (percentage) and what it was adjusted to */
+        audio_encoder_load_get(&load, &complexity, &bitrate);
+        sprintf(buf, "%u", load);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/Load", device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%u", complexity);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/Complexity",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, bitrate);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/Bitrate", device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+
+        /* Audio packet loss (percentage) FEC is currently sized for */
+        if (audio_encoder_fec_is_enabled())
+        {
+            sprintf(buf, "%u", rtp_audio_loss_get());
+            snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/PacketLoss",
+                device_name_get());
+            mqtt_publish(topic, (uint8_t *)buf, strlen(buf),
+                config_mqtt_qos_get(), config_mqtt_retained_get());
+        }
+
+        /* Silent packets and bytes that weren't sent */
+        rtp_opus_stats_get(&packets_suppressed, &dtx_bytes_saved);
+        sprintf(buf, "%" PRIu32, packets_suppressed);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/DTX/PacketsSaved",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu64, dtx_bytes_saved);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Opus/DTX/BytesSaved",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    if (sound_detector_is_enabled())
+    {
+        /* Average RMS and maximal peak sound levels (in dBFS) */
+        sound_detector_levels_get(&rms, &peak);
+        sprintf(buf, "%d", rms);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/SoundLevel/Rms", device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%d", peak);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/SoundLevel/Peak",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    if (talkback_is_enabled())
+    {
+        /* Talkback latency and jitter (in ms), and packets lost, late and
+         * times playback ran dry */
+        talkback_stats_get(&talkback_stats, &talkback_latency);
+        sprintf(buf, "%" PRIu32, talkback_latency / 1000);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Talkback/Latency",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, talkback_stats.jitter / 1000);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Talkback/Jitter",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, talkback_stats.lost);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Talkback/Lost", device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, talkback_stats.late);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Talkback/Late", device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, talkback_stats.underruns);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Talkback/Underruns",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    if (timelapse_is_enabled())
+    {
+        /* Timelapse frames, time awake (in ms) and energy (in mJ) per frame */
+        timelapse_stats_get(&timelapse_frames, &awake_time, &energy);
+        sprintf(buf, "%" PRIu32, timelapse_frames);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Timelapse/Frames",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, awake_time);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Timelapse/AwakeTime",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, energy);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Timelapse/Energy",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    if (recorder_is_enabled())
+    {
+        /* Frames recorded and dropped, and failed syncs to the card */
+        recorder_stats_get(&frames_written, &frames_dropped, &sync_failures);
+        sprintf(buf, "%" PRIu32, frames_written);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Recorder/Frames/Written",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, frames_dropped);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Recorder/Frames/Dropped",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+        sprintf(buf, "%" PRIu32, sync_failures);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/Recorder/SyncFailures",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    if (!suppressor_is_enabled())
+        return;
+
+    /* Static scene suppression ratio (percentage) and bytes saved */
+    suppressor_stats_get(&frames_sent, &frames_suppressed, &bytes_saved);
+    sprintf(buf, "%" PRIu32, frames_sent + frames_suppressed ?
+        frames_suppressed * 100 / (frames_sent + frames_suppressed) : 0);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Suppression/Ratio", device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+    sprintf(buf, "%" PRIu64, bytes_saved);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Suppression/BytesSaved",
+        device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
 }
 
 static void self_publish(void)
@@ -197,10 +501,26 @@ static void management_on_capture_mqtt(const char *topic,
     }
 }
 
+static void management_on_profile_mqtt(const char *topic,
+    const uint8_t *payload, size_t len, void *ctx)
+{
+    char buf[8];
+
+    /* Payload is the number of seconds to profile for */
+    if (!len || len >= sizeof(buf))
+        return;
+
+    memcpy(buf, payload, len);
+    buf[len] = '\0';
+    task_layout_profile(atoi(buf));
+}
+
 static void _management_on_restart_mqtt(const char *topic,
     const uint8_t *payload, size_t len, void *ctx);
 static void _management_on_capture_mqtt(const char *topic,
     const uint8_t *payload, size_t len, void *ctx);
+static void _management_on_profile_mqtt(const char *topic,
+    const uint8_t *payload, size_t len, void *ctx);
 
 static void management_subscribe(void)
 {
@@ -213,12 +533,18 @@ static void management_subscribe(void)
 
     snprintf(topic, MAX_TOPIC_LEN, "%s/Capture", device_name_get());
     mqtt_subscribe(topic, 0, _management_on_capture_mqtt, NULL, NULL);
+
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Profile", device_name_get());
+    mqtt_subscribe(topic, 0, _management_on_profile_mqtt, NULL, NULL);
 }
 
 static void management_unsubscribe(void)
 {
     char topic[MAX_TOPIC_LEN];
 
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Profile", device_name_get());
+    mqtt_unsubscribe(topic);
+
     snprintf(topic, MAX_TOPIC_LEN, "%s/Capture", device_name_get());
     mqtt_unsubscribe(topic);
 
@@ -288,15 +614,46 @@ static void mqtt_on_disconnected(void)
     }
 }
 
-/* Motion sensor callback functions */
-static void motion_sensor_on_trigger(int pin, int level)
+/* Event trigger functions, the camera and recorder stay active while any
+ * source is triggered */
+typedef enum {
+    TRIGGER_MOTION_SENSOR = 1 << 0,
+    TRIGGER_MOTION_DETECTOR = 1 << 1,
+    TRIGGER_SOUND = 1 << 2,
+} trigger_t;
+
+#define TRIGGER_MOTION (TRIGGER_MOTION_SENSOR | TRIGGER_MOTION_DETECTOR)
+
+static uint8_t event_triggers = 0;
+
+static void event_trigger_set(trigger_t trigger, int level)
 {
+    if (level)
+        event_triggers |= trigger;
+    else
+        event_triggers &= ~trigger;
+
+    camera_motion_set(!!event_triggers);
+    if (level)
+        prebuffer_trigger();
+    recorder_motion_set(!!event_triggers);
+}
+
+/* Motion is reported while either the sensor or the detector is triggered,
+ * so one clearing doesn't end the other's event */
+static void motion_trigger_set(trigger_t trigger, int level)
+{
+    uint8_t was_detected = !!(event_triggers & TRIGGER_MOTION);
     char topic[MAX_TOPIC_LEN];
     char *payload = "false";
     size_t len = 5;
 
+    event_trigger_set(trigger, level);
+    if (!!(event_triggers & TRIGGER_MOTION) == was_detected)
+        return;
+
     snprintf(topic, MAX_TOPIC_LEN, "%s/MotionDetected", device_name_get());
-    if (level)
+    if (!was_detected)
     {
         payload = "true";
         len = 4;
@@ -306,6 +663,76 @@ static void motion_sensor_on_trigger(int pin, int level)
         config_mqtt_retained_get());
 }
 
+/* Motion sensor callback functions */
+static void motion_sensor_on_trigger(int pin, int level)
+{
+    motion_trigger_set(TRIGGER_MOTION_SENSOR, level);
+}
+
+/* Motion detector callback functions */
+static void motion_detector_on_trigger(uint8_t detected, uint8_t score,
+    uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    char topic[MAX_TOPIC_LEN];
+    char buf[32];
+
+    /* Score (percentage of the frame that changed) */
+    sprintf(buf, "%u", score);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/MotionDetected/Score",
+        device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+
+    /* Bounding box of the changed area (in pixels) */
+    if (detected)
+    {
+        sprintf(buf, "%u,%u,%u,%u", x, y, width, height);
+        snprintf(topic, MAX_TOPIC_LEN, "%s/MotionDetected/BoundingBox",
+            device_name_get());
+        mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+            config_mqtt_retained_get());
+    }
+
+    motion_trigger_set(TRIGGER_MOTION_DETECTOR, detected);
+}
+
+/* Sound detector callback functions */
+static void sound_detector_on_trigger(uint8_t detected, int8_t level)
+{
+    char topic[MAX_TOPIC_LEN];
+    char buf[8];
+    char *payload = "false";
+    size_t len = 5;
+
+    /* Level (in dBFS) that started or ended the event */
+    sprintf(buf, "%d", level);
+    snprintf(topic, MAX_TOPIC_LEN, "%s/SoundDetected/Level",
+        device_name_get());
+    mqtt_publish(topic, (uint8_t *)buf, strlen(buf), config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+
+    snprintf(topic, MAX_TOPIC_LEN, "%s/SoundDetected", device_name_get());
+    if (detected)
+    {
+        payload = "true";
+        len = 4;
+    }
+    ESP_LOGI(TAG, "Sound detected: %s", payload);
+    event_trigger_set(TRIGGER_SOUND, detected);
+    mqtt_publish(topic, (uint8_t *)payload, len, config_mqtt_qos_get(),
+        config_mqtt_retained_get());
+}
+
+/* Task layout callback functions */
+static void task_layout_on_profile(const char *report)
+{
+    char topic[MAX_TOPIC_LEN];
+
+    snprintf(topic, MAX_TOPIC_LEN, "%s/Profile/Report", device_name_get());
+    mqtt_publish(topic, (uint8_t *)report, strlen(report),
+        config_mqtt_qos_get(), config_mqtt_retained_get());
+}
+
 /* IPCAM task and event callbacks */
 typedef enum {
     EVENT_TYPE_HEARTBEAT_TIMER,
@@ -315,9 +742,13 @@ typedef enum {
     EVENT_TYPE_OTA_COMPLETED,
     EVENT_TYPE_MANAGEMENT_RESTART_MQTT,
     EVENT_TYPE_MANAGEMENT_CAPTURE_MQTT,
+    EVENT_TYPE_MANAGEMENT_PROFILE_MQTT,
     EVENT_TYPE_MQTT_CONNECTED,
     EVENT_TYPE_MQTT_DISCONNECTED,
     EVENT_TYPE_MOTION_SENSOR_TRIGGERED,
+    EVENT_TYPE_MOTION_DETECTOR_TRIGGERED,
+    EVENT_TYPE_SOUND_DETECTOR_TRIGGERED,
+    EVENT_TYPE_TASK_PROFILE_COMPLETED,
 } event_type_t;
 
 typedef struct {
@@ -337,10 +768,32 @@ typedef struct {
             int pin;
             int level;
         } motion_sensor_triggered;
+        struct {
+            uint8_t detected;
+            uint8_t score;
+            uint16_t x;
+            uint16_t y;
+            uint16_t width;
+            uint16_t height;
+        } motion_detector_triggered;
+        struct {
+            uint8_t detected;
+            int8_t level;
+        } sound_detector_triggered;
+        struct {
+            char *report;
+        } task_profile_completed;
     };
 } event_t;
 
 static QueueHandle_t event_queue;
+static stats_queue_t *event_queue_stats;
+
+static void event_queue_send(event_t *event)
+{
+    stats_queue_sent(event_queue_stats,
+        xQueueSend(event_queue, &event, portMAX_DELAY));
+}
 
 static void ipcam_handle_event(event_t *event)
 {
@@ -378,6 +831,13 @@ static void ipcam_handle_event(event_t *event)
         free(event->mqtt_message.topic);
         free(event->mqtt_message.payload);
         break;
+    case EVENT_TYPE_MANAGEMENT_PROFILE_MQTT:
+        management_on_profile_mqtt(event->mqtt_message.topic,
+            event->mqtt_message.payload, event->mqtt_message.len,
+            event->mqtt_message.ctx);
+        free(event->mqtt_message.topic);
+        free(event->mqtt_message.payload);
+        break;
     case EVENT_TYPE_MQTT_CONNECTED:
         mqtt_on_connected();
         break;
@@ -388,6 +848,22 @@ static void ipcam_handle_event(event_t *event)
         motion_sensor_on_trigger(event->motion_sensor_triggered.pin,
             event->motion_sensor_triggered.level);
         break;
+    case EVENT_TYPE_MOTION_DETECTOR_TRIGGERED:
+        motion_detector_on_trigger(event->motion_detector_triggered.detected,
+            event->motion_detector_triggered.score,
+            event->motion_detector_triggered.x,
+            event->motion_detector_triggered.y,
+            event->motion_detector_triggered.width,
+            event->motion_detector_triggered.height);
+        break;
+    case EVENT_TYPE_SOUND_DETECTOR_TRIGGERED:
+        sound_detector_on_trigger(event->sound_detector_triggered.detected,
+            event->sound_detector_triggered.level);
+        break;
+    case EVENT_TYPE_TASK_PROFILE_COMPLETED:
+        task_layout_on_profile(event->task_profile_completed.report);
+        free(event->task_profile_completed.report);
+        break;
     }
 
     free(event);
@@ -415,7 +891,7 @@ static void heartbeat_timer_cb(TimerHandle_t xTimer)
     event->type = EVENT_TYPE_HEARTBEAT_TIMER;
 
     ESP_LOGD(TAG, "Queuing event HEARTBEAT_TIMER");
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
 }
 
 static int start_ipcam_task(void)
@@ -424,8 +900,9 @@ static int start_ipcam_task(void)
 
     if (!(event_queue = xQueueCreate(10, sizeof(event_t *))))
         return -1;
+    event_queue_stats = stats_queue_register("ipcam_events", event_queue);
 
-    if (xTaskCreatePinnedToCore(ipcam_task, "ipcam_task", 4096, NULL, 5, NULL,
+    if (task_layout_create(ipcam_task, "ipcam_task", 4096, NULL, 5, NULL,
         1) != pdPASS)
     {
         return -1;
@@ -452,7 +929,7 @@ static void _mqtt_on_message(event_type_t type, const char *topic,
 
     ESP_LOGD(TAG, "Queuing event MQTT message %d (%s, %p, %u, %p)", type, topic,
         payload, len, ctx);
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
 }
 
 static void _network_on_connected(void)
@@ -462,7 +939,7 @@ static void _network_on_connected(void)
     event->type = EVENT_TYPE_NETWORK_CONNECTED;
 
     ESP_LOGD(TAG, "Queuing event NETWORK_CONNECTED");
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
 }
 
 static void _network_on_disconnected(void)
@@ -472,7 +949,7 @@ static void _network_on_disconnected(void)
     event->type = EVENT_TYPE_NETWORK_DISCONNECTED;
 
     ESP_LOGD(TAG, "Queuing event NETWORK_DISCONNECTED");
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
 }
 
 static void _ota_on_mqtt(const char *topic, const uint8_t *payload, size_t len,
@@ -490,7 +967,7 @@ static void _ota_on_completed(ota_type_t type, ota_err_t err)
     event->ota_completed.err = err;
 
     ESP_LOGD(TAG, "Queuing event HEARTBEAT_TIMER (%d, %d)", type, err);
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
 }
 
 static void _management_on_restart_mqtt(const char *topic,
@@ -507,6 +984,13 @@ static void _management_on_capture_mqtt(const char *topic,
         ctx);
 }
 
+static void _management_on_profile_mqtt(const char *topic,
+    const uint8_t *payload, size_t len, void *ctx)
+{
+    _mqtt_on_message(EVENT_TYPE_MANAGEMENT_PROFILE_MQTT, topic, payload, len,
+        ctx);
+}
+
 static void _mqtt_on_connected(void)
 {
     event_t *event = malloc(sizeof(*event));
@@ -514,7 +998,7 @@ static void _mqtt_on_connected(void)
     event->type = EVENT_TYPE_MQTT_CONNECTED;
 
     ESP_LOGD(TAG, "Queuing event MQTT_CONNECTED");
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
 }
 
 static void _mqtt_on_disconnected(void)
@@ -524,7 +1008,7 @@ static void _mqtt_on_disconnected(void)
     event->type = EVENT_TYPE_MQTT_DISCONNECTED;
 
     ESP_LOGD(TAG, "Queuing event MQTT_DISCONNECTED");
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
 }
 
 static void _motion_sensor_triggered(int pin, int level)
@@ -536,7 +1020,69 @@ static void _motion_sensor_triggered(int pin, int level)
     event->motion_sensor_triggered.level = level;
 
     ESP_LOGD(TAG, "Queuing event MOTION_SENSOR_TRIGGERED");
-    xQueueSend(event_queue, &event, portMAX_DELAY);
+    event_queue_send(event);
+}
+
+static void _motion_detector_triggered(uint8_t detected, uint8_t score,
+    uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    event_t *event = malloc(sizeof(*event));
+
+    event->type = EVENT_TYPE_MOTION_DETECTOR_TRIGGERED;
+    event->motion_detector_triggered.detected = detected;
+    event->motion_detector_triggered.score = score;
+    event->motion_detector_triggered.x = x;
+    event->motion_detector_triggered.y = y;
+    event->motion_detector_triggered.width = width;
+    event->motion_detector_triggered.height = height;
+
+    ESP_LOGD(TAG, "Queuing event MOTION_DETECTOR_TRIGGERED");
+    event_queue_send(event);
+}
+
+static void _sound_detector_triggered(uint8_t detected, int8_t level)
+{
+    event_t *event = malloc(sizeof(*event));
+
+    event->type = EVENT_TYPE_SOUND_DETECTOR_TRIGGERED;
+    event->sound_detector_triggered.detected = detected;
+    event->sound_detector_triggered.level = level;
+
+    ESP_LOGD(TAG, "Queuing event SOUND_DETECTOR_TRIGGERED");
+    event_queue_send(event);
+}
+
+static void _task_layout_on_profile(const char *report)
+{
+    event_t *event = malloc(sizeof(*event));
+
+    event->type = EVENT_TYPE_TASK_PROFILE_COMPLETED;
+    event->task_profile_completed.report = strdup(report);
+
+    ESP_LOGD(TAG, "Queuing event TASK_PROFILE_COMPLETED");
+    event_queue_send(event);
+}
+
+/* Sample rate of the encoded audio, or 0 if there's no microphone */
+static uint32_t audio_sample_rate_get(void)
+{
+    if (config_microphone_clk_get() == -1 || config_microphone_din_get() == -1)
+        return 0;
+
+    return config_microphone_sample_rate_get();
+}
+
+/* Sample rate of the audio in recordings and live streams, which only hold
+ * Opus */
+static uint32_t recorded_audio_sample_rate_get(void)
+{
+    if (audio_encoder_atocodec(config_microphone_codec_get()) !=
+        AUDIO_CODEC_OPUS)
+    {
+        return 0;
+    }
+
+    return audio_sample_rate_get();
 }
 
 void app_main()
@@ -556,6 +1102,15 @@ void app_main()
     /* Init configuration */
     config_failed = config_initialize();
 
+    /* Init task layout profiling */
+    task_layout_set_on_profile(_task_layout_on_profile);
+
+    /* Init stats, sampling task usage every 10 seconds */
+    ESP_ERROR_CHECK(stats_initialize(10));
+
+    /* Init pipeline tracing */
+    ESP_ERROR_CHECK(trace_initialize(config_trace_records_get()));
+
     /* Init remote logging */
     ESP_ERROR_CHECK(log_initialize());
 
@@ -581,6 +1136,11 @@ void app_main()
         break;
     }
 
+    /* Init time synchronization, used for timestamping recordings */
+    esp_sntp_config_t sntp_config =
+        ESP_NETIF_SNTP_DEFAULT_CONFIG(config_network_ntp_server_get());
+    ESP_ERROR_CHECK(esp_netif_sntp_init(&sntp_config));
+
     /* Init mDNS */
     ESP_ERROR_CHECK(mdns_init());
     mdns_hostname_set(device_name_get());
@@ -602,6 +1162,40 @@ void app_main()
     ESP_ERROR_CHECK(motion_sensor_initialize(config_motion_sensor_pin_get()));
     motion_sensor_set_on_trigger(_motion_sensor_triggered);
 
+    /* Init motion detector */
+    ESP_ERROR_CHECK(motion_detector_initialize(
+        config_motion_detector_threshold_get(),
+        config_motion_detector_area_get()));
+    motion_detector_set_on_trigger(_motion_detector_triggered);
+
+    /* Init static scene suppression */
+    ESP_ERROR_CHECK(suppressor_initialize(
+        config_rtp_suppression_threshold_get(),
+        config_rtp_suppression_keyframe_interval_get()));
+
+    /* Init pre-event buffer */
+    ESP_ERROR_CHECK(prebuffer_initialize(config_prebuffer_size_get(),
+        config_prebuffer_seconds_get(), config_camera_fps_get(),
+        recorded_audio_sample_rate_get()));
+
+    /* Init SD card */
+    ESP_ERROR_CHECK(sdcard_initialize("/sdcard", config_sdcard_clk_get(),
+        config_sdcard_mosi_get(), config_sdcard_miso_get(),
+        config_sdcard_cs_get()));
+
+    /* Init recorder */
+    ESP_ERROR_CHECK(recorder_initialize(config_recorder_path_get(),
+        recorder_atomode(config_recorder_mode_get()),
+        config_recorder_segment_duration_get(),
+        config_recorder_hold_time_get(), config_recorder_buffer_size_get(),
+        config_recorder_preallocate_get(),
+        recorded_audio_sample_rate_get()));
+
+    /* Init live stream */
+    ESP_ERROR_CHECK(live_initialize(config_live_max_clients_get(),
+        config_live_frame_size_get(), config_live_frames_get(),
+        recorded_audio_sample_rate_get()));
+
     /* Init camera */
     ESP_ERROR_CHECK(camera_initialize(config_camera_pin_pwdn_get(),
         config_camera_pin_reset_get(), config_camera_pin_xclk_get(),
@@ -612,25 +1206,61 @@ void app_main()
         config_camera_pin_d1_get(), config_camera_pin_d0_get(),
         config_camera_pin_vsync_get(), config_camera_pin_href_get(),
         config_camera_pin_pclk_get(), config_camera_resolution_get(),
-        config_camera_fps_get(), config_camera_vertical_flip_get(),
+        config_camera_fps_get(), config_camera_idle_fps_get(),
+        config_camera_hold_time_get(), config_camera_vertical_flip_get(),
         config_camera_horizontal_mirror_get(), config_camera_quality_get()));
 
-    /* Init microphone */
-    ESP_ERROR_CHECK(microphone_initialize(config_microphone_clk_get(),
-        config_microphone_din_get(), config_microphone_sample_rate_get()));
+    /* Init timelapse, this takes over the camera */
+    ESP_ERROR_CHECK(timelapse_initialize(config_timelapse_path_get(),
+        config_timelapse_interval_get(), config_timelapse_fps_get(),
+        config_timelapse_clip_frames_get(), config_timelapse_upload_url_get(),
+        config_timelapse_active_power_get()));
 
-    /* Init audio encoder, if needed */
+    /* Init audio encoder, if needed. The microphone captures frames of the
+     * size it encodes, and FEC is sized to the loss estimate until receivers
+     * report theirs */
+    rtp_audio_loss_estimate_set(config_opus_packet_loss_get());
     if (config_microphone_clk_get() != -1 &&
         config_microphone_din_get() != -1)
     {
-        ESP_ERROR_CHECK(audio_encoder_initialize(AUDIO_CODEC_OPUS,
-            config_microphone_sample_rate_get()));
+        ESP_ERROR_CHECK(audio_encoder_initialize(
+            audio_encoder_atocodec(config_microphone_codec_get()),
+            config_microphone_sample_rate_get(), config_opus_bitrate_get(),
+            config_opus_frame_duration_get(), config_opus_ptime_get(),
+            config_opus_complexity_get(), config_opus_vbr_get(),
+            config_opus_dtx_get(), config_opus_fec_get(),
+            config_opus_cpu_budget_get()));
     }
 
+    /* Init audio pre-processing */
+    ESP_ERROR_CHECK(audio_processor_initialize(
+        config_microphone_sample_rate_get(), config_microphone_dc_block_get(),
+        config_microphone_high_pass_get(), config_microphone_agc_target_get(),
+        config_microphone_agc_max_gain_get(),
+        config_microphone_noise_gate_get()));
+
+    /* Init sound detector */
+    ESP_ERROR_CHECK(sound_detector_initialize(audio_sample_rate_get(),
+        config_sound_detector_threshold_get(),
+        config_sound_detector_hysteresis_get(),
+        config_sound_detector_hold_time_get()));
+    sound_detector_set_on_trigger(_sound_detector_triggered);
+
+    /* Init microphone */
+    ESP_ERROR_CHECK(microphone_initialize(config_microphone_clk_get(),
+        config_microphone_din_get(), config_microphone_sample_rate_get()));
+
+    /* Init talkback, after the microphone which needs the first I2S port */
+    ESP_ERROR_CHECK(talkback_initialize(config_talkback_port_get(),
+        config_talkback_bclk_get(), config_talkback_ws_get(),
+        config_talkback_dout_get(), config_talkback_sample_rate_get(),
+        config_talkback_min_delay_get(), config_talkback_max_delay_get()));
+
     /* Init RTP */
     ESP_ERROR_CHECK(rtp_initialize(config_rtp_host_get(),
         config_rtp_video_port_get(), config_rtp_audio_port_get()));
     rtp_ttl_set(config_rtp_ttl_get());
+    rtp_latency_test_set(config_rtp_latency_test_get());
 
     /* Start IPCAM task */
     ESP_ERROR_CHECK(start_ipcam_task());
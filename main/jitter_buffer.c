@@ -0,0 +1,289 @@
+#include "jitter_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Types */
+typedef struct {
+    uint8_t is_valid;
+    uint16_t seq;
+    uint32_t timestamp;
+    uint32_t duration;
+    size_t length;
+    uint8_t *data;
+} slot_t;
+
+struct jitter_buffer_t {
+    slot_t *slots;
+    size_t count;
+    size_t max_packet_size;
+    uint32_t clock_rate;
+    /* In RTP timestamp units */
+    uint32_t min_delay;
+    uint32_t max_delay;
+    uint8_t has_packets;
+    uint8_t has_played;
+    uint8_t is_playing;
+    /* The next packet to play, or the first buffered one until playing */
+    uint16_t next_seq;
+    uint32_t next_timestamp;
+    uint16_t highest_seq;
+    /* End of the latest buffered packet */
+    uint32_t end_timestamp;
+    uint32_t last_duration;
+    /* Interarrival jitter, times 16 (RFC3550) */
+    uint8_t has_transit;
+    uint32_t transit;
+    uint32_t jitter;
+    jitter_buffer_stats_t stats;
+};
+
+static uint32_t units_to_us(jitter_buffer_t *jitter_buffer, uint32_t units)
+{
+    return (uint64_t)units * 1000000 / jitter_buffer->clock_rate;
+}
+
+static slot_t *slot_get(jitter_buffer_t *jitter_buffer, uint16_t seq)
+{
+    return &jitter_buffer->slots[seq % jitter_buffer->count];
+}
+
+static void jitter_buffer_reset(jitter_buffer_t *jitter_buffer)
+{
+    size_t i;
+
+    for (i = 0; i < jitter_buffer->count; i++)
+        jitter_buffer->slots[i].is_valid = 0;
+
+    jitter_buffer->has_packets = 0;
+    jitter_buffer->is_playing = 0;
+}
+
+static uint32_t target_delay_get(jitter_buffer_t *jitter_buffer)
+{
+    uint32_t delay = (jitter_buffer->jitter >> 4) * 4;
+
+    if (delay < jitter_buffer->min_delay)
+        return jitter_buffer->min_delay;
+    if (delay > jitter_buffer->max_delay)
+        return jitter_buffer->max_delay;
+
+    return delay;
+}
+
+static uint32_t delay_get(jitter_buffer_t *jitter_buffer)
+{
+    if (!jitter_buffer->has_packets)
+        return 0;
+
+    return jitter_buffer->end_timestamp - jitter_buffer->next_timestamp;
+}
+
+static void jitter_update(jitter_buffer_t *jitter_buffer, uint32_t timestamp,
+    int64_t arrival_time)
+{
+    uint32_t arrival = arrival_time * jitter_buffer->clock_rate / 1000000;
+    uint32_t transit = arrival - timestamp;
+    int32_t d = transit - jitter_buffer->transit;
+
+    jitter_buffer->transit = transit;
+    if (!jitter_buffer->has_transit)
+    {
+        jitter_buffer->has_transit = 1;
+        return;
+    }
+
+    if (d < 0)
+        d = -d;
+    jitter_buffer->jitter += d - ((jitter_buffer->jitter + 8) >> 4);
+}
+
+int jitter_buffer_put(jitter_buffer_t *jitter_buffer, uint16_t seq,
+    uint32_t timestamp, uint32_t duration, const uint8_t *data, size_t length,
+    int64_t arrival_time)
+{
+    slot_t *slot;
+
+    if (length > jitter_buffer->max_packet_size || !duration)
+        return -1;
+
+    /* Too far from the expected packet either way, the sender probably
+     * restarted, and its timestamps say nothing of the jitter so far */
+    if ((jitter_buffer->has_packets || jitter_buffer->has_played) &&
+        abs((int16_t)(seq - jitter_buffer->next_seq)) >=
+        (int)jitter_buffer->count)
+    {
+        jitter_buffer_reset(jitter_buffer);
+        jitter_buffer->has_played = 0;
+        jitter_buffer->has_transit = 0;
+    }
+
+    jitter_update(jitter_buffer, timestamp, arrival_time);
+    jitter_buffer->stats.received++;
+
+    if (!jitter_buffer->has_packets)
+    {
+        /* Anything before what was last played is too late */
+        if (jitter_buffer->has_played &&
+            (int16_t)(seq - jitter_buffer->next_seq) < 0)
+        {
+            jitter_buffer->stats.late++;
+            return 0;
+        }
+
+        jitter_buffer->has_packets = 1;
+        jitter_buffer->next_seq = jitter_buffer->highest_seq = seq;
+        jitter_buffer->next_timestamp = timestamp;
+        jitter_buffer->end_timestamp = timestamp + duration;
+    }
+    else if ((int16_t)(seq - jitter_buffer->next_seq) < 0)
+    {
+        /* Until playing, reordered packets can still go before the first */
+        if (jitter_buffer->is_playing || (uint16_t)(jitter_buffer->highest_seq -
+            seq) >= jitter_buffer->count)
+        {
+            jitter_buffer->stats.late++;
+            return 0;
+        }
+
+        jitter_buffer->next_seq = seq;
+        jitter_buffer->next_timestamp = timestamp;
+    }
+
+    slot = slot_get(jitter_buffer, seq);
+    if (slot->is_valid && slot->seq == seq)
+        return 0;
+
+    slot->is_valid = 1;
+    slot->seq = seq;
+    slot->timestamp = timestamp;
+    slot->duration = duration;
+    slot->length = length;
+    memcpy(slot->data, data, length);
+
+    if ((int16_t)(seq - jitter_buffer->highest_seq) > 0)
+        jitter_buffer->highest_seq = seq;
+    if ((int32_t)(timestamp + duration - jitter_buffer->end_timestamp) > 0)
+        jitter_buffer->end_timestamp = timestamp + duration;
+
+    return 0;
+}
+
+static void slot_consume(jitter_buffer_t *jitter_buffer, slot_t *slot)
+{
+    slot->is_valid = 0;
+    jitter_buffer->next_seq = slot->seq + 1;
+    jitter_buffer->next_timestamp = slot->timestamp + slot->duration;
+    jitter_buffer->last_duration = slot->duration;
+    jitter_buffer->has_played = 1;
+}
+
+jitter_buffer_result_t jitter_buffer_get(jitter_buffer_t *jitter_buffer,
+    uint8_t *data, size_t *length)
+{
+    uint32_t target = target_delay_get(jitter_buffer);
+    slot_t *slot;
+
+    if (!jitter_buffer->has_packets)
+        return JITTER_BUFFER_EMPTY;
+
+    if (!jitter_buffer->is_playing)
+    {
+        if (delay_get(jitter_buffer) < target)
+            return JITTER_BUFFER_EMPTY;
+        jitter_buffer->is_playing = 1;
+    }
+
+    /* Well above the target, e.g., once the jitter dropped, a packet is
+     * skipped to bring the delay down */
+    slot = slot_get(jitter_buffer, jitter_buffer->next_seq);
+    if (slot->is_valid && slot->seq == jitter_buffer->next_seq &&
+        delay_get(jitter_buffer) > target + target / 2 &&
+        delay_get(jitter_buffer) - slot->duration >= target)
+    {
+        slot_consume(jitter_buffer, slot);
+        jitter_buffer->stats.dropped++;
+        slot = slot_get(jitter_buffer, jitter_buffer->next_seq);
+    }
+
+    if (slot->is_valid && slot->seq == jitter_buffer->next_seq)
+    {
+        memcpy(data, slot->data, slot->length);
+        *length = slot->length;
+        slot_consume(jitter_buffer, slot);
+        return JITTER_BUFFER_PACKET;
+    }
+
+    /* Missing, but later ones arrived. Below the target delay it's waited
+     * for, which raises the delay towards the target as the jitter grows */
+    if ((int16_t)(jitter_buffer->highest_seq - jitter_buffer->next_seq) > 0)
+    {
+        if (delay_get(jitter_buffer) < target)
+        {
+            jitter_buffer->stats.stretched++;
+            return JITTER_BUFFER_LOST;
+        }
+
+        jitter_buffer->next_seq++;
+        jitter_buffer->next_timestamp += jitter_buffer->last_duration;
+        jitter_buffer->stats.lost++;
+        return JITTER_BUFFER_LOST;
+    }
+
+    /* Ran dry, this one is concealed and the buffer fills up again */
+    jitter_buffer->stats.underruns++;
+    jitter_buffer_reset(jitter_buffer);
+    return JITTER_BUFFER_LOST;
+}
+
+void jitter_buffer_stats_get(jitter_buffer_t *jitter_buffer,
+    jitter_buffer_stats_t *stats)
+{
+    *stats = jitter_buffer->stats;
+    stats->jitter = units_to_us(jitter_buffer, jitter_buffer->jitter >> 4);
+    stats->delay = units_to_us(jitter_buffer, delay_get(jitter_buffer));
+    stats->target_delay = units_to_us(jitter_buffer,
+        target_delay_get(jitter_buffer));
+}
+
+void jitter_buffer_destroy(jitter_buffer_t *jitter_buffer)
+{
+    if (!jitter_buffer)
+        return;
+
+    if (jitter_buffer->slots)
+        free(jitter_buffer->slots[0].data);
+    free(jitter_buffer->slots);
+    free(jitter_buffer);
+}
+
+jitter_buffer_t *jitter_buffer_create(size_t slots, size_t max_packet_size,
+    uint32_t clock_rate, uint32_t min_delay, uint32_t max_delay)
+{
+    jitter_buffer_t *jitter_buffer = calloc(1, sizeof(*jitter_buffer));
+    uint8_t *data;
+    size_t i;
+
+    if (!jitter_buffer || !slots || !clock_rate)
+        goto Error;
+
+    if (!(jitter_buffer->slots = calloc(slots, sizeof(slot_t))) ||
+        !(data = malloc(slots * max_packet_size)))
+    {
+        goto Error;
+    }
+
+    for (i = 0; i < slots; i++)
+        jitter_buffer->slots[i].data = data + i * max_packet_size;
+
+    jitter_buffer->count = slots;
+    jitter_buffer->max_packet_size = max_packet_size;
+    jitter_buffer->clock_rate = clock_rate;
+    jitter_buffer->min_delay = (uint64_t)min_delay * clock_rate / 1000000;
+    jitter_buffer->max_delay = (uint64_t)max_delay * clock_rate / 1000000;
+
+    return jitter_buffer;
+
+Error:
+    jitter_buffer_destroy(jitter_buffer);
+    return NULL;
+}
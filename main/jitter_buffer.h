@@ -0,0 +1,50 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Reorders received RTP packets and holds them long enough to absorb the
+ * measured interarrival jitter. It has no locking of its own and no platform
+ * dependencies */
+typedef struct jitter_buffer_t jitter_buffer_t;
+
+typedef enum {
+    JITTER_BUFFER_PACKET,
+    JITTER_BUFFER_LOST, /* Conceal a packet */
+    JITTER_BUFFER_EMPTY, /* Still buffering, play silence */
+} jitter_buffer_result_t;
+
+typedef struct {
+    uint32_t received;
+    uint32_t late; /* Arrived after being played out or concealed */
+    uint32_t lost;
+    uint32_t dropped; /* Played out early to lower the delay */
+    uint32_t stretched; /* Concealed waiting for a packet, to raise it */
+    uint32_t underruns;
+    /* In microseconds */
+    uint32_t jitter;
+    uint32_t delay;
+    uint32_t target_delay;
+} jitter_buffer_stats_t;
+
+/* Holds up to slots packets of max_packet_size. The delay (in microseconds)
+ * targets 4 times the jitter, within the given bounds */
+jitter_buffer_t *jitter_buffer_create(size_t slots, size_t max_packet_size,
+    uint32_t clock_rate, uint32_t min_delay, uint32_t max_delay);
+void jitter_buffer_destroy(jitter_buffer_t *jitter_buffer);
+
+/* The duration is in RTP timestamp units, and the arrival time in
+ * microseconds */
+int jitter_buffer_put(jitter_buffer_t *jitter_buffer, uint16_t seq,
+    uint32_t timestamp, uint32_t duration, const uint8_t *data, size_t length,
+    int64_t arrival_time);
+/* Called once per packet duration, copies the next packet out. The duration
+ * of a lost packet is assumed to be that of the previous one */
+jitter_buffer_result_t jitter_buffer_get(jitter_buffer_t *jitter_buffer,
+    uint8_t *data, size_t *length);
+
+void jitter_buffer_stats_get(jitter_buffer_t *jitter_buffer,
+    jitter_buffer_stats_t *stats);
+
+#endif
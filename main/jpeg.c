@@ -0,0 +1,588 @@
+#include "jpeg.h"
+#include <esp_log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HUFFMAN_FAST_BITS 9
+#define MAX_COMPONENTS 3
+/* Largest DC difference category, of 8-bit baseline */
+#define DC_MAX_CATEGORY 11
+
+/* Types */
+typedef struct {
+    /* (length << 8) | value for codes up to HUFFMAN_FAST_BITS, 0 otherwise */
+    uint16_t fast[1 << HUFFMAN_FAST_BITS];
+    int32_t maxcode[17];
+    uint16_t mincode[17];
+    uint8_t valptr[17];
+    uint8_t values[256];
+} huffman_table_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t qtable;
+    uint8_t dc_table;
+    uint8_t ac_table;
+    int16_t dc_pred;
+} component_t;
+
+struct jpeg_dc_decoder_t {
+    huffman_table_t dc_tables[4];
+    huffman_table_t ac_tables[4];
+    uint16_t dc_quantizers[4];
+    component_t components[MAX_COMPONENTS];
+    uint8_t num_components;
+    component_t *scan_components[MAX_COMPONENTS];
+    uint8_t num_scan_components;
+    uint16_t width;
+    uint16_t height;
+    uint16_t restart_interval;
+    uint8_t *map;
+    size_t map_size;
+
+    /* Entropy coded data reader */
+    const uint8_t *ptr;
+    const uint8_t *end;
+    uint32_t bits;
+    int nbits;
+    uint8_t marker;
+};
+
+/* Constants */
+static const char *TAG = "JPEG";
+
+/* Huffman decoding, see ITU T.81 Annex C and F.2.2 */
+static int huffman_table_build(huffman_table_t *table, const uint8_t *counts,
+    const uint8_t *values, size_t number_of_values)
+{
+    uint32_t code = 0;
+    int len, i, j, k = 0;
+
+    memset(table->fast, 0, sizeof(table->fast));
+    for (len = 1; len <= 16; len++)
+    {
+        table->valptr[len] = k;
+        table->mincode[len] = code;
+        for (i = 0; i < counts[len - 1]; i++, k++, code++)
+        {
+            int shift = HUFFMAN_FAST_BITS - len;
+
+            if (len > HUFFMAN_FAST_BITS)
+                continue;
+
+            for (j = 0; j < (1 << shift); j++)
+                table->fast[(code << shift) + j] = len << 8 | values[k];
+        }
+        table->maxcode[len] = counts[len - 1] ? (int32_t)code - 1 : -1;
+
+        if (code > (1U << len))
+            return -1;
+        code <<= 1;
+    }
+
+    memcpy(table->values, values, number_of_values);
+    return 0;
+}
+
+static void bits_fill(jpeg_dc_decoder_t *decoder)
+{
+    while (decoder->nbits <= 24)
+    {
+        uint32_t byte = 0;
+
+        /* Once a marker is reached, keep feeding zeros */
+        if (!decoder->marker && decoder->ptr < decoder->end)
+        {
+            byte = *decoder->ptr++;
+            if (byte == 0xff)
+            {
+                uint8_t next = 0xd9;
+
+                while (decoder->ptr < decoder->end &&
+                    (next = *decoder->ptr++) == 0xff);
+
+                /* A stuffed zero byte means a literal 0xff */
+                if (next)
+                {
+                    decoder->marker = next;
+                    byte = 0;
+                }
+            }
+        }
+
+        decoder->bits |= byte << (24 - decoder->nbits);
+        decoder->nbits += 8;
+    }
+}
+
+static inline void bits_consume(jpeg_dc_decoder_t *decoder, int n)
+{
+    decoder->bits <<= n;
+    decoder->nbits -= n;
+}
+
+static int huffman_decode(jpeg_dc_decoder_t *decoder,
+    const huffman_table_t *table)
+{
+    uint16_t entry;
+    uint32_t code;
+    int len;
+
+    bits_fill(decoder);
+
+    entry = table->fast[decoder->bits >> (32 - HUFFMAN_FAST_BITS)];
+    if (entry)
+    {
+        bits_consume(decoder, entry >> 8);
+        return entry & 0xff;
+    }
+
+    for (len = HUFFMAN_FAST_BITS + 1; len <= 16; len++)
+    {
+        code = decoder->bits >> (32 - len);
+        if ((int32_t)code <= table->maxcode[len])
+        {
+            bits_consume(decoder, len);
+            return table->values[table->valptr[len] + code -
+                table->mincode[len]];
+        }
+    }
+
+    return -1;
+}
+
+static int receive_extend(jpeg_dc_decoder_t *decoder, int size)
+{
+    int32_t value;
+
+    if (!size)
+        return 0;
+
+    bits_fill(decoder);
+    value = decoder->bits >> (32 - size);
+    bits_consume(decoder, size);
+
+    if (value < (1 << (size - 1)))
+        value -= (1 << size) - 1;
+
+    return value;
+}
+
+/* Decodes a single block, returning its DC coefficient. AC coefficients are
+ * entropy decoded only as far as needed to skip over them. */
+static int decode_block_dc(jpeg_dc_decoder_t *decoder, component_t *component,
+    int16_t *dc)
+{
+    int symbol, k;
+
+    /* The table comes from the stream, the category is a shift width */
+    if ((symbol = huffman_decode(decoder,
+        &decoder->dc_tables[component->dc_table])) < 0 ||
+        symbol > DC_MAX_CATEGORY)
+    {
+        return -1;
+    }
+
+    component->dc_pred += receive_extend(decoder, symbol);
+    *dc = component->dc_pred;
+
+    for (k = 1; k < 64; k++)
+    {
+        if ((symbol = huffman_decode(decoder,
+            &decoder->ac_tables[component->ac_table])) < 0)
+        {
+            return -1;
+        }
+
+        /* End of block */
+        if (symbol == 0x00)
+            break;
+
+        /* Zero run length in upper nibble, coefficient size in lower one */
+        k += symbol >> 4;
+        if (symbol & 0x0f)
+        {
+            bits_fill(decoder);
+            bits_consume(decoder, symbol & 0x0f);
+        }
+    }
+
+    return 0;
+}
+
+static void restart(jpeg_dc_decoder_t *decoder)
+{
+    int i;
+
+    decoder->bits = 0;
+    decoder->nbits = 0;
+    if (decoder->marker >= 0xd0 && decoder->marker <= 0xd7)
+        decoder->marker = 0;
+
+    for (i = 0; i < decoder->num_components; i++)
+        decoder->components[i].dc_pred = 0;
+}
+
+/* Marker parsing */
+static int parse_sof(jpeg_dc_decoder_t *decoder, const uint8_t *p,
+    const uint8_t *end)
+{
+    int i;
+
+    if (end - p < 6)
+        return -1;
+
+    decoder->height = p[1] << 8 | p[2];
+    decoder->width = p[3] << 8 | p[4];
+    decoder->num_components = p[5];
+    p += 6;
+
+    if (!decoder->num_components || decoder->num_components > MAX_COMPONENTS ||
+        end - p < decoder->num_components * 3)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < decoder->num_components; i++, p += 3)
+    {
+        decoder->components[i].id = p[0];
+        decoder->components[i].h = p[1] >> 4;
+        decoder->components[i].v = p[1] & 0x0f;
+        decoder->components[i].qtable = p[2] & 0x03;
+
+        if (!decoder->components[i].h || !decoder->components[i].v)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int parse_dht(jpeg_dc_decoder_t *decoder, const uint8_t *p,
+    const uint8_t *end)
+{
+    while (end - p >= 17)
+    {
+        huffman_table_t *table = (p[0] >> 4) ?
+            &decoder->ac_tables[p[0] & 0x03] : &decoder->dc_tables[p[0] & 0x03];
+        size_t i, number_of_values = 0;
+
+        for (i = 0; i < 16; i++)
+            number_of_values += p[1 + i];
+
+        if (number_of_values > 256 ||
+            (size_t)(end - p) < 17 + number_of_values)
+        {
+            return -1;
+        }
+
+        if (huffman_table_build(table, p + 1, p + 17, number_of_values))
+            return -1;
+
+        p += 17 + number_of_values;
+    }
+
+    return 0;
+}
+
+static int parse_dqt(jpeg_dc_decoder_t *decoder, const uint8_t *p,
+    const uint8_t *end)
+{
+    while (end - p >= 65)
+    {
+        uint8_t id = p[0] & 0x03;
+
+        /* Only the DC quantizer (first entry) is of interest */
+        if (p[0] >> 4)
+        {
+            if (end - p < 129)
+                return -1;
+            decoder->dc_quantizers[id] = p[1] << 8 | p[2];
+            p += 129;
+        }
+        else
+        {
+            decoder->dc_quantizers[id] = p[1];
+            p += 65;
+        }
+    }
+
+    return 0;
+}
+
+static int parse_sos(jpeg_dc_decoder_t *decoder, const uint8_t *p,
+    const uint8_t *end)
+{
+    int i, j;
+
+    if (end - p < 1)
+        return -1;
+
+    decoder->num_scan_components = p[0];
+    p++;
+
+    if (!decoder->num_scan_components ||
+        decoder->num_scan_components > decoder->num_components ||
+        end - p < decoder->num_scan_components * 2)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < decoder->num_scan_components; i++, p += 2)
+    {
+        for (j = 0; j < decoder->num_components; j++)
+        {
+            if (decoder->components[j].id == p[0])
+                break;
+        }
+        if (j == decoder->num_components)
+            return -1;
+
+        decoder->components[j].dc_table = p[1] >> 4 & 0x03;
+        decoder->components[j].ac_table = p[1] & 0x03;
+        decoder->scan_components[i] = &decoder->components[j];
+    }
+
+    return 0;
+}
+
+static const uint8_t *parse_headers(jpeg_dc_decoder_t *decoder,
+    const uint8_t *buffer, size_t length)
+{
+    const uint8_t *p = buffer + 2, *end = buffer + length;
+
+    if (length < 4 || buffer[0] != 0xff || buffer[1] != 0xd8)
+        return NULL;
+
+    decoder->num_components = 0;
+    decoder->restart_interval = 0;
+
+    while (end - p >= 4)
+    {
+        const uint8_t *segment = p + 4;
+        const uint8_t *segment_end = p + 2 + (p[2] << 8 | p[3]);
+        int ret = 0;
+
+        if (p[0] != 0xff)
+            return NULL;
+
+        /* Fill bytes */
+        if (p[1] == 0xff)
+        {
+            p++;
+            continue;
+        }
+
+        if (segment_end > end || segment_end < segment)
+            return NULL;
+
+        switch (p[1])
+        {
+        case 0xc0: /* Start Of Frame (baseline DCT) */
+        case 0xc1: /* Start Of Frame (extended sequential DCT) */
+            ret = parse_sof(decoder, segment, segment_end);
+            break;
+        case 0xc4: /* Define Huffman Table(s) */
+            ret = parse_dht(decoder, segment, segment_end);
+            break;
+        case 0xdb: /* Define Quantization Table(s) */
+            ret = parse_dqt(decoder, segment, segment_end);
+            break;
+        case 0xdd: /* Define Restart Interval */
+            decoder->restart_interval = segment[0] << 8 | segment[1];
+            break;
+        case 0xda: /* Start Of Scan */
+            if (!decoder->num_components ||
+                parse_sos(decoder, segment, segment_end))
+            {
+                return NULL;
+            }
+            return segment_end;
+        case 0xc2: /* Start Of Frame (progressive DCT) */
+        case 0xc3: /* Start Of Frame (lossless) */
+        case 0xd9: /* End Of Image */
+            ESP_LOGD(TAG, "Got unsupported marker 0x%02x", p[1]);
+            return NULL;
+        default: /* Application-specific, comments, etc. */
+            break;
+        }
+
+        if (ret)
+            return NULL;
+
+        p = segment_end;
+    }
+
+    return NULL;
+}
+
+static inline uint8_t dc_to_luma(int16_t dc, uint16_t quantizer)
+{
+    /* The dequantized DC coefficient is 8 times the block's average level */
+    int32_t luma = (dc * quantizer) / 8 + 128;
+
+    return luma < 0 ? 0 : luma > 255 ? 255 : luma;
+}
+
+const uint8_t *jpeg_dc_decode(jpeg_dc_decoder_t *decoder,
+    const uint8_t *buffer, size_t length, uint16_t *width, uint16_t *height)
+{
+    component_t *luma = &decoder->components[0];
+    uint16_t quantizer, map_width, map_height;
+    int mcus_x, mcus_y, mcu_x, mcu_y, hmax = 1, vmax = 1, mcu_count = 0;
+    int i, h, v, bx, by;
+    uint8_t *map;
+    int16_t dc;
+
+    if (!(decoder->ptr = parse_headers(decoder, buffer, length)))
+    {
+        ESP_LOGD(TAG, "Failed parsing JPEG headers");
+        return NULL;
+    }
+
+    /* Only the luma component is of interest */
+    if (decoder->scan_components[0] != luma)
+        return NULL;
+
+    /* The map only needs to grow when the resolution changes */
+    map_width = (decoder->width + 7) / 8;
+    map_height = (decoder->height + 7) / 8;
+    if ((size_t)map_width * map_height > decoder->map_size)
+    {
+        free(decoder->map);
+        decoder->map_size = (size_t)map_width * map_height;
+        if (!(decoder->map = malloc(decoder->map_size)))
+        {
+            ESP_LOGE(TAG, "Failed allocating DC map (%ux%u)", map_width,
+                map_height);
+            decoder->map_size = 0;
+            return NULL;
+        }
+    }
+    map = decoder->map;
+
+    for (i = 0; i < decoder->num_components; i++)
+    {
+        if (decoder->components[i].h > hmax)
+            hmax = decoder->components[i].h;
+        if (decoder->components[i].v > vmax)
+            vmax = decoder->components[i].v;
+    }
+
+    if (decoder->num_scan_components == 1)
+    {
+        /* Non-interleaved, each MCU is a single block */
+        mcus_x = ((decoder->width * luma->h + hmax - 1) / hmax + 7) / 8;
+        mcus_y = ((decoder->height * luma->v + vmax - 1) / vmax + 7) / 8;
+    }
+    else
+    {
+        mcus_x = (decoder->width + 8 * hmax - 1) / (8 * hmax);
+        mcus_y = (decoder->height + 8 * vmax - 1) / (8 * vmax);
+    }
+
+    quantizer = decoder->dc_quantizers[luma->qtable] ? : 1;
+    decoder->end = buffer + length;
+    decoder->marker = 0;
+    restart(decoder);
+
+    for (mcu_y = 0; mcu_y < mcus_y; mcu_y++)
+    {
+        for (mcu_x = 0; mcu_x < mcus_x; mcu_x++)
+        {
+            if (decoder->num_scan_components == 1)
+            {
+                if (decode_block_dc(decoder, luma, &dc))
+                    return NULL;
+                if (mcu_x < map_width && mcu_y < map_height)
+                    map[mcu_y * map_width + mcu_x] = dc_to_luma(dc, quantizer);
+            }
+            else
+            {
+                for (i = 0; i < decoder->num_scan_components; i++)
+                {
+                    component_t *component = decoder->scan_components[i];
+
+                    for (v = 0; v < component->v; v++)
+                    {
+                        for (h = 0; h < component->h; h++)
+                        {
+                            if (decode_block_dc(decoder, component, &dc))
+                                return NULL;
+                            if (component != luma)
+                                continue;
+
+                            bx = mcu_x * component->h + h;
+                            by = mcu_y * component->v + v;
+                            if (bx < map_width && by < map_height)
+                            {
+                                map[by * map_width + bx] =
+                                    dc_to_luma(dc, quantizer);
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (decoder->restart_interval &&
+                ++mcu_count % decoder->restart_interval == 0)
+            {
+                restart(decoder);
+            }
+        }
+    }
+
+    *width = map_width;
+    *height = map_height;
+    return map;
+}
+
+jpeg_dc_decoder_t *jpeg_dc_decoder_create(void)
+{
+    return calloc(1, sizeof(jpeg_dc_decoder_t));
+}
+
+void jpeg_dc_decoder_destroy(jpeg_dc_decoder_t *decoder)
+{
+    free(decoder->map);
+    free(decoder);
+}
+
+int jpeg_size_get(const uint8_t *buffer, size_t length, uint16_t *width,
+    uint16_t *height)
+{
+    const uint8_t *p = buffer + 2, *end = buffer + length;
+
+    if (length < 4 || buffer[0] != 0xff || buffer[1] != 0xd8)
+        return -1;
+
+    while (end - p >= 4 && p[0] == 0xff)
+    {
+        const uint8_t *segment = p + 4;
+
+        if (p[1] == 0xff)
+        {
+            p++;
+            continue;
+        }
+
+        /* Any Start Of Frame, skipping DHT, JPG and DAC which share the range */
+        if (p[1] >= 0xc0 && p[1] <= 0xcf && p[1] != 0xc4 && p[1] != 0xc8 &&
+            p[1] != 0xcc)
+        {
+            if (end - segment < 5)
+                return -1;
+            *height = segment[1] << 8 | segment[2];
+            *width = segment[3] << 8 | segment[4];
+            return 0;
+        }
+
+        if (p[1] == 0xda || p[1] == 0xd9)
+            return -1;
+
+        p += 2 + (p[2] << 8 | p[3]);
+    }
+
+    return -1;
+}
@@ -0,0 +1,22 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct jpeg_dc_decoder_t jpeg_dc_decoder_t;
+
+/* Decodes only the DC coefficient of each luma block, producing a 1/8-scale
+ * map of the average luma (0-255) of every 8x8 block, row-by-row. The map is
+ * owned by the decoder and is valid until the next call. */
+const uint8_t *jpeg_dc_decode(jpeg_dc_decoder_t *decoder,
+    const uint8_t *buffer, size_t length, uint16_t *width, uint16_t *height);
+
+jpeg_dc_decoder_t *jpeg_dc_decoder_create(void);
+void jpeg_dc_decoder_destroy(jpeg_dc_decoder_t *decoder);
+
+/* Gets the image dimensions from the Start Of Frame header */
+int jpeg_size_get(const uint8_t *buffer, size_t length, uint16_t *width,
+    uint16_t *height);
+
+#endif
@@ -0,0 +1,312 @@
+#include "live.h"
+#include "jpeg.h"
+#include "mkv.h"
+#include "pool.h"
+#include "rtp.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Types */
+typedef struct {
+    uint8_t track;
+    int64_t timestamp;
+    size_t length;
+    uint8_t refcount;
+    uint8_t data[];
+} live_frame_t;
+
+typedef struct {
+    QueueHandle_t queue;
+    /* Set when a frame couldn't be queued, the client then skips ahead */
+    volatile uint8_t is_behind;
+} client_t;
+
+/* Constants */
+static const char *TAG = "Live";
+static const size_t client_queue_size = 16;
+
+/* Internal state */
+static SemaphoreHandle_t lock = NULL;
+static pool_t *video_pool = NULL, *audio_pool = NULL;
+static client_t *clients = NULL;
+static uint8_t max_clients = 0, num_clients = 0;
+static uint32_t sample_rate = 0;
+static uint32_t frames_dropped = 0;
+
+static void frame_release(live_frame_t *frame)
+{
+    uint8_t refcount;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    refcount = --frame->refcount;
+    xSemaphoreGive(lock);
+
+    if (!refcount)
+        pool_put(frame);
+}
+
+/* Every client skips ahead to the next image, as if its queue was full */
+static void frame_drop(void)
+{
+    uint8_t i;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (i = 0; i < max_clients; i++)
+    {
+        if (!clients[i].queue)
+            continue;
+
+        clients[i].is_behind = 1;
+        frames_dropped++;
+    }
+    xSemaphoreGive(lock);
+}
+
+static int live_add(uint8_t track, const uint8_t *data, size_t length,
+    int64_t timestamp)
+{
+    pool_t *pool = track == MKV_TRACK_VIDEO ? video_pool : audio_pool;
+    live_frame_t *frame;
+    uint8_t i;
+
+    /* Checked without the lock, a new client can wait for the next frame */
+    if (!num_clients)
+        return 0;
+
+    /* A single copy is shared by all clients, each sends straight from it */
+    if (sizeof(*frame) + length > pool_block_size(pool) ||
+        !(frame = pool_get(pool)))
+    {
+        ESP_LOGD(TAG, "No buffer for a %zu byte frame", length);
+        frame_drop();
+        return -1;
+    }
+
+    frame->track = track;
+    frame->timestamp = timestamp;
+    frame->length = length;
+    frame->refcount = 1;
+    memcpy(frame->data, data, length);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (i = 0; i < max_clients; i++)
+    {
+        client_t *client = &clients[i];
+
+        if (!client->queue)
+            continue;
+
+        if (xQueueSend(client->queue, &frame, 0) != pdTRUE)
+        {
+            client->is_behind = 1;
+            frames_dropped++;
+            continue;
+        }
+        frame->refcount++;
+    }
+    xSemaphoreGive(lock);
+
+    frame_release(frame);
+
+    return 0;
+}
+
+int live_add_jpeg(const uint8_t *data, size_t length, int64_t timestamp)
+{
+    return live_add(MKV_TRACK_VIDEO, data, length, timestamp);
+}
+
+int live_add_opus(const uint8_t *data, size_t length, int64_t timestamp)
+{
+    if (!sample_rate)
+        return 0;
+
+    return live_add(MKV_TRACK_AUDIO, data, length, timestamp);
+}
+
+static client_t *client_add(void)
+{
+    client_t *client = NULL;
+    QueueHandle_t queue;
+    uint8_t i;
+
+    if (!(queue = xQueueCreate(client_queue_size, sizeof(live_frame_t *))))
+        return NULL;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (i = 0; i < max_clients; i++)
+    {
+        if (clients[i].queue)
+            continue;
+
+        client = &clients[i];
+        client->queue = queue;
+        client->is_behind = 0;
+        num_clients++;
+        break;
+    }
+    xSemaphoreGive(lock);
+
+    if (!client)
+        vQueueDelete(queue);
+
+    return client;
+}
+
+static void queue_flush(QueueHandle_t queue)
+{
+    live_frame_t *frame;
+
+    while (xQueueReceive(queue, &frame, 0) == pdTRUE)
+        frame_release(frame);
+}
+
+static void client_remove(client_t *client)
+{
+    QueueHandle_t queue = client->queue;
+
+    /* Nothing is queued once the client is out of the list */
+    xSemaphoreTake(lock, portMAX_DELAY);
+    client->queue = NULL;
+    num_clients--;
+    xSemaphoreGive(lock);
+
+    queue_flush(queue);
+    vQueueDelete(queue);
+}
+
+int live_stream(live_sink_func_t sink, void *ctx)
+{
+    client_t *client;
+    live_frame_t *frame;
+    mkv_writer_t mkv;
+    int64_t start = 0;
+    uint8_t is_started = 0, wait_for_video = 1;
+    uint16_t width, height;
+    int ret = 0;
+
+    if (!clients || !(client = client_add()))
+        return -1;
+
+    ESP_LOGI(TAG, "Client connected, %u watching", num_clients);
+    mkv_writer_init(&mkv, sink, ctx);
+
+    while (!ret)
+    {
+        if (xQueueReceive(client->queue, &frame, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        /* Skip whatever piled up, resuming at the next image. Every JPEG is a
+         * keyframe so that's the earliest point the stream can resume at */
+        if (client->is_behind)
+        {
+            client->is_behind = 0;
+            frame_release(frame);
+            queue_flush(client->queue);
+            wait_for_video = 1;
+            continue;
+        }
+
+        if (wait_for_video && frame->track != MKV_TRACK_VIDEO)
+        {
+            frame_release(frame);
+            continue;
+        }
+        wait_for_video = 0;
+
+        if (!is_started)
+        {
+            if (jpeg_size_get(frame->data, frame->length, &width, &height) ||
+                mkv_header_write(&mkv, width, height, sample_rate))
+            {
+                ret = -1;
+                frame_release(frame);
+                break;
+            }
+            start = frame->timestamp;
+            is_started = 1;
+        }
+
+        /* Audio captured right before the first image is skipped */
+        if (frame->timestamp >= start)
+        {
+            ret = mkv_block_write(&mkv, frame->track,
+                (frame->timestamp - start) / 1000, frame->data, frame->length);
+        }
+
+        frame_release(frame);
+    }
+
+    client_remove(client);
+    ESP_LOGI(TAG, "Client disconnected after %" PRIu64 " bytes", mkv.offset);
+
+    return is_started ? 0 : ret;
+}
+
+void live_stats_get(uint8_t *_clients, uint32_t *_frames_dropped)
+{
+    *_clients = 0;
+    *_frames_dropped = 0;
+    if (!lock)
+        return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *_clients = num_clients;
+    *_frames_dropped = frames_dropped;
+    xSemaphoreGive(lock);
+}
+
+uint8_t live_is_enabled(void)
+{
+    return clients != NULL;
+}
+
+int live_initialize(uint8_t _max_clients, size_t frame_size, uint8_t frames,
+    uint32_t _sample_rate)
+{
+    if (!_max_clients)
+    {
+        ESP_LOGI(TAG, "Live stream disabled");
+        return 0;
+    }
+
+    ESP_LOGD(TAG, "Initializing live stream");
+
+    if (!(lock = xSemaphoreCreateMutex()))
+    {
+        ESP_LOGE(TAG, "Failed creating mutex");
+        return -1;
+    }
+
+    /* Images are shared by the clients, audio packets are small enough for
+     * every client to have a full queue of them */
+    if (!(video_pool = pool_create(sizeof(live_frame_t) + frame_size, frames,
+        MALLOC_CAP_SPIRAM)))
+    {
+        return -1;
+    }
+
+    if (_sample_rate && !(audio_pool = pool_create(sizeof(live_frame_t) +
+        RTP_MAX_PAYLOAD_SIZE, _max_clients * (client_queue_size + 1),
+        MALLOC_CAP_SPIRAM)))
+    {
+        return -1;
+    }
+
+    if (!(clients = calloc(_max_clients, sizeof(*clients))))
+    {
+        ESP_LOGE(TAG, "Failed allocating clients");
+        return -1;
+    }
+
+    max_clients = _max_clients;
+    sample_rate = _sample_rate;
+
+    return 0;
+}
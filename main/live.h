@@ -0,0 +1,23 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return non-zero to stop streaming */
+typedef int (*live_sink_func_t)(const void *data, size_t length, void *ctx);
+
+/* Frames are shared by all clients, these don't copy if nobody's watching.
+ * Frames are copied into preallocated buffers, larger ones are dropped */
+int live_add_jpeg(const uint8_t *data, size_t length, int64_t timestamp);
+int live_add_opus(const uint8_t *data, size_t length, int64_t timestamp);
+
+/* Streams Matroska to the sink until it fails, blocking the caller */
+int live_stream(live_sink_func_t sink, void *ctx);
+
+void live_stats_get(uint8_t *clients, uint32_t *frames_dropped);
+uint8_t live_is_enabled(void);
+int live_initialize(uint8_t max_clients, size_t frame_size, uint8_t frames,
+    uint32_t sample_rate);
+
+#endif
@@ -1,46 +1,291 @@
 #include "microphone.h"
 #include "audio_encoder.h"
+#include "audio_processor.h"
+#include "pool.h"
+#include "sound_detector.h"
+#include "stats.h"
+#include "task_layout.h"
+#include <esp_attr.h>
 #include <esp_log.h>
 #include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
 #include <esp_timer.h>
 #include <driver/i2s_pdm.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <sys/socket.h>
 #include <string.h>
 #include <endian.h>
 
+/* Largest DMA buffer a single descriptor can hold */
+#define DMA_BUFFER_MAX_SIZE 4092
+/* Each DMA buffer holds a whole frame, the encoder has all but the one being
+ * written to to release it */
+#define DMA_BUFFERS_COUNT 6
+/* The filled DMA buffer is only reported as such from v5.4 on */
+#define DMA_BUF_IS_REPORTED (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0))
+
+/* Types */
+typedef struct {
+    int16_t *samples;
+    /* Counts the times the DMA filled it */
+    uint32_t fills;
+    uint8_t is_held;
+} dma_buffer_t;
+
+typedef struct {
+    dma_buffer_t *buffer;
+    uint32_t fills;
+    int64_t timestamp;
+} dma_frame_t;
+
 static const char *TAG = "Microphone";
+/* Enough for the frames queued to the encoder, the one being encoded and the
+ * one being captured */
+static const size_t pcm_pool_size = 8;
 
 /* Internal state */
 static uint8_t is_capturing = 0;
 static SemaphoreHandle_t capture_semaphore;
-static i2s_chan_handle_t chan_handle;
+static i2s_chan_handle_t chan_handle = NULL;
+static size_t frame_size = 0;
+static pool_t *pcm_pool = NULL;
+/* Frames are handed over directly from the DMA buffers, when they fit */
+static uint8_t is_dma_direct = 0;
+static QueueHandle_t dma_queue;
+static stats_queue_t *dma_queue_stats;
+static dma_buffer_t dma_buffers[DMA_BUFFERS_COUNT];
+static portMUX_TYPE dma_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t dma_frames = 0, dma_exhaustions = 0, overruns = 0;
+/* Frames handed to the encoder and not freed yet, queued or being encoded */
+static uint32_t frames_encoding = 0;
+
+static int16_t *IRAM_ATTR dma_buf_get(i2s_event_data_t *event)
+{
+#if DMA_BUF_IS_REPORTED
+    return event->dma_buf;
+#else
+    return NULL;
+#endif
+}
+
+/* Called from the I2S ISR once a DMA buffer was filled. The driver's own
+ * queue of filled buffers is never read from in this mode */
+static bool IRAM_ATTR dma_on_recv(i2s_chan_handle_t handle,
+    i2s_event_data_t *event, void *ctx)
+{
+    int16_t *samples = dma_buf_get(event);
+    dma_frame_t frame = {
+        .timestamp = esp_timer_get_time(),
+    };
+    BaseType_t woken = pdFALSE, result = pdFALSE;
+    dma_buffer_t *buffer = NULL;
+    uint8_t is_overrun = 0;
+    size_t i;
+
+    if (!is_capturing || !samples ||
+        event->size < sizeof(int16_t) * frame_size)
+    {
+        return false;
+    }
+
+    portENTER_CRITICAL_ISR(&dma_lock);
+    for (i = 0; i < DMA_BUFFERS_COUNT && !buffer; i++)
+    {
+        if (dma_buffers[i].samples == samples || !dma_buffers[i].samples)
+        {
+            buffer = &dma_buffers[i];
+            buffer->samples = samples;
+            frame.buffer = buffer;
+            frame.fills = ++buffer->fills;
+        }
+    }
+
+    /* Refilled while still held, the frame it held was overwritten. If it's
+     * still queued, it's skipped as its fills no longer match */
+    if (buffer && buffer->is_held)
+    {
+        is_overrun = 1;
+        overruns++;
+        dma_exhaustions++;
+    }
+    else if (buffer && (result = xQueueSendFromISR(dma_queue, &frame,
+        &woken)) == pdTRUE)
+    {
+        buffer->is_held = 1;
+        dma_frames++;
+    }
+    else
+        dma_exhaustions++;
+    portEXIT_CRITICAL_ISR(&dma_lock);
+
+    /* An overrun buffer is still queued, it wasn't sent again */
+    if (buffer && !is_overrun)
+        stats_queue_sent(dma_queue_stats, result);
+
+    return woken == pdTRUE;
+}
+
+/* The driver's queue of filled buffers overflowed, they aren't read fast
+ * enough */
+static bool IRAM_ATTR dma_on_recv_q_ovf(i2s_chan_handle_t handle,
+    i2s_event_data_t *event, void *ctx)
+{
+    portENTER_CRITICAL_ISR(&dma_lock);
+    overruns++;
+    portEXIT_CRITICAL_ISR(&dma_lock);
+
+    return false;
+}
+
+static void dma_buffer_release(void *ctx)
+{
+    size_t i;
+
+    portENTER_CRITICAL(&dma_lock);
+    for (i = 0; i < DMA_BUFFERS_COUNT; i++)
+    {
+        if (dma_buffers[i].samples == ctx)
+            dma_buffers[i].is_held = 0;
+    }
+    portEXIT_CRITICAL(&dma_lock);
+}
+
+/* A DMA buffer refilled while still held is counted as an overrun by the
+ * ISR, whether it was queued or being encoded */
+static void dma_frame_free(void *ctx)
+{
+    portENTER_CRITICAL(&dma_lock);
+    frames_encoding--;
+    portEXIT_CRITICAL(&dma_lock);
+
+    dma_buffer_release(ctx);
+}
+
+static void pcm_frame_free(void *ctx)
+{
+    portENTER_CRITICAL(&dma_lock);
+    frames_encoding--;
+    portEXIT_CRITICAL(&dma_lock);
+
+    pool_put(ctx);
+}
+
+static void microphone_frame_process(int16_t *samples, size_t count,
+    int64_t timestamp, audio_encoder_frame_free_func_t free_func)
+{
+    /* Metered before processing, the AGC would level it out */
+    sound_detector_process(samples, count);
+    audio_processor_process(samples, count);
+
+    /* XXX TODO go through ipcam.c */
+    if (audio_encoder_encode(samples, count, timestamp, free_func, samples))
+        free_func(samples);
+}
+
+/* Passed on by reference only when nothing is queued or being encoded ahead
+ * of it, so it's encoded well before the DMA comes around to its buffer
+ * again. Otherwise it's copied out first */
+static void dma_frame_process(const dma_frame_t *frame)
+{
+    int16_t *samples = frame->buffer->samples, *pcm_buffer;
+    uint8_t is_stale, is_idle;
+
+    portENTER_CRITICAL(&dma_lock);
+    is_stale = frame->fills != frame->buffer->fills;
+    is_idle = !frames_encoding;
+    if (!is_stale && is_idle)
+        frames_encoding++;
+    portEXIT_CRITICAL(&dma_lock);
+
+    /* Refilled before it was taken, the overrun was counted then */
+    if (is_stale)
+    {
+        dma_buffer_release(samples);
+        return;
+    }
+
+    if (is_idle)
+    {
+        microphone_frame_process(samples, frame_size, frame->timestamp,
+            dma_frame_free);
+        return;
+    }
+
+    /* The encoder is too far behind to keep up with a copy either */
+    if (!(pcm_buffer = pool_get(pcm_pool)))
+    {
+        portENTER_CRITICAL(&dma_lock);
+        dma_exhaustions++;
+        portEXIT_CRITICAL(&dma_lock);
+        dma_buffer_release(samples);
+        return;
+    }
+
+    /* Released once copied, unless it was refilled while copying */
+    memcpy(pcm_buffer, samples, sizeof(int16_t) * frame_size);
+    portENTER_CRITICAL(&dma_lock);
+    is_stale = frame->fills != frame->buffer->fills;
+    frame->buffer->is_held = 0;
+    if (!is_stale)
+        frames_encoding++;
+    portEXIT_CRITICAL(&dma_lock);
+
+    if (is_stale)
+        pool_put(pcm_buffer);
+    else
+    {
+        microphone_frame_process(pcm_buffer, frame_size, frame->timestamp,
+            pcm_frame_free);
+    }
+}
 
 static void microphone_capture_task(void *pvParameter)
 {
-    uint32_t sample_rate = (uint32_t)pvParameter;
-    size_t buffer_size = audio_encoder_frame_size(AUDIO_CODEC_OPUS, sample_rate);
+    size_t buffer_size = sizeof(int16_t) * frame_size;
+    dma_frame_t frame;
 
     while (1)
     {
         if (xSemaphoreTake(capture_semaphore, portMAX_DELAY) != pdTRUE)
             continue;
 
-        int16_t *pcm_buffer = (int16_t *)malloc(buffer_size * sizeof(int16_t));
+        if (is_dma_direct)
+        {
+            if (xQueueReceive(dma_queue, &frame, pdMS_TO_TICKS(1000)) ==
+                pdTRUE)
+            {
+                dma_frame_process(&frame);
+            }
+
+            xSemaphoreGive(capture_semaphore);
+            continue;
+        }
+
+        int16_t *pcm_buffer = pool_get(pcm_pool);
         size_t pcm_length;
 
-        if (i2s_channel_read(chan_handle, pcm_buffer, buffer_size * sizeof(int16_t), &pcm_length, 1000) != ESP_OK)
+        /* The encoder fell behind, the DMA buffers hold a few more frames */
+        if (!pcm_buffer)
+        {
+            xSemaphoreGive(capture_semaphore);
+            vTaskDelay(1);
+            continue;
+        }
+
+        if (i2s_channel_read(chan_handle, pcm_buffer, buffer_size, &pcm_length, 1000) != ESP_OK)
         {
             ESP_LOGE(TAG, "Microphone capture failed");
+            pool_put(pcm_buffer);
             xSemaphoreGive(capture_semaphore);
             continue;
         }
 
-        /* XXX TODO go through ipcam.c */
-        audio_encoder_encode(pcm_buffer, pcm_length / sizeof(int16_t),
-            esp_timer_get_time(), free, pcm_buffer);
+        microphone_frame_process(pcm_buffer, pcm_length / sizeof(int16_t),
+            esp_timer_get_time(), pool_put);
 
         xSemaphoreGive(capture_semaphore);
     }
@@ -50,6 +295,26 @@ static void microphone_capture_task(void *pvParameter)
     vTaskDelete(NULL);
 }
 
+void microphone_stats_get(uint32_t *allocations, uint32_t *exhaustions,
+    uint32_t *_overruns)
+{
+    pool_stats_t stats = {};
+
+    if (pcm_pool)
+        pool_stats_get(pcm_pool, &stats);
+
+    portENTER_CRITICAL(&dma_lock);
+    *allocations = is_dma_direct ? dma_frames : stats.allocations;
+    *exhaustions = is_dma_direct ? dma_exhaustions : stats.exhaustions;
+    *_overruns = overruns;
+    portEXIT_CRITICAL(&dma_lock);
+}
+
+uint8_t microphone_is_enabled(void)
+{
+    return chan_handle != NULL;
+}
+
 void microphone_start(void)
 {
     if (is_capturing)
@@ -74,8 +339,26 @@ void microphone_stop(void)
     ESP_LOGI(TAG, "Stopped microphone capture");
 }
 
+/* Samples per DMA buffer, a whole frame when it fits in one. Otherwise, the
+ * frame is split evenly so reads never end mid buffer */
+static size_t dma_frame_num_get(size_t samples)
+{
+    size_t parts = 1;
+
+    while (samples / parts * sizeof(int16_t) > DMA_BUFFER_MAX_SIZE ||
+        samples % parts)
+    {
+        parts++;
+    }
+
+    return samples / parts;
+}
+
 int microphone_initialize(int clk, int din, uint32_t sample_rate)
 {
+    i2s_event_callbacks_t callbacks = {};
+    size_t dma_frame_num;
+
     ESP_LOGD(TAG, "Initializing microphone");
 
     if (!(capture_semaphore = xSemaphoreCreateBinary()))
@@ -90,7 +373,13 @@ int microphone_initialize(int clk, int din, uint32_t sample_rate)
         return 0;
     }
 
+    frame_size = audio_encoder_frame_size();
+    dma_frame_num = dma_frame_num_get(frame_size);
+    is_dma_direct = DMA_BUF_IS_REPORTED && dma_frame_num == frame_size;
+
     i2s_chan_config_t chan_config = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    chan_config.dma_desc_num = DMA_BUFFERS_COUNT;
+    chan_config.dma_frame_num = dma_frame_num;
     ESP_ERROR_CHECK(i2s_new_channel(&chan_config, NULL, &chan_handle));
 
     i2s_pdm_rx_config_t pdm_rx_cfg = {
@@ -105,10 +394,40 @@ int microphone_initialize(int clk, int din, uint32_t sample_rate)
         },
     };
     ESP_ERROR_CHECK(i2s_channel_init_pdm_rx_mode(chan_handle, &pdm_rx_cfg));
+
+    /* Buffers are passed on to the encoder as is and recycled once encoded.
+     * Reading from the DMA buffers directly, they're only for copies */
+    if (!(pcm_pool = pool_create(sizeof(int16_t) * frame_size, pcm_pool_size,
+        MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL)))
+    {
+        ESP_LOGE(TAG, "Failed allocating PCM buffers");
+        return -1;
+    }
+
+    if (is_dma_direct)
+    {
+        /* Filled DMA buffers are passed on to the encoder as is, and are
+         * released once encoded */
+        if (!(dma_queue = xQueueCreate(DMA_BUFFERS_COUNT, sizeof(dma_frame_t))))
+        {
+            ESP_LOGE(TAG, "Failed creating queue");
+            return -1;
+        }
+        dma_queue_stats = stats_queue_register("microphone_dma", dma_queue);
+        callbacks.on_recv = dma_on_recv;
+    }
+    else
+        callbacks.on_recv_q_ovf = dma_on_recv_q_ovf;
+
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(chan_handle,
+        &callbacks, NULL));
     ESP_ERROR_CHECK(i2s_channel_enable(chan_handle));
 
-    if (xTaskCreatePinnedToCore(microphone_capture_task,
-        "microphone_capture_task", 4096, (void *)sample_rate, 5, NULL, 1) !=
+    ESP_LOGI(TAG, "Capturing frames of %zu samples %s", frame_size,
+        is_dma_direct ? "directly from DMA buffers" : "into PCM buffers");
+
+    if (task_layout_create(microphone_capture_task,
+        "microphone_capture_task", 4096, NULL, 5, NULL, 1) !=
         pdPASS)
     {
         ESP_LOGI(TAG, "Failed starting capture task");
@@ -5,6 +5,12 @@
 
 void microphone_start(void);
 void microphone_stop(void);
+
+/* Frames passed on to the encoder, the times no buffer was available for one,
+ * and the times the DMA buffers overran before being read */
+void microphone_stats_get(uint32_t *allocations, uint32_t *exhaustions,
+    uint32_t *overruns);
+uint8_t microphone_is_enabled(void);
 int microphone_initialize(int clk, int din, uint32_t sample_rate);
 
 #endif
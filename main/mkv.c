@@ -0,0 +1,270 @@
+#include "mkv.h"
+#include <string.h>
+
+/* Element IDs, see RFC 9559 */
+#define EBML_ID_EBML 0x1a45dfa3
+#define EBML_ID_VERSION 0x4286
+#define EBML_ID_READ_VERSION 0x42f7
+#define EBML_ID_MAX_ID_LENGTH 0x42f2
+#define EBML_ID_MAX_SIZE_LENGTH 0x42f3
+#define EBML_ID_DOC_TYPE 0x4282
+#define EBML_ID_DOC_TYPE_VERSION 0x4287
+#define EBML_ID_DOC_TYPE_READ_VERSION 0x4285
+#define MKV_ID_SEGMENT 0x18538067
+#define MKV_ID_INFO 0x1549a966
+#define MKV_ID_TIMESTAMP_SCALE 0x2ad7b1
+#define MKV_ID_MUXING_APP 0x4d80
+#define MKV_ID_WRITING_APP 0x5741
+#define MKV_ID_TRACKS 0x1654ae6b
+#define MKV_ID_TRACK_ENTRY 0xae
+#define MKV_ID_TRACK_NUMBER 0xd7
+#define MKV_ID_TRACK_UID 0x73c5
+#define MKV_ID_TRACK_TYPE 0x83
+#define MKV_ID_FLAG_LACING 0x9c
+#define MKV_ID_CODEC_ID 0x86
+#define MKV_ID_CODEC_PRIVATE 0x63a2
+#define MKV_ID_SEEK_PRE_ROLL 0x56bb
+#define MKV_ID_VIDEO 0xe0
+#define MKV_ID_PIXEL_WIDTH 0xb0
+#define MKV_ID_PIXEL_HEIGHT 0xba
+#define MKV_ID_AUDIO 0xe1
+#define MKV_ID_SAMPLING_FREQUENCY 0xb5
+#define MKV_ID_CHANNELS 0x9f
+#define MKV_ID_CLUSTER 0x1f43b675
+#define MKV_ID_CLUSTER_TIMESTAMP 0xe7
+#define MKV_ID_SIMPLE_BLOCK 0xa3
+
+#define MKV_TRACK_TYPE_VIDEO 1
+#define MKV_TRACK_TYPE_AUDIO 2
+
+/* Constants */
+static const uint8_t unknown_size[] = {
+    0x01, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+/* A new cluster is started on the first video frame after this interval so
+ * players can seek with that granularity */
+static const int64_t CLUSTER_DURATION = 1000;
+
+/* EBML encoding helpers, writing into a buffer */
+static uint8_t *ebml_id(uint8_t *p, uint32_t id)
+{
+    if (id > 0xffffff)
+        *p++ = id >> 24;
+    if (id > 0xffff)
+        *p++ = id >> 16;
+    if (id > 0xff)
+        *p++ = id >> 8;
+    *p++ = id;
+
+    return p;
+}
+
+static uint8_t *ebml_size(uint8_t *p, uint64_t size)
+{
+    int len = 1, i;
+
+    /* All ones is reserved for unknown sizes */
+    while (len < 8 && size >= (1ULL << (7 * len)) - 1)
+        len++;
+
+    for (i = len - 1; i >= 0; i--)
+        *p++ = (size >> (8 * i)) | (i == len - 1 ? 0x80 >> (len - 1) : 0);
+
+    return p;
+}
+
+static uint8_t *ebml_uint(uint8_t *p, uint32_t id, uint64_t value)
+{
+    int len = 1, i;
+
+    while (len < 8 && value >> (8 * len))
+        len++;
+
+    p = ebml_id(p, id);
+    p = ebml_size(p, len);
+    for (i = len - 1; i >= 0; i--)
+        *p++ = value >> (8 * i);
+
+    return p;
+}
+
+static uint8_t *ebml_float(uint8_t *p, uint32_t id, double value)
+{
+    uint64_t bits;
+    int i;
+
+    memcpy(&bits, &value, sizeof(bits));
+    p = ebml_id(p, id);
+    p = ebml_size(p, 8);
+    for (i = 7; i >= 0; i--)
+        *p++ = bits >> (8 * i);
+
+    return p;
+}
+
+static uint8_t *ebml_binary(uint8_t *p, uint32_t id, const void *data,
+    size_t length)
+{
+    p = ebml_id(p, id);
+    p = ebml_size(p, length);
+    memcpy(p, data, length);
+
+    return p + length;
+}
+
+static uint8_t *ebml_string(uint8_t *p, uint32_t id, const char *s)
+{
+    return ebml_binary(p, id, s, strlen(s));
+}
+
+/* Master elements get a fixed 8 byte size which is patched once the content
+ * is known, returning where the content starts */
+static uint8_t *ebml_master_start(uint8_t *p, uint32_t id)
+{
+    p = ebml_id(p, id);
+    memcpy(p, unknown_size, sizeof(unknown_size));
+
+    return p + sizeof(unknown_size);
+}
+
+static void ebml_master_end(uint8_t *content, uint8_t *p)
+{
+    uint64_t size = p - content;
+    int i;
+
+    for (i = 1; i < 8; i++)
+        content[i - 8] = size >> (8 * (7 - i));
+}
+
+static int writer_write(mkv_writer_t *writer, const void *data, size_t length)
+{
+    if (writer->write(data, length, writer->ctx))
+        return -1;
+
+    writer->offset += length;
+
+    return 0;
+}
+
+void mkv_writer_init(mkv_writer_t *writer, mkv_write_func_t write, void *ctx)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->write = write;
+    writer->ctx = ctx;
+}
+
+int mkv_header_write(mkv_writer_t *writer, uint16_t width, uint16_t height,
+    uint32_t sample_rate)
+{
+    uint8_t buf[320], *p = buf, *ebml, *info, *tracks, *track, *sub;
+    /* See RFC 7845 section 5.1, mono with no pre-skip */
+    uint8_t opus_head[19] = {
+        'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, 1, 0, 0,
+        sample_rate, sample_rate >> 8, sample_rate >> 16, sample_rate >> 24,
+        0, 0, 0
+    };
+
+    ebml = ebml_master_start(p, EBML_ID_EBML);
+    p = ebml_uint(ebml, EBML_ID_VERSION, 1);
+    p = ebml_uint(p, EBML_ID_READ_VERSION, 1);
+    p = ebml_uint(p, EBML_ID_MAX_ID_LENGTH, 4);
+    p = ebml_uint(p, EBML_ID_MAX_SIZE_LENGTH, 8);
+    p = ebml_string(p, EBML_ID_DOC_TYPE, "matroska");
+    p = ebml_uint(p, EBML_ID_DOC_TYPE_VERSION, 4);
+    p = ebml_uint(p, EBML_ID_DOC_TYPE_READ_VERSION, 2);
+    ebml_master_end(ebml, p);
+
+    /* The segment keeps its unknown size so it can be streamed */
+    p = ebml_master_start(p, MKV_ID_SEGMENT);
+
+    info = ebml_master_start(p, MKV_ID_INFO);
+    p = ebml_uint(info, MKV_ID_TIMESTAMP_SCALE, 1000000);
+    p = ebml_string(p, MKV_ID_MUXING_APP, "ipcam");
+    p = ebml_string(p, MKV_ID_WRITING_APP, "ipcam");
+    ebml_master_end(info, p);
+
+    tracks = ebml_master_start(p, MKV_ID_TRACKS);
+
+    track = ebml_master_start(tracks, MKV_ID_TRACK_ENTRY);
+    p = ebml_uint(track, MKV_ID_TRACK_NUMBER, MKV_TRACK_VIDEO);
+    p = ebml_uint(p, MKV_ID_TRACK_UID, MKV_TRACK_VIDEO);
+    p = ebml_uint(p, MKV_ID_TRACK_TYPE, MKV_TRACK_TYPE_VIDEO);
+    p = ebml_uint(p, MKV_ID_FLAG_LACING, 0);
+    p = ebml_string(p, MKV_ID_CODEC_ID, "V_MJPEG");
+    sub = ebml_master_start(p, MKV_ID_VIDEO);
+    p = ebml_uint(sub, MKV_ID_PIXEL_WIDTH, width);
+    p = ebml_uint(p, MKV_ID_PIXEL_HEIGHT, height);
+    ebml_master_end(sub, p);
+    ebml_master_end(track, p);
+
+    if (sample_rate)
+    {
+        track = ebml_master_start(p, MKV_ID_TRACK_ENTRY);
+        p = ebml_uint(track, MKV_ID_TRACK_NUMBER, MKV_TRACK_AUDIO);
+        p = ebml_uint(p, MKV_ID_TRACK_UID, MKV_TRACK_AUDIO);
+        p = ebml_uint(p, MKV_ID_TRACK_TYPE, MKV_TRACK_TYPE_AUDIO);
+        p = ebml_uint(p, MKV_ID_FLAG_LACING, 0);
+        p = ebml_string(p, MKV_ID_CODEC_ID, "A_OPUS");
+        p = ebml_binary(p, MKV_ID_CODEC_PRIVATE, opus_head,
+            sizeof(opus_head));
+        p = ebml_uint(p, MKV_ID_SEEK_PRE_ROLL, 80000000);
+        sub = ebml_master_start(p, MKV_ID_AUDIO);
+        /* Opus always decodes at 48kHz, the input rate is informational */
+        p = ebml_float(sub, MKV_ID_SAMPLING_FREQUENCY, 48000);
+        p = ebml_uint(p, MKV_ID_CHANNELS, 1);
+        ebml_master_end(sub, p);
+        ebml_master_end(track, p);
+    }
+
+    ebml_master_end(tracks, p);
+
+    writer->in_cluster = 0;
+
+    return writer_write(writer, buf, p - buf);
+}
+
+static int cluster_start(mkv_writer_t *writer, int64_t time)
+{
+    uint8_t buf[32], *p;
+
+    p = ebml_id(buf, MKV_ID_CLUSTER);
+    memcpy(p, unknown_size, sizeof(unknown_size));
+    p = ebml_uint(p + sizeof(unknown_size), MKV_ID_CLUSTER_TIMESTAMP, time);
+
+    writer->cluster_offset = writer->offset;
+    writer->cluster_time = time;
+    writer->in_cluster = 1;
+
+    return writer_write(writer, buf, p - buf);
+}
+
+int mkv_block_write(mkv_writer_t *writer, uint8_t track, int64_t time,
+    const uint8_t *data, size_t length)
+{
+    uint8_t buf[16], *p;
+    int64_t relative = time - writer->cluster_time;
+
+    if (time < 0)
+        return -1;
+
+    if (!writer->in_cluster || relative > INT16_MAX || relative < INT16_MIN ||
+        (track == MKV_TRACK_VIDEO && relative >= CLUSTER_DURATION))
+    {
+        if (cluster_start(writer, time))
+            return -1;
+        relative = 0;
+    }
+
+    /* Track number, relative timestamp and flags, every frame is a keyframe */
+    p = ebml_id(buf, MKV_ID_SIMPLE_BLOCK);
+    p = ebml_size(p, length + 4);
+    *p++ = 0x80 | track;
+    *p++ = (uint16_t)relative >> 8;
+    *p++ = (uint16_t)relative;
+    *p++ = 0x80;
+
+    if (writer_write(writer, buf, p - buf))
+        return -1;
+
+    return writer_write(writer, data, length);
+}
@@ -0,0 +1,37 @@
+#ifndef MKV_H
+#define MKV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Constants */
+#define MKV_TRACK_VIDEO 1
+#define MKV_TRACK_AUDIO 2
+
+/* Types */
+typedef int (*mkv_write_func_t)(const void *data, size_t length, void *ctx);
+
+typedef struct {
+    mkv_write_func_t write;
+    void *ctx;
+    uint64_t offset;
+    /* Current cluster, all times are in milliseconds */
+    uint8_t in_cluster;
+    uint64_t cluster_offset;
+    int64_t cluster_time;
+} mkv_writer_t;
+
+void mkv_writer_init(mkv_writer_t *writer, mkv_write_func_t write, void *ctx);
+
+/* Writes the EBML header, segment information and track list. The segment
+ * size is unknown so the output can be streamed. Set sample_rate to 0 if
+ * there's no audio track */
+int mkv_header_write(mkv_writer_t *writer, uint16_t width, uint16_t height,
+    uint32_t sample_rate);
+
+/* Writes a block, starting a new cluster on video frames if needed. The block
+ * data is passed to the write function as is, without copying it */
+int mkv_block_write(mkv_writer_t *writer, uint8_t track, int64_t time,
+    const uint8_t *data, size_t length);
+
+#endif
@@ -0,0 +1,153 @@
+#include "motion_detector.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constants */
+static const char *TAG = "MotionDetector";
+static const int64_t HOLD_TIME_US = 5 * 1000 * 1000;
+/* The background model is kept with 4 fractional bits and adapts by 1/16 of
+ * the difference on every frame */
+static const uint8_t FRACTION_BITS = 4;
+static const uint8_t LEARNING_SHIFT = 4;
+
+/* Internal state */
+static uint16_t *background = NULL;
+static uint16_t map_width = 0, map_height = 0;
+static uint8_t threshold = 0, area = 0;
+static uint8_t is_detected = 0;
+static int64_t last_motion_time = 0;
+
+/* Callback functions */
+static motion_detector_on_trigger_cb_t on_motion_detector_trigger_cb = NULL;
+
+void motion_detector_set_on_trigger(motion_detector_on_trigger_cb_t cb)
+{
+    on_motion_detector_trigger_cb = cb;
+}
+
+static int background_reset(const uint8_t *map, uint16_t width,
+    uint16_t height)
+{
+    size_t i, cells = (size_t)width * height;
+
+    free(background);
+    if (!(background = malloc(cells * sizeof(*background))))
+    {
+        ESP_LOGE(TAG, "Failed allocating background model");
+        map_width = map_height = 0;
+        return -1;
+    }
+
+    for (i = 0; i < cells; i++)
+        background[i] = map[i] << FRACTION_BITS;
+
+    map_width = width;
+    map_height = height;
+    ESP_LOGI(TAG, "Background model reset (%ux%u blocks)", width, height);
+
+    return 0;
+}
+
+int motion_detector_process(const uint8_t *map, uint16_t width,
+    uint16_t height, int64_t timestamp)
+{
+    int64_t start = esp_timer_get_time();
+    uint16_t x, y;
+    uint16_t min_x = UINT16_MAX, min_y = UINT16_MAX, max_x = 0, max_y = 0;
+    size_t i, cells, changed = 0;
+    int32_t sum = 0, offset;
+    uint8_t score;
+
+    if (!threshold || !map)
+        return 0;
+
+    if (width != map_width || height != map_height)
+        return background_reset(map, width, height);
+
+    cells = (size_t)width * height;
+
+    /* Compensate for global brightness changes, e.g., auto exposure */
+    for (i = 0; i < cells; i++)
+        sum += (map[i] << FRACTION_BITS) - background[i];
+    offset = sum / (int32_t)cells;
+
+    for (i = 0, y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++, i++)
+        {
+            int32_t diff = (map[i] << FRACTION_BITS) - background[i];
+
+            background[i] += diff >> LEARNING_SHIFT;
+
+            if (abs(diff - offset) >> FRACTION_BITS <= threshold)
+                continue;
+
+            changed++;
+            if (x < min_x)
+                min_x = x;
+            if (x > max_x)
+                max_x = x;
+            if (y < min_y)
+                min_y = y;
+            if (y > max_y)
+                max_y = y;
+        }
+    }
+
+    score = changed * 100 / cells;
+    ESP_LOGD(TAG, "Score %u%% (%zu blocks) in %" PRId64 "us", score, changed,
+        esp_timer_get_time() - start);
+
+    if (score >= area)
+    {
+        last_motion_time = timestamp;
+        if (is_detected)
+            return 0;
+
+        is_detected = 1;
+        if (on_motion_detector_trigger_cb)
+        {
+            on_motion_detector_trigger_cb(1, score, min_x * 8, min_y * 8,
+                (max_x - min_x + 1) * 8, (max_y - min_y + 1) * 8);
+        }
+    }
+    else if (is_detected && timestamp - last_motion_time > HOLD_TIME_US)
+    {
+        is_detected = 0;
+        if (on_motion_detector_trigger_cb)
+            on_motion_detector_trigger_cb(0, score, 0, 0, 0, 0);
+    }
+
+    return 0;
+}
+
+uint8_t motion_detector_is_enabled(void)
+{
+    return threshold != 0;
+}
+
+int motion_detector_initialize(uint8_t _threshold, uint8_t _area)
+{
+    /* The background is learned again from the next frame */
+    free(background);
+    background = NULL;
+    map_width = map_height = 0;
+    is_detected = 0;
+    threshold = 0;
+
+    if (!_threshold)
+    {
+        ESP_LOGI(TAG, "Motion detector disabled");
+        return 0;
+    }
+
+    ESP_LOGD(TAG, "Initializing motion detector");
+
+    threshold = _threshold;
+    area = _area ? : 1;
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef MOTION_DETECTOR_H
+#define MOTION_DETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Event callback types */
+typedef void (*motion_detector_on_trigger_cb_t)(uint8_t detected,
+    uint8_t score, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+/* Event handlers */
+void motion_detector_set_on_trigger(motion_detector_on_trigger_cb_t cb);
+
+/* Processes a DC map, as produced by jpeg_dc_decode() */
+int motion_detector_process(const uint8_t *map, uint16_t width,
+    uint16_t height, int64_t timestamp);
+
+uint8_t motion_detector_is_enabled(void);
+int motion_detector_initialize(uint8_t threshold, uint8_t area);
+
+#endif
@@ -1,4 +1,5 @@
 #include "motion_sensor.h"
+#include "task_layout.h"
 #include <esp_log.h>
 #include <driver/gpio.h>
 #include <freertos/FreeRTOS.h>
@@ -74,7 +75,8 @@ int motion_sensor_initialize(int pin)
     gpio_install_isr_service(0);
     gpio_isr_handler_add(pin, motion_sensor_isr_handler, (void *)pin);
 
-    xTaskCreate(&motion_sensor_task, "motion_sensor_task", 4096, NULL, 5, NULL);
+    task_layout_create(motion_sensor_task, "motion_sensor_task", 4096, NULL, 5,
+        NULL, tskNO_AFFINITY);
 
     return 0;
 }
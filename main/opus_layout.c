@@ -0,0 +1,71 @@
+#include "opus_layout.h"
+#include <esp_log.h>
+#include <inttypes.h>
+
+/* Constants */
+static const char *TAG = "OpusLayout";
+/* Longest packet Opus allows, in microseconds */
+static const uint32_t max_packet_duration = 120000;
+/* Largest frame Opus produces, in bytes */
+static const size_t max_frame_size = 1276;
+
+/* Frames are limited to twice the average size, leaving room for VBR */
+static size_t frame_size_get(uint32_t bitrate, uint32_t frame_duration)
+{
+    size_t size = 1 + (uint64_t)bitrate * frame_duration / 8000000 * 2;
+
+    return size > max_frame_size ? max_frame_size : size;
+}
+
+/* Combining frames drops all but the first TOC byte and adds up to 2 bytes of
+ * length per frame and 2 bytes of frame count */
+static size_t packet_size_get(size_t frame_size, size_t frames)
+{
+    if (frames == 1)
+        return frame_size;
+
+    return 2 + frames * (frame_size + 2);
+}
+
+int opus_layout_get(uint32_t bitrate, uint32_t frame_duration,
+    uint32_t packet_duration, size_t max_payload_size, opus_layout_t *layout)
+{
+    switch (frame_duration)
+    {
+    case 2500: case 5000: case 10000: case 20000: case 40000: case 60000:
+        break;
+    default:
+        ESP_LOGE(TAG, "Invalid Opus frame duration %" PRIu32 "us",
+            frame_duration);
+        return -1;
+    }
+
+    if (packet_duration < frame_duration ||
+        packet_duration > max_packet_duration ||
+        packet_duration % frame_duration)
+    {
+        ESP_LOGE(TAG, "Opus packet duration %" PRIu32 "us isn't a multiple of "
+            "the frame duration, up to %" PRIu32 "us", packet_duration,
+            max_packet_duration);
+        return -1;
+    }
+
+    layout->max_frame_size = frame_size_get(bitrate, frame_duration);
+    layout->frames_per_packet = packet_duration / frame_duration;
+
+    /* Packets are never fragmented, fewer frames are combined if they might
+     * not fit in one. A single frame is then limited to the payload size */
+    while (packet_size_get(layout->max_frame_size, layout->frames_per_packet) >
+        max_payload_size && layout->frames_per_packet > 1)
+    {
+        layout->frames_per_packet--;
+    }
+    if (layout->max_frame_size > max_payload_size)
+        layout->max_frame_size = max_payload_size;
+
+    layout->packet_duration = layout->frames_per_packet * frame_duration;
+    layout->max_packet_size = packet_size_get(layout->max_frame_size,
+        layout->frames_per_packet);
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef OPUS_LAYOUT_H
+#define OPUS_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Types */
+typedef struct {
+    /* In microseconds, shortened if a packet might not fit in one payload */
+    uint32_t packet_duration;
+    size_t frames_per_packet;
+    /* Upper bounds, in bytes */
+    size_t max_frame_size;
+    size_t max_packet_size;
+} opus_layout_t;
+
+/* Lays out packets of frames at the given bitrate, durations are in
+ * microseconds. Fails if Opus doesn't support the frame duration, or the
+ * packet duration isn't a multiple of it */
+int opus_layout_get(uint32_t bitrate, uint32_t frame_duration,
+    uint32_t packet_duration, size_t max_payload_size, opus_layout_t *layout);
+
+#endif
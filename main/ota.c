@@ -1,5 +1,6 @@
 #include "ota.h"
 #include "config.h"
+#include "task_layout.h"
 #include <stddef.h>
 #include <esp_http_client.h>
 #include <esp_err.h>
@@ -237,7 +238,7 @@ int ota_download(ota_type_t type, const char *url, ota_on_completed_cb_t cb)
     ctx->url = strdup(url);
     ctx->on_completed_cb = cb;
 
-    xTaskCreatePinnedToCore(ota_task, "ota_task", 8192, ctx, 5, NULL, 1);
+    task_layout_create(ota_task, "ota_task", 8192, ctx, 5, NULL, 1);
 
     return 0;
 }
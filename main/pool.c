@@ -0,0 +1,136 @@
+#include "pool.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <stdlib.h>
+
+/* Types */
+typedef struct block_t {
+    /* Set while the block is in use, the next free block otherwise */
+    union {
+        pool_t *pool;
+        struct block_t *next;
+    };
+    /* Aligned for DMA and 64-bit accesses */
+    uint8_t data[] __attribute__((aligned(8)));
+} block_t;
+
+struct pool_t {
+    portMUX_TYPE lock;
+    uint8_t *blocks;
+    block_t *free_list;
+    size_t block_size;
+    pool_stats_t stats;
+};
+
+/* Constants */
+static const char *TAG = "Pool";
+
+void *pool_get(pool_t *pool)
+{
+    block_t *block;
+
+    portENTER_CRITICAL(&pool->lock);
+    if ((block = pool->free_list))
+    {
+        pool->free_list = block->next;
+        pool->stats.allocations++;
+        if (++pool->stats.in_use > pool->stats.high_water)
+            pool->stats.high_water = pool->stats.in_use;
+    }
+    else
+        pool->stats.exhaustions++;
+    portEXIT_CRITICAL(&pool->lock);
+
+    if (!block)
+        return NULL;
+
+    block->pool = pool;
+    return block->data;
+}
+
+void pool_put(void *data)
+{
+    block_t *block;
+    pool_t *pool;
+
+    if (!data)
+        return;
+
+    block = (block_t *)((uint8_t *)data - offsetof(block_t, data));
+    pool = block->pool;
+
+    portENTER_CRITICAL(&pool->lock);
+    block->next = pool->free_list;
+    pool->free_list = block;
+    pool->stats.in_use--;
+    portEXIT_CRITICAL(&pool->lock);
+}
+
+void pool_stats_get(pool_t *pool, pool_stats_t *stats)
+{
+    portENTER_CRITICAL(&pool->lock);
+    *stats = pool->stats;
+    portEXIT_CRITICAL(&pool->lock);
+}
+
+size_t pool_block_size(pool_t *pool)
+{
+    return pool->block_size;
+}
+
+pool_t *pool_create(size_t block_size, size_t count, uint32_t caps)
+{
+    size_t stride = (sizeof(block_t) + block_size + 7) & ~7;
+    uint8_t *blocks;
+    pool_t *pool;
+    size_t i;
+
+    if (!(pool = calloc(1, sizeof(*pool))))
+        return NULL;
+
+    /* All blocks are allocated together, and freed together */
+    if (!(blocks = heap_caps_malloc(stride * count, caps)))
+    {
+        ESP_LOGE(TAG, "Failed allocating %zu blocks of %zu bytes", count,
+            block_size);
+        free(pool);
+        return NULL;
+    }
+
+    portMUX_INITIALIZE(&pool->lock);
+    pool->blocks = blocks;
+    pool->block_size = block_size;
+    pool->stats.count = count;
+    for (i = count; i > 0; i--)
+    {
+        block_t *block = (block_t *)(blocks + (i - 1) * stride);
+
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+
+    return pool;
+}
+
+int pool_destroy(pool_t *pool)
+{
+    size_t in_use;
+
+    if (!pool)
+        return 0;
+
+    portENTER_CRITICAL(&pool->lock);
+    in_use = pool->stats.in_use;
+    portEXIT_CRITICAL(&pool->lock);
+
+    if (in_use)
+    {
+        ESP_LOGW(TAG, "Not destroying a pool with %zu blocks in use", in_use);
+        return -1;
+    }
+
+    heap_caps_free(pool->blocks);
+    free(pool);
+    return 0;
+}
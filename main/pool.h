@@ -0,0 +1,32 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fixed size blocks allocated once, getting and putting one back is O(1) and
+ * safe from any task */
+typedef struct pool_t pool_t;
+
+typedef struct {
+    uint32_t allocations;
+    /* Number of times no block was available */
+    uint32_t exhaustions;
+    size_t in_use;
+    size_t high_water;
+    size_t count;
+} pool_stats_t;
+
+void *pool_get(pool_t *pool);
+/* Takes the block only, so it can be used as a free function */
+void pool_put(void *block);
+
+void pool_stats_get(pool_t *pool, pool_stats_t *stats);
+size_t pool_block_size(pool_t *pool);
+
+/* Caps as in heap_caps_malloc(), e.g. MALLOC_CAP_DMA */
+pool_t *pool_create(size_t block_size, size_t count, uint32_t caps);
+/* Fails, keeping it, while any of its blocks is still in use */
+int pool_destroy(pool_t *pool);
+
+#endif
@@ -0,0 +1,335 @@
+#include "prebuffer.h"
+#include "jpeg.h"
+#include "mkv.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* Types */
+typedef struct {
+    prebuffer_frame_t frame;
+    /* Sequence numbers are contiguous from head to the newest entry */
+    uint32_t seq;
+    uint8_t refcount;
+} entry_t;
+
+typedef struct {
+    mkv_writer_t writer;
+    uint8_t is_started;
+    int64_t start_time;
+} mkv_dump_t;
+
+/* Constants */
+static const char *TAG = "Prebuffer";
+/* Upper bound of audio packets per second, used for sizing the entry table */
+static const size_t max_audio_packets_per_second = 50;
+
+/* Internal state */
+static SemaphoreHandle_t lock = NULL;
+static uint8_t *buffer = NULL;
+static size_t buffer_size = 0;
+static entry_t *entries = NULL;
+static size_t max_entries = 0;
+static size_t head = 0, count = 0;
+static size_t write_offset = 0;
+static int64_t window = 0;
+static uint32_t sample_rate = 0;
+static uint32_t next_seq = 0;
+static uint32_t dropped = 0;
+
+/* Latched pre-event frames, as the range of sequence numbers [first, end) so
+ * nothing is pinned and new frames keep evicting the oldest ones */
+static uint8_t is_latched = 0;
+static uint32_t latch_first = 0, latch_end = 0;
+static int64_t latch_time = 0;
+
+static inline entry_t *entry_get(size_t first, size_t i)
+{
+    return &entries[(first + i) % max_entries];
+}
+
+static inline uint32_t head_seq(void)
+{
+    return count ? entries[head].seq : next_seq;
+}
+
+/* Sequence numbers wrap around */
+static inline uint8_t seq_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+/* Returns 0 and the offset for the new frame if it can be placed without
+ * evicting anything */
+static int space_get(size_t length, size_t *offset)
+{
+    size_t oldest;
+
+    if (count == max_entries)
+        return -1;
+
+    if (!count)
+    {
+        *offset = write_offset + length <= buffer_size ? write_offset : 0;
+        return 0;
+    }
+
+    oldest = entries[head].frame.data - buffer;
+    if (write_offset > oldest)
+    {
+        /* Used space is [oldest, write_offset), try the end, then the start */
+        if (write_offset + length <= buffer_size)
+            *offset = write_offset;
+        else if (length <= oldest)
+            *offset = 0;
+        else
+            return -1;
+        return 0;
+    }
+
+    /* Used space wraps around, free space is [write_offset, oldest) */
+    if (write_offset + length > oldest)
+        return -1;
+
+    *offset = write_offset;
+    return 0;
+}
+
+/* Evicting is O(1) per frame, the entry pinned by a dump can't be evicted */
+static int evict_oldest(void)
+{
+    if (!count || entries[head].refcount)
+        return -1;
+
+    head = (head + 1) % max_entries;
+    count--;
+
+    return 0;
+}
+
+int prebuffer_add(prebuffer_type_t type, const uint8_t *data, size_t length,
+    int64_t timestamp)
+{
+    entry_t *entry;
+    size_t offset;
+
+    if (!buffer || !length || length > buffer_size)
+        return -1;
+
+    /* Audio is only buffered if it's recorded */
+    if (type == PREBUFFER_TYPE_OPUS && !sample_rate)
+        return 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    /* Forget an event nobody collected */
+    if (is_latched && timestamp - latch_time > window)
+        is_latched = 0;
+
+    /* Drop expired frames */
+    while (count && entries[head].frame.timestamp < timestamp - window)
+    {
+        if (evict_oldest())
+            break;
+    }
+
+    while (space_get(length, &offset))
+    {
+        if (evict_oldest())
+        {
+            xSemaphoreGive(lock);
+            ESP_LOGD(TAG, "No space for frame, dropped %" PRIu32, ++dropped);
+            return -1;
+        }
+    }
+
+    entry = entry_get(head, count);
+    entry->frame.type = type;
+    entry->frame.data = buffer + offset;
+    entry->frame.length = length;
+    entry->frame.timestamp = timestamp;
+    entry->seq = next_seq++;
+    entry->refcount = 0;
+
+    /* Copy while holding the lock so readers never see partial frames */
+    memcpy(buffer + offset, data, length);
+    write_offset = offset + length;
+    count++;
+
+    xSemaphoreGive(lock);
+
+    return 0;
+}
+
+void prebuffer_trigger(void)
+{
+    uint32_t n;
+
+    if (!buffer)
+        return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    /* Replaces a previous event, which the new one overlaps */
+    latch_first = head_seq();
+    latch_end = next_seq;
+    latch_time = esp_timer_get_time();
+    is_latched = 1;
+    n = latch_end - latch_first;
+
+    xSemaphoreGive(lock);
+
+    ESP_LOGI(TAG, "Latched %" PRIu32 " pre-event frames", n);
+}
+
+int prebuffer_dump(prebuffer_sink_func_t sink, void *ctx)
+{
+    uint32_t seq, end, evicted = 0;
+    entry_t *entry;
+    int ret = 0;
+
+    if (!buffer)
+        return -1;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    /* The latched event, kept for other readers until it expires, or
+     * everything buffered so far */
+    seq = is_latched ? latch_first : head_seq();
+    end = is_latched ? latch_end : next_seq;
+
+    /* Only the frame handed to the sink is pinned, it's safe to use without
+     * the lock and the rest of the buffer keeps taking new frames */
+    while (!ret)
+    {
+        /* Frames evicted while dumping are skipped */
+        if (seq_before(seq, head_seq()))
+        {
+            evicted += head_seq() - seq;
+            seq = head_seq();
+        }
+        if (!seq_before(seq, end))
+            break;
+
+        entry = entry_get(head, seq - head_seq());
+        entry->refcount++;
+        xSemaphoreGive(lock);
+
+        ret = sink(&entry->frame, ctx);
+        seq++;
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        entry->refcount--;
+    }
+
+    xSemaphoreGive(lock);
+
+    if (evicted)
+        ESP_LOGW(TAG, "%" PRIu32 " pre-event frames evicted before dumped",
+            evicted);
+
+    return ret;
+}
+
+static int mkv_sink(const prebuffer_frame_t *frame, void *ctx)
+{
+    mkv_dump_t *dump = (mkv_dump_t *)ctx;
+    uint8_t track = frame->type == PREBUFFER_TYPE_JPEG ? MKV_TRACK_VIDEO :
+        MKV_TRACK_AUDIO;
+    uint16_t width, height;
+
+    /* The header takes the resolution of the first video frame, audio before
+     * it is skipped so times never go negative */
+    if (!dump->is_started)
+    {
+        if (track != MKV_TRACK_VIDEO)
+            return 0;
+
+        if (jpeg_size_get(frame->data, frame->length, &width, &height))
+        {
+            ESP_LOGE(TAG, "Failed parsing JPEG header");
+            return -1;
+        }
+
+        if (mkv_header_write(&dump->writer, width, height, sample_rate))
+            return -1;
+
+        dump->start_time = frame->timestamp;
+        dump->is_started = 1;
+    }
+
+    if (frame->timestamp < dump->start_time)
+        return 0;
+
+    return mkv_block_write(&dump->writer, track,
+        (frame->timestamp - dump->start_time) / 1000, frame->data,
+        frame->length);
+}
+
+int prebuffer_mkv_dump(mkv_write_func_t write, void *ctx)
+{
+    mkv_dump_t dump = {};
+
+    mkv_writer_init(&dump.writer, write, ctx);
+
+    return prebuffer_dump(mkv_sink, &dump);
+}
+
+uint8_t prebuffer_is_enabled(void)
+{
+    return buffer != NULL;
+}
+
+int prebuffer_initialize(size_t size, uint8_t seconds, int fps,
+    uint32_t _sample_rate)
+{
+    /* Starting over, nothing may be dumping by now */
+    free(buffer);
+    free(entries);
+    buffer = NULL;
+    entries = NULL;
+    head = count = write_offset = 0;
+    is_latched = 0;
+
+    if (!size || !seconds)
+    {
+        ESP_LOGI(TAG, "Pre-event buffer disabled");
+        return 0;
+    }
+
+    ESP_LOGD(TAG, "Initializing pre-event buffer");
+
+    if (!lock && !(lock = xSemaphoreCreateMutex()))
+    {
+        ESP_LOGE(TAG, "Failed creating mutex");
+        return -1;
+    }
+
+    max_entries = seconds * (fps + max_audio_packets_per_second);
+    if (!(entries = calloc(max_entries, sizeof(*entries))))
+    {
+        ESP_LOGE(TAG, "Failed allocating entries");
+        return -1;
+    }
+
+    /* The entire budget is allocated up front, nothing is allocated later */
+    if (!(buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM)))
+    {
+        ESP_LOGE(TAG, "Failed allocating %zu bytes in PSRAM", size);
+        free(entries);
+        entries = NULL;
+        return -1;
+    }
+
+    buffer_size = size;
+    window = (int64_t)seconds * 1000 * 1000;
+    sample_rate = _sample_rate;
+
+    ESP_LOGI(TAG, "Buffering %u seconds in %zu bytes", seconds, size);
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef PREBUFFER_H
+#define PREBUFFER_H
+
+#include "mkv.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Types */
+typedef enum {
+    PREBUFFER_TYPE_JPEG,
+    PREBUFFER_TYPE_OPUS,
+} prebuffer_type_t;
+
+typedef struct {
+    prebuffer_type_t type;
+    const uint8_t *data;
+    size_t length;
+    int64_t timestamp;
+} prebuffer_frame_t;
+
+/* Return non-zero to stop dumping */
+typedef int (*prebuffer_sink_func_t)(const prebuffer_frame_t *frame,
+    void *ctx);
+
+int prebuffer_add(prebuffer_type_t type, const uint8_t *data, size_t length,
+    int64_t timestamp);
+
+/* Latches the current contents until they expire, new frames still evict the
+ * oldest ones */
+void prebuffer_trigger(void);
+/* Dumps the latched frames, or all of them if there's no event */
+int prebuffer_dump(prebuffer_sink_func_t sink, void *ctx);
+/* Dumps as a Matroska stream with both tracks, starting at a video frame */
+int prebuffer_mkv_dump(mkv_write_func_t write, void *ctx);
+
+uint8_t prebuffer_is_enabled(void);
+/* Audio is buffered only if sample_rate isn't 0 */
+int prebuffer_initialize(size_t size, uint8_t seconds, int fps,
+    uint32_t sample_rate);
+
+#endif
@@ -0,0 +1,676 @@
+#include "recorder.h"
+#include "jpeg.h"
+#include "mkv.h"
+#include "prebuffer.h"
+#include "task_layout.h"
+#include <dirent.h>
+#include <errno.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define WRITE_BUFFER_SIZE (32 * 1024)
+#define MAX_PENDING_ENTRIES 16
+
+/* Types */
+typedef struct {
+    /* MKV_TRACK_*, or 0 to wake the writer up */
+    uint8_t track;
+    int64_t timestamp;
+} item_t;
+
+/* Constants */
+static const char *TAG = "Recorder";
+/* Data and index are synced this often, bounding what's lost on power loss */
+static const int64_t SYNC_INTERVAL_US = 2 * 1000 * 1000;
+
+/* Configuration */
+static char *path = NULL;
+static recorder_mode_t mode = RECORDER_MODE_CONTINUOUS;
+static int64_t segment_duration = 0;
+static int64_t hold_time = 0;
+static size_t preallocate = 0;
+static uint32_t sample_rate = 0;
+
+/* Internal state */
+static RingbufHandle_t ring = NULL;
+static portMUX_TYPE state_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t is_recording = 0, is_start_pending = 0;
+static int64_t stop_time = 0;
+static uint32_t frames_written = 0, frames_dropped = 0, sync_failures = 0;
+/* The segment being written and how much of it is safe to read */
+static uint32_t active_segment = 0;
+static uint64_t synced_size = 0;
+
+/* Current segment, only used by the writer task */
+static uint32_t segment_number = 0;
+static int fd = -1, index_fd = -1;
+static mkv_writer_t mkv;
+static int64_t segment_start = 0;
+static int64_t last_sync = 0;
+static uint64_t last_cluster_offset = 0;
+static recorder_index_entry_t pending_entries[MAX_PENDING_ENTRIES];
+static size_t pending_count = 0, index_count = 0;
+
+/* Writes are buffered and always start at a multiple of the buffer size. A
+ * partially filled buffer is written on sync but kept, so it's rewritten in
+ * place once full */
+static uint8_t *write_buffer = NULL;
+static size_t write_used = 0;
+static uint64_t write_base = 0;
+
+static int buffer_write(size_t length)
+{
+    if (pwrite(fd, write_buffer, length, write_base) != (ssize_t)length)
+    {
+        ESP_LOGE(TAG, "Failed writing segment: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int file_write(const void *data, size_t length, void *ctx)
+{
+    const uint8_t *p = data;
+
+    while (length)
+    {
+        size_t n = WRITE_BUFFER_SIZE - write_used;
+
+        if (n > length)
+            n = length;
+
+        memcpy(write_buffer + write_used, p, n);
+        write_used += n;
+        p += n;
+        length -= n;
+
+        if (write_used < WRITE_BUFFER_SIZE)
+            continue;
+
+        if (buffer_write(WRITE_BUFFER_SIZE))
+            return -1;
+        write_base += WRITE_BUFFER_SIZE;
+        write_used = 0;
+    }
+
+    return 0;
+}
+
+static void segment_file_name(char *buf, size_t size, uint32_t number,
+    const char *ext)
+{
+    snprintf(buf, size, "%s/%08" PRIu32 ".%s", path, number, ext);
+}
+
+/* Pending entries are kept until they're written, so a failed sync is retried
+ * on the next one */
+static int segment_sync(void)
+{
+    size_t length = pending_count * sizeof(*pending_entries);
+    off_t offset = sizeof(recorder_index_header_t) +
+        index_count * sizeof(*pending_entries);
+
+    last_sync = esp_timer_get_time();
+
+    if (buffer_write(write_used))
+        goto Error;
+
+    if (fsync(fd))
+    {
+        ESP_LOGE(TAG, "Failed syncing segment: %s", strerror(errno));
+        goto Error;
+    }
+
+    portENTER_CRITICAL(&state_lock);
+    synced_size = write_base + write_used;
+    portEXIT_CRITICAL(&state_lock);
+
+    /* Only index data that's already on the card, a partial write is
+     * overwritten by the retry */
+    if (pwrite(index_fd, pending_entries, length, offset) != (ssize_t)length ||
+        fsync(index_fd))
+    {
+        ESP_LOGE(TAG, "Failed writing index: %s", strerror(errno));
+        goto Error;
+    }
+
+    index_count += pending_count;
+    pending_count = 0;
+
+    return 0;
+
+Error:
+    portENTER_CRITICAL(&state_lock);
+    sync_failures++;
+    portEXIT_CRITICAL(&state_lock);
+    return -1;
+}
+
+static void segment_close(void)
+{
+    if (fd == -1)
+        return;
+
+    segment_sync();
+
+    /* Drop whatever was preallocated but not used */
+    if (ftruncate(fd, mkv.offset))
+        ESP_LOGW(TAG, "Failed truncating segment: %s", strerror(errno));
+
+    close(fd);
+    close(index_fd);
+    fd = index_fd = -1;
+
+    portENTER_CRITICAL(&state_lock);
+    active_segment = 0;
+    portEXIT_CRITICAL(&state_lock);
+
+    ESP_LOGI(TAG, "Closed segment %08" PRIu32 " (%" PRIu64 " bytes)",
+        segment_number, mkv.offset);
+}
+
+static int segment_open(const uint8_t *data, size_t length, int64_t timestamp)
+{
+    recorder_index_header_t header = { .magic = RECORDER_INDEX_MAGIC };
+    char file_name[64];
+    struct timeval now;
+    uint16_t width, height;
+
+    if (jpeg_size_get(data, length, &width, &height))
+        return -1;
+
+    segment_number++;
+
+    segment_file_name(file_name, sizeof(file_name), segment_number, "mkv");
+    if ((fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed creating %s: %s", file_name, strerror(errno));
+        return -1;
+    }
+
+    /* Reserving space up front avoids FAT updates on every cluster */
+    if (preallocate && ftruncate(fd, preallocate))
+        ESP_LOGW(TAG, "Failed preallocating %s: %s", file_name, strerror(errno));
+
+    segment_file_name(file_name, sizeof(file_name), segment_number, "idx");
+    if ((index_fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed creating %s: %s", file_name, strerror(errno));
+        close(fd);
+        fd = -1;
+        return -1;
+    }
+
+    gettimeofday(&now, NULL);
+    header.start_time = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000 -
+        (esp_timer_get_time() - timestamp) / 1000;
+    if (write(index_fd, &header, sizeof(header)) != sizeof(header))
+    {
+        ESP_LOGE(TAG, "Failed writing index: %s", strerror(errno));
+        goto Error;
+    }
+
+    write_used = 0;
+    write_base = 0;
+    pending_count = index_count = 0;
+    last_cluster_offset = 0;
+    last_sync = esp_timer_get_time();
+    segment_start = timestamp;
+
+    mkv_writer_init(&mkv, file_write, NULL);
+    if (mkv_header_write(&mkv, width, height, sample_rate))
+        goto Error;
+
+    portENTER_CRITICAL(&state_lock);
+    active_segment = segment_number;
+    synced_size = 0;
+    portEXIT_CRITICAL(&state_lock);
+
+    ESP_LOGI(TAG, "Recording segment %08" PRIu32 " (%ux%u)", segment_number,
+        width, height);
+
+    return 0;
+
+Error:
+    close(fd);
+    close(index_fd);
+    fd = index_fd = -1;
+    return -1;
+}
+
+static void item_write(const item_t *item, const uint8_t *data, size_t length)
+{
+    int64_t time;
+    int ret;
+
+    if (!item->track)
+        return;
+
+    /* Segments start on a video frame, rolling over once long enough */
+    if (item->track == MKV_TRACK_VIDEO && fd != -1 &&
+        item->timestamp - segment_start >= segment_duration)
+    {
+        segment_close();
+    }
+
+    if (fd == -1 && (item->track != MKV_TRACK_VIDEO ||
+        segment_open(data, length, item->timestamp)))
+    {
+        return;
+    }
+
+    time = (item->timestamp - segment_start) / 1000;
+    ret = mkv_block_write(&mkv, item->track, time, data, length);
+
+    portENTER_CRITICAL(&state_lock);
+    if (ret)
+        frames_dropped++;
+    else
+        frames_written++;
+    portEXIT_CRITICAL(&state_lock);
+
+    if (ret)
+        return;
+
+    if (mkv.cluster_offset == last_cluster_offset)
+        return;
+
+    last_cluster_offset = mkv.cluster_offset;
+
+    /* The segment still plays if syncing keeps failing, seeking just lands on
+     * an earlier cluster */
+    if (pending_count == MAX_PENDING_ENTRIES && segment_sync())
+    {
+        ESP_LOGW(TAG, "Cluster at %" PRIu64 " not indexed", mkv.cluster_offset);
+        return;
+    }
+
+    pending_entries[pending_count].time = mkv.cluster_time;
+    pending_entries[pending_count].offset = mkv.cluster_offset;
+    pending_count++;
+}
+
+static int enqueue(uint8_t track, const uint8_t *data, size_t length,
+    int64_t timestamp)
+{
+    item_t *item;
+
+    if (xRingbufferSendAcquire(ring, (void **)&item, sizeof(*item) + length,
+        0) != pdTRUE)
+    {
+        portENTER_CRITICAL(&state_lock);
+        frames_dropped++;
+        portEXIT_CRITICAL(&state_lock);
+        return -1;
+    }
+
+    item->track = track;
+    item->timestamp = timestamp;
+    if (length)
+        memcpy(item + 1, data, length);
+
+    xRingbufferSendComplete(ring, item);
+
+    return 0;
+}
+
+static int prebuffer_sink(const prebuffer_frame_t *frame, void *ctx)
+{
+    item_t item = {
+        .track = frame->type == PREBUFFER_TYPE_JPEG ? MKV_TRACK_VIDEO :
+            MKV_TRACK_AUDIO,
+        .timestamp = frame->timestamp,
+    };
+
+    if (item.track == MKV_TRACK_AUDIO && !sample_rate)
+        return 0;
+
+    item_write(&item, frame->data, frame->length);
+
+    return 0;
+}
+
+/* Pre-event frames are written first so timestamps only move forward, frames
+ * captured while dumping are skipped */
+static void recording_start(void)
+{
+    if (prebuffer_is_enabled())
+        prebuffer_dump(prebuffer_sink, NULL);
+
+    portENTER_CRITICAL(&state_lock);
+    is_recording = 1;
+    portEXIT_CRITICAL(&state_lock);
+}
+
+/* Nothing is queued once recording stopped, so the segment is closed after
+ * writing what's left */
+static void recording_stop(void)
+{
+    item_t *item;
+    size_t size;
+
+    while ((item = xRingbufferReceive(ring, &size, 0)))
+    {
+        item_write(item, (uint8_t *)(item + 1), size - sizeof(*item));
+        vRingbufferReturnItem(ring, item);
+    }
+
+    segment_close();
+}
+
+static void recorder_task(void *pvParameter)
+{
+    item_t *item;
+    size_t size;
+    int64_t now;
+    uint8_t start, stop;
+
+    while (1)
+    {
+        if ((item = xRingbufferReceive(ring, &size, pdMS_TO_TICKS(500))))
+        {
+            /* Frames queued as recording stopped don't start a segment */
+            if (fd != -1 || is_recording)
+                item_write(item, (uint8_t *)(item + 1), size - sizeof(*item));
+            vRingbufferReturnItem(ring, item);
+        }
+
+        now = esp_timer_get_time();
+
+        if (fd != -1 && now - last_sync >= SYNC_INTERVAL_US)
+            segment_sync();
+
+        portENTER_CRITICAL(&state_lock);
+        start = is_start_pending;
+        is_start_pending = 0;
+        stop = is_recording && stop_time && now >= stop_time;
+        if (stop)
+        {
+            is_recording = 0;
+            stop_time = 0;
+        }
+        portEXIT_CRITICAL(&state_lock);
+
+        if (start)
+            recording_start();
+        if (stop)
+            recording_stop();
+    }
+
+    vTaskDelete(NULL);
+}
+
+static int recorder_add(uint8_t track, const uint8_t *data, size_t length,
+    int64_t timestamp)
+{
+    if (!ring || !is_recording)
+        return 0;
+
+    return enqueue(track, data, length, timestamp);
+}
+
+int recorder_add_jpeg(const uint8_t *data, size_t length, int64_t timestamp)
+{
+    return recorder_add(MKV_TRACK_VIDEO, data, length, timestamp);
+}
+
+int recorder_add_opus(const uint8_t *data, size_t length, int64_t timestamp)
+{
+    if (!sample_rate)
+        return 0;
+
+    return recorder_add(MKV_TRACK_AUDIO, data, length, timestamp);
+}
+
+/* Starting and stopping is left to the writer, which owns the segment */
+void recorder_motion_set(uint8_t detected)
+{
+    static const item_t wake = {};
+    uint8_t start;
+
+    if (!ring || mode != RECORDER_MODE_MOTION)
+        return;
+
+    portENTER_CRITICAL(&state_lock);
+    start = detected && !is_recording && !is_start_pending;
+    if (start)
+        is_start_pending = 1;
+    stop_time = detected ? 0 : esp_timer_get_time() + hold_time;
+    portEXIT_CRITICAL(&state_lock);
+
+    /* If the ring is full the writer is busy and sees the request soon */
+    if (start)
+        xRingbufferSend(ring, &wake, sizeof(wake), 0);
+}
+
+void recorder_stats_get(uint32_t *_frames_written, uint32_t *_frames_dropped,
+    uint32_t *_sync_failures)
+{
+    portENTER_CRITICAL(&state_lock);
+    *_frames_written = frames_written;
+    *_frames_dropped = frames_dropped;
+    *_sync_failures = sync_failures;
+    portEXIT_CRITICAL(&state_lock);
+}
+
+static int index_open(uint32_t number, recorder_index_header_t *header,
+    size_t *count)
+{
+    char file_name[64];
+    struct stat st;
+    int index;
+
+    segment_file_name(file_name, sizeof(file_name), number, "idx");
+    if ((index = open(file_name, O_RDONLY)) < 0)
+        return -1;
+
+    if (fstat(index, &st) || read(index, header, sizeof(*header)) !=
+        sizeof(*header) || header->magic != RECORDER_INDEX_MAGIC)
+    {
+        close(index);
+        return -1;
+    }
+
+    *count = (st.st_size - sizeof(*header)) / sizeof(recorder_index_entry_t);
+
+    return index;
+}
+
+static int index_entry_read(int index, size_t i, recorder_index_entry_t *entry)
+{
+    off_t offset = sizeof(recorder_index_header_t) + i * sizeof(*entry);
+
+    return pread(index, entry, sizeof(*entry), offset) != sizeof(*entry);
+}
+
+int recorder_segment_info_get(uint32_t number, recorder_segment_info_t *info)
+{
+    recorder_index_header_t header;
+    recorder_index_entry_t entry;
+    char file_name[64];
+    struct stat st;
+    size_t count;
+    int index;
+
+    if (!path)
+        return -1;
+
+    segment_file_name(file_name, sizeof(file_name), number, "mkv");
+    if (stat(file_name, &st) || (index = index_open(number, &header,
+        &count)) < 0)
+    {
+        return -1;
+    }
+
+    info->start_time = header.start_time;
+    info->duration = 0;
+    info->header_size = 0;
+    if (count && !index_entry_read(index, 0, &entry))
+        info->header_size = entry.offset;
+    if (count && !index_entry_read(index, count - 1, &entry))
+        info->duration = entry.time;
+    close(index);
+
+    /* Past the synced size of the active segment is preallocated space */
+    info->size = st.st_size;
+    portENTER_CRITICAL(&state_lock);
+    if (number == active_segment)
+        info->size = synced_size;
+    portEXIT_CRITICAL(&state_lock);
+
+    return 0;
+}
+
+int recorder_segment_seek(uint32_t number, int64_t time, uint64_t *offset)
+{
+    recorder_index_header_t header;
+    recorder_index_entry_t entry;
+    size_t count, low = 0, high;
+    int index, ret = -1;
+
+    if (!path || (index = index_open(number, &header, &count)) < 0)
+        return -1;
+
+    /* Find the last cluster starting at or before the requested time */
+    high = count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+
+        if (index_entry_read(index, mid, &entry))
+            goto Exit;
+
+        if (entry.time <= time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (!index_entry_read(index, low ? low - 1 : 0, &entry))
+    {
+        *offset = entry.offset;
+        ret = 0;
+    }
+
+Exit:
+    close(index);
+    return ret;
+}
+
+const char *recorder_path_get(void)
+{
+    return path;
+}
+
+uint8_t recorder_is_enabled(void)
+{
+    return ring != NULL;
+}
+
+recorder_mode_t recorder_atomode(const char *mode)
+{
+    if (mode && !strcmp(mode, "motion"))
+        return RECORDER_MODE_MOTION;
+
+    return RECORDER_MODE_CONTINUOUS;
+}
+
+/* Continue numbering after the last segment on the card */
+static void segment_number_init(void)
+{
+    struct dirent *entry;
+    DIR *dir;
+
+    if (!(dir = opendir(path)))
+        return;
+
+    while ((entry = readdir(dir)))
+    {
+        char *ext;
+        uint32_t number = strtoul(entry->d_name, &ext, 10);
+
+        if (!strcasecmp(ext, ".mkv") && number > segment_number)
+            segment_number = number;
+    }
+
+    closedir(dir);
+}
+
+int recorder_initialize(const char *_path, recorder_mode_t _mode,
+    uint16_t _segment_duration, int _hold_time, size_t buffer_size,
+    size_t _preallocate, uint32_t _sample_rate)
+{
+    StaticRingbuffer_t *ring_struct;
+    uint8_t *ring_storage;
+
+    if (!_path || !buffer_size)
+    {
+        ESP_LOGI(TAG, "Recorder disabled");
+        return 0;
+    }
+
+    ESP_LOGD(TAG, "Initializing recorder");
+
+    if (mkdir(_path, 0755) && errno != EEXIST)
+    {
+        ESP_LOGE(TAG, "Failed creating %s: %s", _path, strerror(errno));
+        return 0;
+    }
+
+    path = strdup(_path);
+    mode = _mode;
+    segment_duration = (int64_t)_segment_duration * 1000 * 1000;
+    hold_time = (int64_t)_hold_time * 1000 * 1000;
+    preallocate = _preallocate;
+    sample_rate = _sample_rate;
+
+    /* Writes go through internal DMA capable memory, frames are staged in
+     * PSRAM so a slow card never stalls capture */
+    if (!(write_buffer = heap_caps_malloc(WRITE_BUFFER_SIZE, MALLOC_CAP_DMA)))
+    {
+        ESP_LOGE(TAG, "Failed allocating write buffer");
+        return -1;
+    }
+
+    ring_struct = heap_caps_malloc(sizeof(*ring_struct), MALLOC_CAP_INTERNAL);
+    ring_storage = heap_caps_malloc(buffer_size, MALLOC_CAP_SPIRAM);
+    if (!ring_struct || !ring_storage || !(ring = xRingbufferCreateStatic(
+        buffer_size, RINGBUF_TYPE_NOSPLIT, ring_storage, ring_struct)))
+    {
+        ESP_LOGE(TAG, "Failed allocating %zu bytes in PSRAM", buffer_size);
+        free(ring_struct);
+        free(ring_storage);
+        free(write_buffer);
+        write_buffer = NULL;
+        return -1;
+    }
+
+    segment_number_init();
+
+    if (task_layout_create(recorder_task, "recorder_task", 4096, NULL, 4,
+        NULL, 1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed creating recorder task");
+        return -1;
+    }
+
+    is_recording = mode == RECORDER_MODE_CONTINUOUS;
+
+    ESP_LOGI(TAG, "Recording %s to %s", mode == RECORDER_MODE_MOTION ?
+        "on motion" : "continuously", path);
+
+    return 0;
+}
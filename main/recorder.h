@@ -0,0 +1,66 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Constants */
+#define RECORDER_INDEX_MAGIC 0x58444952 /* "RIDX" */
+
+/* Types */
+typedef enum {
+    RECORDER_MODE_CONTINUOUS,
+    RECORDER_MODE_MOTION,
+} recorder_mode_t;
+
+/* Each segment NNNNNNNN.mkv has an NNNNNNNN.idx file next to it, holding this
+ * header followed by an entry per cluster. Entries are only appended once the
+ * data they point to was synced */
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    /* Wall clock time of the first frame, in milliseconds since the epoch */
+    int64_t start_time;
+} recorder_index_header_t;
+
+typedef struct {
+    /* Milliseconds since the first frame */
+    int64_t time;
+    /* File offset of the cluster starting at that time */
+    uint64_t offset;
+} recorder_index_entry_t;
+
+typedef struct {
+    /* Milliseconds since the epoch */
+    int64_t start_time;
+    /* Milliseconds, up to the last indexed cluster */
+    int64_t duration;
+    /* Bytes that can be read, which excludes preallocated space */
+    uint64_t size;
+    /* Bytes before the first cluster, needed to play from any cluster */
+    uint64_t header_size;
+} recorder_segment_info_t;
+
+/* Frames are copied, these never block */
+int recorder_add_jpeg(const uint8_t *data, size_t length, int64_t timestamp);
+int recorder_add_opus(const uint8_t *data, size_t length, int64_t timestamp);
+
+/* Starts and stops recording in motion mode */
+void recorder_motion_set(uint8_t detected);
+
+/* Segments are accessed by their number, i.e., NNNNNNNN.mkv */
+int recorder_segment_info_get(uint32_t number, recorder_segment_info_t *info);
+/* Returns the offset of the cluster at or before time, in milliseconds */
+int recorder_segment_seek(uint32_t number, int64_t time, uint64_t *offset);
+
+void recorder_stats_get(uint32_t *frames_written, uint32_t *frames_dropped,
+    uint32_t *sync_failures);
+const char *recorder_path_get(void);
+uint8_t recorder_is_enabled(void);
+
+recorder_mode_t recorder_atomode(const char *mode);
+int recorder_initialize(const char *path, recorder_mode_t mode,
+    uint16_t segment_duration, int hold_time, size_t buffer_size,
+    size_t preallocate, uint32_t sample_rate);
+
+#endif
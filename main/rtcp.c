@@ -0,0 +1,139 @@
+#include "rtcp.h"
+#include <esp_log.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <endian.h>
+
+#define RTCP_PT_SR 200 /* From RFC3550 */
+#define RTCP_PT_RR 201
+#define RTCP_SENDER_INFO_SIZE 20
+
+#if BYTE_ORDER != BIG_ENDIAN && BYTE_ORDER != LITTLE_ENDIAN
+#error "Couldn't detect endianess"
+#endif
+
+/* Types */
+typedef struct {
+#if BYTE_ORDER == BIG_ENDIAN
+    uint8_t version:2;
+    uint8_t p:1;
+    uint8_t rc:5;
+#else
+    uint8_t rc:5;
+    uint8_t p:1;
+    uint8_t version:2;
+#endif
+    uint8_t pt;
+    uint16_t length; /* In 32bit words, minus one */
+    uint32_t ssrc;
+} __attribute__((packed)) rtcp_hdr_t;
+
+typedef struct {
+    uint32_t ssrc;
+    uint8_t fraction_lost; /* Out of 256 */
+    uint8_t cumulative_lost[3];
+    uint32_t highest_seq;
+    uint32_t jitter;
+    uint32_t lsr;
+    uint32_t dlsr;
+} __attribute__((packed)) rtcp_report_block_t;
+
+static const char *TAG = "RTCP";
+
+int rtcp_reports_parse(const uint8_t *buffer, size_t length, uint32_t ssrc,
+    rtcp_on_report_cb_t cb, void *ctx)
+{
+    int reports = 0, i;
+
+    while (length)
+    {
+        const rtcp_hdr_t *hdr = (const rtcp_hdr_t *)buffer;
+        const rtcp_report_block_t *blocks;
+        size_t packet_length, blocks_offset = sizeof(*hdr);
+
+        if (length < sizeof(*hdr))
+            return -1;
+
+        packet_length = (be16toh(hdr->length) + 1) * 4;
+        if (hdr->version != 2 || packet_length < sizeof(*hdr) ||
+            packet_length > length)
+        {
+            return -1;
+        }
+
+        if (hdr->pt == RTCP_PT_SR)
+            blocks_offset += RTCP_SENDER_INFO_SIZE;
+
+        if (hdr->pt == RTCP_PT_SR || hdr->pt == RTCP_PT_RR)
+        {
+            if (blocks_offset + hdr->rc * sizeof(rtcp_report_block_t) >
+                packet_length)
+            {
+                return -1;
+            }
+
+            blocks = (const rtcp_report_block_t *)(buffer + blocks_offset);
+            for (i = 0; i < hdr->rc; i++)
+            {
+                if (be32toh(blocks[i].ssrc) != ssrc)
+                    continue;
+
+                cb(blocks[i].fraction_lost, ctx);
+                reports++;
+            }
+        }
+
+        buffer += packet_length;
+        length -= packet_length;
+    }
+
+    return reports;
+}
+
+int rtcp_socket_create(const char *destination, uint16_t port)
+{
+    struct sockaddr_in src = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct ip_mreq mreq = {
+        .imr_interface.s_addr = htonl(INADDR_ANY),
+    };
+    int sock;
+
+    if (!inet_pton(AF_INET, destination, &mreq.imr_multiaddr))
+    {
+        ESP_LOGE(TAG, "Failed parsing IP address");
+        return -1;
+    }
+
+    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed creating socket: %d (%m)", errno);
+        return -1;
+    }
+
+    if (bind(sock, (struct sockaddr *)&src, sizeof(src)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed binding socket: %d (%m)", errno);
+        goto Error;
+    }
+
+    /* Receivers report to the group the media is sent to */
+    if (IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr)) &&
+        setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)))
+    {
+        ESP_LOGE(TAG, "Failed joining multicast group: %d (%m)", errno);
+        goto Error;
+    }
+
+    return sock;
+
+Error:
+    close(sock);
+    return -1;
+}
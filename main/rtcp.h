@@ -0,0 +1,22 @@
+#ifndef RTCP_H
+#define RTCP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Called with the fraction (out of 256) of the source's packets lost since
+ * the previous report */
+typedef void (*rtcp_on_report_cb_t)(uint8_t fraction_lost, void *ctx);
+
+/* Goes through the sender and receiver reports of a compound packet, calling
+ * back for every report block about ssrc, other packets are skipped. Returns
+ * the number of those blocks, or -1 if a packet is malformed, after calling
+ * back for the ones before it */
+int rtcp_reports_parse(const uint8_t *buffer, size_t length, uint32_t ssrc,
+    rtcp_on_report_cb_t cb, void *ctx);
+
+/* A socket receiving reports on port, joined to the destination's group
+ * when it's multicast, where receivers send them. Returns -1 on failure */
+int rtcp_socket_create(const char *destination, uint16_t port);
+
+#endif
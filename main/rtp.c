@@ -1,21 +1,32 @@
 #include "rtp.h"
+#include "rtcp.h"
+#include "stats.h"
+#include "task_layout.h"
+#include "trace.h"
 #include "wifi.h"
 #include <esp_camera.h>
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_timer.h>
+#include <opus.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
 #include <freertos/queue.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
 #include <string.h>
 #include <endian.h>
 
 #define RTP_PT_JPEG 26 /* From RFC1890 */
 #define RTP_JPEG_RESTART 0x40 /* From RFC2435 */
 #define PACKET_SIZE 1300
+#define RTP_EXT_ONE_BYTE 0xbede /* From RFC8285 */
 
 #if BYTE_ORDER != BIG_ENDIAN && BYTE_ORDER != LITTLE_ENDIAN
 #error "Couldn't detect endianess"
@@ -52,6 +63,9 @@ typedef struct {
     uint32_t csrc[0];    /* Optional CSRC list */
 } __attribute__((packed)) rtp_hdr_t;
 
+_Static_assert(RTP_MAX_PAYLOAD_SIZE == PACKET_SIZE - sizeof(rtp_hdr_t),
+    "RTP_MAX_PAYLOAD_SIZE doesn't match the packet size");
+
 typedef struct {
 #if BYTE_ORDER == BIG_ENDIAN
     uint32_t off:24;     /* Fragment byte offset */
@@ -72,14 +86,36 @@ typedef struct {
     uint16_t length;
 } __attribute__((packed)) jpeg_hdr_qtable_t;
 
+/* Latency test header extension, with one-byte element headers. Each is the
+ * element's ID (4 bits) and its length minus one (4 bits) */
+typedef struct {
+    uint16_t profile;
+    uint16_t length;          /* In 32bit words */
+    uint8_t capture_time_hdr;
+    uint64_t capture_time;    /* Wall clock, in microseconds since the epoch */
+    uint8_t frame_number_hdr;
+    uint32_t frame_number;
+    uint8_t queue_delay_hdr;
+    uint32_t queue_delay;     /* From capture until queued, in microseconds */
+    uint8_t send_delay_hdr;
+    uint32_t send_delay;      /* From capture until this packet was sent */
+} __attribute__((packed)) rtp_latency_ext_t;
+
+_Static_assert(sizeof(rtp_latency_ext_t) % 4 == 0,
+    "Header extensions are padded to 32bit words");
+
 typedef enum {
     FRAME_TYPE_JPEG,
     FRAME_TYPE_OPUS,
+    FRAME_TYPE_PCMU,
+    FRAME_TYPE_PCMA,
 } frame_type_t;
 
 typedef struct {
     frame_type_t type;
     int64_t timestamp;
+    int64_t queued_at;
+    uint32_t number;
     const uint8_t *buffer;
     size_t length;
     union {
@@ -94,12 +130,38 @@ typedef struct {
 
 static const char *TAG = "RTP";
 static const size_t video_queue_size = 10;
-static const size_t audio_queue_size = 10;
+static const size_t audio_queue_size = RTP_AUDIO_QUEUE_SIZE;
+static const uint32_t audio_ssrc = 0xdeadbabe;
+/* The configured loss estimate is used again once receivers stop reporting
+ * for this long, in microseconds */
+static const int64_t rtcp_report_timeout = 15000000;
+/* Histogram buckets, frame sizes are in bytes and latencies in microseconds */
+static const uint32_t frame_size_bounds[] = {
+    8192, 16384, 32768, 65536, 131072, 262144,
+};
+static const uint32_t latency_bounds[] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000,
+};
 
 static int video_socket = -1, audio_socket = -1;
 static uint8_t ttl = 1;
+static uint8_t is_latency_test = 0;
 static QueueHandle_t video_queue, audio_queue;
+static stats_queue_t *video_queue_stats, *audio_queue_stats;
 static SemaphoreHandle_t queue_semaphore;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static rtp_stats_t video_stats, audio_stats;
+static stats_histogram_t frame_sizes =
+    STATS_HISTOGRAM_INITIALIZER(frame_size_bounds);
+static stats_histogram_t video_latency =
+    STATS_HISTOGRAM_INITIALIZER(latency_bounds);
+static stats_histogram_t audio_latency =
+    STATS_HISTOGRAM_INITIALIZER(latency_bounds);
+static uint32_t opus_packets_suppressed = 0;
+static uint64_t opus_bytes_saved = 0;
+static int rtcp_socket = -1;
+static uint8_t audio_loss = 0, audio_loss_estimate = 0;
+static int64_t audio_loss_reported_at = 0;
 
 static int create_socket(const char *destination, uint16_t port)
 {
@@ -149,6 +211,19 @@ Error:
     return -1;
 }
 
+static void packet_stats_add(rtp_stats_t *stats, ssize_t sent)
+{
+    portENTER_CRITICAL(&stats_lock);
+    if (sent < 0)
+        stats->errors++;
+    else
+    {
+        stats->packets++;
+        stats->bytes += sent;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
+
 static int parse_jpeg(frame_t *frame, uint8_t const **lqt, uint8_t const **cqt,
     uint8_t const **scan, size_t *len)
 {
@@ -192,17 +267,46 @@ static int parse_jpeg(frame_t *frame, uint8_t const **lqt, uint8_t const **cqt,
 }
 
 /* Adapted from https://tools.ietf.org/html/rfc2435, appendix C */
+static void latency_ext_init(rtp_latency_ext_t *ext, const frame_t *frame)
+{
+    struct timeval now;
+
+    /* Receivers compare it against their own clock, both should be synced */
+    gettimeofday(&now, NULL);
+
+    ext->profile = htobe16(RTP_EXT_ONE_BYTE);
+    ext->length = htobe16((sizeof(*ext) - 4) / 4);
+    ext->capture_time_hdr = RTP_EXT_ID_CAPTURE_TIME << 4 |
+        (sizeof(ext->capture_time) - 1);
+    ext->capture_time = htobe64((int64_t)now.tv_sec * 1000000 + now.tv_usec -
+        (esp_timer_get_time() - frame->timestamp));
+    ext->frame_number_hdr = RTP_EXT_ID_FRAME_NUMBER << 4 |
+        (sizeof(ext->frame_number) - 1);
+    ext->frame_number = htobe32(frame->number);
+    ext->queue_delay_hdr = RTP_EXT_ID_QUEUE_DELAY << 4 |
+        (sizeof(ext->queue_delay) - 1);
+    ext->queue_delay = htobe32(frame->queued_at - frame->timestamp);
+    ext->send_delay_hdr = RTP_EXT_ID_SEND_DELAY << 4 |
+        (sizeof(ext->send_delay) - 1);
+}
+
 static int rtp_send_jpeg_data(uint16_t start_seq, uint32_t ts, uint32_t ssrc,
     const uint8_t *jpeg_data, size_t len, uint8_t type, uint8_t typespec,
-    int width, int height, uint8_t q, const uint8_t *lqt, const uint8_t *cqt)
+    int width, int height, uint8_t q, const uint8_t *lqt, const uint8_t *cqt,
+    const frame_t *frame)
 {
     uint8_t packet_buf[PACKET_SIZE];
     rtp_hdr_t *rtp_hdr = (rtp_hdr_t *)packet_buf;
-    jpeg_hdr_t *jpg_hdr = (jpeg_hdr_t *)((uint8_t *)rtp_hdr + sizeof(rtp_hdr_t));
+    /* Only there in latency test mode */
+    rtp_latency_ext_t *ext = (rtp_latency_ext_t *)(packet_buf + sizeof(rtp_hdr_t));
+    size_t ext_len = is_latency_test ? sizeof(rtp_latency_ext_t) : 0;
+    jpeg_hdr_t *jpg_hdr = (jpeg_hdr_t *)((uint8_t *)rtp_hdr + sizeof(rtp_hdr_t) +
+        ext_len);
     jpeg_hdr_qtable_t *qtbl_hdr = (jpeg_hdr_qtable_t *)((uint8_t *)jpg_hdr + sizeof(jpeg_hdr_t));
     uint8_t *ptr;
     size_t bytes_left = len;
     size_t data_len;
+    ssize_t sent;
 
     /* Initialize RTP header */
     rtp_hdr->version = 2;
@@ -215,6 +319,12 @@ static int rtp_send_jpeg_data(uint16_t start_seq, uint32_t ts, uint32_t ssrc,
     rtp_hdr->ts = htobe32(ts);
     rtp_hdr->ssrc = htobe32(ssrc);
 
+    if (ext_len)
+    {
+        rtp_hdr->x = 1;
+        latency_ext_init(ext, frame);
+    }
+
     /* Initialize JPEG header */
     jpg_hdr->tspec = typespec;
     jpg_hdr->off = 0;
@@ -253,8 +363,12 @@ static int rtp_send_jpeg_data(uint16_t start_seq, uint32_t ts, uint32_t ssrc,
 
         memcpy(ptr, jpeg_data + be24toh(jpg_hdr->off), data_len);
 
-        if (send(video_socket, packet_buf, (ptr - packet_buf) + data_len, 0)
-            < 0)
+        if (ext_len)
+            ext->send_delay = htobe32(esp_timer_get_time() - frame->timestamp);
+        sent = send(video_socket, packet_buf, (ptr - packet_buf) + data_len,
+            0);
+        packet_stats_add(&video_stats, sent);
+        if (sent < 0)
         {
             ESP_LOGE(TAG, "Failed sending JPEG packet: %d (%s)", errno, strerror(errno));
             goto Error;
@@ -289,38 +403,84 @@ static int rtp_send_jpeg_frame(frame_t *frame)
 
     timestamp = frame->timestamp * 90000 /* Hz */ / 1000000;
     sequence_number = rtp_send_jpeg_data(sequence_number, timestamp, ssrc,
-        jpeg_data, len, 0, 0, frame->jpeg.width, frame->jpeg.height, q, lqt, cqt);
+        jpeg_data, len, 0, 0, frame->jpeg.width, frame->jpeg.height, q, lqt, cqt,
+        frame);
 
     return 0;
 }
 
+/* With DTX, frames with nothing to play are at most a TOC byte long, leaving
+ * no data once combined. Comfort noise updates are sent as regular frames */
+static uint8_t opus_is_silent(const uint8_t *data, size_t length)
+{
+    const uint8_t *frames[48];
+    opus_int16 sizes[48];
+    int i, count;
+
+    if ((count = opus_packet_parse(data, length, NULL, frames, sizes, NULL)) <=
+        0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (sizes[i] > 1)
+            return 0;
+    }
+
+    return 1;
+}
+
 static int rtp_send_opus_frame(frame_t *frame)
 {
     static uint16_t sequence_number = 0;
-    uint32_t ssrc = 0xdeadbabe;
+    static uint8_t is_talkspurt = 0;
 
     uint8_t packet_buf[PACKET_SIZE];
     rtp_hdr_t *rtp_hdr = (rtp_hdr_t *)packet_buf;
+    ssize_t sent;
 
     /* Initialize RTP header */
     rtp_hdr->version = 2;
     rtp_hdr->p = 0;
     rtp_hdr->x = 0;
     rtp_hdr->cc = 0;
-    rtp_hdr->m = 1;
+    rtp_hdr->m = 0;
     rtp_hdr->pt = 97;
-    rtp_hdr->seq = htobe16(sequence_number++);
     rtp_hdr->ts = htobe32(frame->timestamp * 48000 /* Hz */ / 1000000);
-    rtp_hdr->ssrc = htobe32(ssrc);
+    rtp_hdr->ssrc = htobe32(audio_ssrc);
 
-    if (frame->length > 1000)
+    if (frame->length > RTP_MAX_PAYLOAD_SIZE)
     {
-        ESP_LOGE(TAG, "Packet to long!!! %d", frame->length);
+        ESP_LOGE(TAG, "Opus packet too long: %zu", frame->length);
         return 0;
     }
 
+    /* Silence isn't sent at all. Timestamps follow the capture time so they
+     * carry on from where they'd be, and the marker bit flags the first
+     * packet of each talkspurt (RFC7587) */
+    if (opus_is_silent(frame->buffer, frame->length))
+    {
+        is_talkspurt = 0;
+        portENTER_CRITICAL(&stats_lock);
+        opus_packets_suppressed++;
+        opus_bytes_saved += sizeof(*rtp_hdr) + frame->length;
+        portEXIT_CRITICAL(&stats_lock);
+        return 0;
+    }
+
+    if (!is_talkspurt)
+    {
+        rtp_hdr->m = 1;
+        is_talkspurt = 1;
+    }
+    rtp_hdr->seq = htobe16(sequence_number++);
+
     memcpy(packet_buf + sizeof(*rtp_hdr), frame->buffer, frame->length);
-    if (send(audio_socket, packet_buf, sizeof(*rtp_hdr) + frame->length, 0) < 0)
+    sent = send(audio_socket, packet_buf, sizeof(*rtp_hdr) + frame->length, 0);
+    packet_stats_add(&audio_stats, sent);
+    if (sent < 0)
     {
         ESP_LOGE(TAG, "Failed sending Opus packet: %d (%s)", errno, strerror(errno));
     }
@@ -328,9 +488,101 @@ static int rtp_send_opus_frame(frame_t *frame)
     return 0;
 }
 
+/* G.711 has static payload types and an 8kHz clock (RFC3551) */
+static int rtp_send_g711_frame(frame_t *frame)
+{
+    static uint16_t sequence_number = 0;
+    static uint8_t is_started = 0;
+
+    uint8_t packet_buf[PACKET_SIZE];
+    rtp_hdr_t *rtp_hdr = (rtp_hdr_t *)packet_buf;
+    ssize_t sent;
+
+    /* Initialize RTP header, the stream is a single talkspurt */
+    rtp_hdr->version = 2;
+    rtp_hdr->p = 0;
+    rtp_hdr->x = 0;
+    rtp_hdr->cc = 0;
+    rtp_hdr->m = !is_started;
+    is_started = 1;
+    rtp_hdr->pt = frame->type == FRAME_TYPE_PCMA ? 8 : 0;
+    rtp_hdr->seq = htobe16(sequence_number++);
+    rtp_hdr->ts = htobe32(frame->timestamp * 8000 /* Hz */ / 1000000);
+    rtp_hdr->ssrc = htobe32(audio_ssrc);
+
+    if (frame->length > RTP_MAX_PAYLOAD_SIZE)
+    {
+        ESP_LOGE(TAG, "G.711 packet too long: %zu", frame->length);
+        return 0;
+    }
+
+    memcpy(packet_buf + sizeof(*rtp_hdr), frame->buffer, frame->length);
+    sent = send(audio_socket, packet_buf, sizeof(*rtp_hdr) + frame->length, 0);
+    packet_stats_add(&audio_stats, sent);
+    if (sent < 0)
+    {
+        ESP_LOGE(TAG, "Failed sending G.711 packet: %d (%s)", errno,
+            strerror(errno));
+    }
+
+    return 0;
+}
+
+/* Receiver reports, on their own or after a sender report, carry the
+ * fraction of our audio packets lost since the previous report. Smoothed, a
+ * single report covers a few seconds at most */
+static void on_audio_report(uint8_t fraction_lost, void *ctx)
+{
+    portENTER_CRITICAL(&stats_lock);
+    audio_loss = (audio_loss * 3 + fraction_lost * 100 / 256) / 4;
+    audio_loss_reported_at = esp_timer_get_time();
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void rtcp_task(void *pvParameter)
+{
+    static uint8_t buffer[512];
+    ssize_t length;
+
+    while (1)
+    {
+        if ((length = recv(rtcp_socket, buffer, sizeof(buffer), 0)) < 0)
+        {
+            ESP_LOGE(TAG, "Failed receiving RTCP: %d (%s)", errno,
+                strerror(errno));
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        if (rtcp_reports_parse(buffer, length, audio_ssrc, on_audio_report,
+            NULL) < 0)
+        {
+            ESP_LOGD(TAG, "Malformed RTCP packet (%zd bytes)", length);
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+static int rtcp_initialize(const char *destination, uint16_t port)
+{
+    if ((rtcp_socket = rtcp_socket_create(destination, port)) < 0)
+        return -1;
+
+    if (task_layout_create(rtcp_task, "rtcp_task", 2048, NULL, 3, NULL,
+        1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed creating RTCP task");
+        return -1;
+    }
+
+    return 0;
+}
+
 static void stream_task(void *pvParameter)
 {
     frame_t frame;
+    int64_t latency;
 
     while (1)
     {
@@ -342,12 +594,33 @@ static void stream_task(void *pvParameter)
             if (xQueueReceive(video_queue, &frame, 0) != pdTRUE)
                 continue;
         }
+        trace_event(TRACE_EVENT_DEQUEUE, frame.timestamp);
 
+        trace_event(TRACE_EVENT_SEND_FIRST, frame.timestamp);
         switch (frame.type)
         {
         case FRAME_TYPE_JPEG: rtp_send_jpeg_frame(&frame); break;
         case FRAME_TYPE_OPUS: rtp_send_opus_frame(&frame); break;
+        case FRAME_TYPE_PCMU:
+        case FRAME_TYPE_PCMA: rtp_send_g711_frame(&frame); break;
+        }
+        trace_event(TRACE_EVENT_SEND_LAST, frame.timestamp);
+
+        /* From capture until it was sent */
+        latency = esp_timer_get_time() - frame.timestamp;
+        portENTER_CRITICAL(&stats_lock);
+        if (frame.type == FRAME_TYPE_JPEG)
+        {
+            video_stats.frames++;
+            stats_histogram_add(&frame_sizes, frame.length);
+            stats_histogram_add(&video_latency, latency);
         }
+        else
+        {
+            audio_stats.frames++;
+            stats_histogram_add(&audio_latency, latency);
+        }
+        portEXIT_CRITICAL(&stats_lock);
 
         /* Free frame */
         if (frame.free_func)
@@ -359,19 +632,29 @@ static void stream_task(void *pvParameter)
 
 static int add_frame_to_queue(frame_t *frame)
 {
-    static QueueHandle_t queue;
+    QueueHandle_t queue = NULL;
+    stats_queue_t *queue_stats = NULL;
+    BaseType_t result;
 
     switch (frame->type)
     {
     case FRAME_TYPE_JPEG:
         queue = video_queue;
+        queue_stats = video_queue_stats;
         break;
     case FRAME_TYPE_OPUS:
+    case FRAME_TYPE_PCMU:
+    case FRAME_TYPE_PCMA:
         queue = audio_queue;
+        queue_stats = audio_queue_stats;
         break;
     };
 
-    if (xQueueSend(queue, frame, 0) != pdTRUE)
+    trace_event(TRACE_EVENT_ENQUEUE, frame->timestamp);
+    frame->queued_at = esp_timer_get_time();
+    result = xQueueSend(queue, frame, 0);
+    stats_queue_sent(queue_stats, result);
+    if (result != pdTRUE)
     {
         ESP_LOGE(TAG, "Video queue full!");
         return -1;
@@ -389,9 +672,12 @@ static int add_frame_to_queue(frame_t *frame)
 int rtp_send_jpeg(int width, int height, const uint8_t *buffer, size_t length,
     int64_t timestamp, rtp_frame_free_func_t free_func, void *ctx)
 {
+    /* Numbered before queueing, so frames dropped on the way show as lost */
+    static uint32_t frame_number = 0;
     frame_t jpeg_frame = {
         .type = FRAME_TYPE_JPEG,
         .timestamp = timestamp,
+        .number = frame_number++,
         .buffer = buffer,
         .length = length,
         .jpeg = {
@@ -420,11 +706,104 @@ int rtp_send_opus(const uint8_t *buffer, size_t length, int64_t timestamp,
     return add_frame_to_queue(&opus_frame);
 }
 
+int rtp_send_pcmu(const uint8_t *buffer, size_t length, int64_t timestamp,
+    rtp_frame_free_func_t free_func, void *ctx)
+{
+    frame_t pcmu_frame = {
+        .type = FRAME_TYPE_PCMU,
+        .timestamp = timestamp,
+        .buffer = buffer,
+        .length = length,
+        .free_func = free_func,
+        .free_ctx = ctx,
+    };
+
+    return add_frame_to_queue(&pcmu_frame);
+}
+
+int rtp_send_pcma(const uint8_t *buffer, size_t length, int64_t timestamp,
+    rtp_frame_free_func_t free_func, void *ctx)
+{
+    frame_t pcma_frame = {
+        .type = FRAME_TYPE_PCMA,
+        .timestamp = timestamp,
+        .buffer = buffer,
+        .length = length,
+        .free_func = free_func,
+        .free_ctx = ctx,
+    };
+
+    return add_frame_to_queue(&pcma_frame);
+}
+
+void rtp_stats_get(rtp_stats_t *video, rtp_stats_t *audio)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *video = video_stats;
+    *audio = audio_stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void rtp_histograms_get(stats_histogram_t *_frame_sizes,
+    stats_histogram_t *_video_latency, stats_histogram_t *_audio_latency)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *_frame_sizes = frame_sizes;
+    *_video_latency = video_latency;
+    *_audio_latency = audio_latency;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void rtp_opus_stats_get(uint32_t *packets_suppressed, uint64_t *bytes_saved)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *packets_suppressed = opus_packets_suppressed;
+    *bytes_saved = opus_bytes_saved;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+uint8_t rtp_audio_loss_get(void)
+{
+    uint8_t loss;
+
+    portENTER_CRITICAL(&stats_lock);
+    if (audio_loss_reported_at && esp_timer_get_time() -
+        audio_loss_reported_at < rtcp_report_timeout)
+    {
+        loss = audio_loss;
+    }
+    else
+    {
+        loss = audio_loss = audio_loss_estimate;
+        audio_loss_reported_at = 0;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    return loss;
+}
+
+void rtp_audio_loss_estimate_set(uint8_t loss)
+{
+    portENTER_CRITICAL(&stats_lock);
+    audio_loss_estimate = loss;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
 void rtp_ttl_set(uint8_t _ttl)
 {
     ttl = _ttl;
 }
 
+void rtp_latency_test_set(uint8_t enabled)
+{
+    is_latency_test = enabled;
+}
+
+uint8_t rtp_latency_test_is_enabled(void)
+{
+    return is_latency_test;
+}
+
 int rtp_initialize(const char *destination, uint16_t video_port,
     uint16_t audio_port)
 {
@@ -447,6 +826,8 @@ int rtp_initialize(const char *destination, uint16_t video_port,
         ESP_LOGE(TAG, "Failed creating queues");
         return -1;
     }
+    video_queue_stats = stats_queue_register("rtp_video", video_queue);
+    audio_queue_stats = stats_queue_register("rtp_audio", audio_queue);
 
     if (!(queue_semaphore = xSemaphoreCreateCounting(
         video_queue_size + audio_queue_size, 0)))
@@ -455,12 +836,16 @@ int rtp_initialize(const char *destination, uint16_t video_port,
         return -1;
     }
     
-    if (xTaskCreatePinnedToCore(stream_task, "stream_task", 4096, NULL, 5,
+    if (task_layout_create(stream_task, "stream_task", 4096, NULL, 5,
         NULL, 1) != pdPASS)
     {
         ESP_LOGE(TAG, "Failed creating stream task");
         return -1;
     }
 
+    /* Without receiver reports, the configured loss estimate is used */
+    if (audio_port && rtcp_initialize(destination, audio_port + 1))
+        ESP_LOGW(TAG, "Not receiving RTCP, audio loss won't be measured");
+
     return 0;
 }
@@ -1,17 +1,64 @@
 #ifndef RTP_H
 #define RTP_H
 
+#include "stats.h"
 #include <stdint.h>
 #include <stddef.h>
 
+/* Largest payload, including any payload header, sent in a single packet */
+#define RTP_MAX_PAYLOAD_SIZE 1288
+/* Audio packets waiting to be sent, once full new ones are dropped */
+#define RTP_AUDIO_QUEUE_SIZE 10
+
+/* Elements of the latency test header extension, and the URIs they're
+ * advertised with in the SDP */
+#define RTP_EXT_ID_CAPTURE_TIME 1
+#define RTP_EXT_ID_FRAME_NUMBER 2
+#define RTP_EXT_ID_QUEUE_DELAY 3
+#define RTP_EXT_ID_SEND_DELAY 4
+#define RTP_EXT_URI_CAPTURE_TIME "urn:ipcam:rtp-hdrext:capture-time"
+#define RTP_EXT_URI_FRAME_NUMBER "urn:ipcam:rtp-hdrext:frame-number"
+#define RTP_EXT_URI_QUEUE_DELAY "urn:ipcam:rtp-hdrext:queue-delay"
+#define RTP_EXT_URI_SEND_DELAY "urn:ipcam:rtp-hdrext:send-delay"
+
 typedef void (*rtp_frame_free_func_t)(void *ctx);
 
+typedef struct {
+    uint32_t frames;
+    uint32_t packets;
+    uint64_t bytes;
+    /* Packets that failed sending */
+    uint32_t errors;
+} rtp_stats_t;
+
 int rtp_send_jpeg(int width, int height, const uint8_t *buffer, size_t length,
     int64_t timestamp, rtp_frame_free_func_t free_func, void *ctx);
 int rtp_send_opus(const uint8_t *buffer, size_t length, int64_t timestamp,
     rtp_frame_free_func_t free_func, void *ctx);
+int rtp_send_pcmu(const uint8_t *buffer, size_t length, int64_t timestamp,
+    rtp_frame_free_func_t free_func, void *ctx);
+int rtp_send_pcma(const uint8_t *buffer, size_t length, int64_t timestamp,
+    rtp_frame_free_func_t free_func, void *ctx);
+
+/* Frames taken off the queues, and the packets and bytes sent for them */
+void rtp_stats_get(rtp_stats_t *video, rtp_stats_t *audio);
+/* Sizes (in bytes) of the video frames sent, and the latency (in
+ * microseconds) from capturing a frame to sending it */
+void rtp_histograms_get(stats_histogram_t *frame_sizes,
+    stats_histogram_t *video_latency, stats_histogram_t *audio_latency);
+/* Opus packets holding only silence (DTX) aren't sent */
+void rtp_opus_stats_get(uint32_t *packets_suppressed, uint64_t *bytes_saved);
+
+/* Percentage of audio packets lost, as reported over RTCP to the port after
+ * the audio one, or the estimate while there are no reports */
+uint8_t rtp_audio_loss_get(void);
+void rtp_audio_loss_estimate_set(uint8_t loss);
 
 void rtp_ttl_set(uint8_t ttl);
+/* Video packets carry an RFC8285 header extension with the frame's capture
+ * time, number, and how long until it was queued and each packet sent */
+void rtp_latency_test_set(uint8_t enabled);
+uint8_t rtp_latency_test_is_enabled(void);
 
 int rtp_initialize(const char *destination, uint16_t video_port,
     uint16_t audio_port);
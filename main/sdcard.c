@@ -0,0 +1,71 @@
+#include "sdcard.h"
+#include <driver/sdspi_host.h>
+#include <esp_log.h>
+#include <esp_vfs_fat.h>
+#include <sdmmc_cmd.h>
+
+/* Constants */
+static const char *TAG = "SDCard";
+
+/* Internal state */
+static sdmmc_card_t *card = NULL;
+
+uint8_t sdcard_is_mounted(void)
+{
+    return card != NULL;
+}
+
+int sdcard_initialize(const char *mount_point, int clk, int mosi, int miso,
+    int cs)
+{
+    /* Large allocation units keep recordings contiguous and FAT updates rare */
+    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
+        .format_if_mount_failed = false,
+        .max_files = 5,
+        .allocation_unit_size = 32 * 1024,
+    };
+    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
+    spi_bus_config_t bus_config = {
+        .mosi_io_num = mosi,
+        .miso_io_num = miso,
+        .sclk_io_num = clk,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = 32 * 1024,
+    };
+    sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
+    esp_err_t err;
+
+    if (clk == -1 || mosi == -1 || miso == -1 || cs == -1)
+    {
+        ESP_LOGI(TAG, "SD card disabled");
+        return 0;
+    }
+
+    ESP_LOGD(TAG, "Initializing SD card");
+
+    if ((err = spi_bus_initialize(host.slot, &bus_config, SDSPI_DEFAULT_DMA)))
+    {
+        ESP_LOGE(TAG, "Failed initializing SPI bus: %s", esp_err_to_name(err));
+        return -1;
+    }
+
+    slot_config.gpio_cs = cs;
+    slot_config.host_id = host.slot;
+
+    /* A missing card isn't fatal, recording is simply unavailable */
+    if ((err = esp_vfs_fat_sdspi_mount(mount_point, &host, &slot_config,
+        &mount_config, &card)))
+    {
+        ESP_LOGE(TAG, "Failed mounting SD card: %s", esp_err_to_name(err));
+        card = NULL;
+        spi_bus_free(host.slot);
+        return 0;
+    }
+
+    ESP_LOGI(TAG, "Mounted %s (%llu MB) on %s", card->cid.name,
+        (uint64_t)card->csd.capacity * card->csd.sector_size / (1024 * 1024),
+        mount_point);
+
+    return 0;
+}
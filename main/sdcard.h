@@ -0,0 +1,10 @@
+#ifndef SDCARD_H
+#define SDCARD_H
+
+#include <stdint.h>
+
+uint8_t sdcard_is_mounted(void);
+int sdcard_initialize(const char *mount_point, int clk, int mosi, int miso,
+    int cs);
+
+#endif
@@ -0,0 +1,141 @@
+#include "sound_detector.h"
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <math.h>
+
+/* Constants */
+static const char *TAG = "SoundDetector";
+/* Reported for digital silence */
+static const int8_t MIN_LEVEL = -96;
+
+/* Configuration */
+static uint32_t on_level = 0, off_level = 0; /* RMS, 0 when disabled */
+static uint32_t hold_samples = 0;
+
+/* Internal state */
+static uint8_t is_detected = 0;
+static uint32_t quiet_samples = 0;
+static portMUX_TYPE levels_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t levels_energy = 0;
+static uint32_t levels_samples = 0;
+static uint16_t levels_peak = 0;
+
+/* Callback functions */
+static sound_detector_on_trigger_cb_t on_sound_detector_trigger_cb = NULL;
+
+void sound_detector_set_on_trigger(sound_detector_on_trigger_cb_t cb)
+{
+    on_sound_detector_trigger_cb = cb;
+}
+
+static int8_t level_to_dbfs(uint32_t level)
+{
+    float dbfs;
+
+    if (!level)
+        return MIN_LEVEL;
+
+    dbfs = 20 * log10f(level / (float)INT16_MAX);
+    return dbfs < MIN_LEVEL ? MIN_LEVEL : dbfs > 0 ? 0 : dbfs;
+}
+
+void sound_detector_process(const int16_t *samples, size_t count)
+{
+    int64_t sum = 0;
+    uint64_t energy = 0;
+    int16_t min = INT16_MAX, max = INT16_MIN;
+    int32_t mean;
+    uint32_t rms, peak;
+    size_t i;
+
+    if (!on_level || !count)
+        return;
+
+    /* A single pass, the DC offset is taken out of the sums afterwards */
+    for (i = 0; i < count; i++)
+    {
+        int32_t x = samples[i];
+
+        sum += x;
+        energy += x * x;
+        if (x < min)
+            min = x;
+        if (x > max)
+            max = x;
+    }
+
+    mean = sum / (int64_t)count;
+    energy -= (int64_t)mean * sum;
+    rms = sqrtf((float)energy / count);
+    peak = max - mean > mean - min ? max - mean : mean - min;
+
+    portENTER_CRITICAL(&levels_lock);
+    levels_energy += energy;
+    levels_samples += count;
+    if (peak > levels_peak)
+        levels_peak = peak;
+    portEXIT_CRITICAL(&levels_lock);
+
+    /* Starts above the threshold, stops once below it by the hysteresis for
+     * the hold time */
+    if (rms >= off_level)
+        quiet_samples = 0;
+    else if (quiet_samples < hold_samples)
+        quiet_samples += count;
+
+    if (!is_detected && rms >= on_level)
+        is_detected = 1;
+    else if (is_detected && quiet_samples >= hold_samples)
+        is_detected = 0;
+    else
+        return;
+
+    ESP_LOGD(TAG, "Sound %s at %ddBFS", is_detected ? "detected" : "stopped",
+        level_to_dbfs(rms));
+    if (on_sound_detector_trigger_cb)
+        on_sound_detector_trigger_cb(is_detected, level_to_dbfs(rms));
+}
+
+void sound_detector_levels_get(int8_t *rms, int8_t *peak)
+{
+    uint64_t energy;
+    uint32_t samples;
+    uint16_t _peak;
+
+    portENTER_CRITICAL(&levels_lock);
+    energy = levels_energy;
+    samples = levels_samples;
+    _peak = levels_peak;
+    levels_energy = 0;
+    levels_samples = 0;
+    levels_peak = 0;
+    portEXIT_CRITICAL(&levels_lock);
+
+    *rms = level_to_dbfs(samples ? sqrtf((float)energy / samples) : 0);
+    *peak = level_to_dbfs(_peak);
+}
+
+uint8_t sound_detector_is_enabled(void)
+{
+    return on_level != 0;
+}
+
+int sound_detector_initialize(uint32_t sample_rate, int8_t threshold,
+    uint8_t hysteresis, uint16_t hold_time)
+{
+    ESP_LOGD(TAG, "Initializing sound detector");
+
+    if (!threshold || !sample_rate)
+    {
+        ESP_LOGI(TAG, "Sound detector disabled");
+        return 0;
+    }
+
+    on_level = INT16_MAX * powf(10, threshold / 20.0f);
+    off_level = INT16_MAX * powf(10, (threshold - hysteresis) / 20.0f);
+    hold_samples = sample_rate * hold_time;
+
+    ESP_LOGI(TAG, "Detecting sound above %ddBFS", threshold);
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef SOUND_DETECTOR_H
+#define SOUND_DETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Event callback types, the level is the frame's RMS level in dBFS */
+typedef void (*sound_detector_on_trigger_cb_t)(uint8_t detected,
+    int8_t level);
+
+/* Event handlers */
+void sound_detector_set_on_trigger(sound_detector_on_trigger_cb_t cb);
+
+/* Meters captured samples, before any gain is applied */
+void sound_detector_process(const int16_t *samples, size_t count);
+
+/* Average RMS and maximal peak levels, in dBFS, since the last call */
+void sound_detector_levels_get(int8_t *rms, int8_t *peak);
+
+uint8_t sound_detector_is_enabled(void);
+/* threshold is a level in dBFS, 0 disables detection, hysteresis is in dB and
+ * hold_time in seconds */
+int sound_detector_initialize(uint32_t sample_rate, int8_t threshold,
+    uint8_t hysteresis, uint16_t hold_time);
+
+#endif
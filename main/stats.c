@@ -0,0 +1,211 @@
+#include "stats.h"
+#include "task_layout.h"
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATS_MAX_TASKS 32
+#define STATS_MAX_QUEUES 8
+
+/* Constants */
+static const char *TAG = "Stats";
+
+/* Internal state */
+static portMUX_TYPE queues_lock = portMUX_INITIALIZER_UNLOCKED;
+static stats_queue_t queues[STATS_MAX_QUEUES];
+static size_t queues_count = 0;
+static SemaphoreHandle_t tasks_lock = NULL;
+static stats_task_t tasks[STATS_MAX_TASKS];
+static size_t tasks_count = 0;
+
+void stats_histogram_add(stats_histogram_t *histogram, uint32_t value)
+{
+    size_t i;
+
+    for (i = 0; i < histogram->count && value > histogram->bounds[i]; i++);
+
+    histogram->buckets[i]++;
+    histogram->sum += value;
+    histogram->total++;
+}
+
+stats_queue_t *stats_queue_register(const char *name, QueueHandle_t queue)
+{
+    stats_queue_t *stats_queue = NULL;
+
+    portENTER_CRITICAL(&queues_lock);
+    if (queues_count < STATS_MAX_QUEUES)
+    {
+        stats_queue = &queues[queues_count++];
+        stats_queue->name = name;
+        stats_queue->handle = queue;
+        stats_queue->size = uxQueueSpacesAvailable(queue) +
+            uxQueueMessagesWaiting(queue);
+    }
+    portEXIT_CRITICAL(&queues_lock);
+
+    if (!stats_queue)
+        ESP_LOGW(TAG, "No room for tracking queue %s", name);
+
+    return stats_queue;
+}
+
+void IRAM_ATTR stats_queue_sent(stats_queue_t *queue, BaseType_t result)
+{
+    UBaseType_t depth;
+
+    if (!queue)
+        return;
+
+    depth = uxQueueMessagesWaitingFromISR(queue->handle);
+
+    portENTER_CRITICAL_SAFE(&queues_lock);
+    if (result == pdTRUE)
+        queue->sent++;
+    else
+        queue->dropped++;
+    if (depth > queue->max_depth)
+        queue->max_depth = depth;
+    portEXIT_CRITICAL_SAFE(&queues_lock);
+}
+
+int stats_queue_get(size_t index, stats_queue_t *queue)
+{
+    portENTER_CRITICAL(&queues_lock);
+    if (index < queues_count)
+        *queue = queues[index];
+    portEXIT_CRITICAL(&queues_lock);
+
+    if (index >= queues_count)
+        return -1;
+
+    queue->depth = uxQueueMessagesWaiting(queue->handle);
+    return 0;
+}
+
+int stats_task_get(size_t index, stats_task_t *task)
+{
+    int ret = -1;
+
+    if (!tasks_lock)
+        return -1;
+
+    xSemaphoreTake(tasks_lock, portMAX_DELAY);
+    if (index < tasks_count)
+    {
+        *task = tasks[index];
+        ret = 0;
+    }
+    xSemaphoreGive(tasks_lock);
+
+    return ret;
+}
+
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+/* Room for tasks created between samples */
+static const UBaseType_t extra_tasks = 8;
+
+/* Configuration */
+static uint16_t sample_interval = 0;
+
+/* Usage over the interval is worked out against the previous sample, by task
+ * handle. New tasks are counted from their creation */
+static void tasks_update(TaskStatus_t *current, UBaseType_t current_count,
+    uint32_t elapsed, TaskStatus_t *previous, UBaseType_t previous_count)
+{
+    UBaseType_t i, j;
+
+    xSemaphoreTake(tasks_lock, portMAX_DELAY);
+    for (i = 0; i < current_count && i < STATS_MAX_TASKS; i++)
+    {
+        stats_task_t *task = &tasks[i];
+        uint32_t run_time = current[i].ulRunTimeCounter;
+
+        for (j = 0; j < previous_count; j++)
+        {
+            if (previous[j].xHandle == current[i].xHandle)
+            {
+                run_time -= previous[j].ulRunTimeCounter;
+                break;
+            }
+        }
+
+        snprintf(task->name, sizeof(task->name), "%s", current[i].pcTaskName);
+#if configTASKLIST_INCLUDE_COREID
+        task->core = current[i].xCoreID == tskNO_AFFINITY ? -1 :
+            current[i].xCoreID;
+#else
+        task->core = -1;
+#endif
+        task->priority = current[i].uxCurrentPriority;
+        task->cpu = (uint64_t)run_time * 1000 / elapsed;
+        task->stack_free = current[i].usStackHighWaterMark;
+    }
+    tasks_count = i;
+    xSemaphoreGive(tasks_lock);
+}
+
+static void stats_task(void *pvParameter)
+{
+    TaskStatus_t *current, *previous = NULL;
+    UBaseType_t current_count, previous_count = 0, max;
+    uint32_t time, previous_time = 0;
+
+    while (1)
+    {
+        max = uxTaskGetNumberOfTasks() + extra_tasks;
+        if (!(current = malloc(max * sizeof(TaskStatus_t))))
+        {
+            ESP_LOGE(TAG, "Failed allocating task status");
+            vTaskDelay(pdMS_TO_TICKS(sample_interval * 1000));
+            continue;
+        }
+
+        current_count = uxTaskGetSystemState(current, max, &time);
+        tasks_update(current, current_count, time - previous_time ? : 1,
+            previous, previous_count);
+
+        free(previous);
+        previous = current;
+        previous_count = current_count;
+        previous_time = time;
+
+        vTaskDelay(pdMS_TO_TICKS(sample_interval * 1000));
+    }
+
+    vTaskDelete(NULL);
+}
+
+int stats_initialize(uint16_t interval)
+{
+    ESP_LOGD(TAG, "Initializing stats");
+
+    sample_interval = interval;
+
+    if (!(tasks_lock = xSemaphoreCreateMutex()))
+    {
+        ESP_LOGE(TAG, "Failed creating mutex");
+        return -1;
+    }
+
+    if (task_layout_create(stats_task, "stats_task", 3072, NULL, 1, NULL,
+        tskNO_AFFINITY) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed creating stats task");
+        return -1;
+    }
+
+    return 0;
+}
+#else
+int stats_initialize(uint16_t interval)
+{
+    ESP_LOGW(TAG, "Task stats require CONFIG_FREERTOS_USE_TRACE_FACILITY and "
+        "CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS");
+    return 0;
+}
+#endif
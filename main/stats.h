@@ -0,0 +1,64 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_HISTOGRAM_MAX_BUCKETS 12
+
+/* Types */
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    /* -1 if it can run on any core */
+    int8_t core;
+    uint8_t priority;
+    /* In tenths of a percent of a core, over the last sampling interval */
+    uint16_t cpu;
+    /* The least that was ever left free, in bytes */
+    uint32_t stack_free;
+} stats_task_t;
+
+typedef struct {
+    const char *name;
+    QueueHandle_t handle;
+    UBaseType_t size;
+    UBaseType_t depth;
+    UBaseType_t max_depth;
+    uint32_t sent;
+    /* Items not sent since the queue was full */
+    uint32_t dropped;
+} stats_queue_t;
+
+/* Values counted into buckets by their upper bounds, in ascending order, with
+ * the last bucket holding the ones above them all. Not locked */
+typedef struct {
+    const uint32_t *bounds;
+    size_t count;
+    uint32_t buckets[STATS_HISTOGRAM_MAX_BUCKETS + 1];
+    uint64_t sum;
+    uint32_t total;
+} stats_histogram_t;
+
+#define STATS_HISTOGRAM_INITIALIZER(_bounds) { \
+    .bounds = _bounds, \
+    .count = sizeof(_bounds) / sizeof(_bounds[0]), \
+}
+
+void stats_histogram_add(stats_histogram_t *histogram, uint32_t value);
+
+/* Tracks a pipeline queue, NULL if there's no room for more */
+stats_queue_t *stats_queue_register(const char *name, QueueHandle_t queue);
+/* Called after every send to the queue, with the result of xQueueSend().
+ * Safe to call from an ISR */
+void stats_queue_sent(stats_queue_t *queue, BaseType_t result);
+
+/* Copy out a task, as of the last sample, or a queue. -1 past the last one */
+int stats_task_get(size_t index, stats_task_t *task);
+int stats_queue_get(size_t index, stats_queue_t *queue);
+
+/* Samples the tasks' run time counters every interval, in seconds */
+int stats_initialize(uint16_t interval);
+
+#endif
@@ -0,0 +1,107 @@
+#include "suppressor.h"
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constants */
+static const char *TAG = "Suppressor";
+
+/* Internal state */
+static uint8_t threshold = 0;
+static int64_t keyframe_interval = 0;
+static uint8_t *last_map = NULL;
+static uint16_t last_width = 0, last_height = 0;
+static int64_t last_sent_time = 0;
+
+/* Statistics */
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t frames_sent = 0, frames_suppressed = 0;
+static uint64_t bytes_saved = 0;
+
+static uint8_t is_static_scene(const uint8_t *map, size_t cells)
+{
+    size_t i;
+
+    for (i = 0; i < cells; i++)
+    {
+        if (abs(map[i] - last_map[i]) > threshold)
+            return 0;
+    }
+
+    return 1;
+}
+
+int suppressor_check(const uint8_t *map, uint16_t width, uint16_t height,
+    size_t length, int64_t timestamp)
+{
+    size_t cells = (size_t)width * height;
+
+    if (!threshold || !map)
+        return 1;
+
+    if (width == last_width && height == last_height &&
+        timestamp - last_sent_time < keyframe_interval &&
+        is_static_scene(map, cells))
+    {
+        portENTER_CRITICAL(&stats_lock);
+        frames_suppressed++;
+        bytes_saved += length;
+        portEXIT_CRITICAL(&stats_lock);
+        return 0;
+    }
+
+    /* Only needs to be reallocated when the resolution changes */
+    if (width != last_width || height != last_height)
+    {
+        free(last_map);
+        last_width = last_height = 0;
+        if (!(last_map = malloc(cells)))
+        {
+            ESP_LOGE(TAG, "Failed allocating DC map");
+            return 1;
+        }
+        last_width = width;
+        last_height = height;
+    }
+
+    memcpy(last_map, map, cells);
+    last_sent_time = timestamp;
+
+    portENTER_CRITICAL(&stats_lock);
+    frames_sent++;
+    portEXIT_CRITICAL(&stats_lock);
+
+    return 1;
+}
+
+void suppressor_stats_get(uint32_t *sent, uint32_t *suppressed,
+    uint64_t *saved)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *sent = frames_sent;
+    *suppressed = frames_suppressed;
+    *saved = bytes_saved;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+uint8_t suppressor_is_enabled(void)
+{
+    return threshold != 0;
+}
+
+int suppressor_initialize(uint8_t _threshold, uint16_t _keyframe_interval)
+{
+    if (!_threshold)
+    {
+        ESP_LOGI(TAG, "Static scene suppression disabled");
+        return 0;
+    }
+
+    ESP_LOGD(TAG, "Initializing static scene suppression");
+
+    threshold = _threshold;
+    keyframe_interval = (int64_t)(_keyframe_interval ? : 1) * 1000 * 1000;
+
+    return 0;
+}
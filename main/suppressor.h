@@ -0,0 +1,19 @@
+#ifndef SUPPRESSOR_H
+#define SUPPRESSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returns 1 if the frame should be sent, 0 if the scene didn't change since
+ * the last frame that was sent. The map is a DC map, as produced by
+ * jpeg_dc_decode() */
+int suppressor_check(const uint8_t *map, uint16_t width, uint16_t height,
+    size_t length, int64_t timestamp);
+
+void suppressor_stats_get(uint32_t *sent, uint32_t *suppressed,
+    uint64_t *bytes_saved);
+
+uint8_t suppressor_is_enabled(void);
+int suppressor_initialize(uint8_t threshold, uint16_t keyframe_interval);
+
+#endif
@@ -0,0 +1,280 @@
+#include "talkback.h"
+#include "jitter_buffer.h"
+#include "rtp.h"
+#include "task_layout.h"
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <driver/i2s_std.h>
+#include <opus.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RTP_HEADER_SIZE 12
+
+/* Constants */
+static const char *TAG = "Talkback";
+/* Opus RTP always uses a 48kHz clock (RFC7587) */
+static const uint32_t opus_clock_rate = 48000;
+/* Longest Opus packet, in milliseconds */
+static const uint32_t opus_max_packet_duration = 120;
+/* Enough for the longest delay with 20ms packets, of up to 120ms at 32kbps.
+ * Larger ones are dropped */
+static const size_t jitter_buffer_slots = 32;
+static const size_t max_packet_size = 512;
+/* Played while buffering, in milliseconds */
+static const uint32_t silence_duration = 20;
+/* I2S DMA buffers of 10ms each */
+static const uint32_t dma_desc_num = 4;
+
+/* Configuration */
+static uint32_t sample_rate = 0;
+
+/* Internal state */
+static int sock = -1;
+static i2s_chan_handle_t chan_handle;
+static SemaphoreHandle_t jitter_buffer_lock;
+static jitter_buffer_t *jitter_buffer = NULL;
+
+/* Skips the RTP header, along with any CSRCs, extension and padding */
+static const uint8_t *rtp_payload_get(const uint8_t *buffer, size_t length,
+    size_t *payload_length)
+{
+    size_t header_length;
+
+    if (length < RTP_HEADER_SIZE || buffer[0] >> 6 != 2)
+        return NULL;
+
+    header_length = RTP_HEADER_SIZE + (buffer[0] & 0x0f) * 4;
+
+    if (buffer[0] & 0x10)
+    {
+        if (length < header_length + 4)
+            return NULL;
+        header_length += 4 + (buffer[header_length + 2] << 8 |
+            buffer[header_length + 3]) * 4;
+    }
+
+    if (buffer[0] & 0x20)
+    {
+        if (length <= header_length || buffer[length - 1] > length -
+            header_length)
+        {
+            return NULL;
+        }
+        length -= buffer[length - 1];
+    }
+
+    if (length <= header_length)
+        return NULL;
+
+    *payload_length = length - header_length;
+    return buffer + header_length;
+}
+
+static void talkback_receive_task(void *pvParameter)
+{
+    static uint8_t buffer[RTP_HEADER_SIZE + 64 + RTP_MAX_PAYLOAD_SIZE];
+    const uint8_t *payload;
+    size_t payload_length;
+    ssize_t length;
+    int duration;
+
+    while (1)
+    {
+        if ((length = recv(sock, buffer, sizeof(buffer), 0)) < 0)
+        {
+            ESP_LOGE(TAG, "Failed receiving: %d (%s)", errno, strerror(errno));
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        if (!(payload = rtp_payload_get(buffer, length, &payload_length)) ||
+            (duration = opus_packet_get_nb_samples(payload, payload_length,
+            opus_clock_rate)) <= 0)
+        {
+            ESP_LOGD(TAG, "Dropping invalid packet");
+            continue;
+        }
+
+        xSemaphoreTake(jitter_buffer_lock, portMAX_DELAY);
+        jitter_buffer_put(jitter_buffer, buffer[2] << 8 | buffer[3],
+            buffer[4] << 24 | buffer[5] << 16 | buffer[6] << 8 | buffer[7],
+            duration, payload, payload_length, esp_timer_get_time());
+        xSemaphoreGive(jitter_buffer_lock);
+    }
+
+    vTaskDelete(NULL);
+}
+
+/* The I2S write blocks once the DMA buffers are full, pacing playback */
+static void talkback_playback_task(void *pvParameter)
+{
+    uint8_t packet[max_packet_size];
+    size_t max_samples = sample_rate * opus_max_packet_duration / 1000;
+    int16_t *pcm = malloc(max_samples * sizeof(int16_t));
+    int samples, last_samples = sample_rate * silence_duration / 1000;
+    jitter_buffer_result_t result;
+    OpusDecoder *decoder;
+    size_t length, written;
+    int err;
+
+    if (!pcm)
+    {
+        ESP_LOGE(TAG, "Failed allocating PCM buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    decoder = opus_decoder_create(sample_rate, 1, &err);
+    if (err < 0)
+    {
+        ESP_LOGE(TAG, "Failed creating Opus decoder: %s", opus_strerror(err));
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (1)
+    {
+        xSemaphoreTake(jitter_buffer_lock, portMAX_DELAY);
+        result = jitter_buffer_get(jitter_buffer, packet, &length);
+        xSemaphoreGive(jitter_buffer_lock);
+
+        switch (result)
+        {
+        case JITTER_BUFFER_PACKET:
+            samples = opus_decode(decoder, packet, length, pcm, max_samples,
+                0);
+            break;
+        /* Concealed as long as the previous packet */
+        case JITTER_BUFFER_LOST:
+            samples = opus_decode(decoder, NULL, 0, pcm, last_samples, 0);
+            break;
+        case JITTER_BUFFER_EMPTY:
+        default:
+            samples = sample_rate * silence_duration / 1000;
+            memset(pcm, 0, samples * sizeof(int16_t));
+            break;
+        }
+
+        if (samples < 0)
+        {
+            ESP_LOGE(TAG, "Failed decoding Opus: %s", opus_strerror(samples));
+            samples = last_samples;
+            memset(pcm, 0, samples * sizeof(int16_t));
+        }
+        else if (result != JITTER_BUFFER_EMPTY)
+            last_samples = samples;
+
+        i2s_channel_write(chan_handle, pcm, samples * sizeof(int16_t),
+            &written, portMAX_DELAY);
+    }
+
+    vTaskDelete(NULL);
+}
+
+void talkback_stats_get(jitter_buffer_stats_t *stats, uint32_t *latency)
+{
+    memset(stats, 0, sizeof(*stats));
+    *latency = 0;
+    if (!jitter_buffer)
+        return;
+
+    xSemaphoreTake(jitter_buffer_lock, portMAX_DELAY);
+    jitter_buffer_stats_get(jitter_buffer, stats);
+    xSemaphoreGive(jitter_buffer_lock);
+
+    *latency = stats->delay + dma_desc_num * 10000;
+}
+
+uint8_t talkback_is_enabled(void)
+{
+    return jitter_buffer != NULL;
+}
+
+int talkback_initialize(uint16_t port, int bclk, int ws, int dout,
+    uint32_t _sample_rate, uint16_t min_delay, uint16_t max_delay)
+{
+    struct sockaddr_in src = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    ESP_LOGD(TAG, "Initializing talkback");
+
+    if (!port || bclk == -1 || ws == -1 || dout == -1)
+    {
+        ESP_LOGI(TAG, "Talkback disabled");
+        return 0;
+    }
+
+    sample_rate = _sample_rate;
+
+    i2s_chan_config_t chan_config = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    chan_config.dma_desc_num = dma_desc_num;
+    chan_config.dma_frame_num = sample_rate / 100;
+    chan_config.auto_clear = true;
+    ESP_ERROR_CHECK(i2s_new_channel(&chan_config, &chan_handle, NULL));
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(sample_rate),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = bclk,
+            .ws = ws,
+            .dout = dout,
+            .din = I2S_GPIO_UNUSED,
+        },
+    };
+    ESP_ERROR_CHECK(i2s_channel_init_std_mode(chan_handle, &std_cfg));
+    ESP_ERROR_CHECK(i2s_channel_enable(chan_handle));
+
+    if (!(jitter_buffer_lock = xSemaphoreCreateMutex()))
+    {
+        ESP_LOGE(TAG, "Failed creating mutex");
+        return -1;
+    }
+
+    if (!(jitter_buffer = jitter_buffer_create(jitter_buffer_slots,
+        max_packet_size, opus_clock_rate, min_delay * 1000,
+        max_delay * 1000)))
+    {
+        ESP_LOGE(TAG, "Failed allocating jitter buffer");
+        return -1;
+    }
+
+    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed creating socket: %d (%m)", errno);
+        return -1;
+    }
+
+    if (bind(sock, (struct sockaddr *)&src, sizeof(src)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed binding socket: %d (%m)", errno);
+        return -1;
+    }
+
+    if (task_layout_create(talkback_receive_task,
+        "talkback_receive_task", 3072, NULL, 5, NULL, 1) != pdPASS ||
+        task_layout_create(talkback_playback_task,
+        "talkback_playback_task", 16384, NULL, 5, NULL, 1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed creating talkback tasks");
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Playing Opus received on port %u", port);
+
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef TALKBACK_H
+#define TALKBACK_H
+
+#include "jitter_buffer.h"
+#include <stdint.h>
+
+/* Jitter buffer stats, and the total latency (in microseconds) from receiving
+ * a packet to playing it, including the I2S DMA buffers */
+void talkback_stats_get(jitter_buffer_stats_t *stats, uint32_t *latency);
+uint8_t talkback_is_enabled(void);
+
+/* Receives Opus over RTP on the given port and plays it on an I2S DAC. The
+ * delays are in milliseconds */
+int talkback_initialize(uint16_t port, int bclk, int ws, int dout,
+    uint32_t sample_rate, uint16_t min_delay, uint16_t max_delay);
+
+#endif
@@ -0,0 +1,217 @@
+#include "task_layout.h"
+#include "config.h"
+#include <esp_log.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constants */
+static const char *TAG = "TaskLayout";
+
+/* Callback functions */
+static task_layout_on_profile_cb_t on_profile_cb = NULL;
+
+void task_layout_set_on_profile(task_layout_on_profile_cb_t cb)
+{
+    on_profile_cb = cb;
+}
+
+BaseType_t task_layout_create(TaskFunction_t func, const char *name,
+    uint32_t stack_size, void *arg, UBaseType_t priority,
+    TaskHandle_t *handle, BaseType_t core)
+{
+    int _core = config_task_core_get(name, core == tskNO_AFFINITY ? -1 : core);
+    int _priority = config_task_priority_get(name, priority);
+
+    stack_size = config_task_stack_size_get(name, stack_size);
+
+    if (_core < 0)
+        core = tskNO_AFFINITY;
+    else if (_core >= portNUM_PROCESSORS)
+    {
+        ESP_LOGW(TAG, "No core %d for %s, running on any core", _core, name);
+        core = tskNO_AFFINITY;
+    }
+    else
+        core = _core;
+
+    if (_priority < 1 || _priority >= configMAX_PRIORITIES)
+    {
+        ESP_LOGW(TAG, "Invalid priority %d for %s, using %u", _priority, name,
+            priority);
+        _priority = priority;
+    }
+
+    ESP_LOGD(TAG, "Creating %s on core %d, priority %d, stack size %" PRIu32,
+        name, core, _priority, stack_size);
+
+    return xTaskCreatePinnedToCore(func, name, stack_size, arg, _priority,
+        handle, core);
+}
+
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+/* Room for tasks created while profiling */
+static const UBaseType_t extra_tasks = 8;
+static const size_t report_line_size = 64;
+/* The run time counters wrap around after a little over an hour */
+static const uint16_t max_duration = 3600;
+
+/* Internal state */
+static uint8_t is_profiling = 0;
+
+static TaskStatus_t *snapshot_get(UBaseType_t *count, uint32_t *time)
+{
+    UBaseType_t max = uxTaskGetNumberOfTasks() + extra_tasks;
+    TaskStatus_t *tasks = malloc(max * sizeof(TaskStatus_t));
+
+    if (tasks)
+        *count = uxTaskGetSystemState(tasks, max, time);
+
+    return tasks;
+}
+
+/* Busiest first */
+static int run_time_cmp(const void *a, const void *b)
+{
+    const TaskStatus_t *task_a = a, *task_b = b;
+
+    if (task_a->ulRunTimeCounter == task_b->ulRunTimeCounter)
+        return 0;
+
+    return task_a->ulRunTimeCounter > task_b->ulRunTimeCounter ? -1 : 1;
+}
+
+static void report_line_add(char **p, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(*p, report_line_size, fmt, args);
+    va_end(args);
+
+    ESP_LOGI(TAG, "%s", *p);
+    *p += strlen(*p);
+    *(*p)++ = '\n';
+    **p = '\0';
+}
+
+static void task_layout_profile_task(void *pvParameter)
+{
+    uint32_t duration = (uintptr_t)pvParameter;
+    TaskStatus_t *start = NULL, *end = NULL;
+    UBaseType_t start_count = 0, end_count = 0, i, j;
+    uint32_t start_time, end_time, elapsed;
+    char *report = NULL, *p, core[4];
+    int c;
+
+    start = snapshot_get(&start_count, &start_time);
+    vTaskDelay(pdMS_TO_TICKS(duration * 1000));
+    end = snapshot_get(&end_count, &end_time);
+
+    if (!start || !end ||
+        !(p = report = malloc((end_count + 1 + portNUM_PROCESSORS) *
+        report_line_size + 1)))
+    {
+        ESP_LOGE(TAG, "Failed allocating profile");
+        goto Exit;
+    }
+
+    /* Run time counters are kept from the task's creation, tasks created
+     * since the first snapshot are counted from zero */
+    for (i = 0; i < end_count; i++)
+    {
+        for (j = 0; j < start_count; j++)
+        {
+            if (end[i].xHandle == start[j].xHandle)
+            {
+                end[i].ulRunTimeCounter -= start[j].ulRunTimeCounter;
+                break;
+            }
+        }
+    }
+    qsort(end, end_count, sizeof(*end), run_time_cmp);
+    elapsed = end_time - start_time ? : 1;
+
+    /* Usage is given as a percentage of a single core, stack as the least
+     * that was ever left free, in bytes */
+    report_line_add(&p, "%-24s %4s %4s %6s %6s", "Task", "Core", "Prio",
+        "Stack", "CPU");
+    for (i = 0; i < end_count; i++)
+    {
+#if configTASKLIST_INCLUDE_COREID
+        if (end[i].xCoreID == tskNO_AFFINITY)
+            strcpy(core, "any");
+        else
+            snprintf(core, sizeof(core), "%d", (int)end[i].xCoreID);
+#else
+        strcpy(core, "-");
+#endif
+        report_line_add(&p, "%-24s %4s %4u %6" PRIu32 " %5.1f%%",
+            end[i].pcTaskName, core, end[i].uxCurrentPriority,
+            (uint32_t)end[i].usStackHighWaterMark,
+            end[i].ulRunTimeCounter * 100.0 / elapsed);
+    }
+
+    /* Whatever the idle task didn't get */
+    for (c = 0; c < portNUM_PROCESSORS; c++)
+    {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(c);
+        uint32_t idle_time = 0;
+
+        for (i = 0; i < end_count; i++)
+        {
+            if (end[i].xHandle == idle)
+                idle_time = end[i].ulRunTimeCounter;
+        }
+
+        report_line_add(&p, "Core %d load: %.1f%%", c,
+            idle_time > elapsed ? 0 : 100 - idle_time * 100.0 / elapsed);
+    }
+
+    if (on_profile_cb)
+        on_profile_cb(report);
+
+Exit:
+    free(report);
+    free(end);
+    free(start);
+    is_profiling = 0;
+    vTaskDelete(NULL);
+}
+
+int task_layout_profile(uint16_t duration)
+{
+    if (!duration || duration > max_duration)
+    {
+        ESP_LOGE(TAG, "Invalid profiling duration %u", duration);
+        return -1;
+    }
+
+    if (is_profiling)
+    {
+        ESP_LOGW(TAG, "Already profiling");
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Profiling tasks for %u seconds", duration);
+    is_profiling = 1;
+    if (task_layout_create(task_layout_profile_task, "profile_task", 4096,
+        (void *)(uintptr_t)duration, 1, NULL, tskNO_AFFINITY) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed creating profile task");
+        is_profiling = 0;
+        return -1;
+    }
+
+    return 0;
+}
+#else
+int task_layout_profile(uint16_t duration)
+{
+    ESP_LOGE(TAG, "Profiling requires CONFIG_FREERTOS_USE_TRACE_FACILITY and "
+        "CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS");
+    return -1;
+}
+#endif
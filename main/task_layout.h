@@ -0,0 +1,24 @@
+#ifndef TASK_LAYOUT_H
+#define TASK_LAYOUT_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdint.h>
+
+/* Event callback types, the report lists every task's core, priority, free
+ * stack and CPU usage */
+typedef void (*task_layout_on_profile_cb_t)(const char *report);
+
+/* Event handlers */
+void task_layout_set_on_profile(task_layout_on_profile_cb_t cb);
+
+/* As xTaskCreatePinnedToCore(), with the core, priority and stack size
+ * overridden by the ones configured for the task's name */
+BaseType_t task_layout_create(TaskFunction_t func, const char *name,
+    uint32_t stack_size, void *arg, UBaseType_t priority,
+    TaskHandle_t *handle, BaseType_t core);
+
+/* Measures the CPU usage of every task over the given number of seconds */
+int task_layout_profile(uint16_t duration);
+
+#endif
@@ -0,0 +1,322 @@
+#include "timelapse.h"
+#include "camera.h"
+#include "jpeg.h"
+#include "mkv.h"
+#include "task_layout.h"
+#include <dirent.h>
+#include <errno.h>
+#include <esp_camera.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define UPLOAD_BUFFER_SIZE 4096
+
+/* Constants */
+static const char *TAG = "Timelapse";
+static const size_t upload_queue_size = 4;
+
+/* Configuration */
+static char *path = NULL;
+static uint32_t interval = 0;
+static uint8_t fps = 0;
+static uint32_t clip_frames = 0;
+static char *upload_url = NULL;
+static uint32_t active_power = 0;
+
+/* Internal state */
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t frames = 0, last_awake_time = 0, last_energy = 0;
+static uint32_t clip_number = 0, clip_frame = 0;
+static int fd = -1;
+static mkv_writer_t mkv;
+/* Numbers of the finished clips waiting to be uploaded */
+static QueueHandle_t upload_queue = NULL;
+
+static int clip_write(const void *data, size_t length, void *ctx)
+{
+    return write(fd, data, length) != (ssize_t)length;
+}
+
+static void clip_file_name(char *buf, size_t size, uint32_t number)
+{
+    snprintf(buf, size, "%s/%08" PRIu32 ".mkv", path, number);
+}
+
+static int clip_open(const uint8_t *data, size_t length)
+{
+    char file_name[64];
+    uint16_t width, height;
+
+    if (jpeg_size_get(data, length, &width, &height))
+        return -1;
+
+    clip_number++;
+    clip_file_name(file_name, sizeof(file_name), clip_number);
+    if ((fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed creating %s: %s", file_name, strerror(errno));
+        return -1;
+    }
+
+    mkv_writer_init(&mkv, clip_write, NULL);
+    if (mkv_header_write(&mkv, width, height, 0))
+    {
+        close(fd);
+        fd = -1;
+        return -1;
+    }
+
+    clip_frame = 0;
+    ESP_LOGI(TAG, "Started clip %08" PRIu32, clip_number);
+
+    return 0;
+}
+
+static int clip_upload(uint32_t number)
+{
+    esp_http_client_config_t config = {
+        .method = HTTP_METHOD_POST,
+        .url = upload_url,
+        .timeout_ms = 30000,
+    };
+    esp_http_client_handle_t handle;
+    char file_name[64], header[64], *buffer = NULL;
+    struct stat st;
+    int file, len, status = -1;
+
+    clip_file_name(file_name, sizeof(file_name), number);
+    if ((file = open(file_name, O_RDONLY)) < 0 || fstat(file, &st))
+        goto Exit;
+
+    if (!(buffer = malloc(UPLOAD_BUFFER_SIZE)))
+        goto Exit;
+
+    handle = esp_http_client_init(&config);
+    sprintf(header, "IPCAM/%s", IPCAM_VER);
+    esp_http_client_set_header(handle, "User-Agent", header);
+    esp_http_client_set_header(handle, "Content-Type", "video/x-matroska");
+    snprintf(header, sizeof(header), "attachment; filename=\"%08" PRIu32
+        ".mkv\"", number);
+    esp_http_client_set_header(handle, "Content-Disposition", header);
+
+    if (esp_http_client_open(handle, st.st_size) == ESP_OK)
+    {
+        while ((len = read(file, buffer, UPLOAD_BUFFER_SIZE)) > 0)
+        {
+            if (esp_http_client_write(handle, buffer, len) != len)
+                break;
+        }
+        if (!len && esp_http_client_fetch_headers(handle) >= 0)
+            status = esp_http_client_get_status_code(handle);
+    }
+    esp_http_client_cleanup(handle);
+
+Exit:
+    ESP_LOGI(TAG, "Uploading clip %08" PRIu32 ": %d", number, status);
+    free(buffer);
+    if (file >= 0)
+        close(file);
+    return status >= 200 && status < 300 ? 0 : -1;
+}
+
+static void clip_close(void)
+{
+    close(fd);
+    fd = -1;
+
+    ESP_LOGI(TAG, "Finished clip %08" PRIu32 " (%" PRIu32 " frames)",
+        clip_number, clip_frame);
+
+    /* Uploads can take longer than the interval, they never delay capture */
+    if (upload_queue && xQueueSend(upload_queue, &clip_number, 0) != pdTRUE)
+        ESP_LOGW(TAG, "Upload queue full, clip %08" PRIu32 " not uploaded",
+            clip_number);
+}
+
+static int clip_append(const uint8_t *data, size_t length)
+{
+    if (fd == -1 && clip_open(data, length))
+        return -1;
+
+    /* Frames are played back at the configured rate, not the capture rate */
+    if (mkv_block_write(&mkv, MKV_TRACK_VIDEO, (int64_t)clip_frame * 1000 / fps,
+        data, length) || fsync(fd))
+    {
+        ESP_LOGE(TAG, "Failed writing frame: %s", strerror(errno));
+        return -1;
+    }
+
+    if (++clip_frame == clip_frames)
+        clip_close();
+
+    return 0;
+}
+
+static void frame_capture(void)
+{
+    int64_t start = esp_timer_get_time(), awake_time;
+    camera_fb_t *fb;
+
+    if (camera_acquire())
+        return;
+
+    if ((fb = esp_camera_fb_get()))
+    {
+        clip_append(fb->buf, fb->len);
+        esp_camera_fb_return(fb);
+    }
+    else
+        ESP_LOGE(TAG, "Camera capture failed");
+
+    camera_release();
+
+    /* Power in mW over the time in us, in mJ */
+    awake_time = esp_timer_get_time() - start;
+    portENTER_CRITICAL(&stats_lock);
+    frames++;
+    last_awake_time = awake_time / 1000;
+    last_energy = awake_time * active_power / 1000000;
+    portEXIT_CRITICAL(&stats_lock);
+
+    ESP_LOGD(TAG, "Captured frame in %" PRId64 "us", awake_time);
+}
+
+static void timelapse_task(void *pvParameter)
+{
+    TickType_t last_wake_time = xTaskGetTickCount();
+
+    while (1)
+    {
+        frame_capture();
+        xTaskDelayUntil(&last_wake_time, interval * configTICK_RATE_HZ);
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void upload_task(void *pvParameter)
+{
+    uint32_t number;
+
+    while (1)
+    {
+        if (xQueueReceive(upload_queue, &number, portMAX_DELAY) == pdTRUE)
+            clip_upload(number);
+    }
+
+    vTaskDelete(NULL);
+}
+
+void timelapse_stats_get(uint32_t *_frames, uint32_t *awake_time,
+    uint32_t *energy)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *_frames = frames;
+    *awake_time = last_awake_time;
+    *energy = last_energy;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+const char *timelapse_path_get(void)
+{
+    return path;
+}
+
+uint8_t timelapse_is_enabled(void)
+{
+    return path != NULL;
+}
+
+static uint8_t dir_exists(const char *name)
+{
+    DIR *dir;
+
+    if (!(dir = opendir(name)))
+        return 0;
+
+    closedir(dir);
+    return 1;
+}
+
+/* Continue numbering after the last clip */
+static void clip_number_init(void)
+{
+    struct dirent *entry;
+    DIR *dir;
+
+    if (!(dir = opendir(path)))
+        return;
+
+    while ((entry = readdir(dir)))
+    {
+        char *ext;
+        uint32_t number = strtoul(entry->d_name, &ext, 10);
+
+        if (!strcasecmp(ext, ".mkv") && number > clip_number)
+            clip_number = number;
+    }
+
+    closedir(dir);
+}
+
+int timelapse_initialize(const char *_path, uint32_t _interval, uint8_t _fps,
+    uint32_t _clip_frames, const char *_upload_url, uint32_t _active_power)
+{
+    if (!_path || !_interval)
+    {
+        ESP_LOGI(TAG, "Timelapse disabled");
+        return 0;
+    }
+
+    ESP_LOGD(TAG, "Initializing timelapse");
+
+    /* SPIFFS has no directories, its mount point can be used as is */
+    if (mkdir(_path, 0755) && errno != EEXIST && !dir_exists(_path))
+    {
+        ESP_LOGE(TAG, "Failed creating %s: %s", _path, strerror(errno));
+        return 0;
+    }
+
+    path = strdup(_path);
+    interval = _interval;
+    fps = _fps ? : 1;
+    clip_frames = _clip_frames;
+    upload_url = _upload_url ? strdup(_upload_url) : NULL;
+    active_power = _active_power;
+
+    clip_number_init();
+
+    /* The camera stays powered down until the first capture */
+    camera_power_manage();
+
+    if (upload_url && (!(upload_queue = xQueueCreate(upload_queue_size,
+        sizeof(uint32_t))) || task_layout_create(upload_task,
+        "timelapse_upload_task", 4096, NULL, 3, NULL, 1) != pdPASS))
+    {
+        ESP_LOGE(TAG, "Failed creating upload task");
+        return -1;
+    }
+
+    if (task_layout_create(timelapse_task, "timelapse_task", 4096, NULL,
+        4, NULL, 1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed creating timelapse task");
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Capturing a frame every %" PRIu32 " seconds to %s",
+        interval, path);
+
+    return 0;
+}
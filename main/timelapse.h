@@ -0,0 +1,16 @@
+#ifndef TIMELAPSE_H
+#define TIMELAPSE_H
+
+#include <stdint.h>
+
+/* Stats of the last captured frame, the energy is estimated from the time
+ * the camera was powered up for and its configured power draw */
+void timelapse_stats_get(uint32_t *frames, uint32_t *awake_time,
+    uint32_t *energy);
+const char *timelapse_path_get(void);
+uint8_t timelapse_is_enabled(void);
+
+int timelapse_initialize(const char *path, uint32_t interval, uint8_t fps,
+    uint32_t clip_frames, const char *upload_url, uint32_t active_power);
+
+#endif
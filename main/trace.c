@@ -0,0 +1,211 @@
+#include "trace.h"
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAX_LABELS 32
+#define TRACE_NAME_SIZE 32
+
+/* Types */
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint8_t version;
+    uint8_t name_size;
+    uint16_t tasks;
+    uint16_t labels;
+    uint16_t record_size;
+    uint32_t records;
+} trace_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t handle;
+    char name[TRACE_NAME_SIZE];
+} trace_task_t;
+
+/* Constants */
+static const char *TAG = "Trace";
+static const uint8_t trace_version = 1;
+
+/* Internal state */
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static trace_record_t *records = NULL;
+static size_t size = 0, head = 0, count = 0;
+static uint8_t is_dumping = 0;
+static const char *labels[TRACE_MAX_LABELS];
+static size_t labels_count = 0;
+
+void IRAM_ATTR trace_event(trace_event_t event, uint32_t arg)
+{
+    int64_t timestamp;
+    uint32_t task;
+    trace_record_t *record;
+
+    if (!records)
+        return;
+
+    timestamp = esp_timer_get_time();
+    task = xPortInIsrContext() ? 0 : (uintptr_t)xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL_SAFE(&lock);
+    if (!is_dumping)
+    {
+        record = &records[head];
+        record->timestamp = timestamp;
+        record->task = task;
+        record->event = event;
+        record->core = xPortGetCoreID();
+        record->reserved = 0;
+        record->arg = arg;
+
+        if (++head == size)
+            head = 0;
+        if (count < size)
+            count++;
+    }
+    portEXIT_CRITICAL_SAFE(&lock);
+}
+
+uint32_t trace_label_add(const char *label)
+{
+    uint32_t index = UINT32_MAX;
+
+    portENTER_CRITICAL(&lock);
+    if (labels_count < TRACE_MAX_LABELS)
+    {
+        index = labels_count++;
+        labels[index] = label;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (index == UINT32_MAX)
+        ESP_LOGW(TAG, "No room for label %s", label);
+
+    return index;
+}
+
+/* Tasks are named by their handle, missing if it can't be listed */
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t *tasks_get(UBaseType_t *n)
+{
+    UBaseType_t max = uxTaskGetNumberOfTasks();
+    TaskStatus_t *tasks = malloc(max * sizeof(TaskStatus_t));
+
+    *n = 0;
+    if (!tasks)
+        ESP_LOGE(TAG, "Failed allocating task status");
+    else
+        *n = uxTaskGetSystemState(tasks, max, NULL);
+
+    return tasks;
+}
+#else
+static TaskStatus_t *tasks_get(UBaseType_t *n)
+{
+    *n = 0;
+    return NULL;
+}
+#endif
+
+int trace_dump(trace_write_func_t write, void *ctx)
+{
+    trace_header_t header = {
+        .magic = { 'I', 'P', 'T', 'R' },
+        .version = trace_version,
+        .name_size = TRACE_NAME_SIZE,
+        .record_size = sizeof(trace_record_t),
+    };
+    char label[TRACE_NAME_SIZE];
+    trace_task_t task = {};
+    TaskStatus_t *tasks = NULL;
+    UBaseType_t tasks_count;
+    size_t first, n, i;
+    int ret;
+
+    if (!records)
+        return -1;
+
+    portENTER_CRITICAL(&lock);
+    if (is_dumping)
+    {
+        portEXIT_CRITICAL(&lock);
+        ESP_LOGW(TAG, "Already dumping");
+        return -1;
+    }
+    is_dumping = 1;
+    n = count;
+    first = (head + size - count) % size;
+    portEXIT_CRITICAL(&lock);
+
+    tasks = tasks_get(&tasks_count);
+    header.tasks = tasks_count;
+    header.labels = labels_count;
+    header.records = n;
+    ret = write(&header, sizeof(header), ctx);
+
+    for (i = 0; i < header.tasks && !ret; i++)
+    {
+        task.handle = (uintptr_t)tasks[i].xHandle;
+        snprintf(task.name, sizeof(task.name), "%s", tasks[i].pcTaskName);
+        ret = write(&task, sizeof(task), ctx);
+    }
+
+    for (i = 0; i < header.labels && !ret; i++)
+    {
+        strncpy(label, labels[i], sizeof(label));
+        ret = write(label, sizeof(label), ctx);
+    }
+
+    /* Oldest first, the ring wraps around at most once */
+    if (!ret && n)
+    {
+        i = first + n > size ? size - first : n;
+        if (!(ret = write(&records[first], i * sizeof(trace_record_t), ctx)) &&
+            i < n)
+        {
+            ret = write(records, (n - i) * sizeof(trace_record_t), ctx);
+        }
+    }
+
+    free(tasks);
+
+    portENTER_CRITICAL(&lock);
+    is_dumping = 0;
+    portEXIT_CRITICAL(&lock);
+
+    return ret;
+}
+
+uint8_t trace_is_enabled(void)
+{
+    return records != NULL;
+}
+
+int trace_initialize(size_t _records)
+{
+    ESP_LOGD(TAG, "Initializing tracing");
+
+    if (!_records)
+    {
+        ESP_LOGI(TAG, "Tracing disabled");
+        return 0;
+    }
+
+    /* Kept internal, so events can be recorded from any context. Recording
+     * starts once it's set */
+    size = _records;
+    if (!(records = heap_caps_calloc(size, sizeof(trace_record_t),
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)))
+    {
+        ESP_LOGE(TAG, "Failed allocating %zu trace records", size);
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Tracing the latest %zu events", size);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Types */
+typedef enum {
+    TRACE_EVENT_CAPTURE_START,
+    TRACE_EVENT_CAPTURE_END,
+    TRACE_EVENT_ENQUEUE,
+    TRACE_EVENT_DEQUEUE,
+    TRACE_EVENT_SEND_FIRST,
+    TRACE_EVENT_SEND_LAST,
+    TRACE_EVENT_ENCODE_START,
+    TRACE_EVENT_ENCODE_END,
+    TRACE_EVENT_HTTP_START,
+    TRACE_EVENT_HTTP_END,
+} trace_event_t;
+
+/* Records are dumped as is, little endian */
+typedef struct {
+    /* In microseconds since boot, wrapping around every ~71 minutes */
+    uint32_t timestamp;
+    /* The handle of the task recording it, 0 from an ISR */
+    uint32_t task;
+    uint16_t event;
+    uint8_t core;
+    uint8_t reserved;
+    /* Frames are identified by their capture timestamp's lower 32 bits, HTTP
+     * handlers by their label */
+    uint32_t arg;
+} trace_record_t;
+
+/* Return non-zero to stop dumping */
+typedef int (*trace_write_func_t)(const void *data, size_t length, void *ctx);
+
+/* Safe to call from an ISR, does nothing while tracing is disabled */
+void trace_event(trace_event_t event, uint32_t arg);
+
+/* Names an event argument, such as an HTTP handler's URI. The label must
+ * outlive tracing. Returns its index, to be passed as the argument */
+uint32_t trace_label_add(const char *label);
+
+/* Writes the task names, labels and records, oldest first. Nothing is
+ * recorded while dumping */
+int trace_dump(trace_write_func_t write, void *ctx);
+
+uint8_t trace_is_enabled(void);
+/* Keeps the given number of the latest records, 0 to disable tracing */
+int trace_initialize(size_t records);
+
+#endif
@@ -35,6 +35,17 @@ uint8_t *wifi_mac_get(void)
     return mac;
 }
 
+int wifi_rssi_get(int8_t *rssi)
+{
+    wifi_ap_record_t ap_info;
+
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+        return -1;
+
+    *rssi = ap_info.rssi;
+    return 0;
+}
+
 void wifi_hostname_set(const char *hostname)
 {
     if (wifi_hostname)
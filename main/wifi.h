@@ -28,6 +28,8 @@ int wifi_connect(const char *ssid, const char *password,
     const char *ca_cert, const char *client_cert, const char *client_key);
 int wifi_reconnect(void);
 uint8_t *wifi_mac_get(void);
+/* Of the access point connected to, -1 if not connected */
+int wifi_rssi_get(int8_t *rssi);
 void wifi_hostname_set(const char *hostname);
 
 #endif
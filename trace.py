@@ -0,0 +1,135 @@
+#!/usr/bin/env python
+
+from __future__ import print_function
+import argparse
+import json
+import struct
+
+try:
+  from urllib.request import urlopen
+except ImportError:
+  from urllib2 import urlopen
+
+HEADER = struct.Struct('<4sBBHHHI')
+RECORD = struct.Struct('<IIHBBI')
+
+# Events come in start/end pairs, except for the queueing ones
+SLICES = {
+  0: ('capture', 'B'),
+  1: ('capture', 'E'),
+  4: ('send', 'B'),
+  5: ('send', 'E'),
+  6: ('encode', 'B'),
+  7: ('encode', 'E'),
+  8: ('http', 'B'),
+  9: ('http', 'E'),
+}
+ENQUEUE = 2
+DEQUEUE = 3
+HTTP = (8, 9)
+
+def parse_name(data):
+  return data.split(b'\0', 1)[0].decode('utf-8', 'replace')
+
+def parse_trace(data):
+  magic, version, name_size, tasks_count, labels_count, record_size, \
+    records_count = HEADER.unpack_from(data)
+  if magic != b'IPTR' or version != 1:
+    raise ValueError('Not a trace dump')
+
+  offset = HEADER.size
+  tasks = dict()
+  for i in range(tasks_count):
+    handle, = struct.unpack_from('<I', data, offset)
+    tasks[handle] = parse_name(data[offset + 4:offset + 4 + name_size])
+    offset += 4 + name_size
+
+  labels = []
+  for i in range(labels_count):
+    labels.append(parse_name(data[offset:offset + name_size]))
+    offset += name_size
+
+  records = []
+  for i in range(records_count):
+    records.append(RECORD.unpack_from(data, offset))
+    offset += record_size
+
+  return tasks, labels, records
+
+def to_chrome_trace(tasks, labels, records):
+  events = []
+  threads = dict()
+  # Open slices per thread, an end without its start was cut off by the ring
+  depth = dict()
+  last, wraps = None, 0
+
+  for timestamp, task, event, core, _, arg in records:
+    # Timestamps wrap around every ~71 minutes
+    if last is not None and timestamp < last:
+      wraps += 1
+    last = timestamp
+    ts = timestamp + (wraps << 32)
+
+    # ISRs are shown as a thread per core, task handles are never that low
+    tid = task if task else core
+    if tid not in threads:
+      threads[tid] = tasks.get(task, '0x%08x' % task) if task else \
+        'ISR core %d' % core
+
+    if event in SLICES:
+      name, ph = SLICES[event]
+      if ph == 'B':
+        depth[tid] = depth.get(tid, 0) + 1
+      elif depth.get(tid, 0) > 0:
+        depth[tid] -= 1
+      else:
+        continue
+      if event in HTTP:
+        name = labels[arg] if arg < len(labels) else name
+        event_args = {'core': core}
+      else:
+        event_args = {'frame': arg, 'core': core}
+      events.append({'name': name, 'ph': ph, 'ts': ts, 'pid': 0, 'tid': tid,
+        'args': event_args})
+    elif event in (ENQUEUE, DEQUEUE):
+      # Frames are followed from the queue to the stream task
+      name = 'enqueue' if event == ENQUEUE else 'dequeue'
+      events.append({'name': name, 'ph': 'i', 's': 't', 'ts': ts, 'pid': 0,
+        'tid': tid, 'args': {'frame': arg, 'core': core}})
+      events.append({'name': 'frame', 'cat': 'frame',
+        'ph': 's' if event == ENQUEUE else 'f', 'bp': 'e', 'id': arg,
+        'ts': ts, 'pid': 0, 'tid': tid})
+
+  events.append({'name': 'process_name', 'ph': 'M', 'pid': 0,
+    'args': {'name': 'ipcam'}})
+  for tid, name in threads.items():
+    events.append({'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': tid,
+      'args': {'name': name}})
+
+  return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+def main():
+  parser = argparse.ArgumentParser(description='Converts a trace dump to '
+    'the Chrome trace format, for chrome://tracing or Perfetto')
+  parser.add_argument('source', help='Host or IP address of the device to '
+    'fetch the trace from, or a trace dump file')
+  parser.add_argument('--file', action='store_true', help='The source is a '
+    'trace dump file')
+  parser.add_argument('--output', default='trace.json', help='Chrome trace '
+    'file to write. Default trace.json')
+  args = parser.parse_args()
+
+  if args.file:
+    data = open(args.source, 'rb').read()
+  else:
+    data = urlopen('http://%s/trace' % args.source).read()
+
+  tasks, labels, records = parse_trace(data)
+  with open(args.output, 'w') as f:
+    json.dump(to_chrome_trace(tasks, labels, records), f)
+
+  print('Wrote %d events from %d tasks to %s' % (len(records), len(tasks),
+    args.output))
+
+if __name__ == '__main__':
+  main()